@@ -0,0 +1,158 @@
+#version 430 core
+
+// one invocation per scene instance
+layout (local_size_x = 64) in;
+
+// std430 layouts - these must match INSTANCE_DATA in SceneMeshes.h
+// and CULL_ITEM and DRAW_COMMAND in GPUCulling.h
+struct InstanceData
+{
+	mat4 model;
+	vec2 UVscale;
+	int textureLayer;
+	int materialIndex;
+};
+
+struct CullItem
+{
+	vec3 center;
+	int commandIndex;
+	vec3 extent;
+	int padding;
+};
+
+struct DrawCommand
+{
+	uint count;
+	uint instanceCount;
+	uint firstIndex;
+	int baseVertex;
+	uint baseInstance;
+};
+
+// every instance, in batch order
+layout (std430, binding = 0) readonly buffer SourceInstances
+{
+	InstanceData sourceInstances[];
+};
+
+// world space bounds and draw command of every instance
+layout (std430, binding = 1) readonly buffer CullItems
+{
+	CullItem cullItems[];
+};
+
+// one command per render batch, with the instance counts zeroed
+layout (std430, binding = 2) buffer DrawCommands
+{
+	DrawCommand drawCommands[];
+};
+
+// the instance buffer the draws read from
+layout (std430, binding = 3) writeonly buffer VisibleInstances
+{
+	InstanceData visibleInstances[];
+};
+
+// normalized, inward facing frustum planes
+uniform vec4 frustumPlanes[6];
+uniform uint instanceCount;
+
+// farthest depth pyramid of the previous frame, with the view of
+// that frame and the size of the depth buffer it was built from
+uniform bool bOcclusionCulling = false;
+uniform sampler2D hiZBuffer;
+uniform mat4 previousViewProjection;
+uniform vec2 hiZDepthSize;
+uniform int hiZLevelCount;
+
+// true when the box was behind the depth of the previous frame
+// everywhere it covered the screen
+bool IsOccluded(CullItem item)
+{
+	vec3 minimum = vec3(1.0f);
+	vec3 maximum = vec3(-1.0f);
+
+	for (int i = 0; i < 8; i++)
+	{
+		vec3 corner = item.center + item.extent * vec3(
+			((i & 1) != 0) ? 1.0f : -1.0f,
+			((i & 2) != 0) ? 1.0f : -1.0f,
+			((i & 4) != 0) ? 1.0f : -1.0f);
+		vec4 clip = previousViewProjection * vec4(corner, 1.0f);
+
+		// a corner behind the eye can put the box anywhere on screen
+		if (clip.w <= 0.0f)
+		{
+			return(false);
+		}
+
+		vec3 ndc = clip.xyz / clip.w;
+		minimum = min(minimum, ndc);
+		maximum = max(maximum, ndc);
+	}
+
+	// the previous frame has no depth off its screen
+	if (any(lessThan(minimum.xy, vec2(-1.0f))) || any(greaterThan(maximum.xy, vec2(1.0f))))
+	{
+		return(false);
+	}
+
+	vec2 pixelMinimum = (minimum.xy * 0.5f + 0.5f) * hiZDepthSize;
+	vec2 pixelMaximum = (maximum.xy * 0.5f + 0.5f) * hiZDepthSize;
+	float nearestDepth = minimum.z * 0.5f + 0.5f;
+
+	// the texels of a level cover 2^(level + 1) depth pixels, so the
+	// first level whose texels are as wide as the box spans at most
+	// two of them each way
+	vec2 pixelSize = pixelMaximum - pixelMinimum;
+	float level = ceil(log2(max(max(pixelSize.x, pixelSize.y), 1.0f))) - 1.0f;
+	int lod = clamp(int(level), 0, hiZLevelCount - 1);
+	float texelPixels = float(1 << (lod + 1));
+	ivec2 levelSize = textureSize(hiZBuffer, lod);
+	ivec2 texelMinimum = clamp(ivec2(pixelMinimum / texelPixels), ivec2(0), levelSize - 1);
+	ivec2 texelMaximum = clamp(ivec2(pixelMaximum / texelPixels), ivec2(0), levelSize - 1);
+
+	float farthestDepth = max(
+		max(texelFetch(hiZBuffer, texelMinimum, lod).r,
+			texelFetch(hiZBuffer, ivec2(texelMaximum.x, texelMinimum.y), lod).r),
+		max(texelFetch(hiZBuffer, ivec2(texelMinimum.x, texelMaximum.y), lod).r,
+			texelFetch(hiZBuffer, texelMaximum, lod).r));
+
+	return(nearestDepth > farthestDepth);
+}
+
+void main()
+{
+	uint index = gl_GlobalInvocationID.x;
+
+	if (index >= instanceCount)
+	{
+		return;
+	}
+
+	CullItem item = cullItems[index];
+
+	// the box is outside when it is fully behind any plane
+	for (int i = 0; i < 6; i++)
+	{
+		vec3 normal = frustumPlanes[i].xyz;
+		float distance = dot(normal, item.center) + frustumPlanes[i].w;
+		float radius = dot(abs(normal), item.extent);
+
+		if (distance + radius < 0.0f)
+		{
+			return;
+		}
+	}
+
+	if (bOcclusionCulling && IsOccluded(item))
+	{
+		return;
+	}
+
+	// visible instances are packed at the front of the range of
+	// their batch, in no particular order
+	uint slot = atomicAdd(drawCommands[item.commandIndex].instanceCount, 1u);
+	visibleInstances[drawCommands[item.commandIndex].baseInstance + slot] = sourceInstances[index];
+}
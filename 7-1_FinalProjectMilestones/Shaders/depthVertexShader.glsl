@@ -0,0 +1,28 @@
+#version 330 core
+
+// only the position and the per-instance model matrix are read -
+// the locations must match the ones of vertexShader.glsl
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 3) in mat4 inInstanceModel;
+
+// the position must be computed exactly as in vertexShader.glsl, so
+// the shading pass finds the same depth with GL_EQUAL
+invariant gl_Position;
+
+// per-frame view data, shared by every draw
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
+
+uniform mat4 model;
+uniform bool bUseInstancing = false;
+
+void main()
+{
+	mat4 modelMatrix = bUseInstancing ? inInstanceModel : model;
+
+	gl_Position = projection * view * modelMatrix * vec4(inVertexPosition, 1.0f);
+}
@@ -0,0 +1,342 @@
+#version 330 core
+
+// must match MAX_LIGHT_SOURCES in ShaderUniforms.h
+#define TOTAL_LIGHTS 4
+// must match MAX_MATERIALS in ShaderUniforms.h
+#define MAX_MATERIALS 64
+
+// variant options, defined by ShaderCache before this line -
+// the defaults build the full shader
+#ifndef USE_TEXTURE
+#define USE_TEXTURE 1
+#endif
+#ifndef USE_LIGHTING
+#define USE_LIGHTING 1
+#endif
+// lights the scene uses, the rest of the block stays unread
+#ifndef LIGHT_COUNT
+#define LIGHT_COUNT TOTAL_LIGHTS
+#endif
+// lights with a shadow map, the first ones of the block
+#ifndef SHADOW_COUNT
+#define SHADOW_COUNT 0
+#endif
+// point lights binned into view space clusters
+#ifndef USE_CLUSTERS
+#define USE_CLUSTERS 0
+#endif
+// the finest texture levels are streamed into separate slots
+#ifndef USE_STREAMING
+#define USE_STREAMING 0
+#endif
+
+#if USE_CLUSTERS
+#extension GL_ARB_shader_storage_buffer_object : require
+
+// must match the cluster grid in ClusteredLights.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_CLUSTER_LIGHTS 64
+#endif
+
+#if USE_STREAMING
+// must match TextureArray.h and TextureStreamer.h
+#define STREAMED_SIZE 1024
+#define FALLBACK_LEVEL 3
+#define MAX_STREAMED_LAYERS 256
+#endif
+
+// std140 layouts - these must match LIGHT_SOURCE and
+// MATERIAL_BLOCK in ShaderUniforms.h
+struct LightSource
+{
+	vec3 position;
+	float focalStrength;
+	vec3 ambientColor;
+	float specularIntensity;
+	vec3 diffuseColor;
+	vec3 specularColor;
+};
+
+struct Material
+{
+	vec3 ambientColor;
+	float ambientStrength;
+	vec3 diffuseColor;
+	float shininess;
+	vec3 specularColor;
+};
+
+in vec3 fragmentPosition;
+in vec3 fragmentVertexNormal;
+in vec2 fragmentTextureCoordinate;
+in vec2 fragmentUVscale;
+flat in int fragmentTextureLayer;
+flat in int fragmentMaterialIndex;
+
+out vec4 outFragmentColor;
+
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
+
+layout (std140) uniform LightData
+{
+	LightSource lightSources[TOTAL_LIGHTS];
+};
+
+// bound to the range of the current material
+layout (std140) uniform MaterialData
+{
+	Material material;
+};
+
+// every material, indexed by fragmentMaterialIndex
+layout (std140) uniform MaterialTable
+{
+	Material materials[MAX_MATERIALS];
+};
+
+#if SHADOW_COUNT > 0
+// std140 layout - this must match SHADOW_BLOCK in ShaderUniforms.h
+layout (std140) uniform ShadowData
+{
+	mat4 shadowMatrices[TOTAL_LIGHTS];
+	// depth bias, normal offset, texel size
+	vec4 shadowParameters;
+};
+
+// the depth of every shadowed light, one per layer
+uniform sampler2DArrayShadow shadowMaps;
+#endif
+
+#if USE_CLUSTERS
+// std430 layout - this must match POINT_LIGHT in ClusteredLights.h
+struct PointLight
+{
+	vec3 position;
+	float range;
+	vec3 color;
+	float specularIntensity;
+};
+
+// every point light of the scene
+layout (std430) buffer ClusterLights
+{
+	PointLight pointLights[];
+};
+
+// lights found in each cluster by the binning shader
+layout (std430) buffer ClusterCounts
+{
+	uint clusterCounts[];
+};
+
+// MAX_CLUSTER_LIGHTS light indices per cluster
+layout (std430) buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+// std140 layout - this must match CLUSTER_BLOCK in ClusteredLights.h
+layout (std140) uniform ClusterData
+{
+	// clusters per pixel, then the scale and bias of the log depth
+	vec4 clusterScale;
+};
+#endif
+
+uniform vec4 objectColor = vec4(1.0f);
+// every scene texture, one per layer
+uniform sampler2DArray objectTextures;
+
+#if USE_STREAMING
+// the levels finer than FALLBACK_LEVEL of the streamed textures,
+// objectTextures holding the rest from FALLBACK_LEVEL down
+uniform sampler2DArray streamedTextures;
+
+// std140 layout - this must match RESIDENCY_BLOCK in TextureStreamer.h
+layout (std140) uniform TextureResidency
+{
+	// slot in streamedTextures or -1, then the finest level
+	ivec4 textureResidency[MAX_STREAMED_LAYERS];
+};
+#endif
+
+vec3 CalcLightSource(LightSource light, Material surface, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection, float lit);
+float CalcShadow(int lightIndex, vec3 lightNormal, vec3 vertexPosition);
+vec3 CalcClusterLights(Material surface, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection);
+vec4 SampleStreamedTexture(vec2 uv, int layer);
+
+void main()
+{
+	vec4 baseColor = objectColor;
+
+#if USE_TEXTURE
+	// indirect draws mix textured and flat instances
+	if (fragmentTextureLayer >= 0)
+	{
+#if USE_STREAMING
+		baseColor = SampleStreamedTexture(fragmentTextureCoordinate * fragmentUVscale, fragmentTextureLayer);
+#else
+		baseColor = texture(objectTextures,
+			vec3(fragmentTextureCoordinate * fragmentUVscale, float(fragmentTextureLayer)));
+#endif
+	}
+#endif
+
+#if USE_LIGHTING
+	vec3 lightNormal = normalize(fragmentVertexNormal);
+	vec3 viewDirection = normalize(viewPosition - fragmentPosition);
+	vec3 phongResult = vec3(0.0f);
+	Material surface = (fragmentMaterialIndex >= 0) ? materials[fragmentMaterialIndex] : material;
+
+	for (int i = 0; i < LIGHT_COUNT; i++)
+	{
+		float lit = (i < SHADOW_COUNT) ? CalcShadow(i, lightNormal, fragmentPosition) : 1.0f;
+		phongResult += CalcLightSource(lightSources[i], surface, lightNormal, fragmentPosition, viewDirection, lit);
+	}
+#if USE_CLUSTERS
+	phongResult += CalcClusterLights(surface, lightNormal, fragmentPosition, viewDirection);
+#endif
+
+	outFragmentColor = vec4(phongResult * baseColor.rgb, baseColor.a);
+#else
+	outFragmentColor = baseColor;
+#endif
+}
+
+// phong lighting contribution of one light source - the ambient
+// part stays when the surface is in shadow
+vec3 CalcLightSource(LightSource light, Material surface, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection, float lit)
+{
+	vec3 ambient;
+	vec3 diffuse;
+	vec3 specular;
+
+	// ambient lighting
+	ambient = light.ambientColor * surface.ambientColor * surface.ambientStrength;
+
+	// diffuse lighting
+	vec3 lightDirection = normalize(light.position - vertexPosition);
+	float impact = max(dot(lightNormal, lightDirection), 0.0f);
+	diffuse = impact * light.diffuseColor * surface.diffuseColor;
+
+	// specular lighting
+	vec3 reflectDirection = reflect(-lightDirection, lightNormal);
+	float specularComponent = pow(max(dot(viewDirection, reflectDirection), 0.0f), light.focalStrength);
+	if (surface.shininess > 0.0f)
+	{
+		specularComponent *= surface.shininess;
+	}
+	specular = light.specularIntensity * specularComponent * light.specularColor * surface.specularColor;
+
+	return(ambient + (diffuse + specular) * lit);
+}
+
+// fraction of the light reaching a position, filtered over four
+// compared taps of the light's shadow map
+float CalcShadow(int lightIndex, vec3 lightNormal, vec3 vertexPosition)
+{
+#if SHADOW_COUNT > 0
+	// offset along the normal so the surface does not shadow itself
+	vec4 shadowPosition = shadowMatrices[lightIndex] *
+		vec4(vertexPosition + lightNormal * shadowParameters.y, 1.0f);
+	vec3 mapPosition = shadowPosition.xyz / shadowPosition.w;
+
+	// outside the light's frustum nothing casts a shadow
+	if ((shadowPosition.w <= 0.0f) || any(greaterThan(abs(mapPosition.xy), vec2(1.0f))) || (mapPosition.z > 1.0f))
+	{
+		return(1.0f);
+	}
+	mapPosition = mapPosition * 0.5f + 0.5f;
+
+	float depth = mapPosition.z - shadowParameters.x;
+	float offset = shadowParameters.z * 0.5f;
+	float lit = 0.0f;
+
+	lit += texture(shadowMaps, vec4(mapPosition.xy + vec2(-offset, -offset), float(lightIndex), depth));
+	lit += texture(shadowMaps, vec4(mapPosition.xy + vec2( offset, -offset), float(lightIndex), depth));
+	lit += texture(shadowMaps, vec4(mapPosition.xy + vec2(-offset,  offset), float(lightIndex), depth));
+	lit += texture(shadowMaps, vec4(mapPosition.xy + vec2( offset,  offset), float(lightIndex), depth));
+
+	return(lit * 0.25f);
+#else
+	return(1.0f);
+#endif
+}
+
+// diffuse and specular contribution of the point lights in the
+// cluster of the fragment, each fading out at its range
+vec3 CalcClusterLights(Material surface, vec3 lightNormal, vec3 vertexPosition, vec3 viewDirection)
+{
+	vec3 result = vec3(0.0f);
+
+#if USE_CLUSTERS
+	float viewDepth = -(view * vec4(vertexPosition, 1.0f)).z;
+	ivec3 cell = ivec3(
+		ivec2(gl_FragCoord.xy * clusterScale.xy),
+		int(floor(log(max(viewDepth, 0.0001f)) * clusterScale.z + clusterScale.w)));
+	cell = clamp(cell, ivec3(0), ivec3(CLUSTER_X - 1, CLUSTER_Y - 1, CLUSTER_Z - 1));
+	uint cluster = uint(cell.x + (cell.y + cell.z * CLUSTER_Y) * CLUSTER_X);
+	uint count = clusterCounts[cluster];
+
+	for (uint i = 0u; i < count; i++)
+	{
+		PointLight light = pointLights[clusterIndices[cluster * uint(MAX_CLUSTER_LIGHTS) + i]];
+		vec3 toLight = light.position - vertexPosition;
+		float distance = length(toLight);
+		float falloff = clamp(1.0f - (distance * distance) / (light.range * light.range), 0.0f, 1.0f);
+		vec3 lightDirection = toLight / max(distance, 0.0001f);
+
+		float impact = max(dot(lightNormal, lightDirection), 0.0f);
+		vec3 diffuse = impact * light.color * surface.diffuseColor;
+
+		vec3 reflectDirection = reflect(-lightDirection, lightNormal);
+		float specularComponent = pow(max(dot(viewDirection, reflectDirection), 0.0f), 32.0f);
+		if (surface.shininess > 0.0f)
+		{
+			specularComponent *= surface.shininess;
+		}
+		vec3 specular = light.specularIntensity * specularComponent * light.color * surface.specularColor;
+
+		result += (diffuse + specular) * falloff * falloff;
+	}
+#endif
+
+	return(result);
+}
+
+// texture color at the mip level the screen space rate of the
+// coordinates asks for, but no finer than the level resident -
+// the levels from FALLBACK_LEVEL down come from the fallback
+// array, and the step between the two arrays is blended
+vec4 SampleStreamedTexture(vec2 uv, int layer)
+{
+#if USE_STREAMING
+	vec2 texelX = dFdx(uv * float(STREAMED_SIZE));
+	vec2 texelY = dFdy(uv * float(STREAMED_SIZE));
+	float lod = 0.5f * log2(max(max(dot(texelX, texelX), dot(texelY, texelY)), 1.0e-8f));
+	ivec4 residency = textureResidency[layer];
+	float level = max(lod, float(residency.y));
+
+	if ((residency.x < 0) || (level >= float(FALLBACK_LEVEL)))
+	{
+		return(textureLod(objectTextures, vec3(uv, float(layer)), level - float(FALLBACK_LEVEL)));
+	}
+
+	vec4 color = textureLod(streamedTextures, vec3(uv, float(residency.x)), min(level, float(FALLBACK_LEVEL - 1)));
+	if (level > float(FALLBACK_LEVEL - 1))
+	{
+		color = mix(color, textureLod(objectTextures, vec3(uv, float(layer)), 0.0f), level - float(FALLBACK_LEVEL - 1));
+	}
+
+	return(color);
+#else
+	return(texture(objectTextures, vec3(uv, float(layer))));
+#endif
+}
@@ -0,0 +1,55 @@
+#version 430 core
+
+// one invocation per texel of the level being built
+layout (local_size_x = 8, local_size_y = 8) in;
+
+// copy of the depth buffer, read for the first level
+uniform sampler2D depthTexture;
+// previous level of the pyramid, read for the others
+layout (r32f, binding = 0) readonly uniform image2D sourceLevel;
+// level being built
+layout (r32f, binding = 1) writeonly uniform image2D targetLevel;
+
+uniform ivec2 sourceSize;
+uniform ivec2 targetSize;
+uniform bool bFromDepth;
+
+// read a source texel, clamped to the edge of a level one texel wide
+float ReadSource(ivec2 coordinate)
+{
+	coordinate = min(coordinate, sourceSize - 1);
+
+	if (bFromDepth)
+	{
+		return(texelFetch(depthTexture, coordinate, 0).r);
+	}
+	return(imageLoad(sourceLevel, coordinate).r);
+}
+
+void main()
+{
+	ivec2 coordinate = ivec2(gl_GlobalInvocationID.xy);
+
+	if (any(greaterThanEqual(coordinate, targetSize)))
+	{
+		return;
+	}
+
+	// the levels are rounded down, so the last texel of a row or
+	// column below an odd sized level also takes in the one left over
+	ivec2 last = ivec2(equal(coordinate, targetSize - 1)) * (sourceSize & 1);
+	ivec2 source = coordinate * 2;
+
+	// each texel keeps the farthest depth of the texels below it, so
+	// nothing behind it can be visible anywhere in its area
+	float depth = 0.0f;
+	for (int y = 0; y <= 1 + last.y; y++)
+	{
+		for (int x = 0; x <= 1 + last.x; x++)
+		{
+			depth = max(depth, ReadSource(source + ivec2(x, y)));
+		}
+	}
+
+	imageStore(targetLevel, coordinate, vec4(depth));
+}
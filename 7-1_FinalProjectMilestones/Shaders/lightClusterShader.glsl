@@ -0,0 +1,117 @@
+#version 430 core
+
+// one invocation per cluster
+layout (local_size_x = 64) in;
+
+// must match the cluster grid in ClusteredLights.h
+#define CLUSTER_X 16
+#define CLUSTER_Y 9
+#define CLUSTER_Z 24
+#define MAX_CLUSTER_LIGHTS 64
+#define CLUSTER_COUNT (CLUSTER_X * CLUSTER_Y * CLUSTER_Z)
+
+// std430 layout - this must match POINT_LIGHT in ClusteredLights.h
+struct PointLight
+{
+	vec3 position;
+	float range;
+	vec3 color;
+	float specularIntensity;
+};
+
+// the bindings must match STORAGE_BINDING in ShaderUniforms.h
+layout (std430, binding = 4) readonly buffer ClusterLights
+{
+	PointLight pointLights[];
+};
+
+// lights found in each cluster
+layout (std430, binding = 5) writeonly buffer ClusterCounts
+{
+	uint clusterCounts[];
+};
+
+// MAX_CLUSTER_LIGHTS light indices per cluster
+layout (std430, binding = 6) writeonly buffer ClusterIndices
+{
+	uint clusterIndices[];
+};
+
+uniform mat4 view;
+uniform mat4 inverseProjection;
+// view depth of the near and far planes
+uniform vec2 depthRange;
+uniform uint lightCount;
+
+// view space position and range of the lights the group is
+// testing, loaded once for all of its clusters
+shared vec4 groupLights[64];
+
+// view space point at a depth on the ray through a corner of the
+// screen, which works for perspective and orthographic views
+vec3 GetCornerPoint(vec2 corner, float depth)
+{
+	vec4 nearPoint = inverseProjection * vec4(corner, -1.0f, 1.0f);
+	vec4 farPoint = inverseProjection * vec4(corner, 1.0f, 1.0f);
+	vec3 nearView = nearPoint.xyz / nearPoint.w;
+	vec3 farView = farPoint.xyz / farPoint.w;
+
+	return(mix(nearView, farView, (depth + nearView.z) / (nearView.z - farView.z)));
+}
+
+void main()
+{
+	uint cluster = gl_GlobalInvocationID.x;
+	bool bActive = (cluster < CLUSTER_COUNT);
+
+	// the slices are spaced evenly in log depth, so the
+	// clusters stay about as deep as they are wide
+	uvec3 cell = uvec3(cluster % CLUSTER_X, (cluster / CLUSTER_X) % CLUSTER_Y, cluster / (CLUSTER_X * CLUSTER_Y));
+	vec2 tileMinimum = vec2(cell.xy) / vec2(CLUSTER_X, CLUSTER_Y) * 2.0f - 1.0f;
+	vec2 tileMaximum = vec2(cell.xy + 1u) / vec2(CLUSTER_X, CLUSTER_Y) * 2.0f - 1.0f;
+	float depthRatio = depthRange.y / depthRange.x;
+	float sliceNear = depthRange.x * pow(depthRatio, float(cell.z) / float(CLUSTER_Z));
+	float sliceFar = depthRange.x * pow(depthRatio, float(cell.z + 1u) / float(CLUSTER_Z));
+
+	// view space bounds of the cluster's eight corners
+	vec3 boundsMinimum = vec3(1e30f);
+	vec3 boundsMaximum = vec3(-1e30f);
+	for (int i = 0; i < 8; i++)
+	{
+		vec2 corner = vec2(((i & 1) != 0) ? tileMaximum.x : tileMinimum.x, ((i & 2) != 0) ? tileMaximum.y : tileMinimum.y);
+		vec3 point = GetCornerPoint(corner, ((i & 4) != 0) ? sliceFar : sliceNear);
+		boundsMinimum = min(boundsMinimum, point);
+		boundsMaximum = max(boundsMaximum, point);
+	}
+
+	uint count = 0u;
+	for (uint first = 0u; first < lightCount; first += 64u)
+	{
+		uint index = first + gl_LocalInvocationIndex;
+		if (index < lightCount)
+		{
+			PointLight light = pointLights[index];
+			groupLights[gl_LocalInvocationIndex] = vec4((view * vec4(light.position, 1.0f)).xyz, light.range);
+		}
+		barrier();
+
+		uint groupCount = min(64u, lightCount - first);
+		for (uint i = 0u; bActive && (i < groupCount) && (count < MAX_CLUSTER_LIGHTS); i++)
+		{
+			// sphere against box, by the closest point of the box
+			vec4 light = groupLights[i];
+			vec3 offset = clamp(light.xyz, boundsMinimum, boundsMaximum) - light.xyz;
+			if (dot(offset, offset) <= light.w * light.w)
+			{
+				clusterIndices[cluster * MAX_CLUSTER_LIGHTS + count] = first + i;
+				count++;
+			}
+		}
+		barrier();
+	}
+
+	if (bActive)
+	{
+		clusterCounts[cluster] = count;
+	}
+}
@@ -0,0 +1,7 @@
+#version 330 core
+
+// the shadow maps and the depth pre-pass only keep the depth, which
+// is written without any shading
+void main()
+{
+}
@@ -0,0 +1,14 @@
+#version 330 core
+
+// only the position and the per-instance model matrix are read -
+// the locations must match the ones of vertexShader.glsl
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 3) in mat4 inInstanceModel;
+
+// projection and view of the light whose map is drawn
+uniform mat4 lightViewProjection;
+
+void main()
+{
+	gl_Position = lightViewProjection * inInstanceModel * vec4(inVertexPosition, 1.0f);
+}
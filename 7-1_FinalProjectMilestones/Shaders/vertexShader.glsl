@@ -0,0 +1,70 @@
+#version 330 core
+
+// vertex attributes of the basic shape meshes
+layout (location = 0) in vec3 inVertexPosition;
+layout (location = 1) in vec3 inVertexNormal;
+layout (location = 2) in vec2 inTextureCoordinate;
+// per-instance attributes - used when bUseInstancing is set
+layout (location = 3) in mat4 inInstanceModel;
+layout (location = 7) in vec2 inInstanceUVscale;
+layout (location = 8) in int inInstanceTextureLayer;
+layout (location = 9) in int inInstanceMaterial;
+
+out vec3 fragmentPosition;
+out vec3 fragmentVertexNormal;
+out vec2 fragmentTextureCoordinate;
+out vec2 fragmentUVscale;
+// texture array layer, -1 for the flat object color
+flat out int fragmentTextureLayer;
+// material table index, -1 for the bound material
+flat out int fragmentMaterialIndex;
+// the depth pre-pass computes the same position, which must come
+// out bit for bit equal for its depth to pass the GL_EQUAL test
+invariant gl_Position;
+
+// per-frame view data, shared by every draw
+layout (std140) uniform FrameData
+{
+	mat4 view;
+	mat4 projection;
+	vec3 viewPosition;
+};
+
+uniform mat4 model;
+uniform vec2 UVscale = vec2(1.0f, 1.0f);
+uniform bool bUseInstancing = false;
+uniform bool bUseInstanceMaterials = false;
+uniform bool bUseTexture = false;
+uniform int textureLayer = 0;
+
+void main()
+{
+	mat4 modelMatrix = bUseInstancing ? inInstanceModel : model;
+
+	fragmentUVscale = bUseInstancing ? inInstanceUVscale : UVscale;
+	if (bUseInstancing)
+	{
+		fragmentTextureLayer = inInstanceTextureLayer;
+	}
+	else
+	{
+		fragmentTextureLayer = bUseTexture ? textureLayer : -1;
+	}
+	// indirect draws mix materials within one call
+	fragmentMaterialIndex = (bUseInstancing && bUseInstanceMaterials) ? inInstanceMaterial : -1;
+
+	// vertex position in world space
+	fragmentPosition = vec3(modelMatrix * vec4(inVertexPosition, 1.0f));
+	// normal in world space, corrected for non-uniform scaling - the
+	// cofactor matrix is used rather than transpose(inverse()) since it
+	// stays valid for the flat cards, which have a zero scale axis
+	mat3 linear = mat3(modelMatrix);
+	mat3 normalMatrix = mat3(
+		cross(linear[1], linear[2]),
+		cross(linear[2], linear[0]),
+		cross(linear[0], linear[1]));
+	fragmentVertexNormal = normalMatrix * inVertexNormal;
+	fragmentTextureCoordinate = inTextureCoordinate;
+
+	gl_Position = projection * view * modelMatrix * vec4(inVertexPosition, 1.0f);
+}
@@ -0,0 +1,412 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.cpp
+// ============
+// run a fixed number of frames along a scripted camera path and report
+// the frame time, GPU time and draw statistics as JSON
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "Benchmark.h"
+#include "GLObject.h"
+
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// defaults of the benchmark options
+	const int g_DefaultFrameCount = 1000;
+	const char* g_DefaultOutputFilename = "benchmark.json";
+}
+
+/***********************************************************
+ *  Benchmark()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+Benchmark::Benchmark(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+	m_settings.bEnabled = false;
+	m_settings.frameCount = g_DefaultFrameCount;
+	m_settings.bOffscreen = false;
+	m_settings.bVsync = false;
+	m_settings.outputFilename = g_DefaultOutputFilename;
+	m_sceneObjectCount = 0;
+	m_framebuffer = 0;
+	m_colorRenderbuffer = 0;
+	m_depthRenderbuffer = 0;
+	m_renderedFrames = 0;
+	m_firstMeasuredFrame = -1;
+	m_nextCollectedFrame = -1;
+	m_lastFrameEnd = 0.0;
+}
+
+/***********************************************************
+ *  ~Benchmark()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+Benchmark::~Benchmark()
+{
+	DestroyFramebuffer();
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ParseArguments()
+ *
+ *  This method is used for reading the benchmark options:
+ *
+ *    --benchmark          run the benchmark and exit
+ *    --frames <count>     measured frames, default 1000
+ *    --offscreen          render into a hidden framebuffer
+ *    --vsync              keep vsync on for the window
+ *    --output <file>      report file, default benchmark.json
+ ***********************************************************/
+Benchmark::SETTINGS Benchmark::ParseArguments(int argc, char* argv[])
+{
+	SETTINGS settings;
+	settings.bEnabled = false;
+	settings.frameCount = g_DefaultFrameCount;
+	settings.bOffscreen = false;
+	settings.bVsync = false;
+	settings.outputFilename = g_DefaultOutputFilename;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--benchmark") == 0)
+		{
+			settings.bEnabled = true;
+		}
+		else if ((strcmp(argv[i], "--frames") == 0) && (i + 1 < argc))
+		{
+			settings.frameCount = std::max(atoi(argv[++i]), 1);
+		}
+		else if (strcmp(argv[i], "--offscreen") == 0)
+		{
+			settings.bOffscreen = true;
+		}
+		else if (strcmp(argv[i], "--vsync") == 0)
+		{
+			settings.bVsync = true;
+		}
+		else if ((strcmp(argv[i], "--output") == 0) && (i + 1 < argc))
+		{
+			settings.outputFilename = argv[++i];
+		}
+	}
+
+	return(settings);
+}
+
+/***********************************************************
+ *  Begin()
+ *
+ *  This method is used for starting a benchmark run.  When
+ *  offscreen rendering is requested, a framebuffer of the
+ *  window size is created for the frames to render into.
+ ***********************************************************/
+bool Benchmark::Begin(const SETTINGS& settings, int width, int height)
+{
+	m_settings = settings;
+	m_renderedFrames = 0;
+	m_firstMeasuredFrame = -1;
+	m_nextCollectedFrame = -1;
+	m_frameMilliseconds.clear();
+	m_measuredFrames.clear();
+	// the measured frames make no allocations of their own
+	m_frameMilliseconds.reserve(m_settings.frameCount);
+	m_measuredFrames.reserve(m_settings.frameCount);
+	m_lastFrameEnd = glfwGetTime();
+
+	// the swap only paces the frames when vsync is requested
+	glfwSwapInterval(m_settings.bVsync ? 1 : 0);
+
+	if (!m_settings.bOffscreen)
+	{
+		return true;
+	}
+
+	glGenRenderbuffers(1, &m_colorRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_colorRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+	glGenRenderbuffers(1, &m_depthRenderbuffer);
+	glBindRenderbuffer(GL_RENDERBUFFER, m_depthRenderbuffer);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_colorRenderbuffer);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, m_depthRenderbuffer);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create the offscreen benchmark framebuffer" << std::endl;
+		DestroyFramebuffer();
+		return false;
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for binding the framebuffer that the
+ *  benchmark frame renders into.  It must be called before
+ *  the frame is cleared.
+ ***********************************************************/
+void Benchmark::BeginFrame()
+{
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for recording the wall clock time of
+ *  a finished frame and collecting the profiled frames
+ *  whose GPU timings have become available.  The run starts
+ *  over while the scene is still loading.
+ ***********************************************************/
+void Benchmark::EndFrame(bool bSceneLoading)
+{
+	double currentTime = glfwGetTime();
+	double frameMilliseconds = (currentTime - m_lastFrameEnd) * 1000.0;
+	m_lastFrameEnd = currentTime;
+
+	if (bSceneLoading)
+	{
+		m_renderedFrames = 0;
+		return;
+	}
+
+	m_renderedFrames++;
+	if ((m_renderedFrames <= WARMUP_FRAMES) || IsFinished())
+	{
+		return;
+	}
+
+	// the profiler has already finished recording this frame
+	if (m_frameMilliseconds.empty())
+	{
+		m_firstMeasuredFrame = m_pProfiler->GetFrameNumber() - 1;
+		m_nextCollectedFrame = m_firstMeasuredFrame;
+	}
+	m_frameMilliseconds.push_back(frameMilliseconds);
+
+	CollectFrames(m_pProfiler->GetLatestCompleteFrameNumber());
+}
+
+/***********************************************************
+ *  CollectFrames()
+ *
+ *  This method is used for copying the profiled measured
+ *  frames up to the passed in frame number, while they are
+ *  still in the profiler history.
+ ***********************************************************/
+void Benchmark::CollectFrames(long long lastFrame)
+{
+	long long lastMeasuredFrame = m_firstMeasuredFrame + (long long)m_frameMilliseconds.size() - 1;
+
+	lastFrame = std::min(lastFrame, lastMeasuredFrame);
+	for (; m_nextCollectedFrame <= lastFrame; m_nextCollectedFrame++)
+	{
+		const FrameProfiler::FRAME_STATS* frame = m_pProfiler->GetFrame(m_nextCollectedFrame);
+		if (NULL != frame)
+		{
+			m_measuredFrames.push_back(*frame);
+		}
+	}
+}
+
+/***********************************************************
+ *  GetPathPosition()
+ *
+ *  This method is used for getting the position of the
+ *  current frame along the camera path.  The warm-up frames
+ *  all stay at the start of the path.
+ ***********************************************************/
+float Benchmark::GetPathPosition() const
+{
+	return((float)m_frameMilliseconds.size() / (float)m_settings.frameCount);
+}
+
+/***********************************************************
+ *  IsFinished()
+ *
+ *  This method is used for checking whether every measured
+ *  frame has been rendered.
+ ***********************************************************/
+bool Benchmark::IsFinished() const
+{
+	return((int)m_frameMilliseconds.size() >= m_settings.frameCount);
+}
+
+/***********************************************************
+ *  Finish()
+ *
+ *  This method is used for reading back the last GPU
+ *  timings and writing the report - the minimum, average,
+ *  99th percentile and maximum of the frame times, CPU and
+ *  GPU times and counters of the measured frames.
+ ***********************************************************/
+bool Benchmark::Finish()
+{
+	m_pProfiler->FlushQueries();
+	CollectFrames(m_pProfiler->GetLatestCompleteFrameNumber());
+
+	DestroyFramebuffer();
+
+	std::vector<double> cpuMilliseconds;
+	std::vector<double> gpuMilliseconds;
+	std::vector<double> counters[FrameProfiler::COUNTER_COUNT];
+
+	for (size_t i = 0; i < m_measuredFrames.size(); i++)
+	{
+		const FrameProfiler::FRAME_STATS& frame = m_measuredFrames[i];
+		double gpuTotal = 0.0;
+
+		for (int scope = 0; scope < FrameProfiler::GPU_SCOPE_COUNT; scope++)
+		{
+			gpuTotal += std::max(frame.gpuMilliseconds[scope], 0.0);
+		}
+		cpuMilliseconds.push_back(frame.cpuMilliseconds[FrameProfiler::CPU_FRAME]);
+		gpuMilliseconds.push_back(gpuTotal);
+		for (int counter = 0; counter < FrameProfiler::COUNTER_COUNT; counter++)
+		{
+			counters[counter].push_back(frame.counters[counter]);
+		}
+	}
+
+	std::ofstream output(m_settings.outputFilename.c_str(), std::ios::trunc);
+	if (!output)
+	{
+		std::cout << "Could not write benchmark report:" << m_settings.outputFilename << std::endl;
+		return false;
+	}
+
+	output << "{\n";
+	output << "\t\"frames\": " << m_frameMilliseconds.size() << ",\n";
+	output << "\t\"warmup_frames\": " << WARMUP_FRAMES << ",\n";
+	output << "\t\"offscreen\": " << (m_settings.bOffscreen ? "true" : "false") << ",\n";
+	output << "\t\"vsync\": " << (m_settings.bVsync ? "true" : "false") << ",\n";
+	output << "\t\"scene_objects\": " << m_sceneObjectCount << ",\n";
+	output << "\t\"gpu_memory_bytes\": " << GLObject::GetTotalBytes() << ",\n";
+	WriteSummary(output, "frame_ms", Summarize(m_frameMilliseconds), false);
+	WriteSummary(output, "cpu_ms", Summarize(cpuMilliseconds), false);
+	WriteSummary(output, "gpu_ms", Summarize(gpuMilliseconds), false);
+	WriteSummary(output, "draw_calls", Summarize(counters[FrameProfiler::COUNTER_DRAW_CALLS]), false);
+	WriteSummary(output, "instances", Summarize(counters[FrameProfiler::COUNTER_INSTANCES]), false);
+	WriteSummary(output, "uniform_updates", Summarize(counters[FrameProfiler::COUNTER_UNIFORM_UPDATES]), false);
+	WriteSummary(output, "state_changes", Summarize(counters[FrameProfiler::COUNTER_STATE_CHANGES]), false);
+	WriteSummary(output, "buffer_uploads", Summarize(counters[FrameProfiler::COUNTER_BUFFER_UPLOADS]), false);
+	WriteSummary(output, "culled_objects", Summarize(counters[FrameProfiler::COUNTER_CULLED_OBJECTS]), false);
+	WriteSummary(output, "triangles", Summarize(counters[FrameProfiler::COUNTER_TRIANGLES]), false);
+	WriteSummary(output, "sync_stalls", Summarize(counters[FrameProfiler::COUNTER_SYNC_STALLS]), false);
+	WriteSummary(output, "heap_allocations", Summarize(counters[FrameProfiler::COUNTER_HEAP_ALLOCATIONS]), true);
+	output << "}\n";
+
+	std::cout << "Wrote benchmark report of " << m_frameMilliseconds.size() << " frames to " << m_settings.outputFilename << std::endl;
+
+	return(!!output);
+}
+
+/***********************************************************
+ *  SetSceneObjectCount()
+ *
+ *  This method is used for setting the number of objects in
+ *  the benchmarked scene, so that reports of different scene
+ *  sizes can be compared.
+ ***********************************************************/
+void Benchmark::SetSceneObjectCount(int objectCount)
+{
+	m_sceneObjectCount = objectCount;
+}
+
+/***********************************************************
+ *  Summarize()
+ *
+ *  This method is used for computing the minimum, average,
+ *  99th percentile and maximum of a series of values.
+ ***********************************************************/
+Benchmark::SUMMARY Benchmark::Summarize(std::vector<double> values)
+{
+	SUMMARY summary = { 0.0, 0.0, 0.0, 0.0 };
+
+	if (values.empty())
+	{
+		return(summary);
+	}
+
+	std::sort(values.begin(), values.end());
+
+	double total = 0.0;
+	for (size_t i = 0; i < values.size(); i++)
+	{
+		total += values[i];
+	}
+
+	// nearest rank percentile
+	size_t p99Index = (size_t)std::ceil(values.size() * 0.99) - 1;
+
+	summary.minimum = values.front();
+	summary.average = total / values.size();
+	summary.p99 = values[std::min(p99Index, values.size() - 1)];
+	summary.maximum = values.back();
+
+	return(summary);
+}
+
+/***********************************************************
+ *  WriteSummary()
+ *
+ *  This method is used for writing a summary as a member of
+ *  the report object.
+ ***********************************************************/
+void Benchmark::WriteSummary(std::ostream& output, const char* name, const SUMMARY& summary, bool bLast)
+{
+	output << "\t\"" << name << "\": { "
+		<< "\"min\": " << summary.minimum << ", "
+		<< "\"avg\": " << summary.average << ", "
+		<< "\"p99\": " << summary.p99 << ", "
+		<< "\"max\": " << summary.maximum << " }"
+		<< (bLast ? "\n" : ",\n");
+}
+
+/***********************************************************
+ *  DestroyFramebuffer()
+ *
+ *  This method is used for freeing the offscreen
+ *  framebuffer and its attachments.
+ ***********************************************************/
+void Benchmark::DestroyFramebuffer()
+{
+	if (m_framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		m_framebuffer = 0;
+	}
+	if (m_colorRenderbuffer != 0)
+	{
+		glDeleteRenderbuffers(1, &m_colorRenderbuffer);
+		m_colorRenderbuffer = 0;
+	}
+	if (m_depthRenderbuffer != 0)
+	{
+		glDeleteRenderbuffers(1, &m_depthRenderbuffer);
+		m_depthRenderbuffer = 0;
+	}
+}
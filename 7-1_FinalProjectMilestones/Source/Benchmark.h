@@ -0,0 +1,114 @@
+///////////////////////////////////////////////////////////////////////////////
+// benchmark.h
+// ============
+// run a fixed number of frames along a scripted camera path and report
+// the frame time, GPU time and draw statistics as JSON
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "FrameProfiler.h"
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  Benchmark
+ *
+ *  This class drives the --benchmark mode.  Frames are only
+ *  measured once the textures have finished loading and a
+ *  few warm-up frames have passed.  The camera position of
+ *  each frame depends only on the frame index, so runs are
+ *  repeatable.  Rendering can go into an offscreen
+ *  framebuffer so that the window and vsync do not gate the
+ *  measured frame rate.
+ ***********************************************************/
+class Benchmark
+{
+public:
+	// constructor
+	Benchmark(FrameProfiler* pProfiler);
+	// destructor
+	~Benchmark();
+
+	// options parsed from the command line
+	struct SETTINGS
+	{
+		bool bEnabled;
+		// measured frames, after the warm-up
+		int frameCount;
+		// render into an offscreen framebuffer instead of the window
+		bool bOffscreen;
+		// leave vsync on for the window swap
+		bool bVsync;
+		std::string outputFilename;
+	};
+
+	// frames rendered after loading before measuring starts
+	static const int WARMUP_FRAMES = 30;
+
+	// read the benchmark options from the command line
+	static SETTINGS ParseArguments(int argc, char* argv[]);
+
+	// create the offscreen framebuffer when it is requested
+	bool Begin(const SETTINGS& settings, int width, int height);
+	// bind the framebuffer the frame renders into
+	void BeginFrame();
+	// record the finished frame - frames are skipped while the
+	// scene is still loading
+	void EndFrame(bool bSceneLoading);
+	// get the position along the camera path, 0 to 1
+	float GetPathPosition() const;
+	// true once every measured frame has been rendered
+	bool IsFinished() const;
+	// write the report and free the offscreen framebuffer
+	bool Finish();
+	// set the number of scene objects recorded in the report
+	void SetSceneObjectCount(int objectCount);
+
+private:
+	// summary of a series of values
+	struct SUMMARY
+	{
+		double minimum;
+		double average;
+		double p99;
+		double maximum;
+	};
+
+	// compute the summary of a series of values
+	static SUMMARY Summarize(std::vector<double> values);
+	// write a summary as a JSON object member
+	static void WriteSummary(std::ostream& output, const char* name, const SUMMARY& summary, bool bLast);
+	// copy the profiled measured frames up to a frame number
+	void CollectFrames(long long lastFrame);
+	// free the offscreen framebuffer
+	void DestroyFramebuffer();
+
+	FrameProfiler* m_pProfiler;
+	SETTINGS m_settings;
+	// objects in the benchmarked scene
+	int m_sceneObjectCount;
+
+	// offscreen framebuffer and its attachments
+	GLuint m_framebuffer;
+	GLuint m_colorRenderbuffer;
+	GLuint m_depthRenderbuffer;
+
+	// frames rendered since loading finished, warm-up included
+	int m_renderedFrames;
+	// profiler frame number of the first measured frame
+	long long m_firstMeasuredFrame;
+	// next profiler frame to copy into m_measuredFrames
+	long long m_nextCollectedFrame;
+	// wall clock time of the previous frame end, in seconds
+	double m_lastFrameEnd;
+	// wall clock time of each measured frame, in milliseconds
+	std::vector<double> m_frameMilliseconds;
+	// profiled timings and counters of the measured frames
+	std::vector<FrameProfiler::FRAME_STATS> m_measuredFrames;
+};
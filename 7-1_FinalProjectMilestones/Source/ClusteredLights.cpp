@@ -0,0 +1,299 @@
+///////////////////////////////////////////////////////////////////////////////
+// clusteredlights.cpp
+// ============
+// bin the scene point lights into view space clusters in a compute shader,
+// so each fragment only shades with the lights that can reach it
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ClusteredLights.h"
+#include "GPUCulling.h"
+#include "ShaderUniforms.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// closest view depth the slices start at, since the log
+	// depth of an orthographic near plane can be undefined
+	const float g_MinimumSliceDepth = 0.05f;
+}
+
+/***********************************************************
+ *  ClusteredLights()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ClusteredLights::ClusteredLights()
+	: m_program(GLObject::OBJECT_PROGRAM),
+	m_lightBuffer(GLObject::OBJECT_BUFFER),
+	m_countBuffer(GLObject::OBJECT_BUFFER),
+	m_indexBuffer(GLObject::OBJECT_BUFFER),
+	m_clusterBuffer(GLObject::OBJECT_BUFFER)
+{
+	m_viewLocation = -1;
+	m_inverseProjectionLocation = -1;
+	m_depthRangeLocation = -1;
+	m_lightCountLocation = -1;
+	m_lightCount = 0;
+	m_binnedView = glm::mat4(1.0f);
+	m_binnedProjection = glm::mat4(1.0f);
+	for (int i = 0; i < 4; i++)
+	{
+		m_binnedViewport[i] = 0;
+	}
+	m_bBinned = false;
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ~ClusteredLights()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ClusteredLights::~ClusteredLights()
+{
+	Destroy();
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for loading the binning compute
+ *  shader and creating the cluster buffers, which hold a
+ *  full run of light indices for every cluster.  It fails
+ *  without OpenGL 4.3, so the caller can leave the point
+ *  lights off.
+ ***********************************************************/
+bool ClusteredLights::Initialize(const char* computeShaderFilename)
+{
+	Destroy();
+
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cout << "Clustered lighting needs OpenGL 4.3 compute shaders and shader storage buffers" << std::endl;
+		return false;
+	}
+
+	m_program.Adopt(GPUCulling::LoadComputeProgram(computeShaderFilename));
+	if (m_program.Get() == 0)
+	{
+		return false;
+	}
+
+	m_viewLocation = glGetUniformLocation(m_program.Get(), "view");
+	m_inverseProjectionLocation = glGetUniformLocation(m_program.Get(), "inverseProjection");
+	m_depthRangeLocation = glGetUniformLocation(m_program.Get(), "depthRange");
+	m_lightCountLocation = glGetUniformLocation(m_program.Get(), "lightCount");
+
+	// the light buffer is never empty, so it can always be bound
+	POINT_LIGHT noLight = {};
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightBuffer.Create());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(POINT_LIGHT), &noLight, GL_STATIC_DRAW);
+	m_lightBuffer.SetByteSize(sizeof(POINT_LIGHT));
+
+	std::vector<GLuint> noCounts(CLUSTER_COUNT, 0);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_countBuffer.Create());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * CLUSTER_COUNT, noCounts.data(), GL_DYNAMIC_COPY);
+	m_countBuffer.SetByteSize(sizeof(GLuint) * CLUSTER_COUNT);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_indexBuffer.Create());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(GLuint) * CLUSTER_COUNT * MAX_CLUSTER_LIGHTS, NULL, GL_DYNAMIC_COPY);
+	m_indexBuffer.SetByteSize(sizeof(GLuint) * CLUSTER_COUNT * MAX_CLUSTER_LIGHTS);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	CLUSTER_BLOCK noClusters = {};
+	glBindBuffer(GL_UNIFORM_BUFFER, m_clusterBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(CLUSTER_BLOCK), &noClusters, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_clusterBuffer.SetByteSize(sizeof(CLUSTER_BLOCK));
+
+	m_lightCount = 0;
+	m_bBinned = false;
+	BindBuffers();
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the compute program and
+ *  the buffers.
+ ***********************************************************/
+void ClusteredLights::Destroy()
+{
+	m_program.Reset();
+	m_lightBuffer.Reset();
+	m_countBuffer.Reset();
+	m_indexBuffer.Reset();
+	m_clusterBuffer.Reset();
+	m_lightCount = 0;
+	m_bBinned = false;
+}
+
+/***********************************************************
+ *  IsInitialized()
+ *
+ *  This method is used for checking whether the compute
+ *  shader was loaded.
+ ***********************************************************/
+bool ClusteredLights::IsInitialized() const
+{
+	return(m_program.Get() != 0);
+}
+
+/***********************************************************
+ *  SetLights()
+ *
+ *  This method is used for uploading the point lights.  The
+ *  clusters are binned again on the next update.
+ ***********************************************************/
+void ClusteredLights::SetLights(const std::vector<POINT_LIGHT>& lights)
+{
+	if (!IsInitialized())
+	{
+		return;
+	}
+
+	m_lightCount = std::min((int)lights.size(), (int)MAX_LIGHTS);
+	if (m_lightCount > 0)
+	{
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_lightBuffer.Get());
+		glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(POINT_LIGHT) * m_lightCount, lights.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+		m_lightBuffer.SetByteSize(sizeof(POINT_LIGHT) * m_lightCount);
+
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+		}
+	}
+	m_bBinned = false;
+}
+
+/***********************************************************
+ *  GetLightCount()
+ *
+ *  This method is used for getting the number of uploaded
+ *  point lights.
+ ***********************************************************/
+int ClusteredLights::GetLightCount() const
+{
+	return(m_lightCount);
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for binning the lights into the
+ *  clusters of the current view.  The near and far planes
+ *  are read back from the projection, and the tiles follow
+ *  the viewport, so a scaled render resolution keeps its
+ *  clusters.  The barrier makes the cluster lists visible
+ *  to the fragment shaders that follow.  Nothing is
+ *  dispatched while the view and lights stay the same.
+ ***********************************************************/
+bool ClusteredLights::Update(const glm::mat4& view, const glm::mat4& projection)
+{
+	if (!IsInitialized())
+	{
+		return false;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+
+	if (m_bBinned &&
+		(memcmp(&view, &m_binnedView, sizeof(glm::mat4)) == 0) &&
+		(memcmp(&projection, &m_binnedProjection, sizeof(glm::mat4)) == 0) &&
+		(memcmp(viewport, m_binnedViewport, sizeof(viewport)) == 0))
+	{
+		return false;
+	}
+	m_binnedView = view;
+	m_binnedProjection = projection;
+	memcpy(m_binnedViewport, viewport, sizeof(viewport));
+	m_bBinned = true;
+
+	// depths of the planes from the third column, which differs
+	// between the perspective and orthographic projections
+	float nearDepth = 0.0f;
+	float farDepth = 0.0f;
+	if (projection[2][3] != 0.0f)
+	{
+		nearDepth = projection[3][2] / (projection[2][2] - 1.0f);
+		farDepth = projection[3][2] / (projection[2][2] + 1.0f);
+	}
+	else
+	{
+		nearDepth = (projection[3][2] + 1.0f) / projection[2][2];
+		farDepth = (projection[3][2] - 1.0f) / projection[2][2];
+	}
+	nearDepth = std::max(nearDepth, g_MinimumSliceDepth);
+	farDepth = std::max(farDepth, nearDepth * 2.0f);
+
+	float logDepthRatio = logf(farDepth / nearDepth);
+	CLUSTER_BLOCK block;
+	block.clusterScale = glm::vec4(
+		(float)CLUSTER_X / (float)std::max(viewport[2], 1),
+		(float)CLUSTER_Y / (float)std::max(viewport[3], 1),
+		(float)CLUSTER_Z / logDepthRatio,
+		-(float)CLUSTER_Z * logf(nearDepth) / logDepthRatio);
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_clusterBuffer.Get());
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(CLUSTER_BLOCK), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	glm::mat4 inverseProjection = glm::inverse(projection);
+
+	glUseProgram(m_program.Get());
+	glUniformMatrix4fv(m_viewLocation, 1, GL_FALSE, glm::value_ptr(view));
+	glUniformMatrix4fv(m_inverseProjectionLocation, 1, GL_FALSE, glm::value_ptr(inverseProjection));
+	glUniform2f(m_depthRangeLocation, nearDepth, farDepth);
+	glUniform1ui(m_lightCountLocation, (GLuint)m_lightCount);
+
+	glDispatchCompute((CLUSTER_COUNT + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the buffer uploads.
+ ***********************************************************/
+void ClusteredLights::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  BindBuffers()
+ *
+ *  This method is used for binding the light and cluster
+ *  buffers to the binding points the binning shader and the
+ *  lit fragment shaders read them from.
+ ***********************************************************/
+void ClusteredLights::BindBuffers()
+{
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderUniforms::CLUSTER_LIGHTS_BINDING, m_lightBuffer.Get());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderUniforms::CLUSTER_COUNTS_BINDING, m_countBuffer.Get());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ShaderUniforms::CLUSTER_INDICES_BINDING, m_indexBuffer.Get());
+	glBindBufferBase(GL_UNIFORM_BUFFER, ShaderUniforms::CLUSTER_BLOCK_BINDING, m_clusterBuffer.Get());
+}
@@ -0,0 +1,120 @@
+///////////////////////////////////////////////////////////////////////////////
+// clusteredlights.h
+// ============
+// bin the scene point lights into view space clusters in a compute shader,
+// so each fragment only shades with the lights that can reach it
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+
+#include <vector>
+
+/***********************************************************
+ *  ClusteredLights
+ *
+ *  This class keeps the point lights of the scene in a
+ *  shader storage buffer and splits the view frustum into a
+ *  grid of clusters: screen tiles, cut into slices evenly
+ *  spaced in log depth.  A compute shader finds the lights
+ *  whose range touches each cluster and writes their
+ *  indices into a fixed run per cluster, which the lit
+ *  fragment shader reads from the cluster of its pixel and
+ *  depth.  The binning is only dispatched again when the
+ *  view, the projection, the viewport or the lights change.
+ *  It needs OpenGL 4.3 for compute shaders and shader
+ *  storage buffers.
+ ***********************************************************/
+class ClusteredLights
+{
+public:
+	// constructor
+	ClusteredLights();
+	// destructor
+	~ClusteredLights();
+
+	// std430 layout of one point light, which must match the
+	// shaders
+	struct POINT_LIGHT
+	{
+		glm::vec3 position;
+		// distance at which the light fades out
+		float range;
+		glm::vec3 color;
+		float specularIntensity;
+	};
+
+	// std140 layout of the ClusterData block
+	struct CLUSTER_BLOCK
+	{
+		// clusters per pixel, then the scale and bias that turn
+		// the log of the view depth into a slice
+		glm::vec4 clusterScale;
+	};
+
+	// size of the cluster grid and the most lights kept per
+	// cluster - these must match the shaders
+	static const int CLUSTER_X = 16;
+	static const int CLUSTER_Y = 9;
+	static const int CLUSTER_Z = 24;
+	static const int MAX_CLUSTER_LIGHTS = 64;
+	static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+	// most point lights in the scene
+	static const int MAX_LIGHTS = 4096;
+	// invocations per compute work group, must match the shader
+	static const int WORKGROUP_SIZE = 64;
+
+	// load the binning compute shader and create the cluster
+	// buffers - false when it is unsupported
+	bool Initialize(const char* computeShaderFilename);
+	// free the compute program and the buffers
+	void Destroy();
+	// true once Initialize() has succeeded
+	bool IsInitialized() const;
+
+	// upload the point lights, past MAX_LIGHTS they are dropped
+	void SetLights(const std::vector<POINT_LIGHT>& lights);
+	// get the number of uploaded point lights
+	int GetLightCount() const;
+
+	// bin the lights into the clusters of the view and the
+	// current viewport and bind the buffers the shaders read -
+	// returns true when the compute program was left in use
+	bool Update(const glm::mat4& view, const glm::mat4& projection);
+
+	// set the profiler that counts the uploads, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+
+private:
+	// bind the buffers to the binding points of the shaders
+	void BindBuffers();
+
+	GLObject m_program;
+	GLint m_viewLocation;
+	GLint m_inverseProjectionLocation;
+	GLint m_depthRangeLocation;
+	GLint m_lightCountLocation;
+
+	// shader storage buffers of the lights and clusters, and
+	// the uniform buffer of the cluster mapping
+	GLObject m_lightBuffer;
+	GLObject m_countBuffer;
+	GLObject m_indexBuffer;
+	GLObject m_clusterBuffer;
+
+	int m_lightCount;
+	// inputs of the last binning, which is skipped while they
+	// stay the same
+	glm::mat4 m_binnedView;
+	glm::mat4 m_binnedProjection;
+	GLint m_binnedViewport[4];
+	bool m_bBinned;
+	// counts the buffer uploads, may be NULL
+	FrameProfiler* m_pProfiler;
+};
@@ -0,0 +1,181 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.cpp
+// ============
+// hand out the transient memory of a frame from one linear block that is
+// rewound at the start of the next frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameArena.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+
+// declaration of global variables
+namespace
+{
+	// every heap allocation made through operator new, on any
+	// thread, for the allocation counter of the profiler
+	std::atomic<unsigned long long> g_HeapAllocations(0);
+	// room left past the largest frame seen when the blocks are
+	// merged, so a slowly growing frame settles on one size
+	const double g_BlockGrowth = 1.5;
+}
+
+/***********************************************************
+ *  operator new()
+ *
+ *  The global allocation functions are replaced to count
+ *  the heap allocations.  The array and nothrow forms call
+ *  these, so every allocation is counted once.
+ ***********************************************************/
+void* operator new(size_t size)
+{
+	g_HeapAllocations.fetch_add(1, std::memory_order_relaxed);
+
+	void* pMemory = malloc((size > 0) ? size : 1);
+	if (NULL == pMemory)
+	{
+		throw std::bad_alloc();
+	}
+	return(pMemory);
+}
+
+void operator delete(void* pMemory) noexcept
+{
+	free(pMemory);
+}
+
+void operator delete(void* pMemory, size_t size) noexcept
+{
+	free(pMemory);
+}
+
+/***********************************************************
+ *  FrameArena()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameArena::FrameArena()
+{
+	m_currentBlock = 0;
+	m_blockOffset = 0;
+	m_usedBytes = 0;
+
+	AddBlock(DEFAULT_BLOCK_SIZE);
+}
+
+/***********************************************************
+ *  ~FrameArena()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameArena::~FrameArena()
+{
+	FreeBlocks();
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for rewinding the arena to the start
+ *  of its first block.  When the last frame spilled into
+ *  more blocks they are merged into one that fits it.
+ ***********************************************************/
+void FrameArena::Reset()
+{
+	if (m_blocks.size() > 1)
+	{
+		size_t blockSize = (size_t)(m_usedBytes * g_BlockGrowth);
+
+		FreeBlocks();
+		AddBlock(std::max(blockSize, (size_t)DEFAULT_BLOCK_SIZE));
+	}
+
+	m_currentBlock = 0;
+	m_blockOffset = 0;
+	m_usedBytes = 0;
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method is used for bump allocating memory from the
+ *  current block, moving on to a new block when it is full.
+ ***********************************************************/
+void* FrameArena::Allocate(size_t size, size_t alignment)
+{
+	size_t offset = (m_blockOffset + alignment - 1) & ~(alignment - 1);
+
+	if (offset + size > m_blocks[m_currentBlock].size)
+	{
+		// malloc aligns a new block for any standard type
+		AddBlock(std::max(size, (size_t)DEFAULT_BLOCK_SIZE));
+		offset = 0;
+	}
+
+	m_blockOffset = offset + size;
+	m_usedBytes += size;
+
+	return(m_blocks[m_currentBlock].pMemory + offset);
+}
+
+/***********************************************************
+ *  GetUsedBytes()
+ *
+ *  This method is used for getting the bytes allocated
+ *  since the last Reset().
+ ***********************************************************/
+size_t FrameArena::GetUsedBytes() const
+{
+	return(m_usedBytes);
+}
+
+/***********************************************************
+ *  GetHeapAllocationCount()
+ *
+ *  This method is used for getting the number of heap
+ *  allocations made so far by every thread, so the profiler
+ *  can count the ones made within a frame.
+ ***********************************************************/
+unsigned long long FrameArena::GetHeapAllocationCount()
+{
+	return(g_HeapAllocations.load(std::memory_order_relaxed));
+}
+
+/***********************************************************
+ *  AddBlock()
+ *
+ *  This method is used for adding a block to the arena and
+ *  allocating from it.
+ ***********************************************************/
+void FrameArena::AddBlock(size_t size)
+{
+	BLOCK block;
+
+	block.pMemory = (unsigned char*)malloc(size);
+	block.size = size;
+	if (NULL == block.pMemory)
+	{
+		throw std::bad_alloc();
+	}
+
+	m_blocks.push_back(block);
+	m_currentBlock = m_blocks.size() - 1;
+	m_blockOffset = 0;
+}
+
+/***********************************************************
+ *  FreeBlocks()
+ *
+ *  This method is used for freeing every block.
+ ***********************************************************/
+void FrameArena::FreeBlocks()
+{
+	for (size_t i = 0; i < m_blocks.size(); i++)
+	{
+		free(m_blocks[i].pMemory);
+	}
+	m_blocks.clear();
+}
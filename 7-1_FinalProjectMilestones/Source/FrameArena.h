@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// framearena.h
+// ============
+// hand out the transient memory of a frame from one linear block that is
+// rewound at the start of the next frame
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/***********************************************************
+ *  FrameArena
+ *
+ *  This class bump allocates the memory of data that only
+ *  lives for one frame, such as the draw command lists of
+ *  the render queue.  Nothing is freed on its own; Reset()
+ *  at the start of a frame rewinds the whole arena at once.
+ *  A frame that needs more than the block holds gets extra
+ *  blocks, and the next Reset() replaces them with a single
+ *  block big enough for that frame, so a steady frame makes
+ *  no heap allocations.  The arena is only used from the
+ *  thread that resets it.
+ ***********************************************************/
+class FrameArena
+{
+public:
+	// constructor
+	FrameArena();
+	// destructor
+	~FrameArena();
+
+	// starting size of the block, in bytes
+	static const size_t DEFAULT_BLOCK_SIZE = 256 * 1024;
+
+	// rewind the arena for a new frame - every earlier
+	// allocation is invalid afterwards
+	void Reset();
+	// allocate memory at a power of two alignment
+	void* Allocate(size_t size, size_t alignment);
+
+	// get the bytes allocated since the last Reset()
+	size_t GetUsedBytes() const;
+	// get the number of heap allocations the program has made
+	static unsigned long long GetHeapAllocationCount();
+
+private:
+	// one block of arena memory
+	struct BLOCK
+	{
+		unsigned char* pMemory;
+		size_t size;
+	};
+
+	// add a block of at least size bytes and make it current
+	void AddBlock(size_t size);
+	// free every block
+	void FreeBlocks();
+
+	std::vector<BLOCK> m_blocks;
+	// block allocated from and the bytes used in it
+	size_t m_currentBlock;
+	size_t m_blockOffset;
+	// bytes allocated since the last Reset()
+	size_t m_usedBytes;
+};
+
+/***********************************************************
+ *  ArenaAllocator
+ *
+ *  This class lets a standard container take its memory
+ *  from a frame arena.  Freeing is left to the arena, so a
+ *  container on the arena has to be rebuilt after every
+ *  Reset().  Without an arena it falls back on the heap.
+ ***********************************************************/
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	// containers moved or swapped keep the arena they came from
+	typedef std::true_type propagate_on_container_copy_assignment;
+	typedef std::true_type propagate_on_container_move_assignment;
+	typedef std::true_type propagate_on_container_swap;
+
+	ArenaAllocator(FrameArena* pArena = NULL) : m_pArena(pArena) {}
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : m_pArena(other.GetArena()) {}
+
+	T* allocate(size_t count)
+	{
+		if (NULL == m_pArena)
+		{
+			return((T*)::operator new(count * sizeof(T)));
+		}
+		return((T*)m_pArena->Allocate(count * sizeof(T), alignof(T)));
+	}
+	void deallocate(T* pMemory, size_t count)
+	{
+		if (NULL == m_pArena)
+		{
+			::operator delete(pMemory);
+		}
+	}
+
+	FrameArena* GetArena() const { return(m_pArena); }
+
+	template <class U>
+	bool operator==(const ArenaAllocator<U>& other) const { return(m_pArena == other.GetArena()); }
+	template <class U>
+	bool operator!=(const ArenaAllocator<U>& other) const { return(m_pArena != other.GetArena()); }
+
+private:
+	FrameArena* m_pArena;
+};
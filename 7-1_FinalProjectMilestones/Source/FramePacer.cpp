@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.cpp
+// ============
+// set the swap interval of the window and hold the frame rate at a cap by
+// sleeping until the next frame is due
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FramePacer.h"
+
+#include "GLFW/glfw3.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#ifndef CREATE_WAITABLE_TIMER_HIGH_RESOLUTION
+#define CREATE_WAITABLE_TIMER_HIGH_RESOLUTION 0x00000002
+#endif
+#endif
+
+// declaration of global variables
+namespace
+{
+	// time before a frame is due that is yielded away rather
+	// than slept, since a sleep may overshoot by this much
+	const double g_SpinSeconds = 0.002;
+	// highest frame rate cap that is accepted
+	const double g_MaxFrameRateCap = 1000.0;
+	// longest sleep in the event queue, so work finishing on
+	// other threads is seen even without an event
+	const double g_IdleTimeoutSeconds = 0.25;
+}
+
+/***********************************************************
+ *  FramePacer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FramePacer::FramePacer()
+{
+	m_settings.swapInterval = SWAP_ON;
+	m_settings.frameRateCap = 0.0;
+	m_settings.bOnDemand = false;
+	m_nextFrameTime = 0.0;
+	m_pTimer = NULL;
+
+#ifdef _WIN32
+	// the default timer resolution of Windows is about 15 ms,
+	// far too coarse for pacing - the high resolution timer
+	// needs Windows 10 1803, and older versions only yield
+	m_pTimer = CreateWaitableTimerExW(NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS);
+#endif
+}
+
+/***********************************************************
+ *  ~FramePacer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FramePacer::~FramePacer()
+{
+#ifdef _WIN32
+	if (NULL != m_pTimer)
+	{
+		CloseHandle((HANDLE)m_pTimer);
+	}
+#endif
+	m_pTimer = NULL;
+}
+
+/***********************************************************
+ *  ParseArguments()
+ *
+ *  This method is used for reading the frame pacing
+ *  options:
+ *
+ *    --swap-interval <off|on|adaptive>   default on
+ *    --fps-cap <frames per second>       default no cap
+ *    --on-demand                         render only on change
+ ***********************************************************/
+FramePacer::SETTINGS FramePacer::ParseArguments(int argc, char* argv[])
+{
+	SETTINGS settings;
+	settings.swapInterval = SWAP_ON;
+	settings.frameRateCap = 0.0;
+	settings.bOnDemand = false;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if ((strcmp(argv[i], "--swap-interval") == 0) && (i + 1 < argc))
+		{
+			const char* pValue = argv[++i];
+
+			if (strcmp(pValue, "off") == 0)
+			{
+				settings.swapInterval = SWAP_OFF;
+			}
+			else if (strcmp(pValue, "on") == 0)
+			{
+				settings.swapInterval = SWAP_ON;
+			}
+			else if (strcmp(pValue, "adaptive") == 0)
+			{
+				settings.swapInterval = SWAP_ADAPTIVE;
+			}
+			else
+			{
+				std::cout << "Unknown swap interval:" << pValue << ", keeping vsync on" << std::endl;
+			}
+		}
+		else if ((strcmp(argv[i], "--fps-cap") == 0) && (i + 1 < argc))
+		{
+			settings.frameRateCap = std::min(std::max(atof(argv[++i]), 0.0), g_MaxFrameRateCap);
+		}
+		else if (strcmp(argv[i], "--on-demand") == 0)
+		{
+			settings.bOnDemand = true;
+		}
+	}
+
+	return(settings);
+}
+
+/***********************************************************
+ *  Begin()
+ *
+ *  This method is used for setting the swap interval of the
+ *  current context.  Adaptive vsync needs the swap control
+ *  tear extension, and falls back to plain vsync without
+ *  it.
+ ***********************************************************/
+void FramePacer::Begin(const SETTINGS& settings)
+{
+	m_settings = settings;
+
+	int swapInterval = 1;
+	switch (m_settings.swapInterval)
+	{
+	case SWAP_OFF:
+		swapInterval = 0;
+		break;
+	case SWAP_ADAPTIVE:
+		if (glfwExtensionSupported("WGL_EXT_swap_control_tear") ||
+			glfwExtensionSupported("GLX_EXT_swap_control_tear"))
+		{
+			swapInterval = -1;
+		}
+		else
+		{
+			std::cout << "Adaptive vsync is not supported, keeping vsync on" << std::endl;
+		}
+		break;
+	default:
+		break;
+	}
+	glfwSwapInterval(swapInterval);
+
+	m_nextFrameTime = glfwGetTime();
+}
+
+/***********************************************************
+ *  WaitForNextFrame()
+ *
+ *  This method is used for waiting until the next frame is
+ *  due under the frame rate cap.  The frames are due at a
+ *  fixed period from each other, so an early frame does not
+ *  shift the ones after it; a frame that is later than a
+ *  whole period starts the cadence over instead of rushing
+ *  the next frames to catch up.
+ ***********************************************************/
+void FramePacer::WaitForNextFrame()
+{
+	if (m_settings.frameRateCap <= 0.0)
+	{
+		return;
+	}
+
+	double period = 1.0 / m_settings.frameRateCap;
+	double currentTime = glfwGetTime();
+
+	if (m_nextFrameTime - currentTime > g_SpinSeconds)
+	{
+		SleepFor(m_nextFrameTime - currentTime - g_SpinSeconds);
+	}
+	while (glfwGetTime() < m_nextFrameTime)
+	{
+		std::this_thread::yield();
+	}
+
+	currentTime = glfwGetTime();
+	m_nextFrameTime += period;
+	if (m_nextFrameTime < currentTime)
+	{
+		m_nextFrameTime = currentTime + period;
+	}
+}
+
+/***********************************************************
+ *  IsOnDemand()
+ *
+ *  This method is used for checking whether the frame loop
+ *  waits for changes between frames.
+ ***********************************************************/
+bool FramePacer::IsOnDemand() const
+{
+	return(m_settings.bOnDemand);
+}
+
+/***********************************************************
+ *  WaitForEvents()
+ *
+ *  This method is used for sleeping in the event queue of
+ *  an idle frame loop.  Input, window changes and the
+ *  empty events posted by other threads end the wait early.
+ ***********************************************************/
+void FramePacer::WaitForEvents()
+{
+	glfwWaitEventsTimeout(g_IdleTimeoutSeconds);
+}
+
+/***********************************************************
+ *  SleepFor()
+ *
+ *  This method is used for sleeping the thread for about
+ *  the passed in time, on the high resolution timer when
+ *  there is one.
+ ***********************************************************/
+void FramePacer::SleepFor(double seconds)
+{
+#ifdef _WIN32
+	if (NULL != m_pTimer)
+	{
+		// negative due times are relative, in 100 ns units
+		LARGE_INTEGER dueTime;
+		dueTime.QuadPart = -(LONGLONG)(seconds * 10000000.0);
+		if (SetWaitableTimer((HANDLE)m_pTimer, &dueTime, 0, NULL, NULL, FALSE))
+		{
+			WaitForSingleObject((HANDLE)m_pTimer, INFINITE);
+		}
+		return;
+	}
+	// without it a sleep can take a whole scheduler tick, so
+	// the rest of the wait is yielded
+#else
+	std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+#endif
+}
@@ -0,0 +1,76 @@
+///////////////////////////////////////////////////////////////////////////////
+// framepacer.h
+// ============
+// set the swap interval of the window and hold the frame rate at a cap by
+// sleeping until the next frame is due
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+/***********************************************************
+ *  FramePacer
+ *
+ *  This class chooses how buffer swaps wait for the display
+ *  and caps the frame rate.  The cap sleeps most of the
+ *  time until the next frame is due and yields the last
+ *  moment away, so frames start on an even cadence without
+ *  burning a core.  Waiting before the events are polled
+ *  keeps the input of a frame as fresh as possible.  In the
+ *  on-demand mode the frame loop sleeps in the event queue
+ *  while nothing changes instead of rendering the same
+ *  frame again.
+ ***********************************************************/
+class FramePacer
+{
+public:
+	// how a buffer swap waits for the display refresh
+	enum SWAP_INTERVAL
+	{
+		// swap at once, tearing if the frame is not in sync
+		SWAP_OFF,
+		// wait for every refresh
+		SWAP_ON,
+		// wait for the refresh, but swap at once when the
+		// frame missed it
+		SWAP_ADAPTIVE
+	};
+
+	// frame pacing options
+	struct SETTINGS
+	{
+		SWAP_INTERVAL swapInterval;
+		// most frames per second, 0 for no cap
+		double frameRateCap;
+		// only render when the view or the scene changed
+		bool bOnDemand;
+	};
+
+	// constructor
+	FramePacer();
+	// destructor
+	~FramePacer();
+
+	// read the frame pacing options from the command line
+	static SETTINGS ParseArguments(int argc, char* argv[]);
+
+	// set the swap interval of the current context and start
+	// the frame cadence
+	void Begin(const SETTINGS& settings);
+	// sleep until the next frame is due under the cap
+	void WaitForNextFrame();
+	// true when frames are only rendered on demand
+	bool IsOnDemand() const;
+	// sleep until an event arrives or the idle timeout passes
+	void WaitForEvents();
+
+private:
+	// sleep for about the passed in seconds
+	void SleepFor(double seconds);
+
+	SETTINGS m_settings;
+	// time the next frame is due, from glfwGetTime()
+	double m_nextFrameTime;
+	// high resolution waitable timer on Windows, NULL elsewhere
+	void* m_pTimer;
+};
@@ -0,0 +1,575 @@
+///////////////////////////////////////////////////////////////////////////////
+// frameprofiler.cpp
+// ============
+// time the CPU and GPU work of each frame, count the draw calls and state
+// changes, and show the results in an on-screen overlay or a CSV file
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "FrameProfiler.h"
+#include "FrameArena.h"
+#include "GLObject.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// column names of the CSV dump, in enum order
+	const char* g_CPUScopeNames[FrameProfiler::CPU_SCOPE_COUNT] =
+	{
+		"cpu_frame_ms",
+		"cpu_prepare_view_ms",
+		"cpu_render_scene_ms",
+		"cpu_culling_ms",
+		"cpu_shadow_pass_ms",
+		"cpu_depth_prepass_ms",
+		"cpu_opaque_pass_ms",
+		"cpu_transparent_pass_ms"
+	};
+	const char* g_GPUScopeNames[FrameProfiler::GPU_SCOPE_COUNT] =
+	{
+		"gpu_shadow_pass_ms",
+		"gpu_depth_prepass_ms",
+		"gpu_opaque_pass_ms",
+		"gpu_transparent_pass_ms",
+		"gpu_hiz_build_ms"
+	};
+	const char* g_CounterNames[FrameProfiler::COUNTER_COUNT] =
+	{
+		"draw_calls",
+		"instances",
+		"uniform_updates",
+		"state_changes",
+		"buffer_uploads",
+		"culled_objects",
+		"triangles",
+		"sync_stalls",
+		"heap_allocations"
+	};
+
+	// overlay layout in pixels - a bar of OVERLAY_BUDGET_WIDTH
+	// is one 60 Hz frame
+	const int g_OverlayMargin = 10;
+	const int g_OverlayBarHeight = 8;
+	const int g_OverlayBarSpacing = 4;
+	const int g_OverlayBudgetWidth = 300;
+	const double g_FrameBudgetMilliseconds = 1000.0 / 60.0;
+	// seconds between window title refreshes
+	const double g_TitleUpdateInterval = 0.5;
+
+	// overlay colors
+	const float g_PanelColor[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+	const float g_BudgetColor[4] = { 1.0f, 1.0f, 1.0f, 1.0f };
+	const float g_CPUBarColor[4] = { 0.2f, 0.8f, 0.3f, 1.0f };
+	const float g_GPUBarColor[4] = { 0.9f, 0.5f, 0.1f, 1.0f };
+}
+
+/***********************************************************
+ *  FrameProfiler()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+FrameProfiler::FrameProfiler()
+{
+	for (int slot = 0; slot < QUERY_FRAMES; slot++)
+	{
+		for (int scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+		{
+			m_queries[slot][scope] = 0;
+			m_bQueryIssued[slot][scope] = false;
+		}
+		m_queryFrames[slot] = -1;
+	}
+	for (int scope = 0; scope < CPU_SCOPE_COUNT; scope++)
+	{
+		m_cpuScopeStarts[scope] = 0.0;
+	}
+
+	FRAME_STATS empty;
+	empty.frameNumber = -1;
+	std::fill(empty.cpuMilliseconds, empty.cpuMilliseconds + CPU_SCOPE_COUNT, 0.0);
+	std::fill(empty.gpuMilliseconds, empty.gpuMilliseconds + GPU_SCOPE_COUNT, -1.0);
+	std::fill(empty.counters, empty.counters + COUNTER_COUNT, 0);
+	m_history.assign(HISTORY_FRAMES, empty);
+	m_currentFrame = empty;
+	m_frameStartAllocations = 0;
+
+	m_activeGPUScope = -1;
+	m_latestCompleteFrame = -1;
+	m_frameNumber = 0;
+	m_bInitialized = false;
+	m_bOverlayVisible = false;
+	m_lastTitleUpdate = 0.0;
+	m_bTitleChanged = false;
+}
+
+/***********************************************************
+ *  ~FrameProfiler()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+FrameProfiler::~FrameProfiler()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for creating the GPU timer queries.
+ *  It must be called once the OpenGL context exists.
+ ***********************************************************/
+bool FrameProfiler::Initialize()
+{
+	if (m_bInitialized)
+	{
+		return true;
+	}
+
+	glGenQueries(QUERY_FRAMES * GPU_SCOPE_COUNT, &m_queries[0][0]);
+	m_bInitialized = true;
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the GPU timer queries.
+ ***********************************************************/
+void FrameProfiler::Destroy()
+{
+	if (!m_bInitialized)
+	{
+		return;
+	}
+
+	glDeleteQueries(QUERY_FRAMES * GPU_SCOPE_COUNT, &m_queries[0][0]);
+	for (int slot = 0; slot < QUERY_FRAMES; slot++)
+	{
+		for (int scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+		{
+			m_queries[slot][scope] = 0;
+			m_bQueryIssued[slot][scope] = false;
+		}
+		m_queryFrames[slot] = -1;
+	}
+	m_activeGPUScope = -1;
+	m_bInitialized = false;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting the recording of a
+ *  frame.  The query slot the frame reuses is read back
+ *  first; it was issued QUERY_FRAMES frames earlier.
+ ***********************************************************/
+void FrameProfiler::BeginFrame()
+{
+	int slot = (int)(m_frameNumber % QUERY_FRAMES);
+
+	if (m_bInitialized && (m_queryFrames[slot] >= 0))
+	{
+		ReadQueries(slot);
+	}
+
+	m_currentFrame.frameNumber = m_frameNumber;
+	std::fill(m_currentFrame.cpuMilliseconds, m_currentFrame.cpuMilliseconds + CPU_SCOPE_COUNT, 0.0);
+	std::fill(m_currentFrame.gpuMilliseconds, m_currentFrame.gpuMilliseconds + GPU_SCOPE_COUNT, -1.0);
+	std::fill(m_currentFrame.counters, m_currentFrame.counters + COUNTER_COUNT, 0);
+	m_frameStartAllocations = FrameArena::GetHeapAllocationCount();
+
+	BeginCPUScope(CPU_FRAME);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for finishing the recording of a
+ *  frame and storing it in the history.
+ ***********************************************************/
+void FrameProfiler::EndFrame()
+{
+	EndCPUScope(CPU_FRAME);
+	// allocations of every thread during the frame
+	m_currentFrame.counters[COUNTER_HEAP_ALLOCATIONS] =
+		(int)(FrameArena::GetHeapAllocationCount() - m_frameStartAllocations);
+
+	m_history[m_frameNumber % HISTORY_FRAMES] = m_currentFrame;
+	m_queryFrames[m_frameNumber % QUERY_FRAMES] = m_frameNumber;
+	m_frameNumber++;
+}
+
+/***********************************************************
+ *  BeginCPUScope()
+ *
+ *  This method is used for starting the timer of a CPU
+ *  scope.
+ ***********************************************************/
+void FrameProfiler::BeginCPUScope(CPU_SCOPE scope)
+{
+	m_cpuScopeStarts[scope] = glfwGetTime();
+}
+
+/***********************************************************
+ *  EndCPUScope()
+ *
+ *  This method is used for stopping the timer of a CPU
+ *  scope.  A scope entered more than once in a frame adds
+ *  up its time.
+ ***********************************************************/
+void FrameProfiler::EndCPUScope(CPU_SCOPE scope)
+{
+	m_currentFrame.cpuMilliseconds[scope] += (glfwGetTime() - m_cpuScopeStarts[scope]) * 1000.0;
+}
+
+/***********************************************************
+ *  BeginGPUScope()
+ *
+ *  This method is used for starting the GPU timer query of
+ *  a pass.  Passes cannot nest or repeat within a frame.
+ ***********************************************************/
+void FrameProfiler::BeginGPUScope(GPU_SCOPE scope)
+{
+	int slot = (int)(m_frameNumber % QUERY_FRAMES);
+
+	if (!m_bInitialized || (m_activeGPUScope >= 0) || m_bQueryIssued[slot][scope])
+	{
+		return;
+	}
+
+	glBeginQuery(GL_TIME_ELAPSED, m_queries[slot][scope]);
+	m_bQueryIssued[slot][scope] = true;
+	m_activeGPUScope = scope;
+}
+
+/***********************************************************
+ *  EndGPUScope()
+ *
+ *  This method is used for ending the GPU timer query of a
+ *  pass.
+ ***********************************************************/
+void FrameProfiler::EndGPUScope(GPU_SCOPE scope)
+{
+	if (m_activeGPUScope != scope)
+	{
+		return;
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	m_activeGPUScope = -1;
+}
+
+/***********************************************************
+ *  AddCount()
+ *
+ *  This method is used for adding to a counter of the
+ *  current frame.
+ ***********************************************************/
+void FrameProfiler::AddCount(COUNTER counter, int amount)
+{
+	m_currentFrame.counters[counter] += amount;
+}
+
+/***********************************************************
+ *  GetLatestFrame()
+ *
+ *  This method is used for getting the most recent frame
+ *  whose GPU timings have been read back.
+ ***********************************************************/
+const FrameProfiler::FRAME_STATS& FrameProfiler::GetLatestFrame() const
+{
+	if (m_latestCompleteFrame < 0)
+	{
+		return(m_currentFrame);
+	}
+	return(m_history[m_latestCompleteFrame % HISTORY_FRAMES]);
+}
+
+/***********************************************************
+ *  GetLatestCompleteFrameNumber()
+ *
+ *  This method is used for getting the number of the most
+ *  recent frame whose GPU timings have been read back.
+ ***********************************************************/
+long long FrameProfiler::GetLatestCompleteFrameNumber() const
+{
+	return(m_latestCompleteFrame);
+}
+
+/***********************************************************
+ *  GetFrame()
+ *
+ *  This method is used for getting a recorded frame that is
+ *  still in the history ring.
+ ***********************************************************/
+const FrameProfiler::FRAME_STATS* FrameProfiler::GetFrame(long long frameNumber) const
+{
+	if ((frameNumber < 0) ||
+		(frameNumber >= m_frameNumber) ||
+		(frameNumber < m_frameNumber - HISTORY_FRAMES))
+	{
+		return(NULL);
+	}
+	return(&m_history[frameNumber % HISTORY_FRAMES]);
+}
+
+/***********************************************************
+ *  GetFrameNumber()
+ *
+ *  This method is used for getting the number the next
+ *  recorded frame will have.
+ ***********************************************************/
+long long FrameProfiler::GetFrameNumber() const
+{
+	return(m_frameNumber);
+}
+
+/***********************************************************
+ *  FlushQueries()
+ *
+ *  This method is used for reading back the queries of all
+ *  finished frames that are still in flight, oldest first.
+ *  This waits for the GPU, so it is only meant for the end
+ *  of a measured run.
+ ***********************************************************/
+void FrameProfiler::FlushQueries()
+{
+	if (!m_bInitialized)
+	{
+		return;
+	}
+
+	for (long long frameNumber = m_frameNumber - QUERY_FRAMES; frameNumber < m_frameNumber; frameNumber++)
+	{
+		if (frameNumber < 0)
+		{
+			continue;
+		}
+
+		int slot = (int)(frameNumber % QUERY_FRAMES);
+		if (m_queryFrames[slot] == frameNumber)
+		{
+			ReadQueries(slot);
+		}
+	}
+}
+
+/***********************************************************
+ *  ReadQueries()
+ *
+ *  This method is used for reading back the GPU timings of
+ *  a query slot into the history entry of its frame.
+ ***********************************************************/
+void FrameProfiler::ReadQueries(int slot)
+{
+	long long frameNumber = m_queryFrames[slot];
+	FRAME_STATS& frame = m_history[frameNumber % HISTORY_FRAMES];
+
+	for (int scope = 0; scope < GPU_SCOPE_COUNT; scope++)
+	{
+		if (m_bQueryIssued[slot][scope])
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(m_queries[slot][scope], GL_QUERY_RESULT, &elapsed);
+			frame.gpuMilliseconds[scope] = elapsed / 1000000.0;
+			m_bQueryIssued[slot][scope] = false;
+		}
+		else
+		{
+			// a pass with nothing to draw took no GPU time
+			frame.gpuMilliseconds[scope] = 0.0;
+		}
+	}
+
+	m_queryFrames[slot] = -1;
+	m_latestCompleteFrame = frameNumber;
+}
+
+/***********************************************************
+ *  ToggleOverlay()
+ *
+ *  This method is used for showing or hiding the overlay.
+ ***********************************************************/
+void FrameProfiler::ToggleOverlay()
+{
+	m_bOverlayVisible = !m_bOverlayVisible;
+}
+
+/***********************************************************
+ *  DrawOverlay()
+ *
+ *  This method is used for drawing the overlay in the top
+ *  left corner: one bar per CPU scope and GPU pass, with a
+ *  white marker at the 60 Hz frame budget.  The numbers and
+ *  counters are shown in the window title.  The bars are
+ *  scissored clears, so no shader or geometry is needed.
+ ***********************************************************/
+void FrameProfiler::DrawOverlay(GLFWwindow* window, const char* windowTitle)
+{
+	if (!m_bOverlayVisible)
+	{
+		// put the plain title back once the overlay is hidden
+		if (m_bTitleChanged)
+		{
+			glfwSetWindowTitle(window, windowTitle);
+			m_bTitleChanged = false;
+		}
+		return;
+	}
+
+	const FRAME_STATS& frame = GetLatestFrame();
+	int framebufferWidth = 0;
+	int framebufferHeight = 0;
+	glfwGetFramebufferSize(window, &framebufferWidth, &framebufferHeight);
+
+	GLfloat previousClearColor[4];
+	glGetFloatv(GL_COLOR_CLEAR_VALUE, previousClearColor);
+	GLboolean bScissorEnabled = glIsEnabled(GL_SCISSOR_TEST);
+	glEnable(GL_SCISSOR_TEST);
+
+	int rowCount = CPU_SCOPE_COUNT + GPU_SCOPE_COUNT;
+	int rowStep = g_OverlayBarHeight + g_OverlayBarSpacing;
+	int panelHeight = rowCount * rowStep + g_OverlayBarSpacing;
+	int panelTop = framebufferHeight - g_OverlayMargin;
+
+	DrawBar(g_OverlayMargin, panelTop - panelHeight,
+		g_OverlayBudgetWidth * 2 + g_OverlayBarSpacing * 2, panelHeight, g_PanelColor);
+
+	for (int row = 0; row < rowCount; row++)
+	{
+		double milliseconds = (row < CPU_SCOPE_COUNT) ?
+			frame.cpuMilliseconds[row] :
+			frame.gpuMilliseconds[row - CPU_SCOPE_COUNT];
+		// bars are clamped at two frame budgets
+		int width = (int)(std::max(milliseconds, 0.0) / g_FrameBudgetMilliseconds * g_OverlayBudgetWidth);
+		width = std::min(width, g_OverlayBudgetWidth * 2);
+
+		DrawBar(g_OverlayMargin + g_OverlayBarSpacing,
+			panelTop - (row + 1) * rowStep,
+			width, g_OverlayBarHeight,
+			(row < CPU_SCOPE_COUNT) ? g_CPUBarColor : g_GPUBarColor);
+	}
+
+	DrawBar(g_OverlayMargin + g_OverlayBarSpacing + g_OverlayBudgetWidth,
+		panelTop - panelHeight, 1, panelHeight, g_BudgetColor);
+
+	glClearColor(previousClearColor[0], previousClearColor[1], previousClearColor[2], previousClearColor[3]);
+	if (!bScissorEnabled)
+	{
+		glDisable(GL_SCISSOR_TEST);
+	}
+
+	double currentTime = glfwGetTime();
+	if (currentTime - m_lastTitleUpdate >= g_TitleUpdateInterval)
+	{
+		char title[256];
+		snprintf(title, sizeof(title),
+			"%s | CPU %.2f ms (view %.2f, scene %.2f) | GPU %.2f ms | %d draws, %d instances, %d uniforms, %d state changes, %d uploads, %d culled, %d triangles, %d stalls, %d allocs | %.1f MB GPU",
+			windowTitle,
+			frame.cpuMilliseconds[CPU_FRAME],
+			frame.cpuMilliseconds[CPU_PREPARE_VIEW],
+			frame.cpuMilliseconds[CPU_RENDER_SCENE],
+			std::max(frame.gpuMilliseconds[GPU_SHADOW_PASS], 0.0) + std::max(frame.gpuMilliseconds[GPU_DEPTH_PREPASS], 0.0) +
+				std::max(frame.gpuMilliseconds[GPU_OPAQUE_PASS], 0.0) + std::max(frame.gpuMilliseconds[GPU_TRANSPARENT_PASS], 0.0) +
+				std::max(frame.gpuMilliseconds[GPU_HIZ_BUILD], 0.0),
+			frame.counters[COUNTER_DRAW_CALLS],
+			frame.counters[COUNTER_INSTANCES],
+			frame.counters[COUNTER_UNIFORM_UPDATES],
+			frame.counters[COUNTER_STATE_CHANGES],
+			frame.counters[COUNTER_BUFFER_UPLOADS],
+			frame.counters[COUNTER_CULLED_OBJECTS],
+			frame.counters[COUNTER_TRIANGLES],
+			frame.counters[COUNTER_SYNC_STALLS],
+			frame.counters[COUNTER_HEAP_ALLOCATIONS],
+			GLObject::GetTotalBytes() / (1024.0 * 1024.0));
+		glfwSetWindowTitle(window, title);
+		m_lastTitleUpdate = currentTime;
+		m_bTitleChanged = true;
+	}
+}
+
+/***********************************************************
+ *  DrawBar()
+ *
+ *  This method is used for filling a rectangle of the
+ *  framebuffer with a color.
+ ***********************************************************/
+void FrameProfiler::DrawBar(int x, int y, int width, int height, const float* color)
+{
+	if ((width <= 0) || (height <= 0))
+	{
+		return;
+	}
+
+	glScissor(x, y, width, height);
+	glClearColor(color[0], color[1], color[2], color[3]);
+	glClear(GL_COLOR_BUFFER_BIT);
+}
+
+/***********************************************************
+ *  WriteCSV()
+ *
+ *  This method is used for writing the recorded frames to
+ *  a CSV file, oldest first.  GPU columns are empty for the
+ *  frames still in flight.
+ ***********************************************************/
+bool FrameProfiler::WriteCSV(const char* filename) const
+{
+	std::ofstream file(filename, std::ios::trunc);
+
+	if (!file)
+	{
+		std::cout << "Could not write profile file:" << filename << std::endl;
+		return false;
+	}
+
+	file << "frame";
+	for (int i = 0; i < CPU_SCOPE_COUNT; i++)
+	{
+		file << "," << g_CPUScopeNames[i];
+	}
+	for (int i = 0; i < GPU_SCOPE_COUNT; i++)
+	{
+		file << "," << g_GPUScopeNames[i];
+	}
+	for (int i = 0; i < COUNTER_COUNT; i++)
+	{
+		file << "," << g_CounterNames[i];
+	}
+	file << "\n";
+
+	long long firstFrame = std::max(m_frameNumber - HISTORY_FRAMES, 0LL);
+	for (long long frameNumber = firstFrame; frameNumber < m_frameNumber; frameNumber++)
+	{
+		const FRAME_STATS& frame = m_history[frameNumber % HISTORY_FRAMES];
+
+		file << frame.frameNumber;
+		for (int i = 0; i < CPU_SCOPE_COUNT; i++)
+		{
+			file << "," << frame.cpuMilliseconds[i];
+		}
+		for (int i = 0; i < GPU_SCOPE_COUNT; i++)
+		{
+			file << ",";
+			if (frame.gpuMilliseconds[i] >= 0.0)
+			{
+				file << frame.gpuMilliseconds[i];
+			}
+		}
+		for (int i = 0; i < COUNTER_COUNT; i++)
+		{
+			file << "," << frame.counters[i];
+		}
+		file << "\n";
+	}
+
+	std::cout << "Wrote " << (m_frameNumber - firstFrame) << " profiled frames to " << filename << std::endl;
+
+	return(!!file);
+}
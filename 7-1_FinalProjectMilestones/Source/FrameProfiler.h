@@ -0,0 +1,155 @@
+///////////////////////////////////////////////////////////////////////////////
+// frameprofiler.h
+// ============
+// time the CPU and GPU work of each frame, count the draw calls and state
+// changes, and show the results in an on-screen overlay or a CSV file
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include "GLFW/glfw3.h"
+
+#include <vector>
+
+/***********************************************************
+ *  FrameProfiler
+ *
+ *  This class records CPU scope timings with glfwGetTime()
+ *  and GPU pass timings with GL_TIME_ELAPSED queries.  The
+ *  queries of a frame are kept in a ring and read back
+ *  QUERY_FRAMES - 1 frames later, so reading them never
+ *  stalls the pipeline.  The last HISTORY_FRAMES frames are
+ *  kept for the overlay and the CSV dump.
+ ***********************************************************/
+class FrameProfiler
+{
+public:
+	// constructor
+	FrameProfiler();
+	// destructor
+	~FrameProfiler();
+
+	// timed CPU scopes
+	enum CPU_SCOPE
+	{
+		CPU_FRAME,
+		CPU_PREPARE_VIEW,
+		CPU_RENDER_SCENE,
+		CPU_CULLING,
+		CPU_SHADOW_PASS,
+		CPU_DEPTH_PREPASS,
+		CPU_OPAQUE_PASS,
+		CPU_TRANSPARENT_PASS,
+		CPU_SCOPE_COUNT
+	};
+
+	// timed GPU passes - these cannot nest
+	enum GPU_SCOPE
+	{
+		GPU_SHADOW_PASS,
+		GPU_DEPTH_PREPASS,
+		GPU_OPAQUE_PASS,
+		GPU_TRANSPARENT_PASS,
+		GPU_HIZ_BUILD,
+		GPU_SCOPE_COUNT
+	};
+
+	// per-frame event counters
+	enum COUNTER
+	{
+		COUNTER_DRAW_CALLS,
+		COUNTER_INSTANCES,
+		COUNTER_UNIFORM_UPDATES,
+		COUNTER_STATE_CHANGES,
+		COUNTER_BUFFER_UPLOADS,
+		COUNTER_CULLED_OBJECTS,
+		COUNTER_TRIANGLES,
+		COUNTER_SYNC_STALLS,
+		COUNTER_HEAP_ALLOCATIONS,
+		COUNTER_COUNT
+	};
+
+	// frames of GPU queries in flight
+	static const int QUERY_FRAMES = 3;
+	// frames kept for the overlay and the CSV dump
+	static const int HISTORY_FRAMES = 600;
+
+	// recorded timings and counts of one frame
+	struct FRAME_STATS
+	{
+		long long frameNumber;
+		double cpuMilliseconds[CPU_SCOPE_COUNT];
+		// negative until the query results have been read back
+		double gpuMilliseconds[GPU_SCOPE_COUNT];
+		int counters[COUNTER_COUNT];
+	};
+
+	// create the GPU timer queries
+	bool Initialize();
+	// free the GPU timer queries
+	void Destroy();
+
+	// start and finish recording a frame
+	void BeginFrame();
+	void EndFrame();
+
+	// time a CPU scope of the current frame
+	void BeginCPUScope(CPU_SCOPE scope);
+	void EndCPUScope(CPU_SCOPE scope);
+	// time a GPU pass of the current frame
+	void BeginGPUScope(GPU_SCOPE scope);
+	void EndGPUScope(GPU_SCOPE scope);
+	// add to a counter of the current frame
+	void AddCount(COUNTER counter, int amount = 1);
+
+	// get the most recent frame with GPU timings
+	const FRAME_STATS& GetLatestFrame() const;
+	// get the number of the latest frame with GPU timings, -1 for none
+	long long GetLatestCompleteFrameNumber() const;
+	// get a frame still in the history, or NULL
+	const FRAME_STATS* GetFrame(long long frameNumber) const;
+	// get the number of the next frame to be recorded
+	long long GetFrameNumber() const;
+	// wait for and read back every query still in flight
+	void FlushQueries();
+
+	// show or hide the on-screen overlay
+	void ToggleOverlay();
+	// draw the overlay bars and show the numbers in the title
+	void DrawOverlay(GLFWwindow* window, const char* windowTitle);
+	// write the recorded frames to a CSV file
+	bool WriteCSV(const char* filename) const;
+
+private:
+	// read back the finished queries of a ring slot
+	void ReadQueries(int slot);
+	// draw one overlay bar as a scissored clear
+	void DrawBar(int x, int y, int width, int height, const float* color);
+
+	// GL_TIME_ELAPSED queries, QUERY_FRAMES x GPU_SCOPE_COUNT
+	GLuint m_queries[QUERY_FRAMES][GPU_SCOPE_COUNT];
+	// true when the query was issued in the frame of the slot
+	bool m_bQueryIssued[QUERY_FRAMES][GPU_SCOPE_COUNT];
+	// GPU pass whose query is running, -1 for none
+	int m_activeGPUScope;
+	// frame number recorded in each query slot
+	long long m_queryFrames[QUERY_FRAMES];
+	// scope start times of the current frame, in seconds
+	double m_cpuScopeStarts[CPU_SCOPE_COUNT];
+	// ring of recorded frames
+	std::vector<FRAME_STATS> m_history;
+	FRAME_STATS m_currentFrame;
+	// heap allocations made before the current frame began
+	unsigned long long m_frameStartAllocations;
+	// index of the latest frame with GPU timings, -1 for none
+	long long m_latestCompleteFrame;
+	long long m_frameNumber;
+	bool m_bInitialized;
+	bool m_bOverlayVisible;
+	// time the window title was last refreshed, in seconds
+	double m_lastTitleUpdate;
+	// true while the window title shows the frame numbers
+	bool m_bTitleChanged;
+};
@@ -0,0 +1,309 @@
+///////////////////////////////////////////////////////////////////////////////
+// globject.cpp
+// ============
+// own the name of an OpenGL buffer, texture, vertex array, program or
+// framebuffer and keep count of the GPU memory held by the live objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GLObject.h"
+
+#include "GLFW/glfw3.h"
+
+#include <atomic>
+
+// declaration of global variables
+namespace
+{
+	// totals of the live objects - programs are also created
+	// by the shader watcher thread
+	std::atomic<int> g_ObjectCounts[GLObject::OBJECT_TYPE_COUNT];
+	std::atomic<long long> g_ByteCounts[GLObject::OBJECT_TYPE_COUNT];
+}
+
+/***********************************************************
+ *  GLObject()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GLObject::GLObject(OBJECT_TYPE type)
+{
+	m_type = type;
+	m_name = 0;
+	m_byteSize = 0;
+}
+
+/***********************************************************
+ *  ~GLObject()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+GLObject::~GLObject()
+{
+	Reset();
+}
+
+/***********************************************************
+ *  GLObject()
+ *
+ *  The move constructor for the class, which leaves the
+ *  other object empty.
+ ***********************************************************/
+GLObject::GLObject(GLObject&& other)
+{
+	m_type = other.m_type;
+	m_name = other.m_name;
+	m_byteSize = other.m_byteSize;
+	other.m_name = 0;
+	other.m_byteSize = 0;
+}
+
+/***********************************************************
+ *  operator=()
+ *
+ *  The move assignment for the class.  The name owned so
+ *  far is freed first.
+ ***********************************************************/
+GLObject& GLObject::operator=(GLObject&& other)
+{
+	if (this != &other)
+	{
+		Reset();
+		m_type = other.m_type;
+		m_name = other.m_name;
+		m_byteSize = other.m_byteSize;
+		other.m_name = 0;
+		other.m_byteSize = 0;
+	}
+
+	return(*this);
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for generating a new object name of
+ *  the owned type, freeing the previous one.
+ ***********************************************************/
+GLuint GLObject::Create()
+{
+	GLuint name = 0;
+
+	switch (m_type)
+	{
+	case OBJECT_BUFFER:
+		glGenBuffers(1, &name);
+		break;
+	case OBJECT_TEXTURE:
+		glGenTextures(1, &name);
+		break;
+	case OBJECT_VERTEX_ARRAY:
+		glGenVertexArrays(1, &name);
+		break;
+	case OBJECT_PROGRAM:
+		name = glCreateProgram();
+		break;
+	case OBJECT_FRAMEBUFFER:
+		glGenFramebuffers(1, &name);
+		break;
+	default:
+		break;
+	}
+	Adopt(name);
+
+	return(m_name);
+}
+
+/***********************************************************
+ *  Adopt()
+ *
+ *  This method is used for taking over an object name that
+ *  was created elsewhere, such as a linked program.
+ ***********************************************************/
+void GLObject::Adopt(GLuint name)
+{
+	if (name == m_name)
+	{
+		return;
+	}
+
+	Reset();
+	m_name = name;
+	if (m_name != 0)
+	{
+		g_ObjectCounts[m_type]++;
+	}
+}
+
+/***********************************************************
+ *  Reset()
+ *
+ *  This method is used for freeing the owned object.  The
+ *  delete call is skipped when no context is current, since
+ *  destroying the context freed the object already.
+ ***********************************************************/
+void GLObject::Reset()
+{
+	if (m_name == 0)
+	{
+		return;
+	}
+
+	if (HasContext())
+	{
+		switch (m_type)
+		{
+		case OBJECT_BUFFER:
+			glDeleteBuffers(1, &m_name);
+			break;
+		case OBJECT_TEXTURE:
+			glDeleteTextures(1, &m_name);
+			break;
+		case OBJECT_VERTEX_ARRAY:
+			glDeleteVertexArrays(1, &m_name);
+			break;
+		case OBJECT_PROGRAM:
+			glDeleteProgram(m_name);
+			break;
+		case OBJECT_FRAMEBUFFER:
+			glDeleteFramebuffers(1, &m_name);
+			break;
+		default:
+			break;
+		}
+	}
+
+	Release();
+}
+
+/***********************************************************
+ *  Release()
+ *
+ *  This method is used for giving up the owned name without
+ *  freeing the object, whose new owner must free it.
+ ***********************************************************/
+GLuint GLObject::Release()
+{
+	GLuint name = m_name;
+
+	if (m_name != 0)
+	{
+		g_ObjectCounts[m_type]--;
+	}
+	SetByteSize(0);
+	m_name = 0;
+
+	return(name);
+}
+
+/***********************************************************
+ *  Get()
+ *
+ *  This method is used for getting the owned object name.
+ ***********************************************************/
+GLuint GLObject::Get() const
+{
+	return(m_name);
+}
+
+/***********************************************************
+ *  GetType()
+ *
+ *  This method is used for getting the kind of the owned
+ *  object.
+ ***********************************************************/
+GLObject::OBJECT_TYPE GLObject::GetType() const
+{
+	return(m_type);
+}
+
+/***********************************************************
+ *  SetByteSize()
+ *
+ *  This method is used for recording the bytes of storage
+ *  allocated for the object, replacing the previous size,
+ *  such as after a buffer is allocated again.
+ ***********************************************************/
+void GLObject::SetByteSize(long long byteSize)
+{
+	g_ByteCounts[m_type] += byteSize - m_byteSize;
+	m_byteSize = byteSize;
+}
+
+/***********************************************************
+ *  GetByteSize()
+ *
+ *  This method is used for getting the bytes of storage
+ *  recorded for the object.
+ ***********************************************************/
+long long GLObject::GetByteSize() const
+{
+	return(m_byteSize);
+}
+
+/***********************************************************
+ *  GetMemoryStats()
+ *
+ *  This method is used for getting the object counts and
+ *  storage of every live object by type.
+ ***********************************************************/
+GLObject::MEMORY_STATS GLObject::GetMemoryStats()
+{
+	MEMORY_STATS stats;
+
+	for (int i = 0; i < OBJECT_TYPE_COUNT; i++)
+	{
+		stats.objectCounts[i] = g_ObjectCounts[i];
+		stats.byteCounts[i] = g_ByteCounts[i];
+	}
+
+	return(stats);
+}
+
+/***********************************************************
+ *  GetTotalBytes()
+ *
+ *  This method is used for getting the storage of every
+ *  live object.
+ ***********************************************************/
+long long GLObject::GetTotalBytes()
+{
+	long long total = 0;
+
+	for (int i = 0; i < OBJECT_TYPE_COUNT; i++)
+	{
+		total += g_ByteCounts[i];
+	}
+
+	return(total);
+}
+
+/***********************************************************
+ *  GetLiveCount()
+ *
+ *  This method is used for getting the number of live
+ *  objects of every type.
+ ***********************************************************/
+int GLObject::GetLiveCount()
+{
+	int total = 0;
+
+	for (int i = 0; i < OBJECT_TYPE_COUNT; i++)
+	{
+		total += g_ObjectCounts[i];
+	}
+
+	return(total);
+}
+
+/***********************************************************
+ *  HasContext()
+ *
+ *  This method is used for checking whether a context is
+ *  current on the calling thread, so that shutdown code can
+ *  skip calls that would have no context to run in.
+ ***********************************************************/
+bool GLObject::HasContext()
+{
+	return(glfwGetCurrentContext() != NULL);
+}
@@ -0,0 +1,93 @@
+///////////////////////////////////////////////////////////////////////////////
+// globject.h
+// ============
+// own the name of an OpenGL buffer, texture, vertex array, program or
+// framebuffer and keep count of the GPU memory held by the live objects
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include <cstddef>
+
+/***********************************************************
+ *  GLObject
+ *
+ *  This class owns one OpenGL object name and frees it when
+ *  it goes out of scope.  It can be moved but not copied,
+ *  so every object has exactly one owner.  The object is
+ *  only freed while a context is current - once the context
+ *  is gone the driver has freed it already.  Owners report
+ *  the size of the storage they allocate, and the totals of
+ *  every live object are kept by type, so long sessions and
+ *  scene rebuilds can be checked for leaks.
+ ***********************************************************/
+class GLObject
+{
+public:
+	// kinds of OpenGL objects that can be owned
+	enum OBJECT_TYPE
+	{
+		OBJECT_BUFFER,
+		OBJECT_TEXTURE,
+		OBJECT_VERTEX_ARRAY,
+		OBJECT_PROGRAM,
+		OBJECT_FRAMEBUFFER,
+		OBJECT_TYPE_COUNT
+	};
+
+	// live objects and their reported storage, by type
+	struct MEMORY_STATS
+	{
+		int objectCounts[OBJECT_TYPE_COUNT];
+		long long byteCounts[OBJECT_TYPE_COUNT];
+	};
+
+	// constructor
+	explicit GLObject(OBJECT_TYPE type);
+	// destructor
+	~GLObject();
+
+	// move the name to a new owner
+	GLObject(GLObject&& other);
+	GLObject& operator=(GLObject&& other);
+	// names are never shared
+	GLObject(const GLObject&) = delete;
+	GLObject& operator=(const GLObject&) = delete;
+
+	// generate a new name, freeing the previous one - programs
+	// come from glCreateProgram()
+	GLuint Create();
+	// take over a name created elsewhere
+	void Adopt(GLuint name);
+	// free the object
+	void Reset();
+	// give up the name without freeing it
+	GLuint Release();
+
+	// get the owned name, 0 for none
+	GLuint Get() const;
+	// get the kind of object owned
+	OBJECT_TYPE GetType() const;
+
+	// record the bytes of storage allocated for the object
+	void SetByteSize(long long byteSize);
+	// get the bytes of storage recorded for the object
+	long long GetByteSize() const;
+
+	// get the totals of every live object
+	static MEMORY_STATS GetMemoryStats();
+	// get the storage of every live object, in bytes
+	static long long GetTotalBytes();
+	// get the number of live objects
+	static int GetLiveCount();
+	// true while a context is current on this thread
+	static bool HasContext();
+
+private:
+	OBJECT_TYPE m_type;
+	GLuint m_name;
+	long long m_byteSize;
+};
@@ -0,0 +1,300 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.cpp
+// ============
+// cull the scene instances against the view frustum in a compute shader
+// that writes the indirect draw commands
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "GPUCulling.h"
+#include "SceneBVH.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+// declaration of global variables
+namespace
+{
+	// shader storage binding points, must match the shader
+	const GLuint g_SourceInstancesBinding = 0;
+	const GLuint g_CullItemsBinding = 1;
+	const GLuint g_DrawCommandsBinding = 2;
+	const GLuint g_VisibleInstancesBinding = 3;
+}
+
+/***********************************************************
+ *  GPUCulling()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+GPUCulling::GPUCulling()
+	: m_program(GLObject::OBJECT_PROGRAM),
+	m_sourceBuffer(GLObject::OBJECT_BUFFER),
+	m_itemBuffer(GLObject::OBJECT_BUFFER),
+	m_commandBuffer(GLObject::OBJECT_BUFFER)
+{
+	m_frustumPlanesLocation = -1;
+	m_instanceCountLocation = -1;
+	m_occlusionCullingLocation = -1;
+	m_previousViewProjectionLocation = -1;
+	m_hiZDepthSizeLocation = -1;
+	m_hiZLevelCountLocation = -1;
+	m_instanceCount = 0;
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ~GPUCulling()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+GPUCulling::~GPUCulling()
+{
+	Destroy();
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for loading the culling compute
+ *  shader and creating its buffers.  It fails without
+ *  OpenGL 4.3, so the caller can keep the CPU culling.
+ ***********************************************************/
+bool GPUCulling::Initialize(const char* computeShaderFilename)
+{
+	Destroy();
+
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cout << "GPU culling needs OpenGL 4.3 compute shaders and multi-draw indirect" << std::endl;
+		return false;
+	}
+
+	m_program.Adopt(LoadComputeProgram(computeShaderFilename));
+	if (m_program.Get() == 0)
+	{
+		return false;
+	}
+
+	m_frustumPlanesLocation = glGetUniformLocation(m_program.Get(), "frustumPlanes");
+	m_instanceCountLocation = glGetUniformLocation(m_program.Get(), "instanceCount");
+	m_occlusionCullingLocation = glGetUniformLocation(m_program.Get(), "bOcclusionCulling");
+	m_previousViewProjectionLocation = glGetUniformLocation(m_program.Get(), "previousViewProjection");
+	m_hiZDepthSizeLocation = glGetUniformLocation(m_program.Get(), "hiZDepthSize");
+	m_hiZLevelCountLocation = glGetUniformLocation(m_program.Get(), "hiZLevelCount");
+
+	// the pyramid is always sampled from its own unit
+	glUseProgram(m_program.Get());
+	glUniform1i(glGetUniformLocation(m_program.Get(), "hiZBuffer"), HiZBuffer::TEXTURE_UNIT);
+
+	m_sourceBuffer.Create();
+	m_itemBuffer.Create();
+	m_commandBuffer.Create();
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the compute program and
+ *  the shader storage buffers.
+ ***********************************************************/
+void GPUCulling::Destroy()
+{
+	m_program.Reset();
+	m_sourceBuffer.Reset();
+	m_itemBuffer.Reset();
+	m_commandBuffer.Reset();
+	m_commandTemplates.clear();
+	m_instanceCount = 0;
+}
+
+/***********************************************************
+ *  IsInitialized()
+ *
+ *  This method is used for checking whether the compute
+ *  shader was loaded.
+ ***********************************************************/
+bool GPUCulling::IsInitialized() const
+{
+	return(m_program.Get() != 0);
+}
+
+/***********************************************************
+ *  SetInstances()
+ *
+ *  This method is used for uploading every instance with
+ *  its culling bounds, and the draw command of each render
+ *  batch.  It only has to be called when the instances
+ *  change, not every frame.
+ ***********************************************************/
+void GPUCulling::SetInstances(
+	const std::vector<SceneMeshes::INSTANCE_DATA>& instances,
+	const std::vector<CULL_ITEM>& items,
+	const std::vector<DRAW_COMMAND>& commands)
+{
+	if (!IsInitialized())
+	{
+		return;
+	}
+
+	m_instanceCount = (int)std::min(instances.size(), items.size());
+	m_commandTemplates = commands;
+	for (size_t i = 0; i < m_commandTemplates.size(); i++)
+	{
+		m_commandTemplates[i].instanceCount = 0;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_sourceBuffer.Get());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(SceneMeshes::INSTANCE_DATA) * m_instanceCount, instances.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_itemBuffer.Get());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(CULL_ITEM) * m_instanceCount, items.data(), GL_STATIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer.Get());
+	glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DRAW_COMMAND) * m_commandTemplates.size(), m_commandTemplates.data(), GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+	m_sourceBuffer.SetByteSize(sizeof(SceneMeshes::INSTANCE_DATA) * m_instanceCount);
+	m_itemBuffer.SetByteSize(sizeof(CULL_ITEM) * m_instanceCount);
+	m_commandBuffer.SetByteSize(sizeof(DRAW_COMMAND) * m_commandTemplates.size());
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS, 3);
+	}
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for zeroing the instance counts of
+ *  the draw commands and dispatching the culling shader.
+ *  The occlusion test projects the bounds with the view of
+ *  the pyramid, so it stays conservative while the camera
+ *  moves, but an instance that comes out from behind an
+ *  occluder is only drawn a frame later.  The barrier makes
+ *  the commands and the instance buffer visible to the
+ *  indirect draws that follow.
+ ***********************************************************/
+void GPUCulling::Cull(const glm::mat4& viewProjection, GLuint instanceBuffer, const HiZBuffer* pHiZBuffer)
+{
+	if (!IsInitialized() || (m_instanceCount == 0) || m_commandTemplates.empty())
+	{
+		return;
+	}
+
+	glm::vec4 planes[6];
+	SceneBVH::GetFrustumPlanes(viewProjection, planes);
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_commandBuffer.Get());
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(DRAW_COMMAND) * m_commandTemplates.size(), m_commandTemplates.data());
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+	glUseProgram(m_program.Get());
+	glUniform4fv(m_frustumPlanesLocation, 6, glm::value_ptr(planes[0]));
+	glUniform1ui(m_instanceCountLocation, (GLuint)m_instanceCount);
+
+	bool bOcclusionCulling = (NULL != pHiZBuffer) && pHiZBuffer->IsBuilt();
+	glUniform1i(m_occlusionCullingLocation, bOcclusionCulling ? 1 : 0);
+	if (bOcclusionCulling)
+	{
+		glUniformMatrix4fv(m_previousViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(pHiZBuffer->GetViewProjection()));
+		glUniform2f(m_hiZDepthSizeLocation, (float)pHiZBuffer->GetDepthWidth(), (float)pHiZBuffer->GetDepthHeight());
+		glUniform1i(m_hiZLevelCountLocation, pHiZBuffer->GetLevelCount());
+		pHiZBuffer->Bind();
+	}
+
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_SourceInstancesBinding, m_sourceBuffer.Get());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_CullItemsBinding, m_itemBuffer.Get());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_DrawCommandsBinding, m_commandBuffer.Get());
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, g_VisibleInstancesBinding, instanceBuffer);
+
+	glDispatchCompute((m_instanceCount + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE, 1, 1);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_VERTEX_ATTRIB_ARRAY_BARRIER_BIT);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+}
+
+/***********************************************************
+ *  BindCommands()
+ *
+ *  This method is used for binding the culled draw commands
+ *  as the source of the indirect draws.
+ ***********************************************************/
+void GPUCulling::BindCommands()
+{
+	glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_commandBuffer.Get());
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the buffer uploads.
+ ***********************************************************/
+void GPUCulling::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  LoadComputeProgram()
+ *
+ *  This method is used for reading, compiling and linking a
+ *  compute shader file.  Errors are written to the console
+ *  and 0 is returned.
+ ***********************************************************/
+GLuint GPUCulling::LoadComputeProgram(const char* filename)
+{
+	std::ifstream file(filename);
+	if (!file)
+	{
+		std::cout << "Could not open compute shader:" << filename << std::endl;
+		return 0;
+	}
+
+	std::stringstream source;
+	source << file.rdbuf();
+	std::string text = source.str();
+	const char* sourceText = text.c_str();
+
+	GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+	glShaderSource(shader, 1, &sourceText, NULL);
+	glCompileShader(shader);
+
+	GLint status = GL_FALSE;
+	glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		char log[1024];
+		glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+		std::cout << "Could not compile compute shader " << filename << ":\n" << log << std::endl;
+		glDeleteShader(shader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glAttachShader(program, shader);
+	glLinkProgram(program);
+	glDeleteShader(shader);
+
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		std::cout << "Could not link compute shader " << filename << ":\n" << log << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return(program);
+}
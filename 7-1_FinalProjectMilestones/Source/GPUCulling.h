@@ -0,0 +1,116 @@
+///////////////////////////////////////////////////////////////////////////////
+// gpuculling.h
+// ============
+// cull the scene instances against the view frustum in a compute shader
+// that writes the indirect draw commands
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+#include "HiZBuffer.h"
+#include "SceneMeshes.h"
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  GPUCulling
+ *
+ *  This class keeps every scene instance and its world
+ *  space bounds in shader storage buffers.  Each frame a
+ *  compute shader tests the bounds against the frustum and
+ *  appends the visible instances to the range of their
+ *  render batch in the instance buffer, counting them in
+ *  one indirect draw command per batch.  With a depth
+ *  pyramid of the previous frame, the instances hidden
+ *  behind its depth are dropped too.  The CPU never
+ *  touches individual instances or reads anything back.
+ *  It needs OpenGL 4.3 for compute shaders and multi-draw
+ *  indirect.
+ ***********************************************************/
+class GPUCulling
+{
+public:
+	// constructor
+	GPUCulling();
+	// destructor
+	~GPUCulling();
+
+	// std430 layout of DrawElementsIndirectCommand
+	struct DRAW_COMMAND
+	{
+		GLuint count;
+		GLuint instanceCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+		GLuint baseInstance;
+	};
+
+	// std430 layout of the culling bounds of one instance
+	struct CULL_ITEM
+	{
+		glm::vec3 center;
+		// command of the render batch of the instance
+		int commandIndex;
+		glm::vec3 extent;
+		int padding;
+	};
+
+	// invocations per compute work group, must match the shader
+	static const int WORKGROUP_SIZE = 64;
+
+	// load the compute shader - false when it is unsupported
+	bool Initialize(const char* computeShaderFilename);
+	// free the compute program and the buffers
+	void Destroy();
+	// true once Initialize() has succeeded
+	bool IsInitialized() const;
+
+	// upload the instances, their bounds and the draw commands,
+	// whose instance counts are ignored
+	void SetInstances(
+		const std::vector<SceneMeshes::INSTANCE_DATA>& instances,
+		const std::vector<CULL_ITEM>& items,
+		const std::vector<DRAW_COMMAND>& commands);
+	// run the culling shader, writing the visible instances into
+	// the passed in instance buffer - the built pyramid of a
+	// Hi-Z buffer also culls the occluded ones, and NULL culls
+	// against the frustum only.  Leaves the compute program in
+	// use
+	void Cull(const glm::mat4& viewProjection, GLuint instanceBuffer, const HiZBuffer* pHiZBuffer);
+	// bind the culled commands for the indirect draws
+	void BindCommands();
+
+	// set the profiler that counts the uploads, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+
+	// read, compile and link a compute shader file, for the
+	// other compute passes too
+	static GLuint LoadComputeProgram(const char* filename);
+
+private:
+	GLObject m_program;
+	GLint m_frustumPlanesLocation;
+	GLint m_instanceCountLocation;
+	GLint m_occlusionCullingLocation;
+	GLint m_previousViewProjectionLocation;
+	GLint m_hiZDepthSizeLocation;
+	GLint m_hiZLevelCountLocation;
+
+	// shader storage buffers read and written by the shader
+	GLObject m_sourceBuffer;
+	GLObject m_itemBuffer;
+	GLObject m_commandBuffer;
+
+	// commands with zero instance counts, copied in every frame
+	std::vector<DRAW_COMMAND> m_commandTemplates;
+	int m_instanceCount;
+	// counts the buffer uploads, may be NULL
+	FrameProfiler* m_pProfiler;
+};
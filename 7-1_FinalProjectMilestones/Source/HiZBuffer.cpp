@@ -0,0 +1,320 @@
+///////////////////////////////////////////////////////////////////////////////
+// hizbuffer.cpp
+// ============
+// build a hierarchical depth pyramid from the depth buffer of a frame, for
+// occlusion culling in the next one
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "HiZBuffer.h"
+#include "GPUCulling.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// image units of the level read and the level written,
+	// must match the shader
+	const GLuint g_SourceLevelUnit = 0;
+	const GLuint g_TargetLevelUnit = 1;
+}
+
+/***********************************************************
+ *  HiZBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+HiZBuffer::HiZBuffer()
+	: m_program(GLObject::OBJECT_PROGRAM),
+	m_depthTexture(GLObject::OBJECT_TEXTURE),
+	m_pyramidTexture(GLObject::OBJECT_TEXTURE)
+{
+	m_sourceSizeLocation = -1;
+	m_targetSizeLocation = -1;
+	m_fromDepthLocation = -1;
+	m_depthWidth = 0;
+	m_depthHeight = 0;
+	m_levelCount = 0;
+	m_viewProjection = glm::mat4(1.0f);
+	m_bBuilt = false;
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ~HiZBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+HiZBuffer::~HiZBuffer()
+{
+	Destroy();
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for loading the reduction compute
+ *  shader.  The textures are created by the first Build(),
+ *  once the size of the viewport is known.  It fails
+ *  without OpenGL 4.3, so the caller can leave occlusion
+ *  culling off.
+ ***********************************************************/
+bool HiZBuffer::Initialize(const char* computeShaderFilename)
+{
+	Destroy();
+
+	if (!GLEW_VERSION_4_3)
+	{
+		std::cout << "The depth pyramid needs OpenGL 4.3 compute shaders and image load and store" << std::endl;
+		return false;
+	}
+
+	m_program.Adopt(GPUCulling::LoadComputeProgram(computeShaderFilename));
+	if (m_program.Get() == 0)
+	{
+		return false;
+	}
+
+	m_sourceSizeLocation = glGetUniformLocation(m_program.Get(), "sourceSize");
+	m_targetSizeLocation = glGetUniformLocation(m_program.Get(), "targetSize");
+	m_fromDepthLocation = glGetUniformLocation(m_program.Get(), "bFromDepth");
+
+	// the depth copy is read from the same unit the pyramid is
+	// bound to between builds
+	glUseProgram(m_program.Get());
+	glUniform1i(glGetUniformLocation(m_program.Get(), "depthTexture"), TEXTURE_UNIT);
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the compute program and
+ *  the textures.
+ ***********************************************************/
+void HiZBuffer::Destroy()
+{
+	m_program.Reset();
+	m_depthTexture.Reset();
+	m_pyramidTexture.Reset();
+	m_depthWidth = 0;
+	m_depthHeight = 0;
+	m_levelCount = 0;
+	m_bBuilt = false;
+}
+
+/***********************************************************
+ *  IsInitialized()
+ *
+ *  This method is used for checking whether the compute
+ *  shader was loaded.
+ ***********************************************************/
+bool HiZBuffer::IsInitialized() const
+{
+	return(m_program.Get() != 0);
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for copying the depth of the current
+ *  viewport and reducing it level by level.  Each level is
+ *  a dispatch reading the previous one, with a barrier in
+ *  between, and the last barrier makes the pyramid visible
+ *  to the texture fetches of the culling shader.  The
+ *  textures follow the viewport, so a scaled render
+ *  resolution builds its pyramid at its own size.
+ ***********************************************************/
+void HiZBuffer::Build(const glm::mat4& viewProjection)
+{
+	if (!IsInitialized())
+	{
+		return;
+	}
+
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	if ((viewport[2] <= 0) || (viewport[3] <= 0))
+	{
+		return;
+	}
+	if ((viewport[2] != m_depthWidth) || (viewport[3] != m_depthHeight))
+	{
+		Resize(viewport[2], viewport[3]);
+	}
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture.Get());
+	glCopyTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, viewport[0], viewport[1], m_depthWidth, m_depthHeight);
+
+	glUseProgram(m_program.Get());
+
+	int sourceWidth = m_depthWidth;
+	int sourceHeight = m_depthHeight;
+	for (int level = 0; level < m_levelCount; level++)
+	{
+		int targetWidth = std::max(sourceWidth / 2, 1);
+		int targetHeight = std::max(sourceHeight / 2, 1);
+
+		glUniform1i(m_fromDepthLocation, (level == 0) ? 1 : 0);
+		glUniform2i(m_sourceSizeLocation, sourceWidth, sourceHeight);
+		glUniform2i(m_targetSizeLocation, targetWidth, targetHeight);
+		// the first level reads the depth copy, so its source
+		// image is bound but never loaded from
+		glBindImageTexture(g_SourceLevelUnit, m_pyramidTexture.Get(), std::max(level - 1, 0), GL_FALSE, 0, GL_READ_ONLY, GL_R32F);
+		glBindImageTexture(g_TargetLevelUnit, m_pyramidTexture.Get(), level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+
+		glDispatchCompute(
+			(targetWidth + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+			(targetHeight + WORKGROUP_SIZE - 1) / WORKGROUP_SIZE,
+			1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+		sourceWidth = targetWidth;
+		sourceHeight = targetHeight;
+	}
+	glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+
+	// the pyramid stays bound for the culling of the next frame
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture.Get());
+	glActiveTexture(GL_TEXTURE0);
+
+	m_viewProjection = viewProjection;
+	m_bBuilt = true;
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+}
+
+/***********************************************************
+ *  IsBuilt()
+ *
+ *  This method is used for checking whether a pyramid was
+ *  built since the textures were last created.
+ ***********************************************************/
+bool HiZBuffer::IsBuilt() const
+{
+	return(m_bBuilt);
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for binding the pyramid to its
+ *  texture unit, for the shaders that sample it.
+ ***********************************************************/
+void HiZBuffer::Bind() const
+{
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture.Get());
+	glActiveTexture(GL_TEXTURE0);
+}
+
+/***********************************************************
+ *  GetDepthWidth()
+ *
+ *  This method is used for getting the width of the depth
+ *  buffer the pyramid was built from.
+ ***********************************************************/
+int HiZBuffer::GetDepthWidth() const
+{
+	return(m_depthWidth);
+}
+
+/***********************************************************
+ *  GetDepthHeight()
+ *
+ *  This method is used for getting the height of the depth
+ *  buffer the pyramid was built from.
+ ***********************************************************/
+int HiZBuffer::GetDepthHeight() const
+{
+	return(m_depthHeight);
+}
+
+/***********************************************************
+ *  GetLevelCount()
+ *
+ *  This method is used for getting the number of levels of
+ *  the pyramid.
+ ***********************************************************/
+int HiZBuffer::GetLevelCount() const
+{
+	return(m_levelCount);
+}
+
+/***********************************************************
+ *  GetViewProjection()
+ *
+ *  This method is used for getting the view and projection
+ *  the pyramid was built with.
+ ***********************************************************/
+const glm::mat4& HiZBuffer::GetViewProjection() const
+{
+	return(m_viewProjection);
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the state changes.
+ ***********************************************************/
+void HiZBuffer::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  Resize()
+ *
+ *  This method is used for creating the depth copy at the
+ *  size of the viewport and the pyramid below it.  Every
+ *  level is half the one above, rounded down as OpenGL
+ *  sizes its mipmaps, down to a single texel.  The previous
+ *  pyramid is dropped, so nothing is culled until the next
+ *  build.
+ ***********************************************************/
+void HiZBuffer::Resize(int width, int height)
+{
+	m_depthWidth = width;
+	m_depthHeight = height;
+
+	int levelWidth = std::max(width / 2, 1);
+	int levelHeight = std::max(height / 2, 1);
+	m_levelCount = 1;
+	for (int size = std::max(levelWidth, levelHeight); size > 1; size /= 2)
+	{
+		m_levelCount++;
+	}
+
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+
+	m_depthTexture.Reset();
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture.Create());
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT24, width, height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	m_depthTexture.SetByteSize((long long)width * height * 4);
+
+	// the texel count of a full mip chain is under 4/3 of its
+	// first level
+	m_pyramidTexture.Reset();
+	glBindTexture(GL_TEXTURE_2D, m_pyramidTexture.Create());
+	glTexStorage2D(GL_TEXTURE_2D, m_levelCount, GL_R32F, levelWidth, levelHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	m_pyramidTexture.SetByteSize((long long)levelWidth * levelHeight * 4 * 4 / 3);
+
+	glActiveTexture(GL_TEXTURE0);
+
+	m_bBuilt = false;
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// hizbuffer.h
+// ============
+// build a hierarchical depth pyramid from the depth buffer of a frame, for
+// occlusion culling in the next one
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+
+/***********************************************************
+ *  HiZBuffer
+ *
+ *  This class copies the depth of the current viewport
+ *  after the opaque draws and reduces it in a compute
+ *  shader into a mip pyramid, where every texel keeps the
+ *  farthest depth of the texels below it.  The first level
+ *  is half the size of the depth buffer, rounded up, and
+ *  each level halves again down to a single texel.  The
+ *  view of the frame is kept with the pyramid, so the
+ *  culling of the next frame can project its bounds into
+ *  it.  It needs OpenGL 4.3 for compute shaders and image
+ *  load and store.
+ ***********************************************************/
+class HiZBuffer
+{
+public:
+	// constructor
+	HiZBuffer();
+	// destructor
+	~HiZBuffer();
+
+	// texture unit the depth copy and the pyramid are bound to,
+	// next to the texture array and the shadow maps
+	static const int TEXTURE_UNIT = 2;
+	// invocations per side of a compute work group, must match
+	// the shader
+	static const int WORKGROUP_SIZE = 8;
+
+	// load the reduction compute shader - false when it is
+	// unsupported
+	bool Initialize(const char* computeShaderFilename);
+	// free the compute program and the textures
+	void Destroy();
+	// true once Initialize() has succeeded
+	bool IsInitialized() const;
+
+	// copy the depth of the current viewport from the bound
+	// framebuffer and build the pyramid, keeping the view it
+	// was drawn with - leaves the compute program in use
+	void Build(const glm::mat4& viewProjection);
+	// true once a pyramid was built
+	bool IsBuilt() const;
+	// bind the pyramid to its texture unit
+	void Bind() const;
+
+	// get the size of the depth buffer the pyramid was built
+	// from and its number of levels
+	int GetDepthWidth() const;
+	int GetDepthHeight() const;
+	int GetLevelCount() const;
+	// get the view the pyramid was built with
+	const glm::mat4& GetViewProjection() const;
+
+	// set the profiler that counts the state changes, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+
+private:
+	// recreate the depth copy and the pyramid for a viewport
+	void Resize(int width, int height);
+
+	GLObject m_program;
+	GLint m_sourceSizeLocation;
+	GLint m_targetSizeLocation;
+	GLint m_fromDepthLocation;
+
+	// copy of the depth buffer and the pyramid built from it
+	GLObject m_depthTexture;
+	GLObject m_pyramidTexture;
+	int m_depthWidth;
+	int m_depthHeight;
+	int m_levelCount;
+
+	glm::mat4 m_viewProjection;
+	bool m_bBuilt;
+	// counts the state changes, may be NULL
+	FrameProfiler* m_pProfiler;
+};
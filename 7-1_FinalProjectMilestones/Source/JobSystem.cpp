@@ -0,0 +1,323 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.cpp
+// ============
+// split the per-frame scene work into chunks run by a pool of worker
+// threads that steal from each other's queues
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "JobSystem.h"
+
+#include <algorithm>
+
+// declaration of global variables
+namespace
+{
+	// more threads than this only add contention over the scene
+	// data, whatever the core count
+	const int g_MaxWorkerThreads = 31;
+}
+
+/***********************************************************
+ *  JobSystem()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+JobSystem::JobSystem() :
+	m_queuedJobs(0),
+	m_unfinishedJobs(0),
+	m_bStopping(false)
+{
+	// the calling thread's queue exists even without workers
+	m_queues.push_back(std::unique_ptr<JOB_QUEUE>(new JOB_QUEUE()));
+	m_queues.back()->front = 0;
+}
+
+/***********************************************************
+ *  ~JobSystem()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+JobSystem::~JobSystem()
+{
+	Stop();
+}
+
+/***********************************************************
+ *  Start()
+ *
+ *  This method is used for starting the worker threads,
+ *  after stopping the running ones.
+ ***********************************************************/
+void JobSystem::Start(int workerCount)
+{
+	Stop();
+
+	workerCount = std::min(std::max(workerCount, 0), g_MaxWorkerThreads);
+
+	m_queues.clear();
+	for (int i = 0; i <= workerCount; i++)
+	{
+		m_queues.push_back(std::unique_ptr<JOB_QUEUE>(new JOB_QUEUE()));
+		m_queues.back()->front = 0;
+	}
+
+	m_bStopping = false;
+	for (int i = 0; i < workerCount; i++)
+	{
+		m_workers.push_back(std::thread(&JobSystem::WorkerLoop, this, i));
+	}
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for stopping and joining the worker
+ *  threads.  It is never called during a ParallelFor(), so
+ *  the queues are empty.
+ ***********************************************************/
+void JobSystem::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+		m_bStopping = true;
+	}
+	m_wakeCondition.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+	m_workers.clear();
+
+	m_queues.resize(1);
+}
+
+/***********************************************************
+ *  GetWorkerCount()
+ *
+ *  This method is used for getting the number of running
+ *  worker threads.
+ ***********************************************************/
+int JobSystem::GetWorkerCount() const
+{
+	return((int)m_workers.size());
+}
+
+/***********************************************************
+ *  GetDefaultWorkerCount()
+ *
+ *  This method is used for getting the worker count that
+ *  leaves the calling thread one core of its own.
+ ***********************************************************/
+int JobSystem::GetDefaultWorkerCount()
+{
+	int hardwareThreads = (int)std::thread::hardware_concurrency();
+
+	return(std::min(std::max(hardwareThreads - 1, 0), g_MaxWorkerThreads));
+}
+
+/***********************************************************
+ *  GetChunkCount()
+ *
+ *  This method is used for getting the number of chunks of
+ *  at most grainSize items that a range is split into, so
+ *  callers can size one output per chunk.
+ ***********************************************************/
+int JobSystem::GetChunkCount(int count, int grainSize)
+{
+	if (count <= 0)
+	{
+		return(0);
+	}
+	grainSize = std::max(grainSize, 1);
+
+	return((count + grainSize - 1) / grainSize);
+}
+
+/***********************************************************
+ *  RunChunks()
+ *
+ *  This method is used for running a ParallelFor() function
+ *  over every chunk of the range [0, count) and returning
+ *  once all of them are done.  The chunks are dealt out
+ *  round robin so each thread starts on its own share, and
+ *  the calling thread works through the queues too instead
+ *  of waiting.  A range of one chunk runs inline without any
+ *  locking.
+ ***********************************************************/
+void JobSystem::RunChunks(int count, int grainSize, CHUNK_CALL pCall, const void* pFunction)
+{
+	int chunkCount = GetChunkCount(count, grainSize);
+
+	grainSize = std::max(grainSize, 1);
+	if (chunkCount == 0)
+	{
+		return;
+	}
+	if ((chunkCount == 1) || m_workers.empty())
+	{
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			pCall(pFunction, chunk, chunk * grainSize, std::min((chunk + 1) * grainSize, count));
+		}
+		return;
+	}
+
+	int queueCount = (int)m_queues.size();
+	int callerQueue = queueCount - 1;
+
+	// every queue was emptied by the last range, so its jobs
+	// start over from the beginning of its storage
+	for (int i = 0; i < queueCount; i++)
+	{
+		std::lock_guard<std::mutex> lock(m_queues[i]->mutex);
+		m_queues[i]->jobs.clear();
+		m_queues[i]->front = 0;
+	}
+
+	m_unfinishedJobs = chunkCount;
+	// each queue pops from its back, so the chunks are pushed
+	// last to first to be started in order
+	for (int chunk = chunkCount - 1; chunk >= 0; chunk--)
+	{
+		JOB job;
+		job.pCall = pCall;
+		job.pFunction = pFunction;
+		job.chunk = chunk;
+		job.first = chunk * grainSize;
+		job.last = std::min(job.first + grainSize, count);
+
+		JOB_QUEUE& queue = *m_queues[chunk % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+		queue.jobs.push_back(job);
+	}
+	m_queuedJobs += chunkCount;
+
+	// taking the lock orders the wake up after the queued count
+	// any sleeping worker checks
+	{
+		std::lock_guard<std::mutex> lock(m_wakeMutex);
+	}
+	m_wakeCondition.notify_all();
+
+	while (m_unfinishedJobs > 0)
+	{
+		JOB job;
+
+		if (FindJob(callerQueue, job))
+		{
+			RunJob(job);
+		}
+		else
+		{
+			// the last chunks are running on the workers
+			std::this_thread::yield();
+		}
+	}
+}
+
+/***********************************************************
+ *  PopJob()
+ *
+ *  This method is used for taking the newest job of a
+ *  thread's own queue.
+ ***********************************************************/
+bool JobSystem::PopJob(int queueIndex, JOB& job)
+{
+	JOB_QUEUE& queue = *m_queues[queueIndex];
+	std::lock_guard<std::mutex> lock(queue.mutex);
+
+	if (queue.front >= queue.jobs.size())
+	{
+		return(false);
+	}
+	job = queue.jobs.back();
+	queue.jobs.pop_back();
+	m_queuedJobs--;
+
+	return(true);
+}
+
+/***********************************************************
+ *  StealJob()
+ *
+ *  This method is used for taking the oldest job of another
+ *  thread's queue, trying each queue after its own in turn.
+ ***********************************************************/
+bool JobSystem::StealJob(int queueIndex, JOB& job)
+{
+	int queueCount = (int)m_queues.size();
+
+	for (int i = 1; i < queueCount; i++)
+	{
+		JOB_QUEUE& queue = *m_queues[(queueIndex + i) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.mutex);
+
+		if (queue.front < queue.jobs.size())
+		{
+			job = queue.jobs[queue.front++];
+			m_queuedJobs--;
+			return(true);
+		}
+	}
+
+	return(false);
+}
+
+/***********************************************************
+ *  FindJob()
+ *
+ *  This method is used for taking the next job for a
+ *  thread, stealing only when its own queue is empty.
+ ***********************************************************/
+bool JobSystem::FindJob(int queueIndex, JOB& job)
+{
+	if (m_queuedJobs <= 0)
+	{
+		return(false);
+	}
+
+	return(PopJob(queueIndex, job) || StealJob(queueIndex, job));
+}
+
+/***********************************************************
+ *  RunJob()
+ *
+ *  This method is used for running a job.  The finished
+ *  count is only lowered afterwards, so ParallelFor() does
+ *  not return while the job still writes its results.
+ ***********************************************************/
+void JobSystem::RunJob(const JOB& job)
+{
+	job.pCall(job.pFunction, job.chunk, job.first, job.last);
+	m_unfinishedJobs--;
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is used for running queued jobs on a worker
+ *  thread, sleeping while there are none, until the pool is
+ *  stopped.
+ ***********************************************************/
+void JobSystem::WorkerLoop(int queueIndex)
+{
+	while (true)
+	{
+		JOB job;
+
+		if (FindJob(queueIndex, job))
+		{
+			RunJob(job);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> lock(m_wakeMutex);
+		m_wakeCondition.wait(lock, [this]() { return(m_bStopping || (m_queuedJobs > 0)); });
+		if (m_bStopping)
+		{
+			return;
+		}
+	}
+}
@@ -0,0 +1,119 @@
+///////////////////////////////////////////////////////////////////////////////
+// jobsystem.h
+// ============
+// split the per-frame scene work into chunks run by a pool of worker
+// threads that steal from each other's queues
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  JobSystem
+ *
+ *  This class owns a pool of worker threads, each with its
+ *  own queue of jobs.  ParallelFor() splits a range into
+ *  chunks, deals them out over the queues and works on them
+ *  itself until every chunk is done.  A thread takes jobs
+ *  from the back of its own queue and, once that is empty,
+ *  steals from the front of the others, so uneven chunks
+ *  still keep every core busy.  No OpenGL calls are made by
+ *  the jobs; the calling thread keeps the context.  With no
+ *  workers every chunk runs on the calling thread.  The
+ *  function is only referenced by the jobs and the queues
+ *  keep their storage, so a frame of jobs makes no heap
+ *  allocations.
+ ***********************************************************/
+class JobSystem
+{
+public:
+	// constructor
+	JobSystem();
+	// destructor
+	~JobSystem();
+
+	// start a number of worker threads, stopping any running ones
+	void Start(int workerCount);
+	// stop and join the worker threads
+	void Stop();
+	// get the number of running worker threads
+	int GetWorkerCount() const;
+	// get one worker thread for every core but the calling one
+	static int GetDefaultWorkerCount();
+
+	// get the number of chunks a range is split into
+	static int GetChunkCount(int count, int grainSize);
+	// run a function(chunk, first, last) over every chunk of a
+	// range, first included and last not, and wait for them -
+	// only called from the thread that started the pool
+	template <class FUNCTION>
+	void ParallelFor(int count, int grainSize, const FUNCTION& function)
+	{
+		RunChunks(count, grainSize, &CallFunction<FUNCTION>, &function);
+	}
+
+private:
+	// calls the function of a ParallelFor() on one chunk
+	typedef void (*CHUNK_CALL)(const void* pFunction, int chunk, int first, int last);
+
+	// one chunk of a ParallelFor() range
+	struct JOB
+	{
+		CHUNK_CALL pCall;
+		const void* pFunction;
+		int chunk;
+		int first;
+		int last;
+	};
+
+	// jobs of one thread, guarded by their own lock so that
+	// only thieves contend for it - the owner takes from the
+	// back and thieves from the front index, and the storage is
+	// kept for the next range
+	struct JOB_QUEUE
+	{
+		std::mutex mutex;
+		std::vector<JOB> jobs;
+		size_t front;
+	};
+
+	// call a ParallelFor() function of a known type
+	template <class FUNCTION>
+	static void CallFunction(const void* pFunction, int chunk, int first, int last)
+	{
+		(*(const FUNCTION*)pFunction)(chunk, first, last);
+	}
+
+	// split a range into jobs and run them with the workers
+	void RunChunks(int count, int grainSize, CHUNK_CALL pCall, const void* pFunction);
+
+	// take a job from the back of a thread's own queue
+	bool PopJob(int queueIndex, JOB& job);
+	// take a job from the front of another thread's queue
+	bool StealJob(int queueIndex, JOB& job);
+	// take a job from anywhere, own queue first
+	bool FindJob(int queueIndex, JOB& job);
+	// run a job and count it as finished
+	void RunJob(const JOB& job);
+	// run jobs until the pool is stopped
+	void WorkerLoop(int queueIndex);
+
+	std::vector<std::thread> m_workers;
+	// one queue per worker, then one for the calling thread
+	std::vector<std::unique_ptr<JOB_QUEUE> > m_queues;
+	// jobs waiting in the queues
+	std::atomic<int> m_queuedJobs;
+	// jobs of the current ParallelFor() not yet finished
+	std::atomic<int> m_unfinishedJobs;
+	// wakes the idle workers when jobs are queued
+	std::mutex m_wakeMutex;
+	std::condition_variable m_wakeCondition;
+	bool m_bStopping;
+};
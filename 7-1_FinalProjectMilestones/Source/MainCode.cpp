@@ -11,8 +11,15 @@
 
 #include "SceneManager.h"
 #include "ViewManager.h"
-#include "ShapeMeshes.h"
-#include "ShaderManager.h"
+#include "ShaderCache.h"
+#include "ShaderUniforms.h"
+#include "FrameArena.h"
+#include "FrameProfiler.h"
+#include "FramePacer.h"
+#include "Benchmark.h"
+#include "GLObject.h"
+#include "ResolutionScaler.h"
+#include "StreamBuffer.h"
 
 // Namespace for declaring global variables
 namespace
@@ -25,10 +32,26 @@ namespace
 
 	// scene manager object for managing the 3D scene prepare and render
 	SceneManager* g_SceneManager = nullptr;
-	// shader manager object for dynamic interaction with the shader code
-	ShaderManager* g_ShaderManager = nullptr;
+	// builds the shader program through its binary cache and
+	// rebuilds it when the shader files change
+	ShaderCache* g_ShaderCache = nullptr;
+	// cached uniform locations and uniform buffers of the shaders
+	ShaderUniforms* g_ShaderUniforms = nullptr;
 	// view manager object for managing the 3D view setup and projection to 2D
 	ViewManager* g_ViewManager = nullptr;
+	// frame timings, GPU pass timings and draw counters
+	FrameProfiler* g_Profiler = nullptr;
+	// scripted benchmark run, only created with --benchmark
+	Benchmark* g_Benchmark = nullptr;
+	// persistently mapped ring of the per-frame view and
+	// instance data
+	StreamBuffer* g_StreamBuffer = nullptr;
+	// transient memory of the current frame
+	FrameArena* g_FrameArena = nullptr;
+	// swap interval and frame rate cap
+	FramePacer* g_FramePacer = nullptr;
+	// scales the rendered resolution to the GPU budget
+	ResolutionScaler* g_ResolutionScaler = nullptr;
 }
 
 // Function declarations - all functions that are called manually
@@ -45,17 +68,39 @@ bool InitializeGLEW();
  ***********************************************************/
 int main(int argc, char* argv[])
 {
+	// read the benchmark options, if any
+	Benchmark::SETTINGS benchmarkSettings = Benchmark::ParseArguments(argc, argv);
+	// read the stress scene and rendering path options, if any
+	SceneManager::SCENE_SETTINGS sceneSettings = SceneManager::ParseArguments(argc, argv);
+	// rebuild the shaders when their files change
+	bool bWatchShaders = ShaderCache::ParseWatchArgument(argc, argv);
+	// read the swap interval, frame cap and dynamic resolution options
+	FramePacer::SETTINGS pacingSettings = FramePacer::ParseArguments(argc, argv);
+	ResolutionScaler::SETTINGS resolutionSettings = ResolutionScaler::ParseArguments(argc, argv);
+
 	// if GLFW fails initialization, then terminate the application
 	if (InitializeGLFW() == false)
 	{
 		return(EXIT_FAILURE);
 	}
 
-	// try to create a new shader manager object
-	g_ShaderManager = new ShaderManager();
+	// an offscreen benchmark run never shows its window
+	if (benchmarkSettings.bEnabled && benchmarkSettings.bOffscreen)
+	{
+		glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	}
+
+	// try to create a new shader cache object
+	g_ShaderCache = new ShaderCache();
+	// try to create a new shader uniforms object
+	g_ShaderUniforms = new ShaderUniforms();
+	// try to create a new profiler object
+	g_Profiler = new FrameProfiler();
+	g_ShaderUniforms->SetProfiler(g_Profiler);
 	// try to create a new view manager object
 	g_ViewManager = new ViewManager(
-		g_ShaderManager);
+		g_ShaderUniforms,
+		g_Profiler);
 
 	// try to create the main display window
 	g_Window = g_ViewManager->CreateDisplayWindow(WINDOW_TITLE);
@@ -66,20 +111,116 @@ int main(int argc, char* argv[])
 		return(EXIT_FAILURE);
 	}
 
-	// load the shader code from the external GLSL files
-	g_ShaderManager->LoadShaders(
-		"../../Utilities/shaders/vertexShader.glsl",
-		"../../Utilities/shaders/fragmentShader.glsl");
-	g_ShaderManager->use();
+	// load the shader code from the external GLSL files, or the
+	// program binary saved by the previous launch
+	GLuint shaderProgram = g_ShaderCache->LoadProgram(
+		"Shaders/vertexShader.glsl",
+		"Shaders/fragmentShader.glsl");
+	if (shaderProgram == 0)
+	{
+		return(EXIT_FAILURE);
+	}
+	glUseProgram(shaderProgram);
+
+	// resolve the uniform locations and create the uniform buffers
+	// once the shader program is active
+	if (g_ShaderUniforms->Initialize() == false)
+	{
+		return(EXIT_FAILURE);
+	}
+	g_Profiler->Initialize();
+
+	// without buffer storage the stream stays unmapped, and the
+	// frame and instance data go through buffer uploads instead
+	g_StreamBuffer = new StreamBuffer();
+	g_StreamBuffer->SetProfiler(g_Profiler);
+	g_StreamBuffer->Create();
+	g_ShaderUniforms->SetStreamBuffer(g_StreamBuffer);
 
 	// try to create a new scene manager object and prepare the 3D scene
-	g_SceneManager = new SceneManager(g_ShaderManager);
+	g_SceneManager = new SceneManager(g_ShaderUniforms, g_Profiler);
+	g_SceneManager->SetSceneSettings(sceneSettings);
+	g_SceneManager->SetShaderCache(g_ShaderCache);
+	g_SceneManager->SetStreamBuffer(g_StreamBuffer);
+	g_FrameArena = new FrameArena();
+	g_SceneManager->SetFrameArena(g_FrameArena);
 	g_SceneManager->PrepareScene();
 
+	// watch the shaders once the scene has built its variants - the
+	// benchmark measures one fixed build of the shaders
+	if (bWatchShaders && !benchmarkSettings.bEnabled)
+	{
+		g_ShaderCache->StartWatching(g_Window);
+	}
+
+	// the benchmark replaces user input with the scripted camera
+	if (benchmarkSettings.bEnabled)
+	{
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+		glfwGetFramebufferSize(g_Window, &framebufferWidth, &framebufferHeight);
+
+		g_Benchmark = new Benchmark(g_Profiler);
+		g_Benchmark->SetSceneObjectCount(g_SceneManager->GetSceneNodeCount());
+		if (g_Benchmark->Begin(benchmarkSettings, framebufferWidth, framebufferHeight) == false)
+		{
+			return(EXIT_FAILURE);
+		}
+	}
+
+	// the benchmark sets its own swap interval, runs uncapped
+	// and measures a fixed resolution
+	g_FramePacer = new FramePacer();
+	g_ResolutionScaler = new ResolutionScaler();
+	g_ResolutionScaler->SetProfiler(g_Profiler);
+	if (NULL == g_Benchmark)
+	{
+		g_FramePacer->Begin(pacingSettings);
+		g_ResolutionScaler->Begin(resolutionSettings);
+	}
+
 	// loop will keep running until the application is closed 
 	// or until an error has occurred
 	while (!glfwWindowShouldClose(g_Window))
 	{
+		if (NULL != g_Benchmark)
+		{
+			g_Benchmark->BeginFrame();
+			g_ViewManager->SetCameraPath(g_Benchmark->GetPathPosition());
+		}
+
+		g_Profiler->BeginFrame();
+		// take back the transient memory of the last frame
+		g_FrameArena->Reset();
+		// wait for the GPU to release the stream region of this frame
+		g_StreamBuffer->BeginFrame();
+
+		// switch to shaders rebuilt by the watcher - a program
+		// the uniforms cannot use is dropped, and one they do not
+		// know, such as the shadow map program, is swapped as it
+		// is for its owner to resolve again
+		int reloadedIndex = 0;
+		GLuint reloadedProgram = 0;
+		while (g_ShaderCache->TakeReloadedProgram(reloadedIndex, reloadedProgram))
+		{
+			GLuint previousProgram = g_ShaderCache->GetProgram(reloadedIndex);
+			if (!g_ShaderUniforms->HasProgram(previousProgram) ||
+				g_ShaderUniforms->ReplaceProgram(previousProgram, reloadedProgram))
+			{
+				g_ShaderCache->ReplaceProgram(reloadedIndex, reloadedProgram);
+			}
+			else
+			{
+				glDeleteProgram(reloadedProgram);
+			}
+		}
+
+		// render at the resolution the GPU budget allows
+		int framebufferWidth = 0;
+		int framebufferHeight = 0;
+		g_ViewManager->GetFramebufferSize(framebufferWidth, framebufferHeight);
+		g_ResolutionScaler->BeginFrame(framebufferWidth, framebufferHeight);
+
 		// Enable z-depth
 		glEnable(GL_DEPTH_TEST);
 
@@ -88,17 +229,63 @@ int main(int argc, char* argv[])
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 		// convert from 3D object space to 2D view
+		g_Profiler->BeginCPUScope(FrameProfiler::CPU_PREPARE_VIEW);
 		g_ViewManager->PrepareSceneView();
+		g_Profiler->EndCPUScope(FrameProfiler::CPU_PREPARE_VIEW);
 
 		// refresh the 3D scene
+		g_Profiler->BeginCPUScope(FrameProfiler::CPU_RENDER_SCENE);
 		g_SceneManager->RenderScene();
+		g_Profiler->EndCPUScope(FrameProfiler::CPU_RENDER_SCENE);
+		// fence the draws that read the stream region of this frame
+		g_StreamBuffer->EndFrame();
+		// stretch a scaled frame over the window
+		g_ResolutionScaler->EndFrame();
 
+		// draw the profiling overlay on top when it is shown
+		g_Profiler->DrawOverlay(g_Window, WINDOW_TITLE);
+		g_Profiler->EndFrame();
 
 		// Flips the the back buffer with the front buffer every frame.
-		glfwSwapBuffers(g_Window);
+		// offscreen benchmark frames are never shown
+		if ((NULL == g_Benchmark) || (benchmarkSettings.bOffscreen == false))
+		{
+			glfwSwapBuffers(g_Window);
+		}
 
-		// query the latest GLFW events
+		// hold the frame rate at its cap, then query the latest
+		// GLFW events so the next frame sees fresh input
+		g_FramePacer->WaitForNextFrame();
 		glfwPollEvents();
+
+		// on demand, sleep in the event queue until the view or
+		// the scene changes or rebuilt shaders are waiting
+		while (g_FramePacer->IsOnDemand() &&
+			!glfwWindowShouldClose(g_Window) &&
+			!g_ViewManager->TakeRedrawRequest() &&
+			!g_SceneManager->NeedsRedraw() &&
+			!g_ShaderCache->HasReloadedProgram())
+		{
+			g_FramePacer->WaitForEvents();
+		}
+
+		if (NULL != g_Benchmark)
+		{
+			g_Benchmark->EndFrame(g_SceneManager->IsLoadingTextures());
+			if (g_Benchmark->IsFinished())
+			{
+				break;
+			}
+		}
+	}
+
+	// write the benchmark report before the scene is freed
+	bool bBenchmarkWritten = true;
+	if (NULL != g_Benchmark)
+	{
+		bBenchmarkWritten = g_Benchmark->Finish();
+		delete g_Benchmark;
+		g_Benchmark = NULL;
 	}
 
 	// clear the allocated manager objects from memory
@@ -107,19 +294,57 @@ int main(int argc, char* argv[])
 		delete g_SceneManager;
 		g_SceneManager = NULL;
 	}
+	if (NULL != g_ResolutionScaler)
+	{
+		delete g_ResolutionScaler;
+		g_ResolutionScaler = NULL;
+	}
+	if (NULL != g_FramePacer)
+	{
+		delete g_FramePacer;
+		g_FramePacer = NULL;
+	}
+	if (NULL != g_StreamBuffer)
+	{
+		delete g_StreamBuffer;
+		g_StreamBuffer = NULL;
+	}
+	if (NULL != g_FrameArena)
+	{
+		delete g_FrameArena;
+		g_FrameArena = NULL;
+	}
+	// the watcher context shares the window, so it goes first
+	if (NULL != g_ShaderCache)
+	{
+		delete g_ShaderCache;
+		g_ShaderCache = NULL;
+	}
 	if (NULL != g_ViewManager)
 	{
 		delete g_ViewManager;
 		g_ViewManager = NULL;
 	}
-	if (NULL != g_ShaderManager)
+	if (NULL != g_Profiler)
+	{
+		delete g_Profiler;
+		g_Profiler = NULL;
+	}
+	if (NULL != g_ShaderUniforms)
+	{
+		delete g_ShaderUniforms;
+		g_ShaderUniforms = NULL;
+	}
+
+	// every owned OpenGL object should be freed by now
+	if (GLObject::GetLiveCount() > 0)
 	{
-		delete g_ShaderManager;
-		g_ShaderManager = NULL;
+		std::cout << "WARNING: " << GLObject::GetLiveCount() << " OpenGL objects holding "
+			<< GLObject::GetTotalBytes() << " bytes were not freed" << std::endl;
 	}
 
 	// Terminates the program successfully
-	exit(EXIT_SUCCESS); 
+	exit(bBenchmarkWritten ? EXIT_SUCCESS : EXIT_FAILURE); 
 }
 
 /***********************************************************
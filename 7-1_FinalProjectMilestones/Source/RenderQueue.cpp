@@ -0,0 +1,286 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.cpp
+// ============
+// collect the draw commands of a frame and sort them so that shader,
+// texture and material changes are kept to a minimum
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "RenderQueue.h"
+
+#include <algorithm>
+
+// view depths past this distance share the last sort bucket
+const float RenderQueue::MAX_SORT_DEPTH = 100.0f;
+
+// declaration of global variables
+namespace
+{
+	// bit widths of the sort key fields
+	const int g_ShaderBits = 4;
+	const int g_TextureBits = 12;
+	const int g_MaterialBits = 16;
+	const int g_MeshBits = 6;
+	const int g_LodBits = 2;
+	const int g_DepthBits = 24;
+
+	// clamp a value into a key field - negative values, such as
+	// an untextured slot of -1, sort ahead of every real value
+	uint64_t KeyField(int value, int bits)
+	{
+		uint64_t maxValue = (1ull << bits) - 1;
+		uint64_t field = (uint64_t)(value + 1);
+
+		if (value < -1)
+		{
+			field = 0;
+		}
+
+		return((field > maxValue) ? maxValue : field);
+	}
+
+	// quantize a view depth into the depth field
+	uint64_t DepthField(float viewDepth)
+	{
+		uint64_t maxValue = (1ull << g_DepthBits) - 1;
+		float normalized = viewDepth / RenderQueue::MAX_SORT_DEPTH;
+
+		if (normalized <= 0.0f)
+		{
+			return(0);
+		}
+		if (normalized >= 1.0f)
+		{
+			return(maxValue);
+		}
+
+		return((uint64_t)(normalized * (float)maxValue));
+	}
+
+	// order draw commands by ascending sort key
+	bool CompareKeys(
+		const RenderQueue::DRAW_COMMAND& a,
+		const RenderQueue::DRAW_COMMAND& b)
+	{
+		return(a.sortKey < b.sortKey);
+	}
+}
+
+/***********************************************************
+ *  RenderQueue()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+RenderQueue::RenderQueue()
+{
+	m_pArena = NULL;
+}
+
+/***********************************************************
+ *  SetFrameArena()
+ *
+ *  This method is used for setting the arena the command
+ *  lists are built in from the next Clear() on.
+ ***********************************************************/
+void RenderQueue::SetFrameArena(FrameArena* pArena)
+{
+	m_pArena = pArena;
+}
+
+/***********************************************************
+ *  MakeDepthKey()
+ *
+ *  This method is used for building a sort key that orders
+ *  depth only draws front to back, using the mesh and its
+ *  level of detail only to break ties.  Every depth draw
+ *  uses the same program and no material, so the state
+ *  fields of the other keys are left out.
+ ***********************************************************/
+uint64_t RenderQueue::MakeDepthKey(
+	int mesh,
+	int lod,
+	float viewDepth)
+{
+	uint64_t key = DepthField(viewDepth);
+
+	key = (key << g_MeshBits) | KeyField(mesh, g_MeshBits);
+	key = (key << g_LodBits) | KeyField(lod, g_LodBits);
+
+	return(key);
+}
+
+/***********************************************************
+ *  MakeOpaqueKey()
+ *
+ *  This method is used for building a sort key that groups
+ *  opaque draws by shader, then texture, then material and
+ *  mesh and its level of detail, and finally front to back
+ *  within the same state.
+ ***********************************************************/
+uint64_t RenderQueue::MakeOpaqueKey(
+	int shader,
+	int textureSlot,
+	int materialIndex,
+	int mesh,
+	int lod,
+	float viewDepth)
+{
+	uint64_t key = KeyField(shader, g_ShaderBits);
+
+	key = (key << g_TextureBits) | KeyField(textureSlot, g_TextureBits);
+	key = (key << g_MaterialBits) | KeyField(materialIndex, g_MaterialBits);
+	key = (key << g_MeshBits) | KeyField(mesh, g_MeshBits);
+	key = (key << g_LodBits) | KeyField(lod, g_LodBits);
+	key = (key << g_DepthBits) | DepthField(viewDepth);
+
+	return(key);
+}
+
+/***********************************************************
+ *  MakeTransparentKey()
+ *
+ *  This method is used for building a sort key that orders
+ *  transparent draws back to front, using the state only to
+ *  break ties between draws at the same depth.
+ ***********************************************************/
+uint64_t RenderQueue::MakeTransparentKey(
+	int shader,
+	int textureSlot,
+	int materialIndex,
+	float viewDepth)
+{
+	uint64_t maxDepth = (1ull << g_DepthBits) - 1;
+	uint64_t key = maxDepth - DepthField(viewDepth);
+
+	key = (key << g_ShaderBits) | KeyField(shader, g_ShaderBits);
+	key = (key << g_TextureBits) | KeyField(textureSlot, g_TextureBits);
+	key = (key << g_MaterialBits) | KeyField(materialIndex, g_MaterialBits);
+
+	return(key);
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing all the submitted draw
+ *  commands.  On the heap the lists keep their memory for
+ *  the next frame.  On an arena the reset has already taken
+ *  their memory back, so new lists are started in it.
+ ***********************************************************/
+void RenderQueue::Clear()
+{
+	for (int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		if (NULL == m_pArena)
+		{
+			m_commands[pass].clear();
+		}
+		else
+		{
+			m_commands[pass] = COMMAND_LIST(ArenaAllocator<DRAW_COMMAND>(m_pArena));
+		}
+	}
+}
+
+/***********************************************************
+ *  Submit()
+ *
+ *  This method is used for adding a draw command to a pass.
+ ***********************************************************/
+void RenderQueue::Submit(PASS pass, DRAW_COMMAND command, float viewDepth)
+{
+	if (pass == DEPTH_PASS)
+	{
+		command.sortKey = MakeDepthKey(
+			command.mesh,
+			command.lod,
+			viewDepth);
+	}
+	else if (pass == OPAQUE_PASS)
+	{
+		command.sortKey = MakeOpaqueKey(
+			command.shader,
+			command.textureSlot,
+			command.materialIndex,
+			command.mesh,
+			command.lod,
+			viewDepth);
+	}
+	else
+	{
+		command.sortKey = MakeTransparentKey(
+			command.shader,
+			command.textureSlot,
+			command.materialIndex,
+			viewDepth);
+	}
+
+	m_commands[pass].push_back(command);
+}
+
+/***********************************************************
+ *  Sort()
+ *
+ *  This method is used for sorting the commands of every
+ *  pass by their keys.
+ ***********************************************************/
+void RenderQueue::Sort()
+{
+	for (int pass = 0; pass < PASS_COUNT; pass++)
+	{
+		SortCommands(m_commands[pass]);
+	}
+}
+
+/***********************************************************
+ *  SortCommands()
+ *
+ *  This method is used for sorting a list of commands by
+ *  their keys, keeping submission order for equal keys.
+ *  std::stable_sort() takes its buffer from the heap on
+ *  every call, so the runs are merged here between the list
+ *  and a scratch list on the list's own allocator.
+ ***********************************************************/
+void RenderQueue::SortCommands(COMMAND_LIST& commands)
+{
+	size_t count = commands.size();
+
+	if (count < 2)
+	{
+		return;
+	}
+
+	COMMAND_LIST scratch(count, DRAW_COMMAND(), commands.get_allocator());
+	DRAW_COMMAND* pSource = commands.data();
+	DRAW_COMMAND* pTarget = scratch.data();
+
+	for (size_t width = 1; width < count; width *= 2)
+	{
+		for (size_t first = 0; first < count; first += width * 2)
+		{
+			size_t middle = std::min(first + width, count);
+			size_t last = std::min(first + width * 2, count);
+
+			// merge takes from the first run on equal keys
+			std::merge(pSource + first, pSource + middle, pSource + middle, pSource + last,
+				pTarget + first, CompareKeys);
+		}
+		std::swap(pSource, pTarget);
+	}
+
+	if (pSource != commands.data())
+	{
+		std::copy(pSource, pSource + count, commands.data());
+	}
+}
+
+/***********************************************************
+ *  GetCommands()
+ *
+ *  This method is used for getting the sorted commands of
+ *  a pass.
+ ***********************************************************/
+const RenderQueue::COMMAND_LIST& RenderQueue::GetCommands(PASS pass) const
+{
+	return(m_commands[pass]);
+}
@@ -0,0 +1,105 @@
+///////////////////////////////////////////////////////////////////////////////
+// renderqueue.h
+// ============
+// collect the draw commands of a frame and sort them so that shader,
+// texture and material changes are kept to a minimum
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrameArena.h"
+
+#include <cstdint>
+#include <vector>
+
+/***********************************************************
+ *  RenderQueue
+ *
+ *  This class holds the draw commands submitted for a frame
+ *  in a depth pre-pass, an opaque pass and a transparent
+ *  pass.  Each command carries a 64 bit sort key; depth
+ *  keys order strictly front to back so the early depth
+ *  test rejects the most, opaque keys order by state and
+ *  then front to back, transparent keys order back to front
+ *  so blending composites correctly.  With a frame
+ *  arena set, the command lists and the sort take their
+ *  memory from the arena of the current frame.
+ ***********************************************************/
+class RenderQueue
+{
+public:
+	// constructor
+	RenderQueue();
+
+	enum PASS
+	{
+		DEPTH_PASS,
+		OPAQUE_PASS,
+		TRANSPARENT_PASS,
+		PASS_COUNT
+	};
+
+	// one batch of instances drawn with a single call
+	struct DRAW_COMMAND
+	{
+		uint64_t sortKey;
+		int shader;
+		int mesh;
+		// level of detail of the mesh
+		int lod;
+		int textureSlot;
+		int materialIndex;
+		int firstInstance;
+		int instanceCount;
+	};
+
+	// commands of one pass, on the frame arena when one is set
+	typedef std::vector<DRAW_COMMAND, ArenaAllocator<DRAW_COMMAND> > COMMAND_LIST;
+
+	// set the arena the command lists are built in, or NULL to
+	// keep them on the heap
+	void SetFrameArena(FrameArena* pArena);
+
+	// remove the commands of the previous frame - with an arena
+	// this must follow its Reset()
+	void Clear();
+	// add a command to a pass - the sort key is computed from
+	// the command state and the passed in view depth
+	void Submit(PASS pass, DRAW_COMMAND command, float viewDepth);
+	// sort every pass by its keys
+	void Sort();
+
+	// get the sorted commands of a pass
+	const COMMAND_LIST& GetCommands(PASS pass) const;
+
+	// build the sort keys for the passes
+	static uint64_t MakeDepthKey(
+		int mesh,
+		int lod,
+		float viewDepth);
+	static uint64_t MakeOpaqueKey(
+		int shader,
+		int textureSlot,
+		int materialIndex,
+		int mesh,
+		int lod,
+		float viewDepth);
+	static uint64_t MakeTransparentKey(
+		int shader,
+		int textureSlot,
+		int materialIndex,
+		float viewDepth);
+
+	// far plane used to quantize the view depth into the keys
+	static const float MAX_SORT_DEPTH;
+
+private:
+	// stable merge sort of a pass, with its scratch list on the
+	// same arena as the commands
+	static void SortCommands(COMMAND_LIST& commands);
+
+	COMMAND_LIST m_commands[PASS_COUNT];
+	// arena of the command lists, may be NULL
+	FrameArena* m_pArena;
+};
@@ -0,0 +1,476 @@
+///////////////////////////////////////////////////////////////////////////////
+// residencymanager.cpp
+// ============
+// decide which texture mip levels and mesh levels of detail stay in video
+// memory, streaming the wanted ones in and evicting the least recently used
+// ones to stay within a budget
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ResidencyManager.h"
+
+#include <algorithm>
+
+/***********************************************************
+ *  ResidencyManager()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ResidencyManager::ResidencyManager()
+{
+	m_budgetBytes = 0;
+	for (int type = 0; type < RESOURCE_TYPE_COUNT; type++)
+	{
+		m_residentBytes[type] = 0;
+	}
+	m_frame = 0;
+}
+
+/***********************************************************
+ *  SetBudget()
+ *
+ *  This method is used for setting the bytes the levels
+ *  above the fallbacks may take.  A lower budget is met by
+ *  the next Update().
+ ***********************************************************/
+void ResidencyManager::SetBudget(long long budgetBytes)
+{
+	m_budgetBytes = std::max(budgetBytes, 0LL);
+}
+
+/***********************************************************
+ *  GetBudget()
+ *
+ *  This method is used for getting the budget in bytes.
+ ***********************************************************/
+long long ResidencyManager::GetBudget() const
+{
+	return(m_budgetBytes);
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for forgetting every resource and
+ *  pool.  The owner frees what was resident.
+ ***********************************************************/
+void ResidencyManager::Clear()
+{
+	m_resources.clear();
+	m_pools.clear();
+	for (int type = 0; type < RESOURCE_TYPE_COUNT; type++)
+	{
+		m_residentBytes[type] = 0;
+	}
+}
+
+/***********************************************************
+ *  AddPool()
+ *
+ *  This method is used for adding a pool with a fixed
+ *  number of entries, such as the slots of a texture array.
+ ***********************************************************/
+int ResidencyManager::AddPool(int capacity)
+{
+	POOL pool;
+	pool.capacity = std::max(capacity, 0);
+	pool.usedCount = 0;
+	m_pools.push_back(pool);
+
+	return((int)m_pools.size() - 1);
+}
+
+/***********************************************************
+ *  AddResource()
+ *
+ *  This method is used for adding a resource with only its
+ *  fallback level resident.  The tag is the owner's name
+ *  for it, such as a texture layer.
+ ***********************************************************/
+int ResidencyManager::AddResource(RESOURCE_TYPE type, int tag, const std::vector<long long>& levelBytes, int pool)
+{
+	RESOURCE resource;
+	resource.type = type;
+	resource.tag = tag;
+	resource.levelBytes = levelBytes;
+	resource.fallbackLevel = (int)levelBytes.size();
+	resource.pool = ((pool >= 0) && (pool < (int)m_pools.size())) ? pool : -1;
+	resource.residentLevel = resource.fallbackLevel;
+	resource.requestedLevel = resource.fallbackLevel;
+	resource.lastUsedFrame = 0;
+	m_resources.push_back(resource);
+
+	return((int)m_resources.size() - 1);
+}
+
+/***********************************************************
+ *  GetResourceCount()
+ *
+ *  This method is used for getting the number of resources.
+ ***********************************************************/
+int ResidencyManager::GetResourceCount() const
+{
+	return((int)m_resources.size());
+}
+
+/***********************************************************
+ *  GetType()
+ *
+ *  This method is used for getting the type a resource was
+ *  added with.
+ ***********************************************************/
+ResidencyManager::RESOURCE_TYPE ResidencyManager::GetType(int resource) const
+{
+	return(m_resources[resource].type);
+}
+
+/***********************************************************
+ *  GetTag()
+ *
+ *  This method is used for getting the tag a resource was
+ *  added with.
+ ***********************************************************/
+int ResidencyManager::GetTag(int resource) const
+{
+	return(m_resources[resource].tag);
+}
+
+/***********************************************************
+ *  GetResidentLevel()
+ *
+ *  This method is used for getting the finest resident
+ *  level of a resource.
+ ***********************************************************/
+int ResidencyManager::GetResidentLevel(int resource) const
+{
+	return(m_resources[resource].residentLevel);
+}
+
+/***********************************************************
+ *  GetResidentBytes()
+ *
+ *  This method is used for getting the bytes of every level
+ *  resident above its fallback.
+ ***********************************************************/
+long long ResidencyManager::GetResidentBytes() const
+{
+	long long bytes = 0;
+
+	for (int type = 0; type < RESOURCE_TYPE_COUNT; type++)
+	{
+		bytes += m_residentBytes[type];
+	}
+
+	return(bytes);
+}
+
+/***********************************************************
+ *  GetResidentBytes()
+ *
+ *  This method is used for getting the bytes resident above
+ *  the fallbacks of one type of resource.
+ ***********************************************************/
+long long ResidencyManager::GetResidentBytes(RESOURCE_TYPE type) const
+{
+	return(m_residentBytes[type]);
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting the requests of a new
+ *  frame.  A resource nothing asks for keeps its levels
+ *  until the budget needs them.
+ ***********************************************************/
+void ResidencyManager::BeginFrame()
+{
+	// the stamps start at 1, so 0 is never a current frame
+	if (++m_frame == 0)
+	{
+		for (size_t i = 0; i < m_resources.size(); i++)
+		{
+			m_resources[i].lastUsedFrame = 0;
+		}
+		m_frame = 1;
+	}
+
+	for (size_t i = 0; i < m_resources.size(); i++)
+	{
+		m_resources[i].requestedLevel = m_resources[i].fallbackLevel;
+	}
+}
+
+/***********************************************************
+ *  Request()
+ *
+ *  This method is used for asking for a level of a resource
+ *  drawn this frame.  The finest level asked for wins.
+ ***********************************************************/
+void ResidencyManager::Request(int resource, int level)
+{
+	if ((resource < 0) || (resource >= (int)m_resources.size()))
+	{
+		return;
+	}
+
+	RESOURCE& entry = m_resources[resource];
+	level = std::min(std::max(level, 0), entry.fallbackLevel);
+	entry.requestedLevel = std::min(entry.requestedLevel, level);
+	entry.lastUsedFrame = m_frame;
+}
+
+/***********************************************************
+ *  Update()
+ *
+ *  This method is used for planning the residency changes
+ *  of this frame.  Levels are given back first while the
+ *  budget is exceeded.  The wanted levels are then taken
+ *  one at a time, from the resources furthest from their
+ *  request, evicting to make room, until the upload bytes
+ *  of this frame run out.  The first level always goes in,
+ *  so streaming makes progress with any upload limit.  A
+ *  level that cannot fit without evicting one drawn this
+ *  frame waits for a later frame.
+ ***********************************************************/
+void ResidencyManager::Update(long long uploadBytes, std::vector<CHANGE>& changes)
+{
+	changes.clear();
+
+	while ((GetResidentBytes() > m_budgetBytes) && EvictLevel(-1, changes))
+	{
+	}
+
+	std::vector<int> wanted;
+	for (int i = 0; i < (int)m_resources.size(); i++)
+	{
+		if (m_resources[i].requestedLevel < m_resources[i].residentLevel)
+		{
+			wanted.push_back(i);
+		}
+	}
+	std::sort(wanted.begin(), wanted.end(),
+		[this](int a, int b)
+		{
+			int deficitA = m_resources[a].residentLevel - m_resources[a].requestedLevel;
+			int deficitB = m_resources[b].residentLevel - m_resources[b].requestedLevel;
+
+			return((deficitA != deficitB) ? (deficitA > deficitB) : (a < b));
+		});
+
+	long long uploadedBytes = 0;
+	for (size_t i = 0; i < wanted.size(); i++)
+	{
+		int index = wanted[i];
+
+		while (m_resources[index].residentLevel > m_resources[index].requestedLevel)
+		{
+			const RESOURCE& resource = m_resources[index];
+			int level = resource.residentLevel - 1;
+			long long bytes = resource.levelBytes[level];
+			// the levels of a pooled resource are paid for by its pool
+			long long chargedBytes = (resource.pool >= 0) ? 0 : bytes;
+
+			if ((uploadedBytes > 0) && (uploadedBytes + bytes > uploadBytes))
+			{
+				return;
+			}
+
+			// the first level above the fallback takes a pool entry
+			if ((resource.pool >= 0) && (resource.residentLevel == resource.fallbackLevel))
+			{
+				const POOL& pool = m_pools[resource.pool];
+
+				if ((pool.usedCount >= pool.capacity) && !EvictPoolEntry(resource.pool, index, changes))
+				{
+					break;
+				}
+			}
+
+			while ((GetResidentBytes() + chargedBytes > m_budgetBytes) && EvictLevel(index, changes))
+			{
+			}
+			if (GetResidentBytes() + chargedBytes > m_budgetBytes)
+			{
+				break;
+			}
+
+			SetResidentLevel(index, level, changes);
+			uploadedBytes += bytes;
+		}
+	}
+}
+
+/***********************************************************
+ *  RestoreLevel()
+ *
+ *  This method is used for moving a resource to the level
+ *  its owner really holds, when a planned change failed,
+ *  so the budget and the pools only charge what is
+ *  resident.  No change is recorded.
+ ***********************************************************/
+void ResidencyManager::RestoreLevel(int resource, int level)
+{
+	if ((resource < 0) || (resource >= (int)m_resources.size()))
+	{
+		return;
+	}
+
+	ChargeLevel(resource, std::min(std::max(level, 0), m_resources[resource].fallbackLevel));
+}
+
+/***********************************************************
+ *  IsLevelInUse()
+ *
+ *  This method is used for checking whether the finest
+ *  resident level of a resource is drawn this frame, which
+ *  it is when the resource was requested at that level or a
+ *  finer one.
+ ***********************************************************/
+bool ResidencyManager::IsLevelInUse(const RESOURCE& resource) const
+{
+	return((resource.lastUsedFrame == m_frame) && (resource.requestedLevel <= resource.residentLevel));
+}
+
+/***********************************************************
+ *  EvictLevel()
+ *
+ *  This method is used for dropping the finest resident
+ *  level of the resource used the longest ago.  The levels
+ *  finer than their request this frame go after every
+ *  older one, and pooled resources free no budget, so they
+ *  are left to EvictPoolEntry().  Returns false when
+ *  nothing can be dropped.
+ ***********************************************************/
+bool ResidencyManager::EvictLevel(int excludedResource, std::vector<CHANGE>& changes)
+{
+	int victim = -1;
+
+	for (int i = 0; i < (int)m_resources.size(); i++)
+	{
+		const RESOURCE& resource = m_resources[i];
+
+		if ((i == excludedResource) ||
+			(resource.pool >= 0) ||
+			(resource.residentLevel >= resource.fallbackLevel) ||
+			IsLevelInUse(resource))
+		{
+			continue;
+		}
+		if ((victim < 0) || (resource.lastUsedFrame < m_resources[victim].lastUsedFrame))
+		{
+			victim = i;
+		}
+	}
+
+	if (victim < 0)
+	{
+		return false;
+	}
+
+	SetResidentLevel(victim, m_resources[victim].residentLevel + 1, changes);
+	return true;
+}
+
+/***********************************************************
+ *  EvictPoolEntry()
+ *
+ *  This method is used for freeing an entry of a full pool
+ *  by dropping every level of its least recently used
+ *  resource that is not drawn above its fallback this
+ *  frame.  Returns false when every entry is in use.
+ ***********************************************************/
+bool ResidencyManager::EvictPoolEntry(int pool, int excludedResource, std::vector<CHANGE>& changes)
+{
+	int victim = -1;
+
+	for (int i = 0; i < (int)m_resources.size(); i++)
+	{
+		const RESOURCE& resource = m_resources[i];
+
+		if ((i == excludedResource) ||
+			(resource.pool != pool) ||
+			(resource.residentLevel >= resource.fallbackLevel) ||
+			((resource.lastUsedFrame == m_frame) && (resource.requestedLevel < resource.fallbackLevel)))
+		{
+			continue;
+		}
+		if ((victim < 0) || (resource.lastUsedFrame < m_resources[victim].lastUsedFrame))
+		{
+			victim = i;
+		}
+	}
+
+	if (victim < 0)
+	{
+		return false;
+	}
+
+	SetResidentLevel(victim, m_resources[victim].fallbackLevel, changes);
+	return true;
+}
+
+/***********************************************************
+ *  SetResidentLevel()
+ *
+ *  This method is used for moving a resource to a new
+ *  finest level and recording the change for the owner.
+ ***********************************************************/
+void ResidencyManager::SetResidentLevel(int index, int level, std::vector<CHANGE>& changes)
+{
+	int previousLevel = m_resources[index].residentLevel;
+
+	if (level == previousLevel)
+	{
+		return;
+	}
+
+	ChargeLevel(index, level);
+
+	CHANGE change;
+	change.resource = index;
+	change.previousLevel = previousLevel;
+	change.residentLevel = level;
+	changes.push_back(change);
+}
+
+/***********************************************************
+ *  ChargeLevel()
+ *
+ *  This method is used for moving a resource to a new
+ *  finest level, updating the charged bytes and its pool
+ *  entry.
+ ***********************************************************/
+void ResidencyManager::ChargeLevel(int index, int level)
+{
+	RESOURCE& resource = m_resources[index];
+	int previousLevel = resource.residentLevel;
+
+	if (level == previousLevel)
+	{
+		return;
+	}
+
+	// the bytes of the levels between the two are added or
+	// given back, unless the pool pays for them
+	if (resource.pool < 0)
+	{
+		for (int i = std::min(level, previousLevel); i < std::max(level, previousLevel); i++)
+		{
+			m_residentBytes[resource.type] += (level < previousLevel) ? resource.levelBytes[i] : -resource.levelBytes[i];
+		}
+	}
+
+	if (resource.pool >= 0)
+	{
+		if (previousLevel == resource.fallbackLevel)
+		{
+			m_pools[resource.pool].usedCount++;
+		}
+		else if (level == resource.fallbackLevel)
+		{
+			m_pools[resource.pool].usedCount--;
+		}
+	}
+
+	resource.residentLevel = level;
+}
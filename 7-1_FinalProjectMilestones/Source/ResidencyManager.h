@@ -0,0 +1,137 @@
+///////////////////////////////////////////////////////////////////////////////
+// residencymanager.h
+// ============
+// decide which texture mip levels and mesh levels of detail stay in video
+// memory, streaming the wanted ones in and evicting the least recently used
+// ones to stay within a budget
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <vector>
+
+/***********************************************************
+ *  ResidencyManager
+ *
+ *  This class keeps the residency of every streamed
+ *  resource: a texture or mesh whose levels run from the
+ *  finest, 0, to a fallback level that is always resident
+ *  and never charged to the budget.  Each frame the culling
+ *  requests the finest level it would draw every visible
+ *  resource at, and Update() plans the levels to stream in,
+ *  most blurred first, evicting one level at a time from
+ *  the least recently used resources to make room.  Levels
+ *  drawn this frame are never evicted.  A resource can
+ *  belong to a pool with a fixed number of entries, taken
+ *  while anything above its fallback is resident.  The
+ *  owner allocates a pool whole, out of its own share of
+ *  video memory, so the levels of a pooled resource only
+ *  count against the upload limit and never the budget.
+ *  No OpenGL calls are made - the owner applies the
+ *  planned changes.
+ ***********************************************************/
+class ResidencyManager
+{
+public:
+	// constructor
+	ResidencyManager();
+
+	enum RESOURCE_TYPE
+	{
+		RESOURCE_TEXTURE,
+		RESOURCE_MESH,
+		RESOURCE_TYPE_COUNT
+	};
+
+	// one planned change of the finest resident level of a
+	// resource, applied by the owner in order
+	struct CHANGE
+	{
+		int resource;
+		int previousLevel;
+		int residentLevel;
+	};
+
+	// set the bytes the levels above the fallbacks may take
+	void SetBudget(long long budgetBytes);
+	// get the budget in bytes
+	long long GetBudget() const;
+
+	// forget every resource and pool
+	void Clear();
+	// add a pool of entries the resources share, returning its
+	// index
+	int AddPool(int capacity);
+	// add a resource with the bytes of each level finer than
+	// its fallback, finest first, and the owner's tag - pool
+	// -1 for none.  Returns its index, starting at the fallback
+	int AddResource(RESOURCE_TYPE type, int tag, const std::vector<long long>& levelBytes, int pool);
+
+	// get the number of resources
+	int GetResourceCount() const;
+	// get the type and tag a resource was added with
+	RESOURCE_TYPE GetType(int resource) const;
+	int GetTag(int resource) const;
+	// get the finest resident level of a resource
+	int GetResidentLevel(int resource) const;
+	// get the bytes charged to the budget, in all or by type -
+	// pooled resources are never charged
+	long long GetResidentBytes() const;
+	long long GetResidentBytes(RESOURCE_TYPE type) const;
+
+	// start the requests of a new frame
+	void BeginFrame();
+	// ask for a level of a resource drawn this frame
+	void Request(int resource, int level);
+	// plan the changes of this frame, streaming in at most
+	// uploadBytes beyond the first level
+	void Update(long long uploadBytes, std::vector<CHANGE>& changes);
+	// move a resource back to the level its owner holds, after
+	// a change the owner could not make
+	void RestoreLevel(int resource, int level);
+
+private:
+	struct RESOURCE
+	{
+		RESOURCE_TYPE type;
+		int tag;
+		// bytes of each level finer than the fallback
+		std::vector<long long> levelBytes;
+		// level count of levelBytes, always resident
+		int fallbackLevel;
+		int pool;
+		int residentLevel;
+		// finest level wanted this frame, the fallback for none
+		int requestedLevel;
+		// frame the resource was last requested in
+		unsigned int lastUsedFrame;
+	};
+
+	struct POOL
+	{
+		int capacity;
+		int usedCount;
+	};
+
+	// true when the finest resident level of a resource is
+	// drawn this frame
+	bool IsLevelInUse(const RESOURCE& resource) const;
+	// drop the finest resident level of the least recently used
+	// resource, other than the excluded one
+	bool EvictLevel(int excludedResource, std::vector<CHANGE>& changes);
+	// drop every level of the least recently used resource of a
+	// pool that is not drawn this frame
+	bool EvictPoolEntry(int pool, int excludedResource, std::vector<CHANGE>& changes);
+	// move a resource to a level and record the change
+	void SetResidentLevel(int resource, int level, std::vector<CHANGE>& changes);
+	// move a resource to a level, charging its bytes and pool
+	// entry
+	void ChargeLevel(int resource, int level);
+
+	std::vector<RESOURCE> m_resources;
+	std::vector<POOL> m_pools;
+	long long m_budgetBytes;
+	long long m_residentBytes[RESOURCE_TYPE_COUNT];
+	unsigned int m_frame;
+};
@@ -0,0 +1,333 @@
+///////////////////////////////////////////////////////////////////////////////
+// resolutionscaler.cpp
+// ============
+// render the scene at a lower resolution when the GPU runs over its frame
+// budget and upscale the result to the window
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ResolutionScaler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// defaults of the dynamic resolution options - the budget
+	// leaves room for the CPU side of a 60 Hz frame
+	const double g_DefaultGPUBudgetMilliseconds = 14.0;
+	const float g_DefaultMinScale = 0.5f;
+	// fraction of the budget a new scale aims at
+	const double g_TargetFraction = 0.9;
+	// the scale only rises when the GPU time falls below this
+	// fraction of the budget, so it does not swing back and forth
+	const double g_RaiseFraction = 0.75;
+	// largest rise of the scale at a time - drops are not
+	// limited, so an overloaded GPU recovers at once
+	const float g_MaxScaleRise = 0.05f;
+	// smaller changes of the scale are ignored
+	const float g_MinScaleChange = 0.02f;
+	// weight of a new GPU timing in the smoothed time
+	const double g_GPUTimeSmoothing = 0.25;
+}
+
+/***********************************************************
+ *  ResolutionScaler()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ResolutionScaler::ResolutionScaler() :
+	m_pProfiler(NULL),
+	m_framebuffer(GLObject::OBJECT_FRAMEBUFFER),
+	m_colorTexture(GLObject::OBJECT_TEXTURE),
+	m_depthTexture(GLObject::OBJECT_TEXTURE),
+	m_width(0),
+	m_height(0),
+	m_renderWidth(0),
+	m_renderHeight(0),
+	m_scale(1.0f),
+	m_filteredGPUMilliseconds(-1.0),
+	m_scaleFrame(0),
+	m_sampledFrame(-1),
+	m_bScaledFrame(false)
+{
+	m_settings.bEnabled = false;
+	m_settings.gpuBudgetMilliseconds = g_DefaultGPUBudgetMilliseconds;
+	m_settings.minScale = g_DefaultMinScale;
+}
+
+/***********************************************************
+ *  ~ResolutionScaler()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ResolutionScaler::~ResolutionScaler()
+{
+	DestroyTarget();
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ParseArguments()
+ *
+ *  This method is used for reading the dynamic resolution
+ *  options:
+ *
+ *    --dynamic-resolution          scale to the GPU budget
+ *    --gpu-budget <ms>             default 14
+ *    --min-resolution-scale <0-1>  default 0.5
+ ***********************************************************/
+ResolutionScaler::SETTINGS ResolutionScaler::ParseArguments(int argc, char* argv[])
+{
+	SETTINGS settings;
+	settings.bEnabled = false;
+	settings.gpuBudgetMilliseconds = g_DefaultGPUBudgetMilliseconds;
+	settings.minScale = g_DefaultMinScale;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--dynamic-resolution") == 0)
+		{
+			settings.bEnabled = true;
+		}
+		else if ((strcmp(argv[i], "--gpu-budget") == 0) && (i + 1 < argc))
+		{
+			settings.gpuBudgetMilliseconds = std::max(atof(argv[++i]), 1.0);
+		}
+		else if ((strcmp(argv[i], "--min-resolution-scale") == 0) && (i + 1 < argc))
+		{
+			settings.minScale = std::min(std::max((float)atof(argv[++i]), 0.1f), 1.0f);
+		}
+	}
+
+	return(settings);
+}
+
+/***********************************************************
+ *  Begin()
+ *
+ *  This method is used for starting the scaling at full
+ *  resolution.
+ ***********************************************************/
+void ResolutionScaler::Begin(const SETTINGS& settings)
+{
+	m_settings = settings;
+	m_scale = 1.0f;
+	m_filteredGPUMilliseconds = -1.0;
+	m_scaleFrame = (NULL != m_pProfiler) ? m_pProfiler->GetFrameNumber() : 0;
+	m_sampledFrame = -1;
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler the GPU
+ *  pass timings are read from.
+ ***********************************************************/
+void ResolutionScaler::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for starting a frame at the scale
+ *  the recent GPU timings call for.  The target follows the
+ *  window size, and a frame that cannot have one renders
+ *  at full scale.  It must be called before the frame is
+ *  cleared.
+ ***********************************************************/
+void ResolutionScaler::BeginFrame(int width, int height)
+{
+	m_bScaledFrame = false;
+
+	if (m_settings.bEnabled && (NULL != m_pProfiler))
+	{
+		UpdateScale();
+
+		if ((width != m_width) || (height != m_height))
+		{
+			DestroyTarget();
+			m_width = width;
+			m_height = height;
+			if ((width > 0) && (height > 0) && !CreateTarget(width, height))
+			{
+				std::cout << "Could not create the dynamic resolution target, rendering at full resolution" << std::endl;
+				m_settings.bEnabled = false;
+			}
+		}
+		m_bScaledFrame = m_settings.bEnabled && (m_scale < 1.0f) && (m_framebuffer.Get() != 0);
+	}
+
+	if (m_bScaledFrame)
+	{
+		m_renderWidth = std::max((int)(width * m_scale), 1);
+		m_renderHeight = std::max((int)(height * m_scale), 1);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer.Get());
+	}
+	else
+	{
+		m_renderWidth = width;
+		m_renderHeight = height;
+	}
+	glViewport(0, 0, m_renderWidth, m_renderHeight);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for stretching a scaled frame over
+ *  the window with a filtered blit and putting the window
+ *  framebuffer and viewport back for the overlay.
+ ***********************************************************/
+void ResolutionScaler::EndFrame()
+{
+	if (!m_bScaledFrame)
+	{
+		return;
+	}
+
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer.Get());
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(
+		0, 0, m_renderWidth, m_renderHeight,
+		0, 0, m_width, m_height,
+		GL_COLOR_BUFFER_BIT, GL_LINEAR);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_width, m_height);
+	m_bScaledFrame = false;
+}
+
+/***********************************************************
+ *  GetScale()
+ *
+ *  This method is used for getting the fraction of the
+ *  window size the current frame renders at.
+ ***********************************************************/
+float ResolutionScaler::GetScale() const
+{
+	return(m_bScaledFrame ? m_scale : 1.0f);
+}
+
+/***********************************************************
+ *  CreateTarget()
+ *
+ *  This method is used for allocating the color and depth
+ *  textures of the target at the window size.
+ ***********************************************************/
+bool ResolutionScaler::CreateTarget(int width, int height)
+{
+	// the blit filters the color, and the depth is never read
+	// back, so neither needs mipmaps
+	glBindTexture(GL_TEXTURE_2D, m_colorTexture.Create());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	m_colorTexture.SetByteSize((long long)width * height * 4);
+
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture.Create());
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT24, width, height, 0, GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	m_depthTexture.SetByteSize((long long)width * height * 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer.Create());
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_colorTexture.Get(), 0);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture.Get(), 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		DestroyTarget();
+		return false;
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  DestroyTarget()
+ *
+ *  This method is used for freeing the render target.
+ ***********************************************************/
+void ResolutionScaler::DestroyTarget()
+{
+	m_framebuffer.Reset();
+	m_colorTexture.Reset();
+	m_depthTexture.Reset();
+}
+
+/***********************************************************
+ *  UpdateScale()
+ *
+ *  This method is used for moving the scale toward the GPU
+ *  budget.  The pixel work grows with the rendered area, so
+ *  the GPU time is taken to follow the square of the scale:
+ *  a frame over the budget drops straight to the scale that
+ *  should fit, while a frame well under it rises by a small
+ *  step at a time.  Only frames rendered at the current
+ *  scale are taken in.
+ ***********************************************************/
+void ResolutionScaler::UpdateScale()
+{
+	long long latestFrame = m_pProfiler->GetLatestCompleteFrameNumber();
+
+	if ((latestFrame < m_scaleFrame) || (latestFrame == m_sampledFrame))
+	{
+		return;
+	}
+	m_sampledFrame = latestFrame;
+
+	const FrameProfiler::FRAME_STATS& frame = m_pProfiler->GetLatestFrame();
+	double gpuMilliseconds =
+		std::max(frame.gpuMilliseconds[FrameProfiler::GPU_DEPTH_PREPASS], 0.0) +
+		std::max(frame.gpuMilliseconds[FrameProfiler::GPU_OPAQUE_PASS], 0.0) +
+		std::max(frame.gpuMilliseconds[FrameProfiler::GPU_TRANSPARENT_PASS], 0.0) +
+		std::max(frame.gpuMilliseconds[FrameProfiler::GPU_HIZ_BUILD], 0.0);
+
+	if (m_filteredGPUMilliseconds < 0.0)
+	{
+		m_filteredGPUMilliseconds = gpuMilliseconds;
+	}
+	else
+	{
+		m_filteredGPUMilliseconds += (gpuMilliseconds - m_filteredGPUMilliseconds) * g_GPUTimeSmoothing;
+	}
+
+	double budget = m_settings.gpuBudgetMilliseconds;
+	float scale = m_scale;
+
+	if (m_filteredGPUMilliseconds > budget)
+	{
+		scale = m_scale * (float)sqrt(budget * g_TargetFraction / m_filteredGPUMilliseconds);
+	}
+	else if (m_filteredGPUMilliseconds < budget * g_RaiseFraction)
+	{
+		float fittingScale = (m_filteredGPUMilliseconds > 0.0) ?
+			m_scale * (float)sqrt(budget * g_TargetFraction / m_filteredGPUMilliseconds) : 1.0f;
+		scale = std::min(fittingScale, m_scale + g_MaxScaleRise);
+	}
+	scale = std::min(std::max(scale, m_settings.minScale), 1.0f);
+
+	// reaching full scale always counts, so the copy stops
+	if ((fabsf(scale - m_scale) < g_MinScaleChange) && !((scale == 1.0f) && (m_scale < 1.0f)))
+	{
+		return;
+	}
+
+	// the smoothed time carries over at what the new scale
+	// should cost
+	m_filteredGPUMilliseconds *= (scale * scale) / (m_scale * m_scale);
+	m_scale = scale;
+	m_scaleFrame = m_pProfiler->GetFrameNumber();
+}
@@ -0,0 +1,94 @@
+///////////////////////////////////////////////////////////////////////////////
+// resolutionscaler.h
+// ============
+// render the scene at a lower resolution when the GPU runs over its frame
+// budget and upscale the result to the window
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+
+#include <GL/glew.h>
+
+/***********************************************************
+ *  ResolutionScaler
+ *
+ *  This class scales the resolution the scene is rendered
+ *  at to keep the GPU time of a frame within a budget.  The
+ *  target is allocated at the window size once, and a
+ *  scaled frame renders into the lower left corner of it,
+ *  so a change of scale never reallocates anything.  The
+ *  corner is stretched over the window with a filtered
+ *  blit.  While the GPU keeps up at full scale the scene
+ *  renders straight into the window with no extra copy.
+ *  The GPU timings arrive frames late, so the scale is only
+ *  changed again once a frame rendered at the current scale
+ *  has been timed.
+ ***********************************************************/
+class ResolutionScaler
+{
+public:
+	// dynamic resolution options
+	struct SETTINGS
+	{
+		bool bEnabled;
+		// GPU time a frame should stay within, in milliseconds
+		double gpuBudgetMilliseconds;
+		// smallest fraction of the window size rendered
+		float minScale;
+	};
+
+	// constructor
+	ResolutionScaler();
+	// destructor
+	~ResolutionScaler();
+
+	// read the dynamic resolution options from the command line
+	static SETTINGS ParseArguments(int argc, char* argv[]);
+
+	// start scaling with the passed in options
+	void Begin(const SETTINGS& settings);
+	// set the profiler the GPU timings are read from
+	void SetProfiler(FrameProfiler* pProfiler);
+
+	// pick the scale of the frame, bind its render target and
+	// set the viewport - the size is that of the window
+	void BeginFrame(int width, int height);
+	// upscale a scaled frame into the window
+	void EndFrame();
+
+	// get the fraction of the window size rendered this frame
+	float GetScale() const;
+
+private:
+	// allocate the render target at the window size
+	bool CreateTarget(int width, int height);
+	// free the render target
+	void DestroyTarget();
+	// move the scale toward the GPU budget
+	void UpdateScale();
+
+	SETTINGS m_settings;
+	FrameProfiler* m_pProfiler;
+	GLObject m_framebuffer;
+	GLObject m_colorTexture;
+	GLObject m_depthTexture;
+	// size of the window and of the target
+	int m_width;
+	int m_height;
+	// size rendered this frame
+	int m_renderWidth;
+	int m_renderHeight;
+	float m_scale;
+	// smoothed GPU time of recent frames, -1 before the first
+	double m_filteredGPUMilliseconds;
+	// first profiler frame rendered at the current scale
+	long long m_scaleFrame;
+	// last profiler frame whose GPU time was taken in
+	long long m_sampledFrame;
+	// true while the frame renders into the target
+	bool m_bScaledFrame;
+};
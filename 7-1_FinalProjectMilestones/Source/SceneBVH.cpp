@@ -0,0 +1,535 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebvh.cpp
+// ============
+// keep the scene objects in a bounding volume hierarchy and find the ones
+// inside the view frustum
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneBVH.h"
+
+#include <algorithm>
+#include <cmath>
+
+// x64 and the default x86 MSVC target both have SSE2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SCENE_BVH_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	// deepest tree walked by Cull() - median splits of a
+	// million items stay far below this
+	const int g_MaxTraversalDepth = 64;
+}
+
+/***********************************************************
+ *  SceneBVH()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneBVH::SceneBVH()
+{
+}
+
+/***********************************************************
+ *  Build()
+ *
+ *  This method is used for building the tree over the
+ *  passed in item bounds.  The item indices are the indices
+ *  of the bounds in the vector.
+ ***********************************************************/
+void SceneBVH::Build(const std::vector<BOUNDS>& itemBounds)
+{
+	int itemCount = (int)itemBounds.size();
+
+	m_itemBounds = itemBounds;
+	m_itemOrder.resize(itemCount);
+	m_itemLeaves.assign(itemCount, -1);
+	m_nodes.clear();
+
+	if (itemCount == 0)
+	{
+		return;
+	}
+
+	for (int i = 0; i < itemCount; i++)
+	{
+		m_itemOrder[i] = i;
+	}
+
+	// a tree with leaves of at least half the maximum size
+	m_nodes.reserve(4 * (itemCount / MAX_LEAF_ITEMS + 1));
+
+	TREE_NODE root;
+	root.parent = -1;
+	root.firstChild = -1;
+	root.firstItem = 0;
+	root.itemCount = itemCount;
+	m_nodes.push_back(root);
+
+	BuildNode(0, 0, itemCount);
+}
+
+/***********************************************************
+ *  BuildNode()
+ *
+ *  This method is used for building the subtree of a range
+ *  of the item order.  The range is split at the median of
+ *  the item centers along its longest axis.
+ ***********************************************************/
+void SceneBVH::BuildNode(int nodeIndex, int firstItem, int itemCount)
+{
+	BOUNDS bounds = m_itemBounds[m_itemOrder[firstItem]];
+	glm::vec3 centerMinimum = (bounds.minimum + bounds.maximum) * 0.5f;
+	glm::vec3 centerMaximum = centerMinimum;
+
+	for (int i = firstItem + 1; i < firstItem + itemCount; i++)
+	{
+		const BOUNDS& item = m_itemBounds[m_itemOrder[i]];
+		glm::vec3 center = (item.minimum + item.maximum) * 0.5f;
+
+		bounds.minimum = glm::min(bounds.minimum, item.minimum);
+		bounds.maximum = glm::max(bounds.maximum, item.maximum);
+		centerMinimum = glm::min(centerMinimum, center);
+		centerMaximum = glm::max(centerMaximum, center);
+	}
+	m_nodes[nodeIndex].bounds = bounds;
+
+	if (itemCount <= MAX_LEAF_ITEMS)
+	{
+		for (int i = firstItem; i < firstItem + itemCount; i++)
+		{
+			m_itemLeaves[m_itemOrder[i]] = nodeIndex;
+		}
+		return;
+	}
+
+	glm::vec3 centerExtent = centerMaximum - centerMinimum;
+	int axis = 0;
+	if (centerExtent.y > centerExtent[axis])
+	{
+		axis = 1;
+	}
+	if (centerExtent.z > centerExtent[axis])
+	{
+		axis = 2;
+	}
+
+	// only the median has to be in place, not the full order
+	int leftCount = itemCount / 2;
+	std::nth_element(
+		m_itemOrder.begin() + firstItem,
+		m_itemOrder.begin() + firstItem + leftCount,
+		m_itemOrder.begin() + firstItem + itemCount,
+		[this, axis](int left, int right)
+		{
+			return((m_itemBounds[left].minimum[axis] + m_itemBounds[left].maximum[axis]) <
+				(m_itemBounds[right].minimum[axis] + m_itemBounds[right].maximum[axis]));
+		});
+
+	int firstChild = (int)m_nodes.size();
+	TREE_NODE child;
+	child.parent = nodeIndex;
+	child.firstChild = -1;
+	child.firstItem = firstItem;
+	child.itemCount = leftCount;
+	m_nodes.push_back(child);
+	child.firstItem = firstItem + leftCount;
+	child.itemCount = itemCount - leftCount;
+	m_nodes.push_back(child);
+
+	// the push may have moved the nodes, so the parent is looked
+	// up again rather than held by reference
+	m_nodes[nodeIndex].firstChild = firstChild;
+
+	BuildNode(firstChild, firstItem, leftCount);
+	BuildNode(firstChild + 1, firstItem + leftCount, itemCount - leftCount);
+}
+
+/***********************************************************
+ *  UpdateItem()
+ *
+ *  This method is used for changing the bounds of an item
+ *  that moved.  The tree is not rebuilt; only the leaf of
+ *  the item and its ancestors are refit, so the cost grows
+ *  with the depth of the tree rather than the item count.
+ ***********************************************************/
+void SceneBVH::UpdateItem(int item, const BOUNDS& bounds)
+{
+	if ((item < 0) || (item >= (int)m_itemBounds.size()))
+	{
+		return;
+	}
+
+	m_itemBounds[item] = bounds;
+
+	for (int nodeIndex = m_itemLeaves[item]; nodeIndex >= 0; nodeIndex = m_nodes[nodeIndex].parent)
+	{
+		RefitNode(nodeIndex);
+	}
+}
+
+/***********************************************************
+ *  RefitNode()
+ *
+ *  This method is used for recomputing the bounds of a node
+ *  from the bounds of its children, or of its items for a
+ *  leaf.
+ ***********************************************************/
+void SceneBVH::RefitNode(int nodeIndex)
+{
+	TREE_NODE& node = m_nodes[nodeIndex];
+
+	if (node.firstChild >= 0)
+	{
+		const BOUNDS& left = m_nodes[node.firstChild].bounds;
+		const BOUNDS& right = m_nodes[node.firstChild + 1].bounds;
+
+		node.bounds.minimum = glm::min(left.minimum, right.minimum);
+		node.bounds.maximum = glm::max(left.maximum, right.maximum);
+		return;
+	}
+
+	node.bounds = m_itemBounds[m_itemOrder[node.firstItem]];
+	for (int i = node.firstItem + 1; i < node.firstItem + node.itemCount; i++)
+	{
+		const BOUNDS& item = m_itemBounds[m_itemOrder[i]];
+
+		node.bounds.minimum = glm::min(node.bounds.minimum, item.minimum);
+		node.bounds.maximum = glm::max(node.bounds.maximum, item.maximum);
+	}
+}
+
+/***********************************************************
+ *  Cull()
+ *
+ *  This method is used for collecting the items whose
+ *  bounds are at least partly inside the frustum of the
+ *  passed in view projection matrix.  Subtrees outside the
+ *  frustum are skipped and subtrees fully inside it are
+ *  added without further tests.  The visible items are
+ *  added in tree order, not item order.
+ ***********************************************************/
+void SceneBVH::Cull(const glm::mat4& viewProjection, std::vector<int>& visibleItems) const
+{
+	visibleItems.clear();
+
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	FRUSTUM frustum;
+	ExtractFrustum(viewProjection, frustum);
+
+	CullNode(frustum, 0, visibleItems);
+}
+
+/***********************************************************
+ *  GetSubtrees()
+ *
+ *  This method is used for splitting the tree into about
+ *  the passed in number of subtrees, breadth first, so they
+ *  hold similar numbers of items.  Leaves reached before
+ *  the count are kept whole.
+ ***********************************************************/
+void SceneBVH::GetSubtrees(int count, std::vector<int>& subtreeRoots) const
+{
+	subtreeRoots.clear();
+
+	if (m_nodes.empty())
+	{
+		return;
+	}
+
+	// inner nodes still to split, oldest first
+	std::vector<int> pending(1, 0);
+	size_t next = 0;
+
+	while ((next < pending.size()) && ((int)(pending.size() - next + subtreeRoots.size()) < count))
+	{
+		const TREE_NODE& node = m_nodes[pending[next++]];
+
+		if (node.firstChild < 0)
+		{
+			subtreeRoots.push_back(pending[next - 1]);
+			continue;
+		}
+		pending.push_back(node.firstChild);
+		pending.push_back(node.firstChild + 1);
+	}
+	subtreeRoots.insert(subtreeRoots.end(), pending.begin() + next, pending.end());
+}
+
+/***********************************************************
+ *  CullSubtree()
+ *
+ *  This method is used for adding the visible items of one
+ *  subtree to a list.  The ancestors of the subtree are not
+ *  tested, which gives the same items as Cull() since each
+ *  node lies inside its parent.
+ ***********************************************************/
+void SceneBVH::CullSubtree(const glm::mat4& viewProjection, int subtreeRoot, std::vector<int>& visibleItems) const
+{
+	if ((subtreeRoot < 0) || (subtreeRoot >= (int)m_nodes.size()))
+	{
+		return;
+	}
+
+	FRUSTUM frustum;
+	ExtractFrustum(viewProjection, frustum);
+
+	CullNode(frustum, subtreeRoot, visibleItems);
+}
+
+/***********************************************************
+ *  CullNode()
+ *
+ *  This method is used for walking the subtree of a node
+ *  with an explicit stack.  Subtrees outside the frustum
+ *  are skipped and subtrees fully inside it are added
+ *  without further tests.
+ ***********************************************************/
+void SceneBVH::CullNode(const FRUSTUM& frustum, int nodeIndex, std::vector<int>& visibleItems) const
+{
+	int stack[g_MaxTraversalDepth];
+	int stackSize = 0;
+	stack[stackSize++] = nodeIndex;
+
+	while (stackSize > 0)
+	{
+		const TREE_NODE& node = m_nodes[stack[--stackSize]];
+		TEST_RESULT result = TestBounds(frustum, node.bounds);
+
+		if (result == TEST_OUTSIDE)
+		{
+			continue;
+		}
+
+		if (result == TEST_INSIDE)
+		{
+			visibleItems.insert(visibleItems.end(),
+				m_itemOrder.begin() + node.firstItem,
+				m_itemOrder.begin() + node.firstItem + node.itemCount);
+			continue;
+		}
+
+		if ((node.firstChild >= 0) && (stackSize + 2 <= g_MaxTraversalDepth))
+		{
+			stack[stackSize++] = node.firstChild + 1;
+			stack[stackSize++] = node.firstChild;
+			continue;
+		}
+
+		// a leaf crossing the frustum tests its items one by one
+		for (int i = node.firstItem; i < node.firstItem + node.itemCount; i++)
+		{
+			int item = m_itemOrder[i];
+
+			if (TestBounds(frustum, m_itemBounds[item]) != TEST_OUTSIDE)
+			{
+				visibleItems.push_back(item);
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  GetItemCount()
+ *
+ *  This method is used for getting the number of items the
+ *  tree was built over.
+ ***********************************************************/
+int SceneBVH::GetItemCount() const
+{
+	return((int)m_itemBounds.size());
+}
+
+/***********************************************************
+ *  GetBounds()
+ *
+ *  This method is used for getting the bounds of the whole
+ *  tree, which the refits keep up to date.  An empty tree
+ *  passes back false.
+ ***********************************************************/
+bool SceneBVH::GetBounds(BOUNDS& bounds) const
+{
+	if (m_itemBounds.empty() || m_nodes.empty())
+	{
+		return false;
+	}
+
+	bounds = m_nodes[0].bounds;
+	return true;
+}
+
+/***********************************************************
+ *  TransformBounds()
+ *
+ *  This method is used for getting the world space box that
+ *  encloses a local box after a transformation.  The box
+ *  center is transformed and the half extents are spread
+ *  over the axes by the absolute matrix values.
+ ***********************************************************/
+SceneBVH::BOUNDS SceneBVH::TransformBounds(const BOUNDS& bounds, const glm::mat4& transform)
+{
+	glm::vec3 center = (bounds.minimum + bounds.maximum) * 0.5f;
+	glm::vec3 extent = (bounds.maximum - bounds.minimum) * 0.5f;
+
+	glm::vec3 worldCenter = glm::vec3(transform * glm::vec4(center, 1.0f));
+	glm::vec3 worldExtent =
+		glm::abs(glm::vec3(transform[0])) * extent.x +
+		glm::abs(glm::vec3(transform[1])) * extent.y +
+		glm::abs(glm::vec3(transform[2])) * extent.z;
+
+	BOUNDS worldBounds;
+	worldBounds.minimum = worldCenter - worldExtent;
+	worldBounds.maximum = worldCenter + worldExtent;
+
+	return(worldBounds);
+}
+
+/***********************************************************
+ *  GetFrustumPlanes()
+ *
+ *  This method is used for extracting the six frustum
+ *  planes from the rows of a view projection matrix, in
+ *  left, right, bottom, top, near, far order.  The planes
+ *  face inwards and are normalized, so a positive distance
+ *  is inside.
+ ***********************************************************/
+void SceneBVH::GetFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6])
+{
+	// glm matrices are column major, so a row is gathered
+	// from the same component of every column
+	glm::vec4 rows[4];
+	for (int row = 0; row < 4; row++)
+	{
+		rows[row] = glm::vec4(
+			viewProjection[0][row],
+			viewProjection[1][row],
+			viewProjection[2][row],
+			viewProjection[3][row]);
+	}
+
+	planes[0] = rows[3] + rows[0];	// left
+	planes[1] = rows[3] - rows[0];	// right
+	planes[2] = rows[3] + rows[1];	// bottom
+	planes[3] = rows[3] - rows[1];	// top
+	planes[4] = rows[3] + rows[2];	// near
+	planes[5] = rows[3] - rows[2];	// far
+
+	for (int i = 0; i < 6; i++)
+	{
+		float length = glm::length(glm::vec3(planes[i]));
+		if (length > 0.0f)
+		{
+			planes[i] = planes[i] / length;
+		}
+	}
+}
+
+/***********************************************************
+ *  ExtractFrustum()
+ *
+ *  This method is used for storing the frustum planes of a
+ *  view projection matrix in the SIMD friendly layout.
+ ***********************************************************/
+void SceneBVH::ExtractFrustum(const glm::mat4& viewProjection, FRUSTUM& frustum)
+{
+	glm::vec4 planes[6];
+	GetFrustumPlanes(viewProjection, planes);
+
+	for (int i = 0; i < 8; i++)
+	{
+		// the padding planes keep every box inside
+		glm::vec4 plane = (i < 6) ? planes[i] : glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+
+		frustum.normalX[i] = plane.x;
+		frustum.normalY[i] = plane.y;
+		frustum.normalZ[i] = plane.z;
+		frustum.absNormalX[i] = std::fabs(plane.x);
+		frustum.absNormalY[i] = std::fabs(plane.y);
+		frustum.absNormalZ[i] = std::fabs(plane.z);
+		frustum.distance[i] = plane.w;
+	}
+}
+
+/***********************************************************
+ *  TestBounds()
+ *
+ *  This method is used for testing a box against the
+ *  frustum planes.  The box is outside when it is fully
+ *  behind any plane, and inside when it is fully in front
+ *  of every plane.
+ ***********************************************************/
+SceneBVH::TEST_RESULT SceneBVH::TestBounds(const FRUSTUM& frustum, const BOUNDS& bounds)
+{
+	glm::vec3 center = (bounds.minimum + bounds.maximum) * 0.5f;
+	glm::vec3 extent = (bounds.maximum - bounds.minimum) * 0.5f;
+	bool bIntersecting = false;
+
+#ifdef SCENE_BVH_USE_SSE
+	__m128 centerX = _mm_set1_ps(center.x);
+	__m128 centerY = _mm_set1_ps(center.y);
+	__m128 centerZ = _mm_set1_ps(center.z);
+	__m128 extentX = _mm_set1_ps(extent.x);
+	__m128 extentY = _mm_set1_ps(extent.y);
+	__m128 extentZ = _mm_set1_ps(extent.z);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int i = 0; i < 8; i += 4)
+	{
+		// signed distance of the box center from four planes
+		__m128 distance = _mm_add_ps(
+			_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(&frustum.normalX[i]), centerX),
+				_mm_mul_ps(_mm_load_ps(&frustum.normalY[i]), centerY)),
+			_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(&frustum.normalZ[i]), centerZ),
+				_mm_load_ps(&frustum.distance[i])));
+		// projected half size of the box onto the four normals
+		__m128 radius = _mm_add_ps(
+			_mm_add_ps(
+				_mm_mul_ps(_mm_load_ps(&frustum.absNormalX[i]), extentX),
+				_mm_mul_ps(_mm_load_ps(&frustum.absNormalY[i]), extentY)),
+			_mm_mul_ps(_mm_load_ps(&frustum.absNormalZ[i]), extentZ));
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) != 0)
+		{
+			return(TEST_OUTSIDE);
+		}
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, radius), zero)) != 0)
+		{
+			bIntersecting = true;
+		}
+	}
+#else
+	for (int i = 0; i < 6; i++)
+	{
+		float distance =
+			frustum.normalX[i] * center.x +
+			frustum.normalY[i] * center.y +
+			frustum.normalZ[i] * center.z +
+			frustum.distance[i];
+		float radius =
+			frustum.absNormalX[i] * extent.x +
+			frustum.absNormalY[i] * extent.y +
+			frustum.absNormalZ[i] * extent.z;
+
+		if (distance + radius < 0.0f)
+		{
+			return(TEST_OUTSIDE);
+		}
+		if (distance - radius < 0.0f)
+		{
+			bIntersecting = true;
+		}
+	}
+#endif
+
+	return(bIntersecting ? TEST_INTERSECTING : TEST_INSIDE);
+}
@@ -0,0 +1,121 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenebvh.h
+// ============
+// keep the scene objects in a bounding volume hierarchy and find the ones
+// inside the view frustum
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  SceneBVH
+ *
+ *  This class holds the world space bounding boxes of the
+ *  scene objects in a binary tree built by median splits.
+ *  Every tree node covers a contiguous range of the sorted
+ *  items, so a node found fully inside the frustum adds its
+ *  items without testing them.  Items that move are refit
+ *  in place, walking from their leaf up to the root.  The
+ *  tree can be split into subtrees that are culled on
+ *  separate threads, since culling only reads it.  The
+ *  box against frustum plane tests run four planes at a
+ *  time with SSE when it is available.
+ ***********************************************************/
+class SceneBVH
+{
+public:
+	// constructor
+	SceneBVH();
+
+	// axis aligned bounding box
+	struct BOUNDS
+	{
+		glm::vec3 minimum;
+		glm::vec3 maximum;
+	};
+
+	// most items kept in one leaf
+	static const int MAX_LEAF_ITEMS = 4;
+
+	// build the tree over the bounds of every item
+	void Build(const std::vector<BOUNDS>& itemBounds);
+	// change the bounds of one item and refit its ancestors
+	void UpdateItem(int item, const BOUNDS& bounds);
+	// find the items that intersect the view frustum
+	void Cull(const glm::mat4& viewProjection, std::vector<int>& visibleItems) const;
+	// split the tree into about count subtrees that together
+	// hold every item, for culling them on several threads
+	void GetSubtrees(int count, std::vector<int>& subtreeRoots) const;
+	// find the items of one subtree that intersect the view
+	// frustum, adding them to the list
+	void CullSubtree(const glm::mat4& viewProjection, int subtreeRoot, std::vector<int>& visibleItems) const;
+	// get the number of items in the tree
+	int GetItemCount() const;
+	// get the bounds of every item in the tree - false when
+	// the tree is empty
+	bool GetBounds(BOUNDS& bounds) const;
+
+	// get the world space bounds of transformed local bounds
+	static BOUNDS TransformBounds(const BOUNDS& bounds, const glm::mat4& transform);
+	// get the six normalized, inward facing frustum planes
+	static void GetFrustumPlanes(const glm::mat4& viewProjection, glm::vec4 planes[6]);
+
+private:
+	// one tree node - the children of an inner node are
+	// stored next to each other
+	struct TREE_NODE
+	{
+		BOUNDS bounds;
+		int parent;
+		// first child, -1 for a leaf
+		int firstChild;
+		// range of m_itemOrder covered by the node
+		int firstItem;
+		int itemCount;
+	};
+
+	// frustum planes in SIMD friendly order, padded to 8 with
+	// planes that every box is inside of
+	struct FRUSTUM
+	{
+		alignas(16) float normalX[8];
+		alignas(16) float normalY[8];
+		alignas(16) float normalZ[8];
+		alignas(16) float absNormalX[8];
+		alignas(16) float absNormalY[8];
+		alignas(16) float absNormalZ[8];
+		alignas(16) float distance[8];
+	};
+
+	// result of testing a box against the frustum
+	enum TEST_RESULT
+	{
+		TEST_OUTSIDE,
+		TEST_INTERSECTING,
+		TEST_INSIDE
+	};
+
+	// build the subtree of a range of m_itemOrder
+	void BuildNode(int nodeIndex, int firstItem, int itemCount);
+	// recompute the bounds of a node from its children or items
+	void RefitNode(int nodeIndex);
+	// add the visible items below a node to the list
+	void CullNode(const FRUSTUM& frustum, int nodeIndex, std::vector<int>& visibleItems) const;
+	// extract the normalized frustum planes of a matrix
+	static void ExtractFrustum(const glm::mat4& viewProjection, FRUSTUM& frustum);
+	// test a box against every frustum plane
+	static TEST_RESULT TestBounds(const FRUSTUM& frustum, const BOUNDS& bounds);
+
+	std::vector<TREE_NODE> m_nodes;
+	// bounds of each item, by item index
+	std::vector<BOUNDS> m_itemBounds;
+	// item indices, ordered so that every node covers a range
+	std::vector<int> m_itemOrder;
+	// leaf node holding each item
+	std::vector<int> m_itemLeaves;
+};
@@ -0,0 +1,1156 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.cpp
+// ============
+// load the textures, materials, lights and nodes of a scene from its JSON
+// file, through a binary form of it that is memory mapped on later launches
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneFile.h"
+
+#include <sys/stat.h>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <utility>
+
+// names of the meshes in the JSON file
+const char* const SceneFile::MESH_NAMES[SceneFile::MESH_NAME_COUNT] =
+{
+	"box",
+	"cone",
+	"cylinder",
+	"plane",
+	"pyramid3",
+	"taperedCylinder"
+};
+
+// declaration of global variables
+namespace
+{
+	// binary file layout values
+	const char g_BinaryMagic[4] = { 'S', 'C', 'N', 'B' };
+	// bump to invalidate the binary files after a layout change
+	const uint32_t g_BinaryVersion = 2;
+	// file name extensions of the source and binary files
+	const char* const g_JSONExtension = ".json";
+	const char* const g_BinaryExtension = ".scenebin";
+
+	// parsed JSON value, a tree of objects and arrays
+	struct JSON_VALUE
+	{
+		enum VALUE_TYPE
+		{
+			JSON_NULL,
+			JSON_BOOL,
+			JSON_NUMBER,
+			JSON_STRING,
+			JSON_ARRAY,
+			JSON_OBJECT
+		};
+
+		VALUE_TYPE type;
+		double number;
+		std::string text;
+		std::vector<JSON_VALUE> items;
+		std::vector<std::pair<std::string, JSON_VALUE> > members;
+		// line the value starts on, for error messages
+		int line;
+	};
+
+	// position of the parser in the JSON text
+	struct JSON_PARSER
+	{
+		const char* pCurrent;
+		const char* pEnd;
+		int line;
+		std::string error;
+	};
+
+	bool ParseValue(JSON_PARSER& parser, JSON_VALUE& value);
+
+	/***********************************************************
+	 *  Fail()
+	 *
+	 *  Record a parse error at the current line, keeping the
+	 *  first one.
+	 ***********************************************************/
+	bool Fail(JSON_PARSER& parser, const char* message)
+	{
+		if (parser.error.empty())
+		{
+			std::ostringstream error;
+			error << "line " << parser.line << ": " << message;
+			parser.error = error.str();
+		}
+		return(false);
+	}
+
+	/***********************************************************
+	 *  SkipSpace()
+	 *
+	 *  Step over white space, counting the lines.
+	 ***********************************************************/
+	void SkipSpace(JSON_PARSER& parser)
+	{
+		while (parser.pCurrent < parser.pEnd)
+		{
+			char c = *parser.pCurrent;
+			if (c == '\n')
+			{
+				parser.line++;
+			}
+			else if (c != ' ' && c != '\t' && c != '\r')
+			{
+				break;
+			}
+			parser.pCurrent++;
+		}
+	}
+
+	/***********************************************************
+	 *  ParseString()
+	 *
+	 *  Parse a quoted string.  Escaped characters outside of
+	 *  ASCII are not needed by scene files and are rejected.
+	 ***********************************************************/
+	bool ParseString(JSON_PARSER& parser, std::string& text)
+	{
+		text.clear();
+		parser.pCurrent++;
+		while (parser.pCurrent < parser.pEnd)
+		{
+			char c = *parser.pCurrent++;
+			if (c == '"')
+			{
+				return(true);
+			}
+			if (c == '\n')
+			{
+				return(Fail(parser, "unterminated string"));
+			}
+			if (c == '\\')
+			{
+				if (parser.pCurrent >= parser.pEnd)
+				{
+					break;
+				}
+				c = *parser.pCurrent++;
+				switch (c)
+				{
+				case '"':
+				case '\\':
+				case '/':
+					break;
+				case 'n':
+					c = '\n';
+					break;
+				case 't':
+					c = '\t';
+					break;
+				case 'r':
+					c = '\r';
+					break;
+				case 'b':
+					c = '\b';
+					break;
+				case 'f':
+					c = '\f';
+					break;
+				default:
+					return(Fail(parser, "unsupported escape in string"));
+				}
+			}
+			text += c;
+		}
+		return(Fail(parser, "unterminated string"));
+	}
+
+	/***********************************************************
+	 *  ParseNumber()
+	 *
+	 *  Parse a number.  The text is zero terminated, so strtod
+	 *  cannot read past its end.
+	 ***********************************************************/
+	bool ParseNumber(JSON_PARSER& parser, JSON_VALUE& value)
+	{
+		char* pNumberEnd = NULL;
+
+		value.type = JSON_VALUE::JSON_NUMBER;
+		value.number = strtod(parser.pCurrent, &pNumberEnd);
+		if (pNumberEnd == parser.pCurrent || pNumberEnd > parser.pEnd)
+		{
+			return(Fail(parser, "invalid number"));
+		}
+		parser.pCurrent = pNumberEnd;
+		return(true);
+	}
+
+	/***********************************************************
+	 *  ParseArray()
+	 *
+	 *  Parse the items of an array.
+	 ***********************************************************/
+	bool ParseArray(JSON_PARSER& parser, JSON_VALUE& value)
+	{
+		value.type = JSON_VALUE::JSON_ARRAY;
+		parser.pCurrent++;
+		SkipSpace(parser);
+		if (parser.pCurrent < parser.pEnd && *parser.pCurrent == ']')
+		{
+			parser.pCurrent++;
+			return(true);
+		}
+
+		while (true)
+		{
+			value.items.push_back(JSON_VALUE());
+			if (!ParseValue(parser, value.items.back()))
+			{
+				return(false);
+			}
+			SkipSpace(parser);
+			if (parser.pCurrent >= parser.pEnd)
+			{
+				return(Fail(parser, "unterminated array"));
+			}
+			char c = *parser.pCurrent++;
+			if (c == ']')
+			{
+				return(true);
+			}
+			if (c != ',')
+			{
+				return(Fail(parser, "expected ',' or ']' in array"));
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  ParseObject()
+	 *
+	 *  Parse the members of an object, keeping their order.
+	 ***********************************************************/
+	bool ParseObject(JSON_PARSER& parser, JSON_VALUE& value)
+	{
+		value.type = JSON_VALUE::JSON_OBJECT;
+		parser.pCurrent++;
+		SkipSpace(parser);
+		if (parser.pCurrent < parser.pEnd && *parser.pCurrent == '}')
+		{
+			parser.pCurrent++;
+			return(true);
+		}
+
+		while (true)
+		{
+			SkipSpace(parser);
+			if (parser.pCurrent >= parser.pEnd || *parser.pCurrent != '"')
+			{
+				return(Fail(parser, "expected a member name"));
+			}
+			value.members.push_back(std::make_pair(std::string(), JSON_VALUE()));
+			if (!ParseString(parser, value.members.back().first))
+			{
+				return(false);
+			}
+			SkipSpace(parser);
+			if (parser.pCurrent >= parser.pEnd || *parser.pCurrent != ':')
+			{
+				return(Fail(parser, "expected ':' after a member name"));
+			}
+			parser.pCurrent++;
+			if (!ParseValue(parser, value.members.back().second))
+			{
+				return(false);
+			}
+			SkipSpace(parser);
+			if (parser.pCurrent >= parser.pEnd)
+			{
+				return(Fail(parser, "unterminated object"));
+			}
+			char c = *parser.pCurrent++;
+			if (c == '}')
+			{
+				return(true);
+			}
+			if (c != ',')
+			{
+				return(Fail(parser, "expected ',' or '}' in object"));
+			}
+		}
+	}
+
+	/***********************************************************
+	 *  ParseLiteral()
+	 *
+	 *  Match one of the keywords true, false or null.
+	 ***********************************************************/
+	bool ParseLiteral(JSON_PARSER& parser, const char* literal)
+	{
+		size_t length = strlen(literal);
+
+		if ((size_t)(parser.pEnd - parser.pCurrent) < length ||
+			strncmp(parser.pCurrent, literal, length) != 0)
+		{
+			return(Fail(parser, "unexpected character"));
+		}
+		parser.pCurrent += length;
+		return(true);
+	}
+
+	/***********************************************************
+	 *  ParseValue()
+	 *
+	 *  Parse any JSON value.
+	 ***********************************************************/
+	bool ParseValue(JSON_PARSER& parser, JSON_VALUE& value)
+	{
+		value.type = JSON_VALUE::JSON_NULL;
+		value.number = 0.0;
+
+		SkipSpace(parser);
+		value.line = parser.line;
+		if (parser.pCurrent >= parser.pEnd)
+		{
+			return(Fail(parser, "unexpected end of file"));
+		}
+
+		char c = *parser.pCurrent;
+		if (c == '{')
+		{
+			return(ParseObject(parser, value));
+		}
+		if (c == '[')
+		{
+			return(ParseArray(parser, value));
+		}
+		if (c == '"')
+		{
+			value.type = JSON_VALUE::JSON_STRING;
+			return(ParseString(parser, value.text));
+		}
+		if (c == 't' || c == 'f')
+		{
+			value.type = JSON_VALUE::JSON_BOOL;
+			value.number = (c == 't') ? 1.0 : 0.0;
+			return(ParseLiteral(parser, (c == 't') ? "true" : "false"));
+		}
+		if (c == 'n')
+		{
+			return(ParseLiteral(parser, "null"));
+		}
+		return(ParseNumber(parser, value));
+	}
+
+	/***********************************************************
+	 *  FindMember()
+	 *
+	 *  Find a member of an object by name, NULL when missing.
+	 ***********************************************************/
+	const JSON_VALUE* FindMember(const JSON_VALUE& object, const char* name)
+	{
+		for (size_t i = 0; i < object.members.size(); i++)
+		{
+			if (object.members[i].first == name)
+			{
+				return(&object.members[i].second);
+			}
+		}
+		return(NULL);
+	}
+
+	/***********************************************************
+	 *  ReportError()
+	 *
+	 *  Print an error found in a scene file.
+	 ***********************************************************/
+	bool ReportError(const std::string& filename, int line, const std::string& message)
+	{
+		std::cout << "Scene file " << filename << " line " << line << ": " << message << std::endl;
+		return(false);
+	}
+
+	/***********************************************************
+	 *  ReadFloats()
+	 *
+	 *  Read a number, or an array of numbers, member into the
+	 *  passed in floats.  A missing member keeps the values
+	 *  they already hold.
+	 ***********************************************************/
+	bool ReadFloats(
+		const std::string& filename,
+		const JSON_VALUE& object,
+		const char* name,
+		float* values,
+		int count)
+	{
+		const JSON_VALUE* pMember = FindMember(object, name);
+
+		if (pMember == NULL)
+		{
+			return(true);
+		}
+		if (count == 1 && pMember->type == JSON_VALUE::JSON_NUMBER)
+		{
+			values[0] = (float)pMember->number;
+			return(true);
+		}
+		if (pMember->type != JSON_VALUE::JSON_ARRAY || (int)pMember->items.size() != count)
+		{
+			return(ReportError(filename, pMember->line,
+				std::string("'") + name + "' must have " + std::to_string(count) + " numbers"));
+		}
+		for (int i = 0; i < count; i++)
+		{
+			if (pMember->items[i].type != JSON_VALUE::JSON_NUMBER)
+			{
+				return(ReportError(filename, pMember->line,
+					std::string("'") + name + "' must only hold numbers"));
+			}
+			values[i] = (float)pMember->items[i].number;
+		}
+		return(true);
+	}
+
+	/***********************************************************
+	 *  ReadText()
+	 *
+	 *  Read a string member into a fixed size field.
+	 ***********************************************************/
+	bool ReadText(
+		const std::string& filename,
+		const JSON_VALUE& object,
+		const char* name,
+		char* text,
+		size_t capacity)
+	{
+		const JSON_VALUE* pMember = FindMember(object, name);
+
+		if (pMember == NULL || pMember->type != JSON_VALUE::JSON_STRING)
+		{
+			return(ReportError(filename, object.line, std::string("'") + name + "' must be a string"));
+		}
+		if (pMember->text.empty() || pMember->text.size() >= capacity)
+		{
+			return(ReportError(filename, pMember->line,
+				std::string("'") + name + "' must have 1 to " + std::to_string(capacity - 1) + " characters"));
+		}
+		memset(text, 0, capacity);
+		memcpy(text, pMember->text.c_str(), pMember->text.size());
+		return(true);
+	}
+
+	/***********************************************************
+	 *  IsTerminated()
+	 *
+	 *  Check that a fixed size text field of a binary image
+	 *  ends within its size.
+	 ***********************************************************/
+	bool IsTerminated(const char* text, size_t capacity)
+	{
+		return(memchr(text, '\0', capacity) != NULL);
+	}
+
+	/***********************************************************
+	 *  GetArray()
+	 *
+	 *  Get an array member of the scene, NULL when it is
+	 *  missing or of the wrong type.
+	 ***********************************************************/
+	const JSON_VALUE* GetArray(const std::string& filename, const JSON_VALUE& scene, const char* name)
+	{
+		const JSON_VALUE* pMember = FindMember(scene, name);
+
+		if (pMember != NULL && pMember->type != JSON_VALUE::JSON_ARRAY)
+		{
+			ReportError(filename, pMember->line, std::string("'") + name + "' must be an array");
+			return(NULL);
+		}
+		return(pMember);
+	}
+
+	/***********************************************************
+	 *  FindTag()
+	 *
+	 *  Find the index of a record by its tag, -1 if none.
+	 ***********************************************************/
+	template <typename RECORD>
+	int FindTag(const std::vector<RECORD>& records, const std::string& tag)
+	{
+		for (size_t i = 0; i < records.size(); i++)
+		{
+			if (tag == records[i].tag)
+			{
+				return((int)i);
+			}
+		}
+		return(-1);
+	}
+
+	/***********************************************************
+	 *  ReadTagIndex()
+	 *
+	 *  Resolve an optional tag member of a node to the index
+	 *  of its record.
+	 ***********************************************************/
+	template <typename RECORD>
+	bool ReadTagIndex(
+		const std::string& filename,
+		const JSON_VALUE& node,
+		const char* name,
+		const std::vector<RECORD>& records,
+		int32_t& index)
+	{
+		const JSON_VALUE* pMember = FindMember(node, name);
+
+		index = -1;
+		if (pMember == NULL || pMember->type == JSON_VALUE::JSON_NULL)
+		{
+			return(true);
+		}
+		if (pMember->type != JSON_VALUE::JSON_STRING)
+		{
+			return(ReportError(filename, pMember->line, std::string("'") + name + "' must be a tag"));
+		}
+		index = FindTag(records, pMember->text);
+		if (index < 0)
+		{
+			return(ReportError(filename, pMember->line,
+				std::string("unknown ") + name + " '" + pMember->text + "'"));
+		}
+		return(true);
+	}
+
+	/***********************************************************
+	 *  AppendTable()
+	 *
+	 *  Append a table of records to a binary image.
+	 ***********************************************************/
+	template <typename RECORD>
+	void AppendTable(std::vector<unsigned char>& image, const std::vector<RECORD>& records, uint32_t& count, uint32_t& offset)
+	{
+		count = (uint32_t)records.size();
+		offset = (uint32_t)image.size();
+		if (!records.empty())
+		{
+			const unsigned char* pBytes = (const unsigned char*)records.data();
+			image.insert(image.end(), pBytes, pBytes + records.size() * sizeof(RECORD));
+		}
+	}
+
+	/***********************************************************
+	 *  GetFileStatus()
+	 *
+	 *  Get the last write time and size of a file - false when
+	 *  it is missing.
+	 ***********************************************************/
+	bool GetFileStatus(const std::string& filename, int64_t& modifiedTime, int64_t& size)
+	{
+		struct stat fileStatus;
+
+		if (stat(filename.c_str(), &fileStatus) != 0)
+		{
+			return(false);
+		}
+		modifiedTime = (int64_t)fileStatus.st_mtime;
+		size = (int64_t)fileStatus.st_size;
+		return(true);
+	}
+}
+
+/***********************************************************
+ *  SceneFile()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneFile::SceneFile() :
+	m_pMapping(NULL),
+	m_mappingSize(0),
+#ifdef _WIN32
+	m_fileHandle(INVALID_HANDLE_VALUE),
+	m_mappingHandle(NULL),
+#else
+	m_fileDescriptor(-1),
+#endif
+	m_pTextures(NULL),
+	m_pMaterials(NULL),
+	m_pLights(NULL),
+	m_pNodes(NULL)
+{
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		m_counts[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~SceneFile()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+SceneFile::~SceneFile()
+{
+	Close();
+}
+
+/***********************************************************
+ *  Load()
+ *
+ *  This method is used for loading a scene.  The binary
+ *  file beside the JSON file is mapped when it was built
+ *  from the JSON file as it is now; otherwise the JSON file
+ *  is compiled and the binary file written for next time.
+ ***********************************************************/
+bool SceneFile::Load(const std::string& jsonFilename)
+{
+	int64_t sourceTime = -1;
+	int64_t sourceSize = -1;
+	std::string binaryPath = GetBinaryPath(jsonFilename);
+
+	Close();
+
+	bool bHaveSource = GetFileStatus(jsonFilename, sourceTime, sourceSize);
+	if (!bHaveSource)
+	{
+		sourceTime = -1;
+		sourceSize = -1;
+	}
+
+	if (MapBinary(binaryPath, sourceTime, sourceSize))
+	{
+		return(true);
+	}
+	if (!bHaveSource)
+	{
+		std::cout << "Could not open scene file:" << jsonFilename << std::endl;
+		return(false);
+	}
+
+	if (!CompileJSON(jsonFilename, sourceTime, sourceSize, m_image))
+	{
+		m_image.clear();
+		return(false);
+	}
+
+	std::ofstream file(binaryPath.c_str(), std::ios::binary | std::ios::trunc);
+	if (file.is_open())
+	{
+		file.write((const char*)m_image.data(), (std::streamsize)m_image.size());
+	}
+	if (!file.is_open() || !file.good())
+	{
+		std::cout << "Could not write scene binary file:" << binaryPath << std::endl;
+	}
+
+	return(SetImage(m_image.data(), m_image.size(), sourceTime, sourceSize));
+}
+
+/***********************************************************
+ *  Close()
+ *
+ *  This method is used for unmapping the binary file and
+ *  freeing the compiled image.  The record pointers are no
+ *  longer valid afterwards.
+ ***********************************************************/
+void SceneFile::Close()
+{
+#ifdef _WIN32
+	if (m_pMapping != NULL)
+	{
+		UnmapViewOfFile(m_pMapping);
+	}
+	if (m_mappingHandle != NULL)
+	{
+		CloseHandle((HANDLE)m_mappingHandle);
+		m_mappingHandle = NULL;
+	}
+	if (m_fileHandle != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle((HANDLE)m_fileHandle);
+		m_fileHandle = INVALID_HANDLE_VALUE;
+	}
+#else
+	if (m_pMapping != NULL)
+	{
+		munmap(m_pMapping, m_mappingSize);
+	}
+	if (m_fileDescriptor >= 0)
+	{
+		close(m_fileDescriptor);
+		m_fileDescriptor = -1;
+	}
+#endif
+	m_pMapping = NULL;
+	m_mappingSize = 0;
+	std::vector<unsigned char>().swap(m_image);
+
+	m_pTextures = NULL;
+	m_pMaterials = NULL;
+	m_pLights = NULL;
+	m_pNodes = NULL;
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		m_counts[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  GetTextureCount()
+ *
+ *  This method is used for getting the number of texture
+ *  records.
+ ***********************************************************/
+int SceneFile::GetTextureCount() const
+{
+	return(m_counts[TABLE_TEXTURES]);
+}
+
+/***********************************************************
+ *  GetTextures()
+ *
+ *  This method is used for getting the texture records.
+ ***********************************************************/
+const SceneFile::TEXTURE_RECORD* SceneFile::GetTextures() const
+{
+	return(m_pTextures);
+}
+
+/***********************************************************
+ *  GetMaterialCount()
+ *
+ *  This method is used for getting the number of material
+ *  records.
+ ***********************************************************/
+int SceneFile::GetMaterialCount() const
+{
+	return(m_counts[TABLE_MATERIALS]);
+}
+
+/***********************************************************
+ *  GetMaterials()
+ *
+ *  This method is used for getting the material records.
+ ***********************************************************/
+const SceneFile::MATERIAL_RECORD* SceneFile::GetMaterials() const
+{
+	return(m_pMaterials);
+}
+
+/***********************************************************
+ *  GetLightCount()
+ *
+ *  This method is used for getting the number of light
+ *  records.
+ ***********************************************************/
+int SceneFile::GetLightCount() const
+{
+	return(m_counts[TABLE_LIGHTS]);
+}
+
+/***********************************************************
+ *  GetLights()
+ *
+ *  This method is used for getting the light records.
+ ***********************************************************/
+const SceneFile::LIGHT_RECORD* SceneFile::GetLights() const
+{
+	return(m_pLights);
+}
+
+/***********************************************************
+ *  GetNodeCount()
+ *
+ *  This method is used for getting the number of node
+ *  records.
+ ***********************************************************/
+int SceneFile::GetNodeCount() const
+{
+	return(m_counts[TABLE_NODES]);
+}
+
+/***********************************************************
+ *  GetNodes()
+ *
+ *  This method is used for getting the node records.
+ ***********************************************************/
+const SceneFile::NODE_RECORD* SceneFile::GetNodes() const
+{
+	return(m_pNodes);
+}
+
+/***********************************************************
+ *  GetBinaryPath()
+ *
+ *  This method is used for getting the path of the binary
+ *  file of a JSON file, which replaces its extension.
+ ***********************************************************/
+std::string SceneFile::GetBinaryPath(const std::string& jsonFilename)
+{
+	size_t extensionLength = strlen(g_JSONExtension);
+
+	if (jsonFilename.size() > extensionLength &&
+		jsonFilename.compare(jsonFilename.size() - extensionLength, extensionLength, g_JSONExtension) == 0)
+	{
+		return(jsonFilename.substr(0, jsonFilename.size() - extensionLength) + g_BinaryExtension);
+	}
+	return(jsonFilename + g_BinaryExtension);
+}
+
+/***********************************************************
+ *  MapBinary()
+ *
+ *  This method is used for mapping a binary file read only
+ *  and pointing the tables into it.  The mapping is dropped
+ *  again when the file is stale or damaged.
+ ***********************************************************/
+bool SceneFile::MapBinary(const std::string& path, int64_t sourceTime, int64_t sourceSize)
+{
+#ifdef _WIN32
+	HANDLE fileHandle = CreateFileA(
+		path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (fileHandle == INVALID_HANDLE_VALUE)
+	{
+		return(false);
+	}
+	m_fileHandle = fileHandle;
+
+	LARGE_INTEGER fileSize;
+	if (!GetFileSizeEx(fileHandle, &fileSize) || fileSize.QuadPart < (LONGLONG)sizeof(FILE_HEADER))
+	{
+		Close();
+		return(false);
+	}
+
+	HANDLE mappingHandle = CreateFileMappingA(fileHandle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mappingHandle == NULL)
+	{
+		Close();
+		return(false);
+	}
+	m_mappingHandle = mappingHandle;
+
+	m_pMapping = MapViewOfFile(mappingHandle, FILE_MAP_READ, 0, 0, 0);
+	m_mappingSize = (size_t)fileSize.QuadPart;
+#else
+	int fileDescriptor = open(path.c_str(), O_RDONLY);
+	if (fileDescriptor < 0)
+	{
+		return(false);
+	}
+	m_fileDescriptor = fileDescriptor;
+
+	struct stat fileStatus;
+	if (fstat(fileDescriptor, &fileStatus) != 0 || fileStatus.st_size < (off_t)sizeof(FILE_HEADER))
+	{
+		Close();
+		return(false);
+	}
+
+	void* pMapping = mmap(NULL, (size_t)fileStatus.st_size, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+	if (pMapping != MAP_FAILED)
+	{
+		m_pMapping = pMapping;
+		m_mappingSize = (size_t)fileStatus.st_size;
+	}
+#endif
+
+	if (m_pMapping == NULL ||
+		!SetImage((const unsigned char*)m_pMapping, m_mappingSize, sourceTime, sourceSize))
+	{
+		Close();
+		return(false);
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  SetImage()
+ *
+ *  This method is used for checking the header of a binary
+ *  image and pointing the tables into it.  Every table must
+ *  lie inside the image at an aligned offset, each node
+ *  index must name a record of its table and every tag and
+ *  filename must end within its field, so a damaged file
+ *  is rejected rather than read out of bounds.
+ ***********************************************************/
+bool SceneFile::SetImage(const unsigned char* pImage, size_t imageSize, int64_t sourceTime, int64_t sourceSize)
+{
+	const size_t recordSizes[TABLE_COUNT] =
+	{
+		sizeof(TEXTURE_RECORD),
+		sizeof(MATERIAL_RECORD),
+		sizeof(LIGHT_RECORD),
+		sizeof(NODE_RECORD)
+	};
+	FILE_HEADER header;
+
+	if (imageSize < sizeof(FILE_HEADER))
+	{
+		return(false);
+	}
+	memcpy(&header, pImage, sizeof(FILE_HEADER));
+
+	if (memcmp(header.magic, g_BinaryMagic, sizeof(g_BinaryMagic)) != 0 ||
+		header.version != g_BinaryVersion)
+	{
+		return(false);
+	}
+	if (sourceTime != -1 &&
+		(header.sourceTime != sourceTime || header.sourceSize != sourceSize))
+	{
+		return(false);
+	}
+
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		uint64_t end = (uint64_t)header.offsets[i] + (uint64_t)header.counts[i] * recordSizes[i];
+		if (header.offsets[i] < sizeof(FILE_HEADER) ||
+			header.offsets[i] % sizeof(uint32_t) != 0 ||
+			end > imageSize)
+		{
+			return(false);
+		}
+	}
+
+	const NODE_RECORD* pNodes = (const NODE_RECORD*)(pImage + header.offsets[TABLE_NODES]);
+	for (uint32_t i = 0; i < header.counts[TABLE_NODES]; i++)
+	{
+		if (pNodes[i].mesh < 0 || pNodes[i].mesh >= MESH_NAME_COUNT ||
+			pNodes[i].textureIndex < -1 || pNodes[i].textureIndex >= (int32_t)header.counts[TABLE_TEXTURES] ||
+			pNodes[i].materialIndex < -1 || pNodes[i].materialIndex >= (int32_t)header.counts[TABLE_MATERIALS])
+		{
+			return(false);
+		}
+	}
+
+	const TEXTURE_RECORD* pTextures = (const TEXTURE_RECORD*)(pImage + header.offsets[TABLE_TEXTURES]);
+	for (uint32_t i = 0; i < header.counts[TABLE_TEXTURES]; i++)
+	{
+		if (!IsTerminated(pTextures[i].tag, sizeof(pTextures[i].tag)) ||
+			!IsTerminated(pTextures[i].filename, sizeof(pTextures[i].filename)))
+		{
+			return(false);
+		}
+	}
+	const MATERIAL_RECORD* pMaterials = (const MATERIAL_RECORD*)(pImage + header.offsets[TABLE_MATERIALS]);
+	for (uint32_t i = 0; i < header.counts[TABLE_MATERIALS]; i++)
+	{
+		if (!IsTerminated(pMaterials[i].tag, sizeof(pMaterials[i].tag)))
+		{
+			return(false);
+		}
+	}
+
+	m_pTextures = pTextures;
+	m_pMaterials = pMaterials;
+	m_pLights = (const LIGHT_RECORD*)(pImage + header.offsets[TABLE_LIGHTS]);
+	m_pNodes = pNodes;
+	for (int i = 0; i < TABLE_COUNT; i++)
+	{
+		m_counts[i] = (int)header.counts[i];
+	}
+
+	return(true);
+}
+
+/***********************************************************
+ *  CompileJSON()
+ *
+ *  This method is used for parsing a JSON scene file into a
+ *  binary image.  The tags of the nodes are resolved to the
+ *  indices of their records, so loading the image never
+ *  searches by name.
+ ***********************************************************/
+bool SceneFile::CompileJSON(
+	const std::string& jsonFilename,
+	int64_t sourceTime,
+	int64_t sourceSize,
+	std::vector<unsigned char>& image)
+{
+	std::ifstream file(jsonFilename.c_str(), std::ios::binary);
+	if (!file.is_open())
+	{
+		std::cout << "Could not open scene file:" << jsonFilename << std::endl;
+		return(false);
+	}
+	std::stringstream contents;
+	contents << file.rdbuf();
+	std::string text = contents.str();
+
+	JSON_PARSER parser;
+	parser.pCurrent = text.c_str();
+	parser.pEnd = text.c_str() + text.size();
+	parser.line = 1;
+
+	JSON_VALUE scene;
+	bool bParsed = ParseValue(parser, scene);
+	if (bParsed)
+	{
+		SkipSpace(parser);
+		if (parser.pCurrent != parser.pEnd)
+		{
+			bParsed = Fail(parser, "unexpected text after the scene");
+		}
+	}
+	if (!bParsed)
+	{
+		std::cout << "Could not parse scene file " << jsonFilename << " " << parser.error << std::endl;
+		return(false);
+	}
+	if (scene.type != JSON_VALUE::JSON_OBJECT)
+	{
+		return(ReportError(jsonFilename, scene.line, "the scene must be an object"));
+	}
+
+	const JSON_VALUE* pTextures = GetArray(jsonFilename, scene, "textures");
+	const JSON_VALUE* pMaterials = GetArray(jsonFilename, scene, "materials");
+	const JSON_VALUE* pLights = GetArray(jsonFilename, scene, "lights");
+	const JSON_VALUE* pNodes = GetArray(jsonFilename, scene, "nodes");
+	if (pNodes == NULL)
+	{
+		return(ReportError(jsonFilename, scene.line, "the scene needs a 'nodes' array"));
+	}
+
+	std::vector<TEXTURE_RECORD> textures;
+	std::vector<MATERIAL_RECORD> materials;
+	std::vector<LIGHT_RECORD> lights;
+	std::vector<NODE_RECORD> nodes;
+	bool bValid = true;
+
+	if (pTextures != NULL)
+	{
+		for (size_t i = 0; bValid && i < pTextures->items.size(); i++)
+		{
+			TEXTURE_RECORD texture;
+			const JSON_VALUE& item = pTextures->items[i];
+			bValid = ReadText(jsonFilename, item, "tag", texture.tag, sizeof(texture.tag)) &&
+				ReadText(jsonFilename, item, "file", texture.filename, sizeof(texture.filename));
+			if (bValid && FindTag(textures, texture.tag) >= 0)
+			{
+				bValid = ReportError(jsonFilename, item.line, std::string("duplicate texture '") + texture.tag + "'");
+			}
+			textures.push_back(texture);
+		}
+	}
+
+	if (pMaterials != NULL)
+	{
+		for (size_t i = 0; bValid && i < pMaterials->items.size(); i++)
+		{
+			MATERIAL_RECORD material;
+			const JSON_VALUE& item = pMaterials->items[i];
+			memset(&material, 0, sizeof(material));
+			bValid = ReadText(jsonFilename, item, "tag", material.tag, sizeof(material.tag)) &&
+				ReadFloats(jsonFilename, item, "ambientColor", material.ambientColor, 3) &&
+				ReadFloats(jsonFilename, item, "ambientStrength", &material.ambientStrength, 1) &&
+				ReadFloats(jsonFilename, item, "diffuseColor", material.diffuseColor, 3) &&
+				ReadFloats(jsonFilename, item, "specularColor", material.specularColor, 3) &&
+				ReadFloats(jsonFilename, item, "shininess", &material.shininess, 1);
+			if (bValid && FindTag(materials, material.tag) >= 0)
+			{
+				bValid = ReportError(jsonFilename, item.line, std::string("duplicate material '") + material.tag + "'");
+			}
+			materials.push_back(material);
+		}
+	}
+
+	if (pLights != NULL)
+	{
+		for (size_t i = 0; bValid && i < pLights->items.size(); i++)
+		{
+			LIGHT_RECORD light;
+			const JSON_VALUE& item = pLights->items[i];
+			memset(&light, 0, sizeof(light));
+			light.focalStrength = 32.0f;
+			light.specularIntensity = 1.0f;
+			bValid = ReadFloats(jsonFilename, item, "position", light.position, 3) &&
+				ReadFloats(jsonFilename, item, "ambientColor", light.ambientColor, 3) &&
+				ReadFloats(jsonFilename, item, "diffuseColor", light.diffuseColor, 3) &&
+				ReadFloats(jsonFilename, item, "specularColor", light.specularColor, 3) &&
+				ReadFloats(jsonFilename, item, "focalStrength", &light.focalStrength, 1) &&
+				ReadFloats(jsonFilename, item, "specularIntensity", &light.specularIntensity, 1) &&
+				ReadFloats(jsonFilename, item, "range", &light.range, 1);
+			if (bValid && (light.range < 0.0f))
+			{
+				bValid = ReportError(jsonFilename, item.line, "a light 'range' cannot be negative");
+			}
+			lights.push_back(light);
+		}
+	}
+
+	for (size_t i = 0; bValid && i < pNodes->items.size(); i++)
+	{
+		NODE_RECORD node;
+		const JSON_VALUE& item = pNodes->items[i];
+		char meshName[MAX_TAG_LENGTH];
+
+		node.mesh = -1;
+		for (int j = 0; j < 3; j++)
+		{
+			node.scaleXYZ[j] = 1.0f;
+			node.rotationDegrees[j] = 0.0f;
+			node.positionXYZ[j] = 0.0f;
+		}
+		node.UVscale[0] = 1.0f;
+		node.UVscale[1] = 1.0f;
+
+		bValid = ReadText(jsonFilename, item, "mesh", meshName, sizeof(meshName)) &&
+			ReadFloats(jsonFilename, item, "scale", node.scaleXYZ, 3) &&
+			ReadFloats(jsonFilename, item, "rotation", node.rotationDegrees, 3) &&
+			ReadFloats(jsonFilename, item, "position", node.positionXYZ, 3) &&
+			ReadFloats(jsonFilename, item, "uvScale", node.UVscale, 2) &&
+			ReadTagIndex(jsonFilename, item, "texture", textures, node.textureIndex) &&
+			ReadTagIndex(jsonFilename, item, "material", materials, node.materialIndex);
+		if (bValid)
+		{
+			for (int j = 0; j < MESH_NAME_COUNT; j++)
+			{
+				if (strcmp(meshName, MESH_NAMES[j]) == 0)
+				{
+					node.mesh = j;
+				}
+			}
+			if (node.mesh < 0)
+			{
+				bValid = ReportError(jsonFilename, item.line, std::string("unknown mesh '") + meshName + "'");
+			}
+		}
+		nodes.push_back(node);
+	}
+
+	if (!bValid)
+	{
+		return(false);
+	}
+
+	FILE_HEADER header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, g_BinaryMagic, sizeof(g_BinaryMagic));
+	header.version = g_BinaryVersion;
+	header.sourceTime = sourceTime;
+	header.sourceSize = sourceSize;
+
+	image.assign(sizeof(FILE_HEADER), 0);
+	AppendTable(image, textures, header.counts[TABLE_TEXTURES], header.offsets[TABLE_TEXTURES]);
+	AppendTable(image, materials, header.counts[TABLE_MATERIALS], header.offsets[TABLE_MATERIALS]);
+	AppendTable(image, lights, header.counts[TABLE_LIGHTS], header.offsets[TABLE_LIGHTS]);
+	AppendTable(image, nodes, header.counts[TABLE_NODES], header.offsets[TABLE_NODES]);
+	memcpy(image.data(), &header, sizeof(FILE_HEADER));
+
+	return(true);
+}
@@ -0,0 +1,161 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenefile.h
+// ============
+// load the textures, materials, lights and nodes of a scene from its JSON
+// file, through a binary form of it that is memory mapped on later launches
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  SceneFile
+ *
+ *  This class reads a scene authored as JSON.  The first
+ *  load compiles the JSON into flat binary records, with
+ *  the texture and material tags of the nodes resolved to
+ *  table indices, and saves them beside it.  Later loads
+ *  only stat the JSON file and map the binary file, whose
+ *  records are read in place without any parsing.  The
+ *  binary file alone is enough to load the scene, so it
+ *  can be shipped without the JSON.
+ ***********************************************************/
+class SceneFile
+{
+public:
+	// constructor
+	SceneFile();
+	// destructor
+	~SceneFile();
+
+	// longest tag and path, with the terminating zero
+	static const int MAX_TAG_LENGTH = 32;
+	static const int MAX_PATH_LENGTH = 128;
+
+	// names of the meshes in the JSON file, in the order of
+	// MESH_TYPE in SceneManager.h
+	static const int MESH_NAME_COUNT = 6;
+	static const char* const MESH_NAMES[MESH_NAME_COUNT];
+
+	// binary layout of a texture reference
+	struct TEXTURE_RECORD
+	{
+		char tag[MAX_TAG_LENGTH];
+		char filename[MAX_PATH_LENGTH];
+	};
+
+	// binary layout of a material
+	struct MATERIAL_RECORD
+	{
+		char tag[MAX_TAG_LENGTH];
+		float ambientColor[3];
+		float ambientStrength;
+		float diffuseColor[3];
+		float specularColor[3];
+		float shininess;
+	};
+
+	// binary layout of a light source
+	struct LIGHT_RECORD
+	{
+		float position[3];
+		float ambientColor[3];
+		float diffuseColor[3];
+		float specularColor[3];
+		float focalStrength;
+		float specularIntensity;
+		// distance a point light fades out at, 0 for a light
+		// that reaches the whole scene
+		float range;
+	};
+
+	// binary layout of a scene node - the texture and material
+	// are indices into the tables of the file, -1 for none
+	struct NODE_RECORD
+	{
+		int32_t mesh;
+		float scaleXYZ[3];
+		float rotationDegrees[3];
+		float positionXYZ[3];
+		float UVscale[2];
+		int32_t textureIndex;
+		int32_t materialIndex;
+	};
+
+	// load a scene from its JSON file, or the binary file beside
+	// it while that is up to date - false on failure
+	bool Load(const std::string& jsonFilename);
+	// unmap the binary file and free the records
+	void Close();
+
+	// get the records of the loaded scene, valid until Close()
+	int GetTextureCount() const;
+	const TEXTURE_RECORD* GetTextures() const;
+	int GetMaterialCount() const;
+	const MATERIAL_RECORD* GetMaterials() const;
+	int GetLightCount() const;
+	const LIGHT_RECORD* GetLights() const;
+	int GetNodeCount() const;
+	const NODE_RECORD* GetNodes() const;
+
+private:
+	// the tables of the binary file, in file order
+	enum TABLE_ID
+	{
+		TABLE_TEXTURES,
+		TABLE_MATERIALS,
+		TABLE_LIGHTS,
+		TABLE_NODES,
+		TABLE_COUNT
+	};
+
+	// binary layout of the file header, followed by the tables
+	struct FILE_HEADER
+	{
+		char magic[4];
+		uint32_t version;
+		// last write time and size of the JSON file compiled
+		int64_t sourceTime;
+		int64_t sourceSize;
+		uint32_t counts[TABLE_COUNT];
+		uint32_t offsets[TABLE_COUNT];
+	};
+
+	// get the path of the binary file of a JSON file
+	static std::string GetBinaryPath(const std::string& jsonFilename);
+	// map a binary file and check its header - a source time of
+	// -1 accepts any source
+	bool MapBinary(const std::string& path, int64_t sourceTime, int64_t sourceSize);
+	// point the tables at a checked binary image
+	bool SetImage(const unsigned char* pImage, size_t imageSize, int64_t sourceTime, int64_t sourceSize);
+	// compile a JSON file into a binary image
+	static bool CompileJSON(
+		const std::string& jsonFilename,
+		int64_t sourceTime,
+		int64_t sourceSize,
+		std::vector<unsigned char>& image);
+
+	// mapped binary file, or NULL
+	void* m_pMapping;
+	size_t m_mappingSize;
+#ifdef _WIN32
+	void* m_fileHandle;
+	void* m_mappingHandle;
+#else
+	int m_fileDescriptor;
+#endif
+	// compiled image when the binary file could not be mapped
+	std::vector<unsigned char> m_image;
+
+	// tables of the loaded image
+	const TEXTURE_RECORD* m_pTextures;
+	const MATERIAL_RECORD* m_pMaterials;
+	const LIGHT_RECORD* m_pLights;
+	const NODE_RECORD* m_pNodes;
+	int m_counts[TABLE_COUNT];
+};
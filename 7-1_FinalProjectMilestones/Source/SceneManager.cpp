@@ -16,14 +16,93 @@
 
 #include <glm/gtx/transform.hpp>
 
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <utility>
+
 // declaration of global variables
 namespace
 {
-	const char* g_ModelName = "model";
-	const char* g_ColorValueName = "objectColor";
-	const char* g_TextureValueName = "objectTexture";
-	const char* g_UseTextureName = "bUseTexture";
-	const char* g_UseLightingName = "bUseLighting";
+	// meshes picked from by the stress scene generator
+	const SceneManager::MESH_TYPE g_StressMeshes[] =
+	{
+		SceneManager::MESH_BOX,
+		SceneManager::MESH_CONE,
+		SceneManager::MESH_CYLINDER,
+		SceneManager::MESH_PLANE,
+		SceneManager::MESH_PYRAMID3,
+		SceneManager::MESH_TAPERED_CYLINDER
+	};
+	// average distance between generated objects
+	const float g_StressObjectSpacing = 1.0f;
+	// default seed of the stress scene generator
+	const unsigned int g_DefaultStressSeed = 1;
+	// scene file loaded when none is passed on the command line
+	const char* const g_DefaultSceneFilename = "Scenes/desk.json";
+	// scene nodes per job of the dirty node pass
+	const int g_NodeGrainSize = 4096;
+	// hierarchy subtrees culled per thread, so that threads
+	// finishing early can steal the rest
+	const int g_CullSubtreesPerThread = 4;
+	// range of a generated point light, in multiples of the
+	// average distance between the lights
+	const float g_PointLightReach = 1.5f;
+
+	// the mesh names of the scene file follow MESH_TYPE
+	static_assert(SceneFile::MESH_NAME_COUNT == SceneManager::MESH_TAPERED_CYLINDER + 1,
+		"scene file mesh names must match MESH_TYPE");
+
+	// projected radius, in normalized device units, below which
+	// each coarser level of detail is used
+	const float g_LodScreenRadii[SceneMeshes::LOD_LEVELS - 1] = { 0.08f, 0.025f };
+	// fraction the radius must pass a boundary by before the
+	// level changes, so objects near a boundary do not pop
+	const float g_LodHysteresis = 0.2f;
+	// closest view depth used for the projected radius
+	const float g_LodNearDepth = 0.1f;
+	// most bytes of texture levels and meshes streamed in per
+	// frame, beyond the first level, so streaming never stalls
+	// a frame for long
+	const long long g_StreamUploadBytesPerFrame = 4 * 1024 * 1024;
+	// share of the video memory budget, after the texture
+	// fallback levels, that sizes the streamed texture slots -
+	// the finer mesh levels of detail get the rest
+	const double g_StreamTextureShare = 0.75;
+
+	// step from the current level of detail to the one of the
+	// projected radius, keeping it while inside the hysteresis
+	int SelectLod(float projectedRadius, int currentLod)
+	{
+		int lod = currentLod;
+
+		while ((lod > 0) && (projectedRadius > g_LodScreenRadii[lod - 1] * (1.0f + g_LodHysteresis)))
+		{
+			lod--;
+		}
+		while ((lod < SceneMeshes::LOD_LEVELS - 1) && (projectedRadius < g_LodScreenRadii[lod] * (1.0f - g_LodHysteresis)))
+		{
+			lod++;
+		}
+
+		return(lod);
+	}
+
+	// finest streamed texture level an instance needs - the
+	// level where one texel of its repeated image covers about
+	// one pixel across its projected diameter
+	int SelectTextureLevel(float projectedRadius, glm::vec2 UVscale, int viewportHeight)
+	{
+		float pixels = std::max(projectedRadius * (float)viewportHeight, 1.0f);
+		float texels = (float)TextureArray::LAYER_SIZE * std::max(std::max(UVscale.x, UVscale.y), 0.001f);
+		int level = (int)floorf(log2f(texels / pixels));
+
+		return(std::min(std::max(level, 0), (int)TextureStreamer::FALLBACK_LEVEL));
+	}
 }
 
 /***********************************************************
@@ -31,10 +110,45 @@ namespace
  *
  *  The constructor for the class
  ***********************************************************/
-SceneManager::SceneManager(ShaderManager *pShaderManager)
+SceneManager::SceneManager(
+	ShaderUniforms *pShaderUniforms,
+	FrameProfiler *pProfiler)
 {
-	m_pShaderManager = pShaderManager;
-	m_basicMeshes = new ShapeMeshes();
+	m_pShaderUniforms = pShaderUniforms;
+	m_pProfiler = pProfiler;
+	m_pShaderCache = NULL;
+	m_pStreamBuffer = NULL;
+	m_streamBufferVersion = 0;
+	m_bInstanceBufferStale = false;
+	m_shaderVariants[0] = 0;
+	m_shaderVariants[1] = 0;
+	m_bUseLighting = false;
+	m_lightCount = 0;
+	m_basicMeshes = new SceneMeshes();
+	m_basicMeshes->SetProfiler(pProfiler);
+	m_currentTextureSlot = -1;
+	m_bInstancesChanged = true;
+	m_bSceneChanged = true;
+	m_cullFrame = 0;
+	m_sceneSettings.objectCount = 0;
+	m_sceneSettings.seed = g_DefaultStressSeed;
+	m_sceneSettings.bGPUCulling = false;
+	m_sceneSettings.bPackedMeshes = false;
+	m_sceneSettings.sceneFilename = g_DefaultSceneFilename;
+	m_sceneSettings.workerThreads = -1;
+	m_sceneSettings.pointLightCount = 0;
+	m_sceneSettings.bDepthPrepass = false;
+	m_sceneSettings.bOcclusionCulling = false;
+	m_sceneSettings.streamingBudget = 0;
+	m_depthProgram = -1;
+	m_viewportHeight = 1;
+	for (int i = 0; i < SceneMeshes::CURVED_MESH_COUNT; i++)
+	{
+		m_meshResources[i] = -1;
+	}
+	m_gpuCulling.SetProfiler(pProfiler);
+	m_clusteredLights.SetProfiler(pProfiler);
+	m_hiZBuffer.SetProfiler(pProfiler);
 }
 
 /***********************************************************
@@ -44,115 +158,374 @@ SceneManager::SceneManager(ShaderManager *pShaderManager)
  ***********************************************************/
 SceneManager::~SceneManager()
 {
-	m_pShaderManager = NULL;
+	m_pShaderUniforms = NULL;
+	m_pProfiler = NULL;
+	m_pShaderCache = NULL;
+	m_pStreamBuffer = NULL;
+	// destroy the created OpenGL textures, stopping the loader
+	// threads first
+	DestroyGLTextures();
 	delete m_basicMeshes;
 	m_basicMeshes = NULL;
-	// destroy the created OpenGL textures
-	DestroyGLTextures();
 }
 
 /***********************************************************
  *  CreateGLTexture()
  *
- *  This method is used for loading textures from image files,
- *  configuring the texture mapping parameters in OpenGL,
- *  generating the mipmaps, and loading the read texture into
- *  the next available texture slot in memory.
+ *  This method is used for queueing a texture image file to
+ *  be decoded on a worker thread.  The tag is registered
+ *  with the next layer of the scene texture array right
+ *  away, so nodes can use it before the image has loaded.
+ *  Textures must be created before BindGLTextures().
  ***********************************************************/
-bool SceneManager::CreateGLTexture(const char* filename, std::string tag)
-{
-	int width = 0;
-	int height = 0;
-	int colorChannels = 0;
-	GLuint textureID = 0;
-
-	// indicate to always flip images vertically when loaded
-	stbi_set_flip_vertically_on_load(true);
-
-	// try to parse the image data from the specified image file
-	unsigned char* image = stbi_load(
-		filename,
-		&width,
-		&height,
-		&colorChannels,
-		0);
-
-	// if the image was successfully read from the image file
-	if (image)
-	{
-		std::cout << "Successfully loaded image:" << filename << ", width:" << width << ", height:" << height << ", channels:" << colorChannels << std::endl;
-
-		glGenTextures(1, &textureID);
-		glBindTexture(GL_TEXTURE_2D, textureID);
-
-		// set the texture wrapping parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		// set texture filtering parameters
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
-		// if the loaded image is in RGB format
-		if (colorChannels == 3)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB8, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, image);
-		// if the loaded image is in RGBA format - it supports transparency
-		else if (colorChannels == 4)
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image);
-		else
+bool SceneManager::CreateGLTexture(const char* filename, const std::string& tag)
+{
+	if (m_textureArray.GetID() != 0)
+	{
+		std::cout << "Could not queue image:" << filename << ", the texture array was already created" << std::endl;
+		return false;
+	}
+
+	// register the texture and associate it with the special tag string
+	TEXTURE_INFO texture;
+	texture.layer = (int)m_textureIDs.size();
+	// known once the image is decoded
+	texture.bTranslucent = false;
+	// set once the texture array is created
+	texture.resource = -1;
+	m_textureIDs.push_back(texture);
+	// the first texture registered with a tag keeps it
+	m_textureSlotsByTag.emplace(tag, texture.layer);
+
+	m_textureLoader.QueueImage(filename, texture.layer, TextureArray::LAYER_SIZE);
+
+	return true;
+}
+
+/***********************************************************
+ *  BindGLTextures()
+ *
+ *  This method is used for creating the texture array with
+ *  a placeholder layer for each queued texture and binding
+ *  it to texture unit 0, where it stays for every draw.
+ *  With a video memory budget, and the shader variants to
+ *  sample them, the array only holds the levels from the
+ *  streaming fallback down, and every texture is handed to
+ *  the residency manager for its finer levels.  Both arrays
+ *  are allocated whole here, so they are paid from the
+ *  budget once: the fallback levels first, then a share of
+ *  what is left for the slots.  The residency manager only
+ *  charges the finer mesh levels, against the rest.
+ ***********************************************************/
+void SceneManager::BindGLTextures()
+{
+	int layerCount = (int)m_textureIDs.size();
+	long long budgetBytes = (long long)m_sceneSettings.streamingBudget * 1024 * 1024;
+	long long fallbackBytes = TextureStreamer::GetFallbackBytes(layerCount);
+	long long slotBudget = (long long)((budgetBytes - fallbackBytes) * g_StreamTextureShare);
+
+	if ((budgetBytes > 0) && (slotBudget < TextureStreamer::GetSlotBytes()))
+	{
+		std::cout << "The video memory budget does not fit the texture fallback levels and one streamed texture" << std::endl;
+	}
+
+	bool bStreaming = (slotBudget >= TextureStreamer::GetSlotBytes()) && (NULL != m_pShaderCache) && (layerCount > 0) &&
+		m_textureStreamer.Initialize(layerCount, slotBudget);
+	if (bStreaming && m_textureArray.Create(layerCount, TextureStreamer::FALLBACK_SIZE))
+	{
+		std::vector<long long> levelBytes;
+		for (int level = 0; level < TextureStreamer::FALLBACK_LEVEL; level++)
+		{
+			levelBytes.push_back(TextureStreamer::GetLevelBytes(level));
+		}
+
+		// a texture takes a slot while any finer level is in
+		int pool = m_residency.AddPool(m_textureStreamer.GetSlotCount());
+		for (int i = 0; i < layerCount; i++)
+		{
+			m_textureIDs[i].resource = m_residency.AddResource(ResidencyManager::RESOURCE_TEXTURE, i, levelBytes, pool);
+		}
+		m_textureStreamer.Bind();
+	}
+	else
+	{
+		if (bStreaming)
+		{
+			std::cout << "Could not create the texture fallback levels, loading the textures whole" << std::endl;
+		}
+		m_textureStreamer.Destroy();
+		m_textureArray.Create(layerCount);
+	}
+	m_textureArray.Bind(0);
+
+	// the mesh levels get what the texture arrays leave, which
+	// is nothing when the textures are loaded whole over budget
+	m_residency.SetBudget(budgetBytes - m_textureArray.GetByteSize() - m_textureStreamer.GetByteSize());
+
+	if (NULL != m_pShaderUniforms)
+	{
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_OBJECT_TEXTURES, 0);
+		if (m_textureStreamer.IsInitialized())
 		{
-			std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
-			return false;
+			m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_STREAMED_TEXTURES, TextureStreamer::TEXTURE_UNIT);
 		}
+	}
+}
+
+/***********************************************************
+ *  UpdateTextureLoads()
+ *
+ *  This method is used for uploading the images that were
+ *  loaded since the last frame into their texture array
+ *  layers.  Nodes using a texture that turns out to be
+ *  translucent are moved into the blended pass.  With
+ *  texture streaming only the fallback levels are uploaded,
+ *  and the streamer keeps the mip chain for the rest.
+ ***********************************************************/
+void SceneManager::UpdateTextureLoads()
+{
+	std::vector<TextureLoader::DECODED_IMAGE> images;
+
+	if (m_textureLoader.PollDecodedImages(images) == 0)
+	{
+		return;
+	}
+
+	bool bTransparencyChanged = false;
+
+	for (size_t i = 0; i < images.size(); i++)
+	{
+		TextureLoader::DECODED_IMAGE& image = images[i];
 
-		// generate the texture mipmaps for mapping textures to lower resolutions
-		glGenerateMipmap(GL_TEXTURE_2D);
+		if (!image.bLoaded)
+		{
+			std::cout << "Could not load image:" << image.filename << std::endl;
+			continue;
+		}
 
-		// free the image data from local memory
-		stbi_image_free(image);
-		glBindTexture(GL_TEXTURE_2D, 0); // Unbind the texture
+		std::cout << "Successfully loaded image:" << image.filename << ", size:" << image.image.size << ", levels:" << image.image.levelCount << std::endl;
 
-		// register the loaded texture and associate it with the special tag string
-		m_textureIDs[m_loadedTextures].ID = textureID;
-		m_textureIDs[m_loadedTextures].tag = tag;
-		m_loadedTextures++;
+		if (m_textureArray.UploadLayer(image.layer, image.image))
+		{
+			if (image.image.bTranslucent)
+			{
+				m_textureIDs[image.layer].bTranslucent = true;
+				for (int j = 0; j < m_sceneNodes.GetCount(); j++)
+				{
+					if (m_sceneNodes.GetTextureSlot(j) == image.layer)
+					{
+						m_sceneNodes.SetTransparent(j, true);
+						bTransparencyChanged = true;
+					}
+				}
+			}
+			if (m_textureStreamer.IsInitialized())
+			{
+				m_textureStreamer.AddImage(image.layer, std::move(image.image));
+			}
+		}
+	}
 
-		return true;
+	// the batches only change when a node switches pass
+	if (bTransparencyChanged)
+	{
+		BuildRenderBatches();
 	}
+}
+
+/***********************************************************
+ *  IsLoadingTextures()
+ *
+ *  This method is used for checking whether any queued
+ *  texture image has not been uploaded yet.
+ ***********************************************************/
+bool SceneManager::IsLoadingTextures()
+{
+	return(m_textureLoader.GetPendingCount() > 0);
+}
 
-	std::cout << "Could not load image:" << filename << std::endl;
+/***********************************************************
+ *  NeedsRedraw()
+ *
+ *  This method is used for checking whether the scene
+ *  changed since it was last rendered, or still has
+ *  textures to swap in, for the on-demand frame loop.
+ ***********************************************************/
+bool SceneManager::NeedsRedraw()
+{
+	return(m_bSceneChanged || IsLoadingTextures());
+}
 
-	// Error loading the image
-	return false;
+/***********************************************************
+ *  GetSceneNodeCount()
+ *
+ *  This method is used for getting the number of nodes in
+ *  the retained scene graph.
+ ***********************************************************/
+int SceneManager::GetSceneNodeCount() const
+{
+	return(m_sceneNodes.GetCount());
 }
 
 /***********************************************************
- *  BindGLTextures()
+ *  ParseArguments()
+ *
+ *  This method is used for reading the scene options:
  *
- *  This method is used for binding the loaded textures to
- *  OpenGL texture memory slots.  There are up to 16 slots.
+ *    --stress <count>     generate count objects, 1 to 1000000
+ *    --seed <value>       seed of the generator, default 1
+ *    --gpu-culling        cull and draw with a compute shader
+ *                         and indirect multi-draws
+ *    --packed-meshes      keep every mesh in one shared vertex
+ *                         and index buffer
+ *    --scene <file>       load the scene content from a JSON
+ *                         file, default Scenes/desk.json
+ *    --threads <count>    worker threads for culling and node
+ *                         updates, default one per core but
+ *                         one, 0 to run them on the render
+ *                         thread
+ *    --point-lights <count>  generate count point lights over
+ *                         the scene, shaded through the light
+ *                         clusters
+ *    --depth-prepass      draw the opaque depth first, then
+ *                         shade only the visible fragments
+ *    --occlusion-culling  cull the instances hidden in the
+ *                         previous frame, with --gpu-culling
+ *    --vram-budget <MB>   stream the finest texture levels and
+ *                         mesh levels of detail, keeping the
+ *                         scene textures and the finer mesh
+ *                         levels within MB of video memory,
+ *                         default 0 to load everything up
+ *                         front
  ***********************************************************/
-void SceneManager::BindGLTextures()
+SceneManager::SCENE_SETTINGS SceneManager::ParseArguments(int argc, char* argv[])
 {
-	for (int i = 0; i < m_loadedTextures; i++)
+	SCENE_SETTINGS settings;
+	settings.objectCount = 0;
+	settings.seed = g_DefaultStressSeed;
+	settings.bGPUCulling = false;
+	settings.bPackedMeshes = false;
+	settings.sceneFilename = g_DefaultSceneFilename;
+	settings.workerThreads = -1;
+	settings.pointLightCount = 0;
+	settings.bDepthPrepass = false;
+	settings.bOcclusionCulling = false;
+	settings.streamingBudget = 0;
+
+	for (int i = 1; i < argc; i++)
 	{
-		// bind textures on corresponding texture units
-		glActiveTexture(GL_TEXTURE0 + i);
-		glBindTexture(GL_TEXTURE_2D, m_textureIDs[i].ID);
+		if ((strcmp(argv[i], "--stress") == 0) && (i + 1 < argc))
+		{
+			settings.objectCount = std::min(std::max(atoi(argv[++i]), 0), (int)MAX_STRESS_OBJECTS);
+		}
+		else if ((strcmp(argv[i], "--seed") == 0) && (i + 1 < argc))
+		{
+			settings.seed = (unsigned int)strtoul(argv[++i], NULL, 10);
+		}
+		else if (strcmp(argv[i], "--gpu-culling") == 0)
+		{
+			settings.bGPUCulling = true;
+		}
+		else if (strcmp(argv[i], "--packed-meshes") == 0)
+		{
+			settings.bPackedMeshes = true;
+		}
+		else if ((strcmp(argv[i], "--scene") == 0) && (i + 1 < argc))
+		{
+			settings.sceneFilename = argv[++i];
+		}
+		else if ((strcmp(argv[i], "--threads") == 0) && (i + 1 < argc))
+		{
+			settings.workerThreads = std::max(atoi(argv[++i]), 0);
+		}
+		else if ((strcmp(argv[i], "--point-lights") == 0) && (i + 1 < argc))
+		{
+			settings.pointLightCount = std::min(std::max(atoi(argv[++i]), 0), (int)ClusteredLights::MAX_LIGHTS);
+		}
+		else if (strcmp(argv[i], "--depth-prepass") == 0)
+		{
+			settings.bDepthPrepass = true;
+		}
+		else if (strcmp(argv[i], "--occlusion-culling") == 0)
+		{
+			settings.bOcclusionCulling = true;
+		}
+		else if ((strcmp(argv[i], "--vram-budget") == 0) && (i + 1 < argc))
+		{
+			settings.streamingBudget = std::max(atoi(argv[++i]), 0);
+		}
 	}
+
+	return(settings);
+}
+
+/***********************************************************
+ *  SetSceneSettings()
+ *
+ *  This method is used for choosing the scene content and
+ *  the rendering path.  A stress object count above 0
+ *  replaces the regular scene with a generated one.  The
+ *  worker threads of the scene jobs are started here.
+ ***********************************************************/
+void SceneManager::SetSceneSettings(const SCENE_SETTINGS& settings)
+{
+	m_sceneSettings = settings;
+	m_sceneSettings.objectCount = std::min(std::max(settings.objectCount, 0), (int)MAX_STRESS_OBJECTS);
+
+	m_jobSystem.Start((settings.workerThreads < 0) ? JobSystem::GetDefaultWorkerCount() : settings.workerThreads);
+	std::cout << "Culling the scene on " << (m_jobSystem.GetWorkerCount() + 1) << " threads" << std::endl;
+}
+
+/***********************************************************
+ *  SetShaderCache()
+ *
+ *  This method is used for setting the builder that
+ *  PrepareScene() loads the shader variants with.
+ ***********************************************************/
+void SceneManager::SetShaderCache(ShaderCache* pShaderCache)
+{
+	m_pShaderCache = pShaderCache;
+}
+
+/***********************************************************
+ *  SetStreamBuffer()
+ *
+ *  This method is used for setting the ring buffer that
+ *  CullScene() writes the visible instances into.  The GPU
+ *  culling path writes its instances on the GPU and keeps
+ *  the instance buffer.
+ ***********************************************************/
+void SceneManager::SetStreamBuffer(StreamBuffer* pStreamBuffer)
+{
+	m_pStreamBuffer = pStreamBuffer;
+}
+
+/***********************************************************
+ *  SetFrameArena()
+ *
+ *  This method is used for setting the arena that the
+ *  render queue builds the draw commands of a frame in.
+ ***********************************************************/
+void SceneManager::SetFrameArena(FrameArena* pArena)
+{
+	m_renderQueue.SetFrameArena(pArena);
 }
 
 /***********************************************************
  *  DestroyGLTextures()
  *
- *  This method is used for freeing the memory in all the
- *  used texture memory slots.
+ *  This method is used for stopping the texture loads and
+ *  freeing the memory of the texture array.  The array owns
+ *  its texture names, which are deleted rather than leaked,
+ *  and skipped once the context is gone.
  ***********************************************************/
 void SceneManager::DestroyGLTextures()
 {
-	for (int i = 0; i < m_loadedTextures; i++)
-	{
-		glGenTextures(1, &m_textureIDs[i].ID);
-	}
+	m_textureLoader.Stop();
+	m_textureStreamer.Destroy();
+	m_textureArray.Destroy();
+	m_textureIDs.clear();
+	m_textureSlotsByTag.clear();
 }
 
 /***********************************************************
@@ -161,50 +534,35 @@ void SceneManager::DestroyGLTextures()
  *  This method is used for getting an ID for the previously
  *  loaded texture bitmap associated with the passed in tag.
  ***********************************************************/
-int SceneManager::FindTextureID(std::string tag)
+int SceneManager::FindTextureID(const std::string& tag)
 {
-	int textureID = -1;
-	int index = 0;
-	bool bFound = false;
-
-	while ((index < m_loadedTextures) && (bFound == false))
+	if (FindTextureSlot(tag) < 0)
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureID = m_textureIDs[index].ID;
-			bFound = true;
-		}
-		else
-			index++;
+		return(-1);
 	}
 
-	return(textureID);
+	// every texture is a layer of the same array texture
+	return((int)m_textureArray.GetID());
 }
 
 /***********************************************************
  *  FindTextureSlot()
  *
  *  This method is used for getting a slot index for the previously
- *  loaded texture bitmap associated with the passed in tag.
+ *  loaded texture bitmap associated with the passed in tag.  The
+ *  slot doubles as the texture handle for SetShaderTexture().
  ***********************************************************/
-int SceneManager::FindTextureSlot(std::string tag)
+int SceneManager::FindTextureSlot(const std::string& tag)
 {
-	int textureSlot = -1;
-	int index = 0;
-	bool bFound = false;
+	std::unordered_map<std::string, int>::const_iterator found =
+		m_textureSlotsByTag.find(tag);
 
-	while ((index < m_loadedTextures) && (bFound == false))
+	if (found == m_textureSlotsByTag.end())
 	{
-		if (m_textureIDs[index].tag.compare(tag) == 0)
-		{
-			textureSlot = index;
-			bFound = true;
-		}
-		else
-			index++;
+		return(-1);
 	}
 
-	return(textureSlot);
+	return(found->second);
 }
 
 /***********************************************************
@@ -212,34 +570,104 @@ int SceneManager::FindTextureSlot(std::string tag)
  *
  *  This method is used for getting a material from the previously
  *  defined materials list that is associated with the passed in tag.
+ *  It returns false when no material has that tag.
  ***********************************************************/
-bool SceneManager::FindMaterial(std::string tag, OBJECT_MATERIAL& material)
+bool SceneManager::FindMaterial(const std::string& tag, OBJECT_MATERIAL& material)
 {
-	if (m_objectMaterials.size() == 0)
+	int materialIndex = FindMaterialIndex(tag);
+
+	if (materialIndex < 0)
 	{
 		return(false);
 	}
 
-	int index = 0;
-	bool bFound = false;
-	while ((index < m_objectMaterials.size()) && (bFound == false))
+	material = m_objectMaterials[materialIndex];
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindMaterialIndex()
+ *
+ *  This method is used for getting the index of a material in
+ *  the previously defined materials list by its tag.  The index
+ *  doubles as the material handle for SetShaderMaterial().
+ ***********************************************************/
+int SceneManager::FindMaterialIndex(const std::string& tag)
+{
+	std::unordered_map<std::string, int>::const_iterator found =
+		m_materialIndicesByTag.find(tag);
+
+	if (found == m_materialIndicesByTag.end())
 	{
-		if (m_objectMaterials[index].tag.compare(tag) == 0)
-		{
-			bFound = true;
-			material.ambientColor = m_objectMaterials[index].ambientColor;
-			material.ambientStrength = m_objectMaterials[index].ambientStrength;
-			material.diffuseColor = m_objectMaterials[index].diffuseColor;
-			material.specularColor = m_objectMaterials[index].specularColor;
-			material.shininess = m_objectMaterials[index].shininess;
-		}
-		else
-		{
-			index++;
-		}
+		return(-1);
 	}
 
-	return(true);
+	return(found->second);
+}
+
+/***********************************************************
+ *  AddObjectMaterial()
+ *
+ *  This method is used for adding a material to the defined
+ *  materials list and registering its tag for lookups.
+ ***********************************************************/
+int SceneManager::AddObjectMaterial(const OBJECT_MATERIAL& material)
+{
+	int materialIndex = (int)m_objectMaterials.size();
+
+	m_objectMaterials.push_back(material);
+	// the first material defined with a tag keeps it
+	m_materialIndicesByTag.emplace(material.tag, materialIndex);
+
+	return(materialIndex);
+}
+
+/***********************************************************
+ *  BuildTransformation()
+ *
+ *  This method is used for composing a model matrix from
+ *  the passed in transformation values.  The result equals
+ *  translation * rotationX * rotationY * rotationZ * scale,
+ *  but is written out directly from the Euler angles so no
+ *  intermediate 4x4 matrices are built or multiplied.
+ ***********************************************************/
+glm::mat4 SceneManager::BuildTransformation(
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	const float cx = cosf(glm::radians(XrotationDegrees));
+	const float sx = sinf(glm::radians(XrotationDegrees));
+	const float cy = cosf(glm::radians(YrotationDegrees));
+	const float sy = sinf(glm::radians(YrotationDegrees));
+	const float cz = cosf(glm::radians(ZrotationDegrees));
+	const float sz = sinf(glm::radians(ZrotationDegrees));
+
+	glm::mat4 model;
+
+	// each rotation column scaled by its axis scale
+	model[0] = glm::vec4(
+		cy * cz,
+		cx * sz + sx * sy * cz,
+		sx * sz - cx * sy * cz,
+		0.0f) * scaleXYZ.x;
+	model[1] = glm::vec4(
+		-cy * sz,
+		cx * cz - sx * sy * sz,
+		sx * cz + cx * sy * sz,
+		0.0f) * scaleXYZ.y;
+	model[2] = glm::vec4(
+		sy,
+		-sx * cy,
+		cx * cy,
+		0.0f) * scaleXYZ.z;
+	// the translation goes straight into the last column
+	model[3] = glm::vec4(positionXYZ, 1.0f);
+
+	return(model);
 }
 
 /***********************************************************
@@ -255,28 +683,25 @@ void SceneManager::SetTransformations(
 	float ZrotationDegrees,
 	glm::vec3 positionXYZ)
 {
-	// variables for this method
-	glm::mat4 modelView;
-	glm::mat4 scale;
-	glm::mat4 rotationX;
-	glm::mat4 rotationY;
-	glm::mat4 rotationZ;
-	glm::mat4 translation;
-
-	// set the scale value in the transform buffer
-	scale = glm::scale(scaleXYZ);
-	// set the rotation values in the transform buffer
-	rotationX = glm::rotate(glm::radians(XrotationDegrees), glm::vec3(1.0f, 0.0f, 0.0f));
-	rotationY = glm::rotate(glm::radians(YrotationDegrees), glm::vec3(0.0f, 1.0f, 0.0f));
-	rotationZ = glm::rotate(glm::radians(ZrotationDegrees), glm::vec3(0.0f, 0.0f, 1.0f));
-	// set the translation value in the transform buffer
-	translation = glm::translate(positionXYZ);
-
-	modelView = translation * rotationX * rotationY * rotationZ * scale;
+	SetTransformations(BuildTransformation(
+		scaleXYZ,
+		XrotationDegrees,
+		YrotationDegrees,
+		ZrotationDegrees,
+		positionXYZ));
+}
 
-	if (NULL != m_pShaderManager)
+/***********************************************************
+ *  SetTransformations()
+ *
+ *  This method is used for setting a precomputed model
+ *  matrix into the transform buffer.
+ ***********************************************************/
+void SceneManager::SetTransformations(const glm::mat4& modelMatrix)
+{
+	if (NULL != m_pShaderUniforms)
 	{
-		m_pShaderManager->setMat4Value(g_ModelName, modelView);
+		m_pShaderUniforms->SetMat4Value(ShaderUniforms::UNIFORM_MODEL, modelMatrix);
 	}
 }
 
@@ -300,10 +725,12 @@ void SceneManager::SetShaderColor(
 	currentColor.b = blueColorValue;
 	currentColor.a = alphaValue;
 
-	if (NULL != m_pShaderManager)
+	if (NULL != m_pShaderUniforms)
 	{
-		m_pShaderManager->setIntValue(g_UseTextureName, false);
-		m_pShaderManager->setVec4Value(g_ColorValueName, currentColor);
+		m_pShaderUniforms->UseProgram(m_shaderVariants[0]);
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_TEXTURE, false);
+		m_pShaderUniforms->SetVec4Value(ShaderUniforms::UNIFORM_OBJECT_COLOR, currentColor);
+		m_currentTextureSlot = -1;
 	}
 }
 
@@ -311,18 +738,31 @@ void SceneManager::SetShaderColor(
  *  SetShaderTexture()
  *
  *  This method is used for setting the texture data
- *  associated with the passed in ID into the shader.
+ *  associated with the passed in tag into the shader.
  ***********************************************************/
 void SceneManager::SetShaderTexture(
-	std::string textureTag)
+	const std::string& textureTag)
 {
-	if (NULL != m_pShaderManager)
-	{
-		m_pShaderManager->setIntValue(g_UseTextureName, true);
+	SetShaderTexture(FindTextureSlot(textureTag));
+}
 
-		int textureID = -1;
-		textureID = FindTextureSlot(textureTag);
-		m_pShaderManager->setSampler2DValue(g_TextureValueName, textureID);
+/***********************************************************
+ *  SetShaderTexture()
+ *
+ *  This method is used for setting the texture data in the
+ *  passed in slot, as returned by FindTextureSlot(), into
+ *  the shader.
+ ***********************************************************/
+void SceneManager::SetShaderTexture(
+	int textureSlot)
+{
+	// skip the uniform updates when the texture is already set
+	if ((NULL != m_pShaderUniforms) && (textureSlot != m_currentTextureSlot))
+	{
+		m_pShaderUniforms->UseProgram(m_shaderVariants[1]);
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_TEXTURE, true);
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_TEXTURE_LAYER, textureSlot);
+		m_currentTextureSlot = textureSlot;
 	}
 }
 
@@ -334,9 +774,9 @@ void SceneManager::SetShaderTexture(
  ***********************************************************/
 void SceneManager::SetTextureUVScale(float u, float v)
 {
-	if (NULL != m_pShaderManager)
+	if (NULL != m_pShaderUniforms)
 	{
-		m_pShaderManager->setVec2Value("UVscale", glm::vec2(u, v));
+		m_pShaderUniforms->SetVec2Value(ShaderUniforms::UNIFORM_UV_SCALE, glm::vec2(u, v));
 	}
 }
 
@@ -344,26 +784,58 @@ void SceneManager::SetTextureUVScale(float u, float v)
  *  SetShaderMaterial()
  *
  *  This method is used for passing the material values
+ *  associated with the passed in tag into the shader.
+ ***********************************************************/
+void SceneManager::SetShaderMaterial(
+	const std::string& materialTag)
+{
+	SetShaderMaterial(FindMaterialIndex(materialTag));
+}
+
+/***********************************************************
+ *  SetShaderMaterial()
+ *
+ *  This method is used for passing the values of the material
+ *  at the passed in index, as returned by FindMaterialIndex(),
  *  into the shader.
  ***********************************************************/
 void SceneManager::SetShaderMaterial(
-	std::string materialTag)
+	int materialIndex)
 {
-	if (m_objectMaterials.size() > 0)
+	// every material already lives in the material uniform
+	// buffer, so switching is a single buffer range bind
+	if (NULL != m_pShaderUniforms)
 	{
-		OBJECT_MATERIAL material;
-		bool bReturn = false;
+		m_pShaderUniforms->BindMaterial(materialIndex);
+	}
+}
 
-		bReturn = FindMaterial(materialTag, material);
-		if (bReturn == true)
-		{
-			m_pShaderManager->setVec3Value("material.ambientColor", material.ambientColor);
-			m_pShaderManager->setFloatValue("material.ambientStrength", material.ambientStrength);
-			m_pShaderManager->setVec3Value("material.diffuseColor", material.diffuseColor);
-			m_pShaderManager->setVec3Value("material.specularColor", material.specularColor);
-			m_pShaderManager->setFloatValue("material.shininess", material.shininess);
-		}
+/***********************************************************
+ *  UploadObjectMaterials()
+ *
+ *  This method is used for copying the defined materials
+ *  into the material uniform buffer.
+ ***********************************************************/
+void SceneManager::UploadObjectMaterials()
+{
+	if (NULL == m_pShaderUniforms)
+	{
+		return;
+	}
+
+	std::vector<ShaderUniforms::MATERIAL_BLOCK> materials(m_objectMaterials.size());
+
+	for (size_t i = 0; i < m_objectMaterials.size(); i++)
+	{
+		materials[i].ambientColor = m_objectMaterials[i].ambientColor;
+		materials[i].ambientStrength = m_objectMaterials[i].ambientStrength;
+		materials[i].diffuseColor = m_objectMaterials[i].diffuseColor;
+		materials[i].shininess = m_objectMaterials[i].shininess;
+		materials[i].specularColor = m_objectMaterials[i].specularColor;
+		materials[i].padding = 0.0f;
 	}
+
+	m_pShaderUniforms->SetMaterials(materials);
 }
 
 /**************************************************************/
@@ -392,7 +864,7 @@ void SceneManager::DefineObjectMaterials()
 	metalMaterial.shininess = 10.0;
 	metalMaterial.tag = "metalMaterial";
 
-	m_objectMaterials.push_back(metalMaterial);
+	AddObjectMaterial(metalMaterial);
 
 	// Material for the wood in the pencil tip
 	// low reclectivity and shininess
@@ -404,7 +876,7 @@ void SceneManager::DefineObjectMaterials()
 	woodMaterial.shininess = 0.3;
 	woodMaterial.tag = "woodMaterial";
 
-	m_objectMaterials.push_back(woodMaterial);
+	AddObjectMaterial(woodMaterial);
 
 	// Material for plastic used in the blue sleeved cards
 	// Matte material with a higher shininess
@@ -416,7 +888,7 @@ void SceneManager::DefineObjectMaterials()
 	plasticMaterial.shininess = 6.0f;
 	plasticMaterial.tag = "plasticMaterial";
 
-	m_objectMaterials.push_back(plasticMaterial);
+	AddObjectMaterial(plasticMaterial);
 
 
 	// Material for the face up trading card
@@ -429,7 +901,7 @@ void SceneManager::DefineObjectMaterials()
 	cardMaterial.shininess = 0.1f;
 	cardMaterial.tag = "cardMaterial";
 
-	m_objectMaterials.push_back(cardMaterial);
+	AddObjectMaterial(cardMaterial);
 
 	// Material for fabric used in the scene for the playmat
 	// Low ambient collor with no shininess
@@ -441,7 +913,7 @@ void SceneManager::DefineObjectMaterials()
 	fabricMaterial.shininess = 0.0f;
 	fabricMaterial.tag = "fabricMaterial";
 
-	m_objectMaterials.push_back(fabricMaterial);
+	AddObjectMaterial(fabricMaterial);
 
 	// Material for the glossy lacquered outside of a pencil
 	// Bright yellow with a strong shininess for the glossy look of a pencil
@@ -453,7 +925,7 @@ void SceneManager::DefineObjectMaterials()
 	glossyPencilMaterial.shininess = 2.0f; 
 	glossyPencilMaterial.tag = "glossyPencilMaterial";
 
-	m_objectMaterials.push_back(glossyPencilMaterial);
+	AddObjectMaterial(glossyPencilMaterial);
 
 	// Material for pencil lead
 	// Dark gray with no shininess
@@ -465,7 +937,7 @@ void SceneManager::DefineObjectMaterials()
 	pencilLeadMaterial.shininess = 0.0f;
 	pencilLeadMaterial.tag = "pencilLeadMaterial";
 
-	m_objectMaterials.push_back(pencilLeadMaterial);
+	AddObjectMaterial(pencilLeadMaterial);
 
 	// Material for pink rubber eraser
 	// Pink with a low shininess
@@ -477,7 +949,7 @@ void SceneManager::DefineObjectMaterials()
 	pinkEraserMaterial.shininess = 2.0f;
 	pinkEraserMaterial.tag = "pinkEraserMaterial";
 
-	m_objectMaterials.push_back(pinkEraserMaterial);
+	AddObjectMaterial(pinkEraserMaterial);
 
 	// Material for marble used for the dice
 	// Matte material with a higher shininess
@@ -489,7 +961,7 @@ void SceneManager::DefineObjectMaterials()
 	marbleMaterial.shininess = 6.0f;
 	marbleMaterial.tag = "marbleMaterial";
 
-	m_objectMaterials.push_back(marbleMaterial);
+	AddObjectMaterial(marbleMaterial);
 
 }
 
@@ -502,49 +974,205 @@ void SceneManager::DefineObjectMaterials()
 /******************************************************************/
 void SceneManager::SetupSceneLights()
 {
-	// this line of code is NEEDED for telling the shaders to render 
+	if (NULL == m_pShaderUniforms)
+	{
+		return;
+	}
+
+	// this line of code is NEEDED for building the shaders that render 
 	// the 3D scene with custom lighting - to use the default rendered 
 	// lighting then comment out the following line
-	m_pShaderManager->setBoolValue(g_UseLightingName, true);
+	m_bUseLighting = true;
+
+	ShaderUniforms::LIGHT_SOURCE lights[2] = {};
 
 	// Lightbulb to the west
-	m_pShaderManager->setVec3Value("lightSources[0].position", -30.0f, 14.0f, -2.0f);
-	m_pShaderManager->setVec3Value("lightSources[0].ambientColor", 0.3f, 0.3f, 0.4f);
-	m_pShaderManager->setVec3Value("lightSources[0].diffuseColor", 0.6f, 0.5f, 0.4f);
-	m_pShaderManager->setVec3Value("lightSources[0].specularColor", 0.2f, 0.2f, 0.2f);
-	m_pShaderManager->setFloatValue("lightSources[0].focalStrength", 32.0f);
-	m_pShaderManager->setFloatValue("lightSources[0].specularIntensity", 0.4f);
+	lights[0].position = glm::vec3(-30.0f, 14.0f, -2.0f);
+	lights[0].ambientColor = glm::vec3(0.3f, 0.3f, 0.4f);
+	lights[0].diffuseColor = glm::vec3(0.6f, 0.5f, 0.4f);
+	lights[0].specularColor = glm::vec3(0.2f, 0.2f, 0.2f);
+	lights[0].focalStrength = 32.0f;
+	lights[0].specularIntensity = 0.4f;
 
 	// Sunlight to the north
-	m_pShaderManager->setVec3Value("lightSources[1].position", 3.0f, 20.0f, -26.0f);
-	m_pShaderManager->setVec3Value("lightSources[1].ambientColor", 0.3f, 0.3f, 0.3f);
-	m_pShaderManager->setVec3Value("lightSources[1].diffuseColor", 0.6f, 0.55f, 0.4f);
-	m_pShaderManager->setVec3Value("lightSources[1].specularColor", 0.6f, 0.6f, 0.6f);
-	m_pShaderManager->setFloatValue("lightSources[1].focalStrength", 32.0f); 
-	m_pShaderManager->setFloatValue("lightSources[1].specularIntensity", 0.6f);
+	lights[1].position = glm::vec3(3.0f, 20.0f, -26.0f);
+	lights[1].ambientColor = glm::vec3(0.3f, 0.3f, 0.3f);
+	lights[1].diffuseColor = glm::vec3(0.6f, 0.55f, 0.4f);
+	lights[1].specularColor = glm::vec3(0.6f, 0.6f, 0.6f);
+	lights[1].focalStrength = 32.0f; 
+	lights[1].specularIntensity = 0.6f;
+
+	// all the lights go into the light uniform buffer at once, and
+	// the shader variants only loop over these
+	m_pShaderUniforms->SetLightSources(lights, 2);
+	m_lightCount = 2;
+
+	// both lights cast shadows
+	glm::vec3 lightPositions[2] = { lights[0].position, lights[1].position };
+	m_shadowMaps.SetLightPositions(lightPositions, 2);
+	// the built-in scene has no point lights of its own
+	m_pointLights.clear();
+}
 
+/***********************************************************
+ *  BuildPointLights()
+ *
+ *  This method is used for adding the generated point
+ *  lights, in random colors and places over the scene
+ *  bounds, and uploading every point light for binning.
+ *  The ranges shrink as the lights get denser, so each
+ *  point keeps about the same number of lights in reach.
+ ***********************************************************/
+void SceneManager::BuildPointLights()
+{
+	if (!m_clusteredLights.IsInitialized())
+	{
+		return;
+	}
 
-}
+	SceneBVH::BOUNDS bounds;
+	int generatedCount = m_sceneSettings.pointLightCount;
 
+	if ((generatedCount > 0) && m_sceneBVH.GetBounds(bounds))
+	{
+		glm::vec3 size = bounds.maximum - bounds.minimum;
+		float range = std::max(std::cbrt(size.x * size.y * size.z / (float)generatedCount) * g_PointLightReach, 0.5f);
 
-/******************************************************************/
-/*  LoadSceneTextures()											***/
-/*																***/
-/*  This method is used for preparing the 3D scene by loading	***/
-/*  the shapes, textures in memory to support the 3D scene		***/
-/*  rendering													***/
-/******************************************************************/
-void SceneManager::LoadSceneTextures()
-{
-	/*** STUDENTS - add the code BELOW for loading the textures that ***/
-	/*** will be used for mapping to objects in the 3D scene. Up to  ***/
-	/*** 16 textures can be loaded per scene. Refer to the code in   ***/
-	/*** the OpenGL Sample for help.                                 ***/
+		std::mt19937 generator(m_sceneSettings.seed);
+		std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
 
+		for (int i = 0; i < generatedCount; i++)
+		{
+			ClusteredLights::POINT_LIGHT light;
+			light.position = glm::vec3(
+				bounds.minimum.x + size.x * unitDistribution(generator),
+				bounds.minimum.y + size.y * unitDistribution(generator),
+				bounds.minimum.z + size.z * unitDistribution(generator));
+			light.range = range;
+			light.color = glm::vec3(
+				0.2f + 0.8f * unitDistribution(generator),
+				0.2f + 0.8f * unitDistribution(generator),
+				0.2f + 0.8f * unitDistribution(generator));
+			light.specularIntensity = 0.5f;
+			m_pointLights.push_back(light);
+		}
 
-	bool bReturn = false;
+		std::cout << "Generated " << generatedCount << " point lights with seed " << m_sceneSettings.seed << std::endl;
+	}
 
-	bReturn = CreateGLTexture(
+	m_clusteredLights.SetLights(m_pointLights);
+}
+
+/***********************************************************
+ *  BuildShaderVariants()
+ *
+ *  This method is used for building the textured and
+ *  untextured shader programs for the scene lighting.  The
+ *  options are compiled in as #defines, so the shaders have
+ *  no branches on them, and the lights loop has a constant
+ *  count.  The lit variants sample the shadow map of every
+ *  light when the maps can be created, and add the point
+ *  lights of their light cluster when the scene has point
+ *  lights and the clusters can be binned, and sample the
+ *  streamed texture levels when they are streamed.  A
+ *  variant that fails to build falls back to the program
+ *  loaded at startup.  The depth only program of the
+ *  pre-pass is built too when it is asked for.
+ ***********************************************************/
+void SceneManager::BuildShaderVariants()
+{
+	m_shaderVariants[0] = 0;
+	m_shaderVariants[1] = 0;
+	m_depthProgram = -1;
+
+	if ((NULL == m_pShaderCache) || (NULL == m_pShaderUniforms))
+	{
+		return;
+	}
+
+	bool bClusters = false;
+	if (m_bUseLighting && (!m_pointLights.empty() || (m_sceneSettings.pointLightCount > 0)))
+	{
+		bClusters = m_clusteredLights.Initialize("Shaders/lightClusterShader.glsl");
+		if (!bClusters)
+		{
+			std::cout << "Could not set up the light clusters, the point lights are left off" << std::endl;
+		}
+	}
+
+	bool bUseLighting = m_bUseLighting && ((m_lightCount > 0) || bClusters);
+	int shadowCount = 0;
+	if (bUseLighting && m_shadowMaps.Initialize(m_pShaderCache,
+		"Shaders/shadowVertexShader.glsl",
+		"Shaders/shadowFragmentShader.glsl"))
+	{
+		shadowCount = m_shadowMaps.GetLightCount();
+	}
+
+	for (int textured = 0; textured < 2; textured++)
+	{
+		std::ostringstream defines;
+		defines << "#define USE_TEXTURE " << textured << "\n";
+		defines << "#define USE_LIGHTING " << (bUseLighting ? 1 : 0) << "\n";
+		defines << "#define LIGHT_COUNT " << m_lightCount << "\n";
+		defines << "#define SHADOW_COUNT " << shadowCount << "\n";
+		defines << "#define USE_CLUSTERS " << (bClusters ? 1 : 0) << "\n";
+		defines << "#define USE_STREAMING " << (m_textureStreamer.IsInitialized() ? 1 : 0) << "\n";
+
+		GLuint program = m_pShaderCache->LoadProgram(
+			"Shaders/vertexShader.glsl",
+			"Shaders/fragmentShader.glsl",
+			defines.str());
+		int programIndex = (program != 0) ? m_pShaderUniforms->AddProgram(program) : -1;
+		if (programIndex < 0)
+		{
+			std::cout << "Could not build shader variant, using the default shaders" << std::endl;
+			continue;
+		}
+		m_shaderVariants[textured] = programIndex;
+	}
+
+	// the maps stay bound to their own unit, next to the
+	// texture array on unit 0
+	if (shadowCount > 0)
+	{
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_SHADOW_MAPS, ShadowMaps::TEXTURE_UNIT);
+	}
+
+	// the pre-pass program reads the frame block like the
+	// variants, so it is registered with them
+	if (m_sceneSettings.bDepthPrepass)
+	{
+		GLuint program = m_pShaderCache->LoadProgram(
+			"Shaders/depthVertexShader.glsl",
+			"Shaders/shadowFragmentShader.glsl");
+		m_depthProgram = (program != 0) ? m_pShaderUniforms->AddProgram(program) : -1;
+		if (m_depthProgram < 0)
+		{
+			std::cout << "Could not build the depth pre-pass shaders, the pre-pass is left off" << std::endl;
+		}
+	}
+}
+
+
+/******************************************************************/
+/*  LoadSceneTextures()											***/
+/*																***/
+/*  This method is used for preparing the 3D scene by loading	***/
+/*  the shapes, textures in memory to support the 3D scene		***/
+/*  rendering													***/
+/******************************************************************/
+void SceneManager::LoadSceneTextures()
+{
+	/*** STUDENTS - add the code BELOW for loading the textures that ***/
+	/*** will be used for mapping to objects in the 3D scene. Up to  ***/
+	/*** 16 textures can be loaded per scene. Refer to the code in   ***/
+	/*** the OpenGL Sample for help.                                 ***/
+
+
+	bool bReturn = false;
+
+	bReturn = CreateGLTexture(
 		"Textures/Eevee_playmat_texture.png", "playmat");
 	bReturn = CreateGLTexture(
 		"Textures/Wood_texture.jpg", "wood");
@@ -565,107 +1193,1642 @@ void SceneManager::LoadSceneTextures()
 	bReturn = CreateGLTexture(
 		"Textures/Marble_texture.jpg", "marble");
 
-	// after the texture image data is loaded into memory, the
-	// loaded textures need to be bound to texture slots - there
-	// are a total of 16 available slots for scene textures
-	BindGLTextures();
+	// the images are decoded in the background - the texture
+	// array is created now with a placeholder in every layer,
+	// and RenderScene() swaps the images in as they finish
+	BindGLTextures();
+}
+
+
+/***********************************************************
+ *  LoadSceneFileTextures()
+ *
+ *  This method is used for queueing the textures of the
+ *  loaded scene file, recording the texture array layer of
+ *  each texture record so the nodes need no tag lookups.
+ ***********************************************************/
+void SceneManager::LoadSceneFileTextures(std::vector<int>& textureSlots)
+{
+	const SceneFile::TEXTURE_RECORD* pTextures = m_sceneFile.GetTextures();
+	int textureCount = m_sceneFile.GetTextureCount();
+
+	textureSlots.assign(textureCount, -1);
+	for (int i = 0; i < textureCount; i++)
+	{
+		int slot = (int)m_textureIDs.size();
+		if (CreateGLTexture(pTextures[i].filename, pTextures[i].tag))
+		{
+			textureSlots[i] = slot;
+		}
+	}
+
+	// the images are decoded in the background, the same as
+	// for the built-in scene
+	BindGLTextures();
+}
+
+/***********************************************************
+ *  LoadSceneFileMaterials()
+ *
+ *  This method is used for defining the materials of the
+ *  loaded scene file, recording the material index of each
+ *  material record.
+ ***********************************************************/
+void SceneManager::LoadSceneFileMaterials(std::vector<int>& materialIndices)
+{
+	const SceneFile::MATERIAL_RECORD* pMaterials = m_sceneFile.GetMaterials();
+	int materialCount = m_sceneFile.GetMaterialCount();
+
+	materialIndices.assign(materialCount, -1);
+	for (int i = 0; i < materialCount; i++)
+	{
+		const SceneFile::MATERIAL_RECORD& record = pMaterials[i];
+		OBJECT_MATERIAL material;
+
+		material.ambientColor = glm::vec3(record.ambientColor[0], record.ambientColor[1], record.ambientColor[2]);
+		material.ambientStrength = record.ambientStrength;
+		material.diffuseColor = glm::vec3(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]);
+		material.specularColor = glm::vec3(record.specularColor[0], record.specularColor[1], record.specularColor[2]);
+		material.shininess = record.shininess;
+		material.tag = record.tag;
+
+		materialIndices[i] = AddObjectMaterial(material);
+	}
+}
+
+/***********************************************************
+ *  SetupSceneFileLights()
+ *
+ *  This method is used for setting up the lights of the
+ *  loaded scene file.  A light with a range is a point
+ *  light, shaded through the light clusters; the others
+ *  reach the whole scene and cast shadows, and those past
+ *  the most the light buffer holds are dropped.  A scene
+ *  without lights is drawn with the unlit shader variants.
+ ***********************************************************/
+void SceneManager::SetupSceneFileLights()
+{
+	if (NULL == m_pShaderUniforms)
+	{
+		return;
+	}
+
+	const SceneFile::LIGHT_RECORD* pLights = m_sceneFile.GetLights();
+	int recordCount = m_sceneFile.GetLightCount();
+	int lightCount = 0;
+	int droppedCount = 0;
+
+	ShaderUniforms::LIGHT_SOURCE lights[ShaderUniforms::MAX_LIGHT_SOURCES] = {};
+	glm::vec3 lightPositions[ShaderUniforms::MAX_LIGHT_SOURCES];
+
+	m_pointLights.clear();
+	for (int i = 0; i < recordCount; i++)
+	{
+		const SceneFile::LIGHT_RECORD& record = pLights[i];
+
+		if (record.range > 0.0f)
+		{
+			ClusteredLights::POINT_LIGHT pointLight;
+			pointLight.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+			pointLight.range = record.range;
+			pointLight.color = glm::vec3(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]);
+			pointLight.specularIntensity = record.specularIntensity;
+			m_pointLights.push_back(pointLight);
+			continue;
+		}
+		if (lightCount == ShaderUniforms::MAX_LIGHT_SOURCES)
+		{
+			droppedCount++;
+			continue;
+		}
+
+		ShaderUniforms::LIGHT_SOURCE& light = lights[lightCount];
+		light.position = glm::vec3(record.position[0], record.position[1], record.position[2]);
+		light.ambientColor = glm::vec3(record.ambientColor[0], record.ambientColor[1], record.ambientColor[2]);
+		light.diffuseColor = glm::vec3(record.diffuseColor[0], record.diffuseColor[1], record.diffuseColor[2]);
+		light.specularColor = glm::vec3(record.specularColor[0], record.specularColor[1], record.specularColor[2]);
+		light.focalStrength = record.focalStrength;
+		light.specularIntensity = record.specularIntensity;
+		lightPositions[lightCount] = light.position;
+		lightCount++;
+	}
+
+	if (droppedCount > 0)
+	{
+		std::cout << "Scene file has " << (lightCount + droppedCount) << " lights without a range, only the first "
+			<< ShaderUniforms::MAX_LIGHT_SOURCES << " are used" << std::endl;
+	}
+
+	m_bUseLighting = (lightCount > 0) || !m_pointLights.empty();
+	m_pShaderUniforms->SetLightSources(lights, lightCount);
+	m_lightCount = lightCount;
+	m_shadowMaps.SetLightPositions(lightPositions, lightCount);
+}
+
+
+/***********************************************************
+ *  PrepareScene()
+ *
+ *  This method is used for preparing the 3D scene by loading
+ *  the shapes, textures in memory to support the 3D scene 
+ *  rendering
+ ***********************************************************/
+void SceneManager::PrepareScene()
+{
+	// the scene content comes from the scene file when it
+	// loads, otherwise the built-in scene is used
+	bool bSceneFile = m_sceneFile.Load(m_sceneSettings.sceneFilename);
+	std::vector<int> textureSlots;
+	std::vector<int> materialIndices;
+
+	if (bSceneFile)
+	{
+		LoadSceneFileTextures(textureSlots);
+		LoadSceneFileMaterials(materialIndices);
+		UploadObjectMaterials();
+		SetupSceneFileLights();
+	}
+	else
+	{
+		std::cout << "Using the built-in scene" << std::endl;
+
+		// load the textures for the 3D scene
+		LoadSceneTextures();
+
+		// define the materials that will be used for the objects
+		// in the 3D scene
+		DefineObjectMaterials();
+		UploadObjectMaterials();
+
+		// add and defile the light sources for the 3D scene
+		SetupSceneLights();
+	}
+	// and build the shaders for them
+	BuildShaderVariants();
+
+	// only one instance of a particular mesh needs to be
+	// loaded in memory no matter how many times it is drawn
+	// in the rendered 3D scene
+
+	m_basicMeshes->SetPackedMeshes(m_sceneSettings.bPackedMeshes);
+	m_basicMeshes->LoadPlaneMesh(); 
+	m_basicMeshes->LoadConeMesh();
+	m_basicMeshes->LoadBoxMesh();
+	m_basicMeshes->LoadCylinderMesh();
+	m_basicMeshes->LoadTaperedCylinderMesh();
+	m_basicMeshes->LoadPyramid3Mesh();
+
+	// build the retained scene graph once - the per-frame
+	// render pass only walks these nodes
+	m_sceneNodes.Clear();
+	m_bSceneChanged = true;
+	if (m_sceneSettings.objectCount > 0)
+	{
+		BuildStressScene();
+	}
+	else if (bSceneFile)
+	{
+		BuildSceneFileNodes(textureSlots, materialIndices);
+	}
+	else
+	{
+		BuildPencil();
+		BuildCards();
+		BuildDice();
+	}
+	// every record was copied, so the file can be unmapped
+	m_sceneFile.Close();
+
+	// group the nodes into instanced batches
+	BuildRenderBatches();
+	// and index their bounds for frustum culling
+	BuildSceneBVH();
+	// the generated point lights are spread over those bounds
+	BuildPointLights();
+
+	// the indirect path needs compute shaders - without them
+	// the scene keeps the CPU culling
+	if (m_sceneSettings.bGPUCulling &&
+		(m_gpuCulling.Initialize("Shaders/cullingShader.glsl") == false))
+	{
+		std::cout << "GPU culling is unavailable, culling on the CPU" << std::endl;
+		m_sceneSettings.bGPUCulling = false;
+	}
+
+	// the occlusion test runs in the culling shader, since the
+	// CPU path would have to read the depth pyramid back
+	if (m_sceneSettings.bOcclusionCulling)
+	{
+		if (!m_sceneSettings.bGPUCulling)
+		{
+			std::cout << "Occlusion culling needs --gpu-culling, it is left off" << std::endl;
+		}
+		else if (!m_hiZBuffer.Initialize("Shaders/hiZShader.glsl"))
+		{
+			std::cout << "Could not build the depth pyramid, occlusion culling is left off" << std::endl;
+		}
+	}
+
+	// the finer mesh levels are only streamed where the CPU
+	// culling sees which levels are drawn
+	RegisterMeshResidency();
+
+	// the compute programs were left in use while they were set up
+	if (NULL != m_pShaderUniforms)
+	{
+		m_pShaderUniforms->UseProgram();
+	}
+}
+
+
+/***********************************************************
+ *  RenderScene()
+ *
+ *  This method is used for rendering the 3D scene from the
+ *  retained scene nodes built in PrepareScene().  Only nodes
+ *  flagged as dirty have their world matrix rebuilt.  The
+ *  nodes outside the view frustum are culled, and every
+ *  batch with visible instances is submitted to the render
+ *  queue, which is sorted by state and flushed once: opaque
+ *  batches first, then transparent batches back to front.
+ *  The shadow maps are drawn first when they are stale.
+ *  With GPU culling the opaque batches skip the queue and
+ *  are drawn with one indirect multi-draw per mesh.  With
+ *  the depth pre-pass the opaque batches are drawn twice:
+ *  depth only and front to back first, then shaded in
+ *  state order with GL_EQUAL, so each pixel is shaded only
+ *  once.  The opaque depth is then reduced into the depth
+ *  pyramid the next frame culls against.
+ ***********************************************************/
+void SceneManager::RenderScene()
+{
+	if (NULL == m_pShaderUniforms)
+	{
+		return;
+	}
+
+	// swap in the textures that finished loading
+	UpdateTextureLoads();
+	UpdateDirtyInstances();
+	m_bSceneChanged = false;
+
+	// the shadow maps are only redrawn when a caster moved
+	if (m_shadowMaps.NeedsUpdate())
+	{
+		RenderShadowMaps();
+	}
+
+	bool bGPUCulling = m_sceneSettings.bGPUCulling;
+	if (bGPUCulling)
+	{
+		CullSceneGPU();
+	}
+	else
+	{
+		CullScene();
+	}
+	// stream in what the culling found visible
+	UpdateResidency();
+
+	// the point lights are binned into the clusters of the view
+	if (m_clusteredLights.Update(m_pShaderUniforms->GetFrameData().view, m_pShaderUniforms->GetFrameData().projection))
+	{
+		// the compute program was left in use
+		m_pShaderUniforms->UseProgram();
+	}
+
+	const glm::mat4& view = m_pShaderUniforms->GetFrameData().view;
+	bool bDepthPrepass = (m_depthProgram >= 0);
+	// the GPU path keeps every batch, in the order of its
+	// indirect commands
+	const std::vector<RENDER_BATCH>& batches = bGPUCulling ? m_renderBatches : m_visibleBatches;
+	const std::vector<SceneMeshes::INSTANCE_DATA>& instances = bGPUCulling ? m_instanceData : m_visibleInstanceData;
+
+	m_renderQueue.Clear();
+	for (size_t i = 0; i < batches.size(); i++)
+	{
+		const RENDER_BATCH& batch = batches[i];
+		RenderQueue::DRAW_COMMAND command;
+
+		if (bGPUCulling && !batch.bTransparent)
+		{
+			continue;
+		}
+
+		command.sortKey = 0;
+		command.shader = m_shaderVariants[batch.bTextured ? 1 : 0];
+		command.mesh = batch.mesh;
+		command.lod = batch.lod;
+		// all textures are layers of the one bound texture array
+		command.textureSlot = 0;
+		command.materialIndex = batch.materialIndex;
+		// the GPU path draws a batch by its indirect command
+		command.firstInstance = bGPUCulling ? (int)i : batch.firstInstance;
+		command.instanceCount = batch.instanceCount;
+
+		// view depth of the first instance of the batch
+		glm::vec4 viewPosition = view * instances[batch.firstInstance].model[3];
+
+		m_renderQueue.Submit(
+			batch.bTransparent ? RenderQueue::TRANSPARENT_PASS : RenderQueue::OPAQUE_PASS,
+			command,
+			-viewPosition.z);
+
+		// the pre-pass draws the same batch depth only
+		if (bDepthPrepass && !batch.bTransparent)
+		{
+			command.shader = m_depthProgram;
+			m_renderQueue.Submit(RenderQueue::DEPTH_PASS, command, -viewPosition.z);
+		}
+	}
+	m_renderQueue.Sort();
+
+	m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_INSTANCING, true);
+	// indirect draws mix materials, so each instance brings its own
+	m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_INSTANCE_MATERIALS, bGPUCulling);
+
+	if (bDepthPrepass)
+	{
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->BeginCPUScope(FrameProfiler::CPU_DEPTH_PREPASS);
+			m_pProfiler->BeginGPUScope(FrameProfiler::GPU_DEPTH_PREPASS);
+		}
+
+		glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+		if (bGPUCulling)
+		{
+			m_pShaderUniforms->UseProgram(m_depthProgram);
+			DrawIndirectBatches();
+		}
+		else
+		{
+			FlushRenderQueue(RenderQueue::DEPTH_PASS);
+		}
+		glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+
+		// the depth is final, so the shading pass only keeps the
+		// fragments that match it and writes nothing more
+		glDepthFunc(GL_EQUAL);
+		glDepthMask(GL_FALSE);
+
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->EndGPUScope(FrameProfiler::GPU_DEPTH_PREPASS);
+			m_pProfiler->EndCPUScope(FrameProfiler::CPU_DEPTH_PREPASS);
+			// the color mask changes and the depth test change
+			m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES, 4);
+		}
+	}
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->BeginCPUScope(FrameProfiler::CPU_OPAQUE_PASS);
+		m_pProfiler->BeginGPUScope(FrameProfiler::GPU_OPAQUE_PASS);
+	}
+	if (bGPUCulling)
+	{
+		// indirect draws mix textured and flat instances, which
+		// the textured variant tells apart per instance
+		m_pShaderUniforms->UseProgram(m_shaderVariants[1]);
+		DrawIndirectBatches();
+	}
+	else
+	{
+		FlushRenderQueue(RenderQueue::OPAQUE_PASS);
+	}
+	if (bDepthPrepass)
+	{
+		glDepthFunc(GL_LESS);
+	}
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->EndGPUScope(FrameProfiler::GPU_OPAQUE_PASS);
+		m_pProfiler->EndCPUScope(FrameProfiler::CPU_OPAQUE_PASS);
+		m_pProfiler->BeginCPUScope(FrameProfiler::CPU_TRANSPARENT_PASS);
+		m_pProfiler->BeginGPUScope(FrameProfiler::GPU_TRANSPARENT_PASS);
+	}
+
+	// transparent objects blend over the opaque ones without
+	// hiding each other in the depth buffer
+	glDepthMask(GL_FALSE);
+	FlushRenderQueue(RenderQueue::TRANSPARENT_PASS);
+	glDepthMask(GL_TRUE);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->EndGPUScope(FrameProfiler::GPU_TRANSPARENT_PASS);
+		m_pProfiler->EndCPUScope(FrameProfiler::CPU_TRANSPARENT_PASS);
+		// the two depth mask changes
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES, 2);
+	}
+
+	// the opaque depth of this frame culls the next one
+	if (m_hiZBuffer.IsInitialized())
+	{
+		const ShaderUniforms::FRAME_BLOCK& frameData = m_pShaderUniforms->GetFrameData();
+
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->BeginGPUScope(FrameProfiler::GPU_HIZ_BUILD);
+		}
+		m_hiZBuffer.Build(frameData.projection * frameData.view);
+		// the compute program was left in use
+		m_pShaderUniforms->UseProgram();
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->EndGPUScope(FrameProfiler::GPU_HIZ_BUILD);
+		}
+	}
+
+	if (bGPUCulling)
+	{
+		glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+		m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_INSTANCE_MATERIALS, false);
+	}
+
+	// later immediate draws use the model and UV scale uniforms
+	m_pShaderUniforms->SetIntValue(ShaderUniforms::UNIFORM_USE_INSTANCING, false);
+}
+
+/***********************************************************
+ *  FlushRenderQueue()
+ *
+ *  This method is used for drawing the sorted commands of a
+ *  render queue pass.  The texture layer comes from the
+ *  instance data, so only shader variant and material
+ *  changes are sent, and only when they differ from the
+ *  previous command.  On the GPU culling path each command
+ *  names its indirect command and the material comes from
+ *  the instance too.  The depth pass writes no color, so it
+ *  sends no material.
+ ***********************************************************/
+void SceneManager::FlushRenderQueue(RenderQueue::PASS pass)
+{
+	const RenderQueue::COMMAND_LIST& commands = m_renderQueue.GetCommands(pass);
+
+	for (size_t i = 0; i < commands.size(); i++)
+	{
+		const RenderQueue::DRAW_COMMAND& command = commands[i];
+
+		// UseProgram() skips the switch when the variant is
+		// already current
+		m_pShaderUniforms->UseProgram(command.shader);
+
+		if (m_sceneSettings.bGPUCulling)
+		{
+			DrawMeshIndirect((MESH_TYPE)command.mesh, command.firstInstance, 1);
+			continue;
+		}
+
+		// SetShaderMaterial() skips the update when the material
+		// is already current
+		if (pass != RenderQueue::DEPTH_PASS)
+		{
+			SetShaderMaterial(command.materialIndex);
+		}
+
+		DrawMeshInstanced((MESH_TYPE)command.mesh, command.instanceCount, command.firstInstance, command.lod);
+	}
+}
+
+/***********************************************************
+ *  DrawIndirectBatches()
+ *
+ *  This method is used for drawing every opaque batch from
+ *  the indirect commands the culling shader filled, with
+ *  one multi-draw per mesh, or a single one when the meshes
+ *  are packed.  The program in use is kept, so the depth
+ *  pre-pass and the shading pass draw the same commands.
+ ***********************************************************/
+void SceneManager::DrawIndirectBatches()
+{
+	m_gpuCulling.BindCommands();
+	for (size_t i = 0; i < m_indirectDraws.size(); i++)
+	{
+		if (m_basicMeshes->IsPacked())
+		{
+			m_basicMeshes->DrawPackedIndirect(m_indirectDraws[i].firstCommand, m_indirectDraws[i].commandCount);
+		}
+		else
+		{
+			DrawMeshIndirect(m_indirectDraws[i].mesh, m_indirectDraws[i].firstCommand, m_indirectDraws[i].commandCount);
+		}
+	}
+}
+
+/***********************************************************
+ *  BuildRenderBatches()
+ *
+ *  This method is used for grouping the scene nodes that
+ *  share a mesh, material and shader variant into render
+ *  batches and laying out their instances contiguously.
+ *  The instance buffer is filled by CullScene() with the
+ *  visible ones.
+ ***********************************************************/
+void SceneManager::BuildRenderBatches()
+{
+	int nodeCount = m_sceneNodes.GetCount();
+	std::vector<int> order(nodeCount);
+	std::vector<int> dirtyNodes;
+
+	for (int i = 0; i < nodeCount; i++)
+	{
+		order[i] = i;
+	}
+
+	// new nodes get their world matrices here, in SIMD groups
+	m_sceneNodes.FindDirtyNodes(0, nodeCount, dirtyNodes);
+	m_sceneNodes.UpdateWorldMatrices(dirtyNodes.data(), (int)dirtyNodes.size());
+
+	// group the nodes by state - nodes with the same state stay
+	// in the order they were added
+	std::stable_sort(order.begin(), order.end(),
+		[this](int left, int right)
+		{
+			bool bLeftTransparent = m_sceneNodes.IsTransparent(left);
+			bool bRightTransparent = m_sceneNodes.IsTransparent(right);
+
+			if (bLeftTransparent != bRightTransparent)
+			{
+				return(bRightTransparent);
+			}
+			if (m_sceneNodes.GetMesh(left) != m_sceneNodes.GetMesh(right))
+			{
+				return(m_sceneNodes.GetMesh(left) < m_sceneNodes.GetMesh(right));
+			}
+			if (m_sceneNodes.GetMaterialIndex(left) != m_sceneNodes.GetMaterialIndex(right))
+			{
+				return(m_sceneNodes.GetMaterialIndex(left) < m_sceneNodes.GetMaterialIndex(right));
+			}
+			return((m_sceneNodes.GetTextureSlot(left) < 0) && (m_sceneNodes.GetTextureSlot(right) >= 0));
+		});
+
+	m_renderBatches.clear();
+	m_instanceData.resize(nodeCount);
+	m_instanceNodes.resize(nodeCount);
+	m_instanceLods.assign(nodeCount, 0);
+	m_instanceTextureLevels.assign(nodeCount, (int)TextureStreamer::FALLBACK_LEVEL);
+	m_instanceCullFrames.assign(nodeCount, 0);
+	m_cullFrame = 0;
+
+	for (size_t i = 0; i < order.size(); i++)
+	{
+		int node = order[i];
+		MESH_TYPE mesh = (MESH_TYPE)m_sceneNodes.GetMesh(node);
+		int materialIndex = m_sceneNodes.GetMaterialIndex(node);
+		bool bTransparent = m_sceneNodes.IsTransparent(node);
+		bool bTextured = (m_sceneNodes.GetTextureSlot(node) >= 0);
+
+		m_sceneNodes.SetInstanceIndex(node, (int)i);
+		m_instanceNodes[i] = node;
+		m_instanceData[i].model = m_sceneNodes.GetWorldMatrix(node);
+		m_instanceData[i].UVscale = m_sceneNodes.GetUVScale(node);
+		m_instanceData[i].textureLayer = m_sceneNodes.GetTextureSlot(node);
+		// materials past the table fall back to the bound one
+		m_instanceData[i].materialIndex =
+			(materialIndex < ShaderUniforms::MAX_MATERIALS) ? materialIndex : -1;
+
+		// start a new batch whenever the state changes - each
+		// transparent node gets its own batch so that it can be
+		// sorted back to front on its own
+		if (m_renderBatches.empty() ||
+			bTransparent ||
+			m_renderBatches.back().bTransparent ||
+			(m_renderBatches.back().mesh != mesh) ||
+			(m_renderBatches.back().materialIndex != materialIndex) ||
+			(m_renderBatches.back().bTextured != bTextured))
+		{
+			RENDER_BATCH batch;
+			batch.mesh = mesh;
+			batch.materialIndex = materialIndex;
+			batch.bTransparent = bTransparent;
+			batch.bTextured = bTextured;
+			batch.lod = 0;
+			batch.firstInstance = (int)i;
+			batch.instanceCount = 0;
+			m_renderBatches.push_back(batch);
+		}
+		m_renderBatches.back().instanceCount++;
+	}
+
+	m_batchVisibility.resize(m_renderBatches.size());
+	m_bInstancesChanged = true;
+	// the casters are the opaque batches
+	m_shadowMaps.Invalidate();
+}
+
+/***********************************************************
+ *  UpdateDirtyInstances()
+ *
+ *  This method is used for rebuilding the world matrices of
+ *  the scene nodes flagged as dirty and refitting their
+ *  bounds in the bounding volume hierarchy.  The matrices
+ *  are rebuilt by the jobs, each job gathering the dirty
+ *  nodes of its range and rebuilding them in SIMD groups,
+ *  each node touching only its own instance; the refits
+ *  walk shared tree nodes, so they run afterwards on this
+ *  thread.  The instance buffer is uploaded by the next
+ *  CullScene(), and a moved node invalidates the shadow
+ *  maps.
+ ***********************************************************/
+void SceneManager::UpdateDirtyInstances()
+{
+	int nodeCount = m_sceneNodes.GetCount();
+
+	m_dirtyNodeChunks.resize(JobSystem::GetChunkCount(nodeCount, g_NodeGrainSize));
+	m_jobSystem.ParallelFor(nodeCount, g_NodeGrainSize,
+		[this](int chunk, int first, int last)
+		{
+			std::vector<int>& dirtyNodes = m_dirtyNodeChunks[chunk];
+
+			// static nodes keep their cached world matrix
+			dirtyNodes.clear();
+			m_sceneNodes.FindDirtyNodes(first, last, dirtyNodes);
+			m_sceneNodes.UpdateWorldMatrices(dirtyNodes.data(), (int)dirtyNodes.size());
+
+			for (size_t i = 0; i < dirtyNodes.size(); i++)
+			{
+				int node = dirtyNodes[i];
+				m_instanceData[m_sceneNodes.GetInstanceIndex(node)].model = m_sceneNodes.GetWorldMatrix(node);
+			}
+		});
+
+	for (size_t chunk = 0; chunk < m_dirtyNodeChunks.size(); chunk++)
+	{
+		const std::vector<int>& dirtyNodes = m_dirtyNodeChunks[chunk];
+
+		for (size_t i = 0; i < dirtyNodes.size(); i++)
+		{
+			int node = dirtyNodes[i];
+			m_sceneBVH.UpdateItem(node, SceneBVH::TransformBounds(
+				GetMeshBounds((MESH_TYPE)m_sceneNodes.GetMesh(node)), m_sceneNodes.GetWorldMatrix(node)));
+			m_bInstancesChanged = true;
+			m_shadowMaps.Invalidate();
+		}
+	}
+}
+
+/***********************************************************
+ *  BuildSceneBVH()
+ *
+ *  This method is used for building the bounding volume
+ *  hierarchy over the world space bounds of the scene
+ *  nodes.  The items of the tree are the node indices.
+ ***********************************************************/
+void SceneManager::BuildSceneBVH()
+{
+	std::vector<SceneBVH::BOUNDS> nodeBounds(m_sceneNodes.GetCount());
+
+	for (int i = 0; i < m_sceneNodes.GetCount(); i++)
+	{
+		nodeBounds[i] = SceneBVH::TransformBounds(
+			GetMeshBounds((MESH_TYPE)m_sceneNodes.GetMesh(i)), m_sceneNodes.GetWorldMatrix(i));
+	}
+
+	m_sceneBVH.Build(nodeBounds);
+	// a few subtrees per thread for the parallel culling
+	m_sceneBVH.GetSubtrees((m_jobSystem.GetWorkerCount() + 1) * g_CullSubtreesPerThread, m_cullSubtrees);
+}
+
+/***********************************************************
+ *  CullScene()
+ *
+ *  This method is used for finding the scene nodes inside
+ *  the view frustum of the current frame and packing their
+ *  instances, batch by batch, into the instance buffer.
+ *  Each batch of a curved mesh is split by level of detail.
+ *  The hierarchy subtrees are culled as separate jobs that
+ *  stamp their instances with the frame, then the batches
+ *  are counted and packed as jobs too; only the prefix sums
+ *  between the passes and the upload run on this thread.
+ *  The buffer is only uploaded when the visible set, their
+ *  levels or the instance data changed since the last upload.
+ ***********************************************************/
+void SceneManager::CullScene()
+{
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->BeginCPUScope(FrameProfiler::CPU_CULLING);
+	}
+
+	const ShaderUniforms::FRAME_BLOCK& frameData = m_pShaderUniforms->GetFrameData();
+	const glm::mat4 viewProjection = frameData.projection * frameData.view;
+
+	// the streamed texture levels follow the render resolution
+	GLint viewport[4];
+	glGetIntegerv(GL_VIEWPORT, viewport);
+	m_viewportHeight = std::max((int)viewport[3], 1);
+
+	// a wrapped frame counter would match stale stamps
+	if (++m_cullFrame == 0)
+	{
+		std::fill(m_instanceCullFrames.begin(), m_instanceCullFrames.end(), 0);
+		m_cullFrame = 1;
+	}
+	const unsigned int cullFrame = m_cullFrame;
+
+	// every instance belongs to one node of one subtree, so the
+	// stamps are written without any locking
+	m_visibleNodeChunks.resize(m_cullSubtrees.size());
+	m_jobSystem.ParallelFor((int)m_cullSubtrees.size(), 1,
+		[this, &viewProjection, cullFrame](int chunk, int first, int last)
+		{
+			std::vector<int>& visibleNodes = m_visibleNodeChunks[chunk];
+
+			visibleNodes.clear();
+			for (int i = first; i < last; i++)
+			{
+				m_sceneBVH.CullSubtree(viewProjection, m_cullSubtrees[i], visibleNodes);
+			}
+			for (size_t i = 0; i < visibleNodes.size(); i++)
+			{
+				m_instanceCullFrames[m_sceneNodes.GetInstanceIndex(visibleNodes[i])] = cullFrame;
+			}
+		});
+
+	int batchCount = (int)m_renderBatches.size();
+	m_jobSystem.ParallelFor(batchCount, 1,
+		[this, &frameData](int chunk, int first, int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				CountVisibleInstances(i, frameData);
+			}
+		});
+
+	// instance order is batch order, so laying the batches out
+	// one after another keeps the visible instances sorted
+	int visibleCount = 0;
+	bool bLodsChanged = false;
+	for (int i = 0; i < batchCount; i++)
+	{
+		m_batchVisibility[i].firstVisible = visibleCount;
+		visibleCount += m_batchVisibility[i].visibleCount;
+		bLodsChanged = bLodsChanged || m_batchVisibility[i].bLodsChanged;
+	}
+
+	m_visibleInstances.resize(visibleCount);
+	m_jobSystem.ParallelFor(batchCount, 1,
+		[this](int chunk, int first, int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				const RENDER_BATCH& batch = m_renderBatches[i];
+				int visible = m_batchVisibility[i].firstVisible;
+
+				for (int instance = batch.firstInstance; instance < batch.firstInstance + batch.instanceCount; instance++)
+				{
+					if (m_instanceCullFrames[instance] == m_cullFrame)
+					{
+						m_visibleInstances[visible++] = instance;
+					}
+				}
+			}
+		});
+
+	bool bVisibleChanged = m_bInstancesChanged || bLodsChanged || (m_visibleInstances != m_uploadedInstances);
+	if (bVisibleChanged)
+	{
+		// lay out the packed batches, one per level of detail in use
+		int packedCount = 0;
+
+		m_visibleBatches.clear();
+		for (int i = 0; i < batchCount; i++)
+		{
+			BATCH_VISIBILITY& visibility = m_batchVisibility[i];
+
+			for (int lod = 0; lod < SceneMeshes::LOD_LEVELS; lod++)
+			{
+				visibility.lodFirstInstances[lod] = packedCount;
+				if (visibility.lodCounts[lod] == 0)
+				{
+					continue;
+				}
+
+				RENDER_BATCH batch = m_renderBatches[i];
+				batch.lod = lod;
+				batch.firstInstance = packedCount;
+				batch.instanceCount = visibility.lodCounts[lod];
+				m_visibleBatches.push_back(batch);
+				packedCount += batch.instanceCount;
+			}
+		}
+
+		m_visibleInstanceData.resize(packedCount);
+		m_jobSystem.ParallelFor(batchCount, 1,
+			[this](int chunk, int first, int last)
+			{
+				for (int i = first; i < last; i++)
+				{
+					PackVisibleInstances(i);
+				}
+			});
+
+		m_uploadedInstances.swap(m_visibleInstances);
+		m_bInstancesChanged = false;
+	}
+	StreamVisibleInstances(bVisibleChanged);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_CULLED_OBJECTS,
+			m_sceneNodes.GetCount() - visibleCount);
+		m_pProfiler->EndCPUScope(FrameProfiler::CPU_CULLING);
+	}
+}
+
+/***********************************************************
+ *  StreamVisibleInstances()
+ *
+ *  This method is used for writing the packed visible
+ *  instances into the stream region of this frame and
+ *  pointing the draws at them.  A region is only fenced for
+ *  the frame that wrote it, so the copy is made every frame
+ *  even when nothing changed, and the driver never has to
+ *  orphan or synchronize the instance buffer.  Without the
+ *  stream, or when the region is full, the instance buffer
+ *  is uploaded instead, and only when it is out of date.
+ ***********************************************************/
+void SceneManager::StreamVisibleInstances(bool bChanged)
+{
+	// an empty view keeps the previous instances, which are
+	// never drawn
+	if (m_visibleInstanceData.empty())
+	{
+		return;
+	}
+
+	GLsizeiptr size = sizeof(SceneMeshes::INSTANCE_DATA) * m_visibleInstanceData.size();
+	StreamBuffer::ALLOCATION allocation;
+
+	// aligning to a whole instance lets the draws reach the
+	// range through their base instance
+	if ((NULL != m_pStreamBuffer) &&
+		m_pStreamBuffer->Allocate(size, sizeof(SceneMeshes::INSTANCE_DATA), allocation))
+	{
+		memcpy(allocation.pMemory, m_visibleInstanceData.data(), size);
+
+		// a grown stream can reuse the name of the buffer the
+		// vertex arrays still hold, so they are detached first
+		if (m_pStreamBuffer->GetBufferVersion() != m_streamBufferVersion)
+		{
+			m_basicMeshes->SetInstanceSource(0, 0);
+			m_streamBufferVersion = m_pStreamBuffer->GetBufferVersion();
+		}
+		m_basicMeshes->SetInstanceSource(m_pStreamBuffer->GetBuffer(),
+			(int)(allocation.offset / sizeof(SceneMeshes::INSTANCE_DATA)));
+		m_bInstanceBufferStale = true;
+		return;
+	}
+
+	if (bChanged || m_bInstanceBufferStale)
+	{
+		m_basicMeshes->SetInstanceData(m_visibleInstanceData.data(), (int)m_visibleInstanceData.size());
+		m_bInstanceBufferStale = false;
+	}
+	m_basicMeshes->SetInstanceSource(0, 0);
+}
+
+/***********************************************************
+ *  CountVisibleInstances()
+ *
+ *  This method is used for counting the instances of a
+ *  batch stamped visible this frame, by level of detail.
+ *  The level of a visible instance of a curved mesh is
+ *  picked from its radius projected on screen.  The radius
+ *  grows with the camera zoom and shrinks with distance,
+ *  and a level only changes once the radius is past the
+ *  boundary by the hysteresis.  With texture streaming the
+ *  same radius gives the texture level of a textured
+ *  instance.  Each job owns its batches, so the counts and
+ *  levels need no locking.
+ ***********************************************************/
+void SceneManager::CountVisibleInstances(int batchIndex, const ShaderUniforms::FRAME_BLOCK& frameData)
+{
+	const RENDER_BATCH& batch = m_renderBatches[batchIndex];
+	BATCH_VISIBILITY& visibility = m_batchVisibility[batchIndex];
+	bool bLevels = HasLevelsOfDetail(batch.mesh);
+	bool bTextureLevels = batch.bTextured && m_textureStreamer.IsInitialized();
+
+	visibility.visibleCount = 0;
+	visibility.bLodsChanged = false;
+	for (int lod = 0; lod < SceneMeshes::LOD_LEVELS; lod++)
+	{
+		visibility.lodCounts[lod] = 0;
+	}
+
+	for (int instance = batch.firstInstance; instance < batch.firstInstance + batch.instanceCount; instance++)
+	{
+		if (m_instanceCullFrames[instance] != m_cullFrame)
+		{
+			continue;
+		}
+		visibility.visibleCount++;
+
+		float radius = (bLevels || bTextureLevels) ? GetProjectedRadius(instance, frameData) : 0.0f;
+		if (bTextureLevels)
+		{
+			m_instanceTextureLevels[instance] = SelectTextureLevel(radius, m_instanceData[instance].UVscale, m_viewportHeight);
+		}
+
+		if (!bLevels)
+		{
+			visibility.lodCounts[0]++;
+			continue;
+		}
+
+		int lod = SelectLod(radius, m_instanceLods[instance]);
+		if (lod != m_instanceLods[instance])
+		{
+			m_instanceLods[instance] = lod;
+			visibility.bLodsChanged = true;
+		}
+		visibility.lodCounts[lod]++;
+	}
+}
+
+/***********************************************************
+ *  PackVisibleInstances()
+ *
+ *  This method is used for copying the visible instances of
+ *  a batch into the packed instance data, at the ranges the
+ *  batch was given for each of its levels of detail.
+ ***********************************************************/
+void SceneManager::PackVisibleInstances(int batchIndex)
+{
+	const RENDER_BATCH& batch = m_renderBatches[batchIndex];
+	const BATCH_VISIBILITY& visibility = m_batchVisibility[batchIndex];
+	bool bLevels = HasLevelsOfDetail(batch.mesh);
+	int packed[SceneMeshes::LOD_LEVELS];
+
+	for (int lod = 0; lod < SceneMeshes::LOD_LEVELS; lod++)
+	{
+		packed[lod] = visibility.lodFirstInstances[lod];
+	}
+
+	for (int i = visibility.firstVisible; i < visibility.firstVisible + visibility.visibleCount; i++)
+	{
+		int instance = m_visibleInstances[i];
+		int lod = bLevels ? m_instanceLods[instance] : 0;
+
+		m_visibleInstanceData[packed[lod]++] = m_instanceData[instance];
+	}
+}
+
+/***********************************************************
+ *  GetProjectedRadius()
+ *
+ *  This method is used for getting the radius of the
+ *  bounding sphere of an instance after projection, in
+ *  normalized device units.  The projection scale holds the
+ *  camera zoom; a perspective projection also divides by
+ *  the view depth of the sphere center.
+ ***********************************************************/
+float SceneManager::GetProjectedRadius(int instance, const ShaderUniforms::FRAME_BLOCK& frameData)
+{
+	const glm::mat4& model = m_instanceData[instance].model;
+	SceneBVH::BOUNDS bounds = GetMeshBounds((MESH_TYPE)m_sceneNodes.GetMesh(m_instanceNodes[instance]));
+
+	glm::vec3 localCenter = (bounds.minimum + bounds.maximum) * 0.5f;
+	float localRadius = glm::length(bounds.maximum - bounds.minimum) * 0.5f;
+	float scale = std::max(std::max(
+		glm::length(glm::vec3(model[0])),
+		glm::length(glm::vec3(model[1]))),
+		glm::length(glm::vec3(model[2])));
+
+	float radius = localRadius * scale * frameData.projection[1][1];
+
+	// only a perspective projection copies the depth into w
+	if (frameData.projection[2][3] != 0.0f)
+	{
+		glm::vec4 viewCenter = frameData.view * (model * glm::vec4(localCenter, 1.0f));
+		radius /= std::max(-viewCenter.z, g_LodNearDepth);
+	}
+
+	return(radius);
+}
+
+/***********************************************************
+ *  HasLevelsOfDetail()
+ *
+ *  This method is used for checking whether a basic shape
+ *  mesh is built at several levels of detail.
+ ***********************************************************/
+bool SceneManager::HasLevelsOfDetail(MESH_TYPE mesh)
+{
+	return((mesh == MESH_CONE) || (mesh == MESH_CYLINDER) || (mesh == MESH_TAPERED_CYLINDER));
+}
+
+/***********************************************************
+ *  GetCurvedMesh()
+ *
+ *  This method is used for getting the curved mesh of the
+ *  mesh library that a basic shape is drawn with.
+ ***********************************************************/
+int SceneManager::GetCurvedMesh(MESH_TYPE mesh)
+{
+	switch (mesh)
+	{
+	case MESH_CONE:
+		return(SceneMeshes::CURVED_CONE);
+	case MESH_CYLINDER:
+		return(SceneMeshes::CURVED_CYLINDER);
+	case MESH_TAPERED_CYLINDER:
+		return(SceneMeshes::CURVED_TAPERED_CYLINDER);
+	default:
+		return(-1);
+	}
+}
+
+/***********************************************************
+ *  RegisterMeshResidency()
+ *
+ *  This method is used for handing the levels of detail of
+ *  the curved meshes finer than the coarsest one to the
+ *  residency manager and freeing them until they are seen.
+ *  Only the CPU culling knows the levels it draws, and the
+ *  packed meshes share their buffers, so those paths keep
+ *  every level loaded.
+ ***********************************************************/
+void SceneManager::RegisterMeshResidency()
+{
+	for (int mesh = 0; mesh < SceneMeshes::CURVED_MESH_COUNT; mesh++)
+	{
+		m_meshResources[mesh] = -1;
+	}
+
+	if ((m_sceneSettings.streamingBudget <= 0) || m_sceneSettings.bGPUCulling || m_basicMeshes->IsPacked())
+	{
+		return;
+	}
+
+	for (int mesh = 0; mesh < SceneMeshes::CURVED_MESH_COUNT; mesh++)
+	{
+		SceneMeshes::CURVED_MESH curvedMesh = (SceneMeshes::CURVED_MESH)mesh;
+		std::vector<long long> levelBytes;
+
+		for (int lod = 0; lod < SceneMeshes::LOD_LEVELS - 1; lod++)
+		{
+			levelBytes.push_back(m_basicMeshes->GetLevelBytes(curvedMesh, lod));
+		}
+		m_meshResources[mesh] = m_residency.AddResource(ResidencyManager::RESOURCE_MESH, mesh, levelBytes, -1);
+
+		for (int lod = 0; lod < SceneMeshes::LOD_LEVELS - 1; lod++)
+		{
+			m_basicMeshes->SetLevelLoaded(curvedMesh, lod, false);
+		}
+	}
+}
+
+/***********************************************************
+ *  UpdateResidency()
+ *
+ *  This method is used for requesting the finest texture
+ *  level and level of detail drawn this frame of every
+ *  streamed resource, then applying the changes the
+ *  residency manager plans.  The texture levels are the
+ *  finest over the visible instances of each layer; the
+ *  GPU culling keeps its visible instances on the GPU, so
+ *  there every loaded texture is requested whole, and the
+ *  budget decides which stay.  A frame that streamed
+ *  anything asks for another, so the rest follows in the
+ *  on-demand frame loop too.
+ ***********************************************************/
+void SceneManager::UpdateResidency()
+{
+	if (m_residency.GetResourceCount() == 0)
+	{
+		return;
+	}
+
+	m_residency.BeginFrame();
+
+	if (m_textureStreamer.IsInitialized())
+	{
+		m_layerTextureLevels.assign(m_textureIDs.size(),
+			m_sceneSettings.bGPUCulling ? 0 : (int)TextureStreamer::FALLBACK_LEVEL);
+
+		if (!m_sceneSettings.bGPUCulling)
+		{
+			for (size_t i = 0; i < m_uploadedInstances.size(); i++)
+			{
+				int instance = m_uploadedInstances[i];
+				int layer = m_instanceData[instance].textureLayer;
+
+				if ((layer >= 0) && (layer < (int)m_layerTextureLevels.size()))
+				{
+					m_layerTextureLevels[layer] = std::min(m_layerTextureLevels[layer], m_instanceTextureLevels[instance]);
+				}
+			}
+		}
+
+		// a texture still loading has nothing to stream
+		for (size_t layer = 0; layer < m_textureIDs.size(); layer++)
+		{
+			if ((m_layerTextureLevels[layer] < TextureStreamer::FALLBACK_LEVEL) && m_textureStreamer.HasImage((int)layer))
+			{
+				m_residency.Request(m_textureIDs[layer].resource, m_layerTextureLevels[layer]);
+			}
+		}
+	}
+
+	// the finest level of detail each curved mesh is drawn at
+	for (size_t i = 0; i < m_renderBatches.size(); i++)
+	{
+		int curvedMesh = GetCurvedMesh(m_renderBatches[i].mesh);
+		if ((curvedMesh < 0) || (m_meshResources[curvedMesh] < 0))
+		{
+			continue;
+		}
+
+		for (int lod = 0; lod < SceneMeshes::LOD_LEVELS; lod++)
+		{
+			if (m_batchVisibility[i].lodCounts[lod] > 0)
+			{
+				m_residency.Request(m_meshResources[curvedMesh], lod);
+				break;
+			}
+		}
+	}
+
+	m_residency.Update(g_StreamUploadBytesPerFrame, m_residencyChanges);
+	for (size_t i = 0; i < m_residencyChanges.size(); i++)
+	{
+		const ResidencyManager::CHANGE& change = m_residencyChanges[i];
+		int tag = m_residency.GetTag(change.resource);
+
+		if (m_residency.GetType(change.resource) == ResidencyManager::RESOURCE_TEXTURE)
+		{
+			// a change that fails, or follows a failed change of the
+			// same layer, puts the resource back at the level the
+			// layer really has, so the budget only charges what is
+			// resident
+			if ((m_textureStreamer.GetResidentLevel(tag) != change.previousLevel) ||
+				!m_textureStreamer.SetResidentLevel(tag, change.previousLevel, change.residentLevel))
+			{
+				m_residency.RestoreLevel(change.resource, m_textureStreamer.GetResidentLevel(tag));
+			}
+			continue;
+		}
+
+		// the levels between the two are built or freed
+		bool bLoaded = (change.residentLevel < change.previousLevel);
+		for (int lod = std::min(change.residentLevel, change.previousLevel); lod < std::max(change.residentLevel, change.previousLevel); lod++)
+		{
+			m_basicMeshes->SetLevelLoaded((SceneMeshes::CURVED_MESH)tag, lod, bLoaded);
+		}
+	}
+	m_textureStreamer.Flush();
+
+	if (!m_residencyChanges.empty())
+	{
+		m_bSceneChanged = true;
+	}
+}
+
+/***********************************************************
+ *  RenderShadowMaps()
+ *
+ *  This method is used for redrawing the shadow map of
+ *  every light.  Each opaque batch is drawn whole, from a
+ *  copy of every instance, at full detail with the depth
+ *  only program; the translucent batches cast no shadow.
+ *  The meshes read their instances from the copy during
+ *  the pass and are detached from it afterwards, so the
+ *  culling passes attach their own instances again.
+ ***********************************************************/
+void SceneManager::RenderShadowMaps()
+{
+	SceneBVH::BOUNDS sceneBounds;
+
+	if (!m_sceneBVH.GetBounds(sceneBounds) ||
+		!m_shadowMaps.BeginUpdate(sceneBounds, m_instanceData.data(), (int)m_instanceData.size()))
+	{
+		return;
+	}
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->BeginCPUScope(FrameProfiler::CPU_SHADOW_PASS);
+		m_pProfiler->BeginGPUScope(FrameProfiler::GPU_SHADOW_PASS);
+	}
+
+	m_basicMeshes->SetInstanceSource(m_shadowMaps.GetInstanceBuffer(), 0);
+	for (int light = 0; light < m_shadowMaps.GetLightCount(); light++)
+	{
+		m_shadowMaps.BeginLight(light);
+		for (size_t i = 0; i < m_renderBatches.size(); i++)
+		{
+			const RENDER_BATCH& batch = m_renderBatches[i];
+
+			if (!batch.bTransparent)
+			{
+				DrawMeshInstanced(batch.mesh, batch.instanceCount, batch.firstInstance, 0);
+			}
+		}
+	}
+	m_shadowMaps.EndUpdate();
+	m_basicMeshes->SetInstanceSource(0, 0);
+
+	m_pShaderUniforms->SetShadowData(
+		m_shadowMaps.GetShadowMatrices(),
+		m_shadowMaps.GetLightCount(),
+		m_shadowMaps.GetShadowParameters());
+	// the depth only program was left in use
+	m_pShaderUniforms->UseProgram();
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->EndGPUScope(FrameProfiler::GPU_SHADOW_PASS);
+		m_pProfiler->EndCPUScope(FrameProfiler::CPU_SHADOW_PASS);
+	}
+}
+
+/***********************************************************
+ *  CullSceneGPU()
+ *
+ *  This method is used for culling every instance against
+ *  the view frustum in the culling compute shader, which
+ *  fills the instance buffer and the indirect commands.
+ *  The instances are only uploaded again when they change.
+ *  With occlusion culling, the instances behind the depth
+ *  pyramid of the last frame are dropped as well.
+ ***********************************************************/
+void SceneManager::CullSceneGPU()
+{
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->BeginCPUScope(FrameProfiler::CPU_CULLING);
+	}
+
+	if (m_bInstancesChanged)
+	{
+		UploadGPUInstances();
+	}
+
+	const ShaderUniforms::FRAME_BLOCK& frameData = m_pShaderUniforms->GetFrameData();
+	m_gpuCulling.Cull(
+		frameData.projection * frameData.view,
+		m_basicMeshes->GetInstanceBuffer(),
+		m_hiZBuffer.IsInitialized() ? &m_hiZBuffer : NULL);
+
+	// the compute program was left in use
+	m_pShaderUniforms->UseProgram();
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->EndCPUScope(FrameProfiler::CPU_CULLING);
+	}
+}
+
+/***********************************************************
+ *  UploadGPUInstances()
+ *
+ *  This method is used for uploading every instance, its
+ *  world space bounds and one indirect command per render
+ *  batch for the culling shader.  Each command starts at
+ *  the instance range of its batch, so the culled instance
+ *  buffer needs room for every instance.  The opaque
+ *  commands are grouped by mesh, so each mesh is drawn with
+ *  one multi-draw call.  The instance bounds are computed
+ *  by the jobs, a batch at a time.
+ ***********************************************************/
+void SceneManager::UploadGPUInstances()
+{
+	std::vector<GPUCulling::DRAW_COMMAND> commands(m_renderBatches.size());
+	std::vector<GPUCulling::CULL_ITEM> items(m_instanceData.size());
+
+	m_jobSystem.ParallelFor((int)m_renderBatches.size(), 1,
+		[this, &items](int chunk, int first, int last)
+		{
+			for (int i = first; i < last; i++)
+			{
+				const RENDER_BATCH& batch = m_renderBatches[i];
+				SceneBVH::BOUNDS meshBounds = GetMeshBounds(batch.mesh);
+
+				for (int instance = batch.firstInstance; instance < batch.firstInstance + batch.instanceCount; instance++)
+				{
+					SceneBVH::BOUNDS bounds = SceneBVH::TransformBounds(meshBounds, m_instanceData[instance].model);
+
+					items[instance].center = (bounds.minimum + bounds.maximum) * 0.5f;
+					items[instance].commandIndex = i;
+					items[instance].extent = (bounds.maximum - bounds.minimum) * 0.5f;
+					items[instance].padding = 0;
+				}
+			}
+		});
+
+	m_indirectDraws.clear();
+	for (size_t i = 0; i < m_renderBatches.size(); i++)
+	{
+		const RENDER_BATCH& batch = m_renderBatches[i];
+
+		SceneMeshes::MESH_RANGE range = GetMeshRange(batch.mesh);
+		commands[i].count = (GLuint)range.indexCount;
+		commands[i].instanceCount = 0;
+		commands[i].firstIndex = range.firstIndex;
+		commands[i].baseVertex = range.baseVertex;
+		commands[i].baseInstance = (GLuint)batch.firstInstance;
+
+		// opaque batches are sorted by mesh, so each mesh is one
+		// run of commands - packed meshes share one vertex array,
+		// so all the opaque commands are a single run
+		if (!batch.bTransparent)
+		{
+			if (m_indirectDraws.empty() ||
+				(!m_basicMeshes->IsPacked() && (m_indirectDraws.back().mesh != batch.mesh)))
+			{
+				INDIRECT_DRAW draw;
+				draw.mesh = batch.mesh;
+				draw.firstCommand = (int)i;
+				draw.commandCount = 0;
+				m_indirectDraws.push_back(draw);
+			}
+			m_indirectDraws.back().commandCount++;
+		}
+	}
+
+	m_gpuCulling.SetInstances(m_instanceData, items, commands);
+	if (!m_instanceData.empty())
+	{
+		m_basicMeshes->SetInstanceData(NULL, (int)m_instanceData.size());
+	}
+	m_bInstancesChanged = false;
+}
+
+/***********************************************************
+ *  GetMeshBounds()
+ *
+ *  This method is used for getting the local space bounds
+ *  of a basic shape mesh, as built by SceneMeshes.
+ ***********************************************************/
+SceneBVH::BOUNDS SceneManager::GetMeshBounds(MESH_TYPE mesh)
+{
+	SceneBVH::BOUNDS bounds;
+
+	switch (mesh)
+	{
+	case MESH_PLANE:
+		// a flat square in the XZ plane
+		bounds.minimum = glm::vec3(-1.0f, 0.0f, -1.0f);
+		bounds.maximum = glm::vec3(1.0f, 0.0f, 1.0f);
+		break;
+	case MESH_CONE:
+	case MESH_CYLINDER:
+	case MESH_TAPERED_CYLINDER:
+		// unit radius around the Y axis from y = 0 to y = 1
+		bounds.minimum = glm::vec3(-1.0f, 0.0f, -1.0f);
+		bounds.maximum = glm::vec3(1.0f, 1.0f, 1.0f);
+		break;
+	case MESH_BOX:
+	case MESH_PYRAMID3:
+	default:
+		// unit size around the origin
+		bounds.minimum = glm::vec3(-0.5f, -0.5f, -0.5f);
+		bounds.maximum = glm::vec3(0.5f, 0.5f, 0.5f);
+		break;
+	}
+
+	return(bounds);
 }
 
+/***********************************************************
+ *  AddSceneNode()
+ *
+ *  This method is used for adding a node to the retained
+ *  scene graph.  The texture and material tags are resolved
+ *  once here so that rendering never searches by string.
+ ***********************************************************/
+int SceneManager::AddSceneNode(
+	MESH_TYPE mesh,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ,
+	const std::string& textureTag,
+	glm::vec2 UVscale,
+	const std::string& materialTag)
+{
+	// the tags are resolved to handles once, here
+	return(AddSceneNode(
+		mesh,
+		scaleXYZ,
+		XrotationDegrees,
+		YrotationDegrees,
+		ZrotationDegrees,
+		positionXYZ,
+		FindTextureSlot(textureTag),
+		UVscale,
+		FindMaterialIndex(materialTag)));
+}
 
 /***********************************************************
- *  PrepareScene()
+ *  AddSceneNode()
  *
- *  This method is used for preparing the 3D scene by loading
- *  the shapes, textures in memory to support the 3D scene 
- *  rendering
+ *  This method is used for adding a node to the retained
+ *  scene graph by texture layer and material index.  A
+ *  texture slot of -1 leaves the node untextured.
  ***********************************************************/
-void SceneManager::PrepareScene()
+int SceneManager::AddSceneNode(
+	MESH_TYPE mesh,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ,
+	int textureSlot,
+	glm::vec2 UVscale,
+	int materialIndex)
 {
-	// load the textures for the 3D scene
-	LoadSceneTextures();
+	bool bTransparent = (textureSlot >= 0) && m_textureIDs[textureSlot].bTranslucent;
 
-	// define the materials that will be used for the objects
-	// in the 3D scene
-	DefineObjectMaterials();
+	// the world matrix is built with the other new nodes by
+	// BuildRenderBatches()
+	return(m_sceneNodes.Add(
+		mesh,
+		scaleXYZ,
+		glm::vec3(XrotationDegrees, YrotationDegrees, ZrotationDegrees),
+		positionXYZ,
+		textureSlot,
+		UVscale,
+		materialIndex,
+		bTransparent));
+}
 
-	// add and defile the light sources for the 3D scene
-	SetupSceneLights();
+/***********************************************************
+ *  SetNodeTransformation()
+ *
+ *  This method is used for changing the scale, rotation and
+ *  position of a scene node.  The world matrix is not rebuilt
+ *  here; the node is flagged so the next render pass rebuilds
+ *  it once, however many times it was changed in between.
+ ***********************************************************/
+void SceneManager::SetNodeTransformation(
+	int nodeIndex,
+	glm::vec3 scaleXYZ,
+	float XrotationDegrees,
+	float YrotationDegrees,
+	float ZrotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	if ((nodeIndex < 0) || (nodeIndex >= m_sceneNodes.GetCount()))
+	{
+		return;
+	}
 
-	// only one instance of a particular mesh needs to be
-	// loaded in memory no matter how many times it is drawn
-	// in the rendered 3D scene
+	if (m_sceneNodes.SetTransformation(
+		nodeIndex,
+		scaleXYZ,
+		glm::vec3(XrotationDegrees, YrotationDegrees, ZrotationDegrees),
+		positionXYZ))
+	{
+		m_bSceneChanged = true;
+	}
+}
 
-	m_basicMeshes->LoadPlaneMesh(); 
-	m_basicMeshes->LoadConeMesh();
-	m_basicMeshes->LoadBoxMesh();
-	m_basicMeshes->LoadCylinderMesh();
-	m_basicMeshes->LoadTaperedCylinderMesh();
-	m_basicMeshes->LoadPyramid3Mesh();
+/***********************************************************
+ *  DrawMesh()
+ *
+ *  This method is used for drawing the basic shape mesh
+ *  identified by the passed in mesh type.
+ ***********************************************************/
+void SceneManager::DrawMesh(MESH_TYPE mesh)
+{
+	switch (mesh)
+	{
+	case MESH_BOX:
+		m_basicMeshes->DrawBoxMesh();
+		break;
+	case MESH_CONE:
+		m_basicMeshes->DrawConeMesh();
+		break;
+	case MESH_CYLINDER:
+		m_basicMeshes->DrawCylinderMesh();
+		break;
+	case MESH_PLANE:
+		m_basicMeshes->DrawPlaneMesh();
+		break;
+	case MESH_PYRAMID3:
+		m_basicMeshes->DrawPyramid3Mesh();
+		break;
+	case MESH_TAPERED_CYLINDER:
+		m_basicMeshes->DrawTaperedCylinderMesh();
+		break;
+	}
 }
 
 /***********************************************************
- *  RenderScene()
+ *  DrawMeshInstanced()
  *
- *  This method is used for rendering the 3D scene by 
- *  transforming and drawing the basic 3D shapes
+ *  This method is used for drawing count instances of the
+ *  basic shape mesh identified by the passed in mesh type,
+ *  at a level of detail for the curved meshes.
  ***********************************************************/
-void SceneManager::RenderScene()
+void SceneManager::DrawMeshInstanced(MESH_TYPE mesh, int count, int firstInstance, int lod)
+{
+	switch (mesh)
+	{
+	case MESH_BOX:
+		m_basicMeshes->DrawBoxMeshInstanced(count, firstInstance);
+		break;
+	case MESH_CONE:
+		m_basicMeshes->DrawConeMeshInstanced(count, firstInstance, lod);
+		break;
+	case MESH_CYLINDER:
+		m_basicMeshes->DrawCylinderMeshInstanced(count, firstInstance, lod);
+		break;
+	case MESH_PLANE:
+		m_basicMeshes->DrawPlaneMeshInstanced(count, firstInstance);
+		break;
+	case MESH_PYRAMID3:
+		m_basicMeshes->DrawPyramid3MeshInstanced(count, firstInstance);
+		break;
+	case MESH_TAPERED_CYLINDER:
+		m_basicMeshes->DrawTaperedCylinderMeshInstanced(count, firstInstance, lod);
+		break;
+	}
+}
+
+/***********************************************************
+ *  DrawMeshIndirect()
+ *
+ *  This method is used for drawing a run of indirect
+ *  commands of the basic shape mesh of the passed in type.
+ ***********************************************************/
+void SceneManager::DrawMeshIndirect(MESH_TYPE mesh, int firstCommand, int commandCount)
+{
+	switch (mesh)
+	{
+	case MESH_BOX:
+		m_basicMeshes->DrawBoxMeshIndirect(firstCommand, commandCount);
+		break;
+	case MESH_CONE:
+		m_basicMeshes->DrawConeMeshIndirect(firstCommand, commandCount);
+		break;
+	case MESH_CYLINDER:
+		m_basicMeshes->DrawCylinderMeshIndirect(firstCommand, commandCount);
+		break;
+	case MESH_PLANE:
+		m_basicMeshes->DrawPlaneMeshIndirect(firstCommand, commandCount);
+		break;
+	case MESH_PYRAMID3:
+		m_basicMeshes->DrawPyramid3MeshIndirect(firstCommand, commandCount);
+		break;
+	case MESH_TAPERED_CYLINDER:
+		m_basicMeshes->DrawTaperedCylinderMeshIndirect(firstCommand, commandCount);
+		break;
+	}
+}
+
+/***********************************************************
+ *  GetMeshRange()
+ *
+ *  This method is used for getting the index count, first
+ *  index and base vertex of the basic shape mesh of the
+ *  passed in type.
+ ***********************************************************/
+SceneMeshes::MESH_RANGE SceneManager::GetMeshRange(MESH_TYPE mesh)
 {
-	RenderPencil();
-	RenderCards();
-	RenderDice();
+	switch (mesh)
+	{
+	case MESH_BOX:
+		return(m_basicMeshes->GetBoxMeshRange());
+	case MESH_CONE:
+		return(m_basicMeshes->GetConeMeshRange());
+	case MESH_CYLINDER:
+		return(m_basicMeshes->GetCylinderMeshRange());
+	case MESH_PLANE:
+		return(m_basicMeshes->GetPlaneMeshRange());
+	case MESH_PYRAMID3:
+		return(m_basicMeshes->GetPyramid3MeshRange());
+	case MESH_TAPERED_CYLINDER:
+		return(m_basicMeshes->GetTaperedCylinderMeshRange());
+	}
+
+	SceneMeshes::MESH_RANGE empty = { 0, 0, 0 };
+	return(empty);
 }
 
 
 /******************************************************************/
-/*  RenderPencil()												***/
+/*  BuildPencil()												***/
 /*																***/
-/*  This method is called to render the pencil in the scene		***/
+/*  This method is called to add the playmat and the pencil		***/
+/*  nodes to the scene graph									***/
 /******************************************************************/
-void SceneManager::RenderPencil()
+void SceneManager::BuildPencil()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-
 	/******************************************************************/
 	// Code for playmat below										***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(15.0f, 1.0f, 8.0f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.0f, .0f, 0.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set texture to playmat
-	SetShaderTexture("playmat");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("fabricMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(15.0f, 1.0f, 8.0f),
+		0.0f, 0.0f, 0.0f,
+		glm::vec3(0.0f, 0.0f, 0.0f),
+		"playmat", glm::vec2(1.0f, 1.0f), "fabricMaterial");
 
 	//***Following are sections for drawing the pencil				
 	// split into a tapered cone and cone for the tip				
@@ -673,484 +2836,252 @@ void SceneManager::RenderPencil()
 	/******************************************************************/
 	// Code for main pencil cylinder								***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.15f, 7.0f, 0.15f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 70.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(12.0f, 0.15f, 4.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture for the cylinder
-	SetShaderTexture("pencilCylinder");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("glossyPencilMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
-
+	AddSceneNode(
+		MESH_CYLINDER,
+		glm::vec3(0.15f, 7.0f, 0.15f),
+		90.0f, 0.0f, 70.0f,
+		glm::vec3(12.0f, 0.15f, 4.0f),
+		"pencilCylinder", glm::vec2(1.0f, 1.0f), "glossyPencilMaterial");
 
 	/******************************************************************/
 	// Code for pencil metal cylinder								***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.155f, 0.35f, 0.155f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 70.0f;
-
-	// set the XYZ position for the mesh
-
-	positionXYZ = glm::vec3(5.6f, 0.15f, 6.33f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture for the metal cylinder
-	SetShaderTexture("metal");
-	SetTextureUVScale(0.7f, 0.7f);
-	SetShaderMaterial("metalMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
-
+	AddSceneNode(
+		MESH_CYLINDER,
+		glm::vec3(0.155f, 0.35f, 0.155f),
+		90.0f, 0.0f, 70.0f,
+		glm::vec3(5.6f, 0.15f, 6.33f),
+		"metal", glm::vec2(0.7f, 0.7f), "metalMaterial");
 
 	/******************************************************************/
 	// Code for pencil eraser cylinder								***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.15f, 0.50f, 0.15f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = 70.0f;
-
-	// set the XYZ position for the mesh
-
-	positionXYZ = glm::vec3(5.6f, 0.15f, 6.33f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderTexture("rubber");
-	SetShaderMaterial("pinkEraserMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawCylinderMesh();
-
+	// the eraser has always been drawn with the UV scale left
+	// over from the metal cylinder, so keep that value
+	AddSceneNode(
+		MESH_CYLINDER,
+		glm::vec3(0.15f, 0.50f, 0.15f),
+		90.0f, 0.0f, 70.0f,
+		glm::vec3(5.6f, 0.15f, 6.33f),
+		"rubber", glm::vec2(0.7f, 0.7f), "pinkEraserMaterial");
 
 	/******************************************************************/
 	// Code for pencil tip tapered cylinder							***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.15f, 0.42f, 0.15f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = -110.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(12.0f, 0.15f, 4.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to wood
-	SetShaderTexture("wood");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("woodMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawTaperedCylinderMesh();
-
-
+	AddSceneNode(
+		MESH_TAPERED_CYLINDER,
+		glm::vec3(0.15f, 0.42f, 0.15f),
+		90.0f, 0.0f, -110.0f,
+		glm::vec3(12.0f, 0.15f, 4.0f),
+		"wood", glm::vec2(1.0f, 1.0f), "woodMaterial");
 
 	/******************************************************************/
 	// Code for pencil led											***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.145f, 0.75f, 0.145f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 90.0f;
-	YrotationDegrees = 0.0f;
-	ZrotationDegrees = -110.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(12.0f, 0.15f, 4.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	SetShaderTexture("lead");
-	SetShaderMaterial("pencilLeadMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawConeMesh();
+	AddSceneNode(
+		MESH_CONE,
+		glm::vec3(0.145f, 0.75f, 0.145f),
+		90.0f, 0.0f, -110.0f,
+		glm::vec3(12.0f, 0.15f, 4.0f),
+		"lead", glm::vec2(1.0f, 1.0f), "pencilLeadMaterial");
 }
 
 
-
 /******************************************************************/
-/* RenderCards()												***/
+/* BuildCards()													***/
 /*																***/
-/* This method is called to render the cards in the scene		***/
+/* This method is called to add the card nodes to the scene		***/
+/* graph														***/
 /******************************************************************/
-void SceneManager::RenderCards()
+void SceneManager::BuildCards()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-
-
-
 	/******************************************************************/
 	/*** Deck of cards Code											***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(3.5f, 2.0f, 4.9f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 5.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-10.0f, 1.0f, 2.7f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to the deck of cards
-	SetShaderTexture("deck");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-
+	AddSceneNode(
+		MESH_BOX,
+		glm::vec3(3.5f, 2.0f, 4.9f),
+		0.0f, 5.0f, 0.0f,
+		glm::vec3(-10.0f, 1.0f, 2.7f),
+		"deck", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 
 	/******************************************************************/
 	/*** Top of deck of cards code									***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(3.5f, 0.02f, 4.9f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 5.0f;
-	ZrotationDegrees = 0.0f;
+	AddSceneNode(
+		MESH_BOX,
+		glm::vec3(3.5f, 0.02f, 4.9f),
+		0.0f, 5.0f, 0.0f,
+		glm::vec3(-10.0f, 2.01f, 2.7f),
+		"plastic", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-10.0f, 2.01f, 2.7f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to plastic
-	SetShaderTexture("plastic");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
-
-
-	
 	/******************************************************************/
 	/*** Plains card Code											***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.75f, 0.0f, 2.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = 20.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-1.5f, 0.05f, 3.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to Plains
-	SetShaderTexture("plains");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("cardMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(1.75f, 0.0f, 2.45f),
+		0.0f, 20.0f, 0.0f,
+		glm::vec3(-1.5f, 0.05f, 3.0f),
+		"plains", glm::vec2(1.0f, 1.0f), "cardMaterial");
 
 	/******************************************************************/
 	/*** Blue card Code												***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.75f, 0.0f, 2.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -10.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-0.25f, 0.02f, 3.0f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to plastic
-	SetShaderTexture("plastic");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(1.75f, 0.0f, 2.45f),
+		0.0f, -10.0f, 0.0f,
+		glm::vec3(-0.25f, 0.02f, 3.0f),
+		"plastic", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 
 	/******************************************************************/
 	/*** Blue card Code (top of stack)								***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.75f, 0.0f, 2.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -20.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.3f, 0.01f, 3.25f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to plastic
-	SetShaderTexture("plastic");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(1.75f, 0.0f, 2.45f),
+		0.0f, -20.0f, 0.0f,
+		glm::vec3(0.3f, 0.01f, 3.25f),
+		"plastic", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 
 	/******************************************************************/
 	/*** Blue card Code (Middle of stack)							***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.75f, 0.0f, 2.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -22.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.3f, 0.005f, 3.3f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to plastic
-	SetShaderTexture("plastic");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
-
-
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(1.75f, 0.0f, 2.45f),
+		0.0f, -22.0f, 0.0f,
+		glm::vec3(0.3f, 0.005f, 3.3f),
+		"plastic", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 
 	/******************************************************************/
 	/*** Blue card Code (bottom of stack)							***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(1.75f, 0.0f, 2.45f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -22.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(0.3f, 0.005f, 3.3f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to plastic
-	SetShaderTexture("plastic");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("plasticMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPlaneMesh();
+	AddSceneNode(
+		MESH_PLANE,
+		glm::vec3(1.75f, 0.0f, 2.45f),
+		0.0f, -22.0f, 0.0f,
+		glm::vec3(0.3f, 0.005f, 3.3f),
+		"plastic", glm::vec2(1.0f, 1.0f), "plasticMaterial");
 }
 
 
-
 /******************************************************************/
-/*  RenderDice()												***/
+/*  BuildDice()													***/
 /*																***/
-/*  This method is called to render the dice in the scene		***/
+/*  This method is called to add the dice nodes to the scene	***/
+/*  graph														***/
 /******************************************************************/
-void SceneManager::RenderDice()
+void SceneManager::BuildDice()
 {
-	// declare the variables for the transformations
-	glm::vec3 scaleXYZ;
-	float XrotationDegrees = 0.0f;
-	float YrotationDegrees = 0.0f;
-	float ZrotationDegrees = 0.0f;
-	glm::vec3 positionXYZ;
-
-	/*** Set needed transformations before drawing the basic mesh.  ***/
-	/*** This same ordering of code should be used for transforming ***/
-	/*** and drawing all the basic 3D shapes.						***/
-
-
-
 	/******************************************************************/
 	/*** Pyramid dice code											***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.8f, 0.8f, 0.8f);
-
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -30.0f;
-	ZrotationDegrees = 0.0f;
-
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-3.1f, 0.4f, -0.64f);
-
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
-
-	//Set the texture to the deck of cards
-	SetShaderTexture("marble");
-	SetTextureUVScale(1.1f, 1.1f);
-	SetShaderMaterial("marbleMaterial");
-
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawPyramid3Mesh();
-
+	AddSceneNode(
+		MESH_PYRAMID3,
+		glm::vec3(0.8f, 0.8f, 0.8f),
+		0.0f, -30.0f, 0.0f,
+		glm::vec3(-3.1f, 0.4f, -0.64f),
+		"marble", glm::vec2(1.1f, 1.1f), "marbleMaterial");
 
 	/******************************************************************/
 	/*** Cube dice code												***/
 	/******************************************************************/
-	// set the XYZ scale for the mesh
-	scaleXYZ = glm::vec3(0.8f, 0.8f, 0.8f);
+	AddSceneNode(
+		MESH_BOX,
+		glm::vec3(0.8f, 0.8f, 0.8f),
+		0.0f, -45.0f, 0.0f,
+		glm::vec3(-1.4f, 0.4f, -1.5f),
+		"marble", glm::vec2(1.0f, 1.0f), "marbleMaterial");
+}
 
-	// set the XYZ rotation for the mesh
-	XrotationDegrees = 0.0f;
-	YrotationDegrees = -45.0f;
-	ZrotationDegrees = 0.0f;
 
-	// set the XYZ position for the mesh
-	positionXYZ = glm::vec3(-1.4f, 0.4f, -1.5f);
+/******************************************************************/
+/*  BuildStressScene()											***/
+/*																***/
+/*  This method is called to fill the scene graph with randomly	***/
+/*  placed objects for scaling tests.  Every mesh, material and	***/
+/*  texture is used, and the same seed always builds the same	***/
+/*  scene.  The objects fill a flat box around the origin that	***/
+/*  grows with the object count, so the density stays the same	***/
+/*  and the benchmark camera path always sees a crowded view.	***/
+/******************************************************************/
+void SceneManager::BuildStressScene()
+{
+	int objectCount = m_sceneSettings.objectCount;
+	int meshCount = (int)(sizeof(g_StressMeshes) / sizeof(g_StressMeshes[0]));
+	int textureCount = (int)m_textureIDs.size();
+	int materialCount = (int)m_objectMaterials.size();
+
+	// a box four times as wide as it is high, holding one object
+	// per spacing cube
+	float width = std::cbrt(4.0f * (float)objectCount) * g_StressObjectSpacing;
+	float height = width * 0.25f;
+
+	std::mt19937 generator(m_sceneSettings.seed);
+	std::uniform_real_distribution<float> unitDistribution(0.0f, 1.0f);
+	std::uniform_int_distribution<int> meshDistribution(0, meshCount - 1);
+	// -1 picks an untextured object
+	std::uniform_int_distribution<int> textureDistribution(-1, textureCount - 1);
+	std::uniform_int_distribution<int> materialDistribution(0, std::max(materialCount - 1, 0));
+
+	m_sceneNodes.Reserve(m_sceneNodes.GetCount() + objectCount);
+
+	for (int i = 0; i < objectCount; i++)
+	{
+		MESH_TYPE mesh = g_StressMeshes[meshDistribution(generator)];
+		float scale = 0.2f + 0.4f * unitDistribution(generator);
+		glm::vec3 scaleXYZ(scale, scale, scale);
+		glm::vec3 rotationDegrees(
+			360.0f * unitDistribution(generator),
+			360.0f * unitDistribution(generator),
+			360.0f * unitDistribution(generator));
+		glm::vec3 positionXYZ(
+			width * (unitDistribution(generator) - 0.5f),
+			height * unitDistribution(generator),
+			width * (unitDistribution(generator) - 0.5f));
+		int textureSlot = textureDistribution(generator);
+		int materialIndex = (materialCount > 0) ? materialDistribution(generator) : -1;
+
+		AddSceneNode(
+			mesh,
+			scaleXYZ,
+			rotationDegrees.x, rotationDegrees.y, rotationDegrees.z,
+			positionXYZ,
+			textureSlot, glm::vec2(1.0f, 1.0f), materialIndex);
+	}
+
+	std::cout << "Generated a stress scene of " << objectCount
+		<< " objects with seed " << m_sceneSettings.seed << std::endl;
+}
 
-	// set the transformations into memory to be used on the drawn meshes
-	SetTransformations(
-		scaleXYZ,
-		XrotationDegrees,
-		YrotationDegrees,
-		ZrotationDegrees,
-		positionXYZ);
+/***********************************************************
+ *  BuildSceneFileNodes()
+ *
+ *  This method is used for adding the nodes of the loaded
+ *  scene file.  The records are read straight from the
+ *  mapped file, and their table indices are turned into
+ *  texture slots and material indices without any lookups.
+ ***********************************************************/
+void SceneManager::BuildSceneFileNodes(const std::vector<int>& textureSlots, const std::vector<int>& materialIndices)
+{
+	const SceneFile::NODE_RECORD* pNodes = m_sceneFile.GetNodes();
+	int nodeCount = m_sceneFile.GetNodeCount();
 
-	//Set the texture to the deck of cards
-	SetShaderTexture("marble");
-	SetTextureUVScale(1.0f, 1.0f);
-	SetShaderMaterial("marbleMaterial");
+	m_sceneNodes.Reserve(m_sceneNodes.GetCount() + nodeCount);
 
-	// draw the mesh with transformation values
-	m_basicMeshes->DrawBoxMesh();
+	for (int i = 0; i < nodeCount; i++)
+	{
+		const SceneFile::NODE_RECORD& record = pNodes[i];
+		int textureSlot = (record.textureIndex >= 0) ? textureSlots[record.textureIndex] : -1;
+		int materialIndex = (record.materialIndex >= 0) ? materialIndices[record.materialIndex] : -1;
+
+		AddSceneNode(
+			(MESH_TYPE)record.mesh,
+			glm::vec3(record.scaleXYZ[0], record.scaleXYZ[1], record.scaleXYZ[2]),
+			record.rotationDegrees[0], record.rotationDegrees[1], record.rotationDegrees[2],
+			glm::vec3(record.positionXYZ[0], record.positionXYZ[1], record.positionXYZ[2]),
+			textureSlot, glm::vec2(record.UVscale[0], record.UVscale[1]), materialIndex);
+	}
 }
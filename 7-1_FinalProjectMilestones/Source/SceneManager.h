@@ -9,10 +9,28 @@
 
 #pragma once
 
-#include "ShaderManager.h"
-#include "ShapeMeshes.h"
+#include "ShaderUniforms.h"
+#include "ClusteredLights.h"
+#include "FrameArena.h"
+#include "FrameProfiler.h"
+#include "GPUCulling.h"
+#include "HiZBuffer.h"
+#include "JobSystem.h"
+#include "RenderQueue.h"
+#include "ResidencyManager.h"
+#include "SceneBVH.h"
+#include "SceneFile.h"
+#include "SceneMeshes.h"
+#include "SceneNodes.h"
+#include "ShaderCache.h"
+#include "ShadowMaps.h"
+#include "StreamBuffer.h"
+#include "TextureArray.h"
+#include "TextureLoader.h"
+#include "TextureStreamer.h"
 
 #include <string>
+#include <unordered_map>
 #include <vector>
 
 
@@ -26,14 +44,21 @@ class SceneManager
 {
 public:
 	// constructor
-	SceneManager(ShaderManager *pShaderManager);
+	SceneManager(
+		ShaderUniforms *pShaderUniforms,
+		FrameProfiler *pProfiler);
 	// destructor
 	~SceneManager();
 
 	struct TEXTURE_INFO
 	{
-		std::string tag;
-		uint32_t ID;
+		// layer of the image in the scene texture array
+		int layer;
+		// true when the image has pixels that are not fully opaque
+		bool bTranslucent;
+		// residency manager resource of the streamed levels, -1
+		// when the whole image is loaded
+		int resource;
 	};
 
 	struct OBJECT_MATERIAL
@@ -46,32 +71,243 @@ public:
 		std::string tag;
 	};
 
+	// basic shape meshes that a scene node can draw
+	enum MESH_TYPE
+	{
+		MESH_BOX,
+		MESH_CONE,
+		MESH_CYLINDER,
+		MESH_PLANE,
+		MESH_PYRAMID3,
+		MESH_TAPERED_CYLINDER
+	};
+
+	// scene content and rendering path options
+	struct SCENE_SETTINGS
+	{
+		// generated stress scene objects, 0 for the regular scene
+		int objectCount;
+		// seed of the random generator, so runs are repeatable
+		unsigned int seed;
+		// cull and draw the batches with a compute shader and
+		// indirect multi-draws
+		bool bGPUCulling;
+		// keep every mesh in one shared vertex and index buffer
+		bool bPackedMeshes;
+		// JSON file of the scene content, the built-in scene
+		// when it cannot be loaded
+		std::string sceneFilename;
+		// worker threads culling and updating the scene, -1 for
+		// one per core but the render thread's
+		int workerThreads;
+		// generated point lights, added to those of the scene
+		int pointLightCount;
+		// lay down the opaque depth before shading, so each
+		// pixel is shaded once
+		bool bDepthPrepass;
+		// drop the instances hidden behind the depth of the
+		// previous frame, on the GPU culling path
+		bool bOcclusionCulling;
+		// megabytes of video memory the streamed texture levels
+		// and mesh levels of detail may take, 0 to load them all
+		// up front
+		int streamingBudget;
+	};
+
+	// largest supported stress scene
+	static const int MAX_STRESS_OBJECTS = 1000000;
+
+	// run of instances drawn with one instanced draw call
+	struct RENDER_BATCH
+	{
+		MESH_TYPE mesh;
+		int materialIndex;
+		bool bTransparent;
+		// drawn with the textured shader variant
+		bool bTextured;
+		// level of detail of the curved meshes
+		int lod;
+		int firstInstance;
+		int instanceCount;
+	};
+
+	// visible instances of a render batch in the current frame
+	struct BATCH_VISIBILITY
+	{
+		// first entry in the sorted visible instances
+		int firstVisible;
+		int visibleCount;
+		// visible instances at each level of detail
+		int lodCounts[SceneMeshes::LOD_LEVELS];
+		// first packed instance of each level of detail
+		int lodFirstInstances[SceneMeshes::LOD_LEVELS];
+		// true when an instance changed level this frame
+		bool bLodsChanged;
+	};
+
+	// run of indirect commands drawn with one multi-draw call,
+	// of one mesh unless the meshes are packed
+	struct INDIRECT_DRAW
+	{
+		MESH_TYPE mesh;
+		int firstCommand;
+		int commandCount;
+	};
+
 private:
-	// pointer to shader manager object
-	ShaderManager* m_pShaderManager;
+	// pointer to the cached shader uniforms and buffers
+	ShaderUniforms* m_pShaderUniforms;
+	// pointer to the frame timings and counters, may be NULL
+	FrameProfiler* m_pProfiler;
+	// pointer to the shader program builder, may be NULL
+	ShaderCache* m_pShaderCache;
+	// pointer to the per-frame ring of the visible instances,
+	// may be NULL
+	StreamBuffer* m_pStreamBuffer;
+	// version of the stream buffer the meshes are attached to
+	int m_streamBufferVersion;
+	// true while the instance buffer holds older data than the
+	// instances streamed last
+	bool m_bInstanceBufferStale;
+	// uniform program index of the untextured and textured
+	// shader variants, both 0 without the shader cache
+	int m_shaderVariants[2];
+	// lighting the shader variants are built for
+	bool m_bUseLighting;
+	int m_lightCount;
+	// point lights of the scene file, shaded through the
+	// light clusters
+	std::vector<ClusteredLights::POINT_LIGHT> m_pointLights;
+	// bins the point lights into view space clusters
+	ClusteredLights m_clusteredLights;
 	// pointer to basic shapes object
-	ShapeMeshes* m_basicMeshes;
-	// total number of loaded textures
-	int m_loadedTextures;
-	// loaded textures info
-	TEXTURE_INFO m_textureIDs[16];
+	SceneMeshes* m_basicMeshes;
+	// loaded textures info, indexed by texture array layer
+	std::vector<TEXTURE_INFO> m_textureIDs;
+	// every scene texture as one layer of a single array texture
+	TextureArray m_textureArray;
+	// decodes the texture images on worker threads
+	TextureLoader m_textureLoader;
 	// defined object materials
 	std::vector<OBJECT_MATERIAL> m_objectMaterials;
+	// texture slot and material index by tag, for O(1) lookups
+	std::unordered_map<std::string, int> m_textureSlotsByTag;
+	std::unordered_map<std::string, int> m_materialIndicesByTag;
+	// retained scene graph built in PrepareScene(), one array
+	// per node field - the tags stay in the lookup maps above
+	SceneNodes m_sceneNodes;
+	// batches of nodes sharing the same mesh, material and shader variant
+	std::vector<RENDER_BATCH> m_renderBatches;
+	// per-instance data of every node, in batch order
+	std::vector<SceneMeshes::INSTANCE_DATA> m_instanceData;
+	// scene node of each instance in m_instanceData
+	std::vector<int> m_instanceNodes;
+	// level of detail each instance was last drawn at
+	std::vector<int> m_instanceLods;
+	// finest streamed texture level each instance needs, found
+	// while it is visible
+	std::vector<int> m_instanceTextureLevels;
+	// height of the viewport culled for, in pixels
+	int m_viewportHeight;
+	// world space bounds of the scene nodes, for frustum culling
+	SceneBVH m_sceneBVH;
+	// splits the scene traversal over the worker threads
+	JobSystem m_jobSystem;
+	// roots of the hierarchy subtrees culled as separate jobs
+	std::vector<int> m_cullSubtrees;
+	// nodes that passed culling this frame, one list per job
+	std::vector<std::vector<int> > m_visibleNodeChunks;
+	// nodes rebuilt this frame, one list per job
+	std::vector<std::vector<int> > m_dirtyNodeChunks;
+	// cull frame each instance was last found visible in
+	std::vector<unsigned int> m_instanceCullFrames;
+	unsigned int m_cullFrame;
+	// visible instances of each render batch this frame
+	std::vector<BATCH_VISIBILITY> m_batchVisibility;
+	// sorted instances of this frame and of the uploaded data
+	std::vector<int> m_visibleInstances;
+	std::vector<int> m_uploadedInstances;
+	// per-instance data of the visible instances, mirrored in
+	// the instance buffer
+	std::vector<SceneMeshes::INSTANCE_DATA> m_visibleInstanceData;
+	// batches of the visible instances in m_visibleInstanceData
+	std::vector<RENDER_BATCH> m_visibleBatches;
+	// true when m_instanceData changed since the last upload
+	bool m_bInstancesChanged;
+	// true when the scene changed since the last RenderScene()
+	bool m_bSceneChanged;
+	// compute shader culling for the indirect draw path
+	GPUCulling m_gpuCulling;
+	// cached depth maps of the lights, redrawn when a caster
+	// or light changes
+	ShadowMaps m_shadowMaps;
+	// farthest depth pyramid of the last frame, for the
+	// occlusion test of the culling shader
+	HiZBuffer m_hiZBuffer;
+	// program of the depth pre-pass, -1 when it is off
+	int m_depthProgram;
+	// streams the finest texture levels and mesh levels of
+	// detail within the video memory budget
+	ResidencyManager m_residency;
+	TextureStreamer m_textureStreamer;
+	// residency resource of each curved mesh, -1 when every
+	// level stays loaded
+	int m_meshResources[SceneMeshes::CURVED_MESH_COUNT];
+	// finest texture level visible this frame by layer, and the
+	// residency changes of this frame
+	std::vector<int> m_layerTextureLevels;
+	std::vector<ResidencyManager::CHANGE> m_residencyChanges;
+	// indirect commands of the opaque batches, one run per mesh
+	std::vector<INDIRECT_DRAW> m_indirectDraws;
+	// sorted draw commands of the current frame
+	RenderQueue m_renderQueue;
+	// texture layer currently set in the shader, -1 for none
+	int m_currentTextureSlot;
+	// generated scene and rendering path options
+	SCENE_SETTINGS m_sceneSettings;
+	// scene content loaded from disk, open during PrepareScene()
+	SceneFile m_sceneFile;
 
-	// load texture images and convert to OpenGL texture data
-	bool CreateGLTexture(const char* filename, std::string tag);
-	// bind loaded OpenGL textures to slots in memory
+	// queue a texture image to be loaded into the next layer
+	bool CreateGLTexture(const char* filename, const std::string& tag);
+	// create and bind the texture array for the queued textures
 	void BindGLTextures();
+	// upload the texture images decoded since the last frame
+	void UpdateTextureLoads();
 	// free the loaded OpenGL textures
 	void DestroyGLTextures();
 	void DefineObjectMaterials();
+	// copy the defined materials into the material uniform buffer
+	void UploadObjectMaterials();
 	void LoadSceneTextures();
 	void SetupSceneLights();
+	// queue the textures, define the materials and set up the
+	// lights of the loaded scene file - the texture slot and
+	// material index of each file record are passed back
+	void LoadSceneFileTextures(std::vector<int>& textureSlots);
+	void LoadSceneFileMaterials(std::vector<int>& materialIndices);
+	void SetupSceneFileLights();
+	// build the shader variants for the scene lighting
+	void BuildShaderVariants();
+	// add the generated point lights over the scene bounds and
+	// upload every point light for the clusters
+	void BuildPointLights();
 	// find a loaded texture by tag
-	int FindTextureID(std::string tag);
-	int FindTextureSlot(std::string tag);
+	int FindTextureID(const std::string& tag);
+	int FindTextureSlot(const std::string& tag);
 	// find a defined material by tag
-	bool FindMaterial(std::string tag, OBJECT_MATERIAL& material);
+	bool FindMaterial(const std::string& tag, OBJECT_MATERIAL& material);
+	int FindMaterialIndex(const std::string& tag);
+	// add a material to the defined materials and index its tag
+	int AddObjectMaterial(const OBJECT_MATERIAL& material);
+
+	// compose a model matrix from the transformation values
+	glm::mat4 BuildTransformation(
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ);
 
 	// set the transformation values 
 	// into the transform buffer
@@ -81,6 +317,8 @@ private:
 		float YrotationDegrees,
 		float ZrotationDegrees,
 		glm::vec3 positionXYZ);
+	// set a precomputed model matrix into the transform buffer
+	void SetTransformations(const glm::mat4& modelMatrix);
 
 	// set the color values into the shader
 	void SetShaderColor(
@@ -91,7 +329,9 @@ private:
 
 	// set the texture data into the shader
 	void SetShaderTexture(
-		std::string textureTag);
+		const std::string& textureTag);
+	void SetShaderTexture(
+		int textureSlot);
 
 	// set the UV scale for the texture mapping
 	void SetTextureUVScale(
@@ -99,7 +339,79 @@ private:
 
 	// set the object material into the shader
 	void SetShaderMaterial(
-		std::string materialTag);
+		const std::string& materialTag);
+	void SetShaderMaterial(
+		int materialIndex);
+
+	// add a node to the retained scene graph
+	int AddSceneNode(
+		MESH_TYPE mesh,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ,
+		const std::string& textureTag,
+		glm::vec2 UVscale,
+		const std::string& materialTag);
+	int AddSceneNode(
+		MESH_TYPE mesh,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ,
+		int textureSlot,
+		glm::vec2 UVscale,
+		int materialIndex);
+	// group the scene nodes into instanced render batches
+	void BuildRenderBatches();
+	// rebuild dirty nodes and refit their bounds
+	void UpdateDirtyInstances();
+	// build the bounding volume hierarchy over the scene nodes
+	void BuildSceneBVH();
+	// find the visible nodes and upload their instance data
+	void CullScene();
+	// write the visible instance data for this frame's draws
+	void StreamVisibleInstances(bool bChanged);
+	// count the visible instances of a batch and pick their
+	// levels of detail
+	void CountVisibleInstances(int batchIndex, const ShaderUniforms::FRAME_BLOCK& frameData);
+	// copy the visible instances of a batch into the packed
+	// instance data, level of detail by level of detail
+	void PackVisibleInstances(int batchIndex);
+	// get the projected radius of an instance on screen
+	float GetProjectedRadius(int instance, const ShaderUniforms::FRAME_BLOCK& frameData);
+	// true for the meshes built at several levels of detail
+	static bool HasLevelsOfDetail(MESH_TYPE mesh);
+	// get the curved mesh of a basic shape, -1 for none
+	static int GetCurvedMesh(MESH_TYPE mesh);
+	// hand the finer levels of detail of the curved meshes to
+	// the residency manager
+	void RegisterMeshResidency();
+	// request the texture levels and levels of detail seen this
+	// frame and stream them in or out
+	void UpdateResidency();
+	// redraw the shadow maps of the lights from every opaque
+	// instance
+	void RenderShadowMaps();
+	// cull the instances on the GPU for the indirect draws
+	void CullSceneGPU();
+	// upload the instances, bounds and commands for GPU culling
+	void UploadGPUInstances();
+	// get the local bounds of a basic shape mesh
+	SceneBVH::BOUNDS GetMeshBounds(MESH_TYPE mesh);
+	// draw the sorted commands of a render queue pass
+	void FlushRenderQueue(RenderQueue::PASS pass);
+	// draw the opaque batches with the indirect commands of
+	// the GPU culling, in the program in use
+	void DrawIndirectBatches();
+	// draw the basic shape mesh of the passed in type
+	void DrawMesh(MESH_TYPE mesh);
+	void DrawMeshInstanced(MESH_TYPE mesh, int count, int firstInstance, int lod);
+	void DrawMeshIndirect(MESH_TYPE mesh, int firstCommand, int commandCount);
+	// get where a basic shape mesh lives in its index buffer
+	SceneMeshes::MESH_RANGE GetMeshRange(MESH_TYPE mesh);
 
 public:
 
@@ -107,11 +419,48 @@ public:
 	// customize for their own 3D scene
 	void PrepareScene();
 	void RenderScene();
+	// true while texture images are still being loaded
+	bool IsLoadingTextures();
+	// true when a frame would show something new
+	bool NeedsRedraw();
+	// get the number of nodes in the retained scene graph
+	int GetSceneNodeCount() const;
+
+	// read the scene options from the command line
+	static SCENE_SETTINGS ParseArguments(int argc, char* argv[]);
+	// choose the scene content and rendering path built by
+	// PrepareScene() - must be called before PrepareScene()
+	void SetSceneSettings(const SCENE_SETTINGS& settings);
+	// set the builder of the shader variants, or NULL to draw
+	// everything with the loaded program - must be called
+	// before PrepareScene()
+	void SetShaderCache(ShaderCache* pShaderCache);
+	// set the ring the visible instances are written into each
+	// frame, or NULL to upload them only when they change
+	void SetStreamBuffer(StreamBuffer* pStreamBuffer);
+	// set the arena the transient draw commands are built in,
+	// reset before every RenderScene(), or NULL for the heap
+	void SetFrameArena(FrameArena* pArena);
+
+	// change the transformation values of a scene node - the
+	// world matrix is rebuilt lazily on the next render pass
+	void SetNodeTransformation(
+		int nodeIndex,
+		glm::vec3 scaleXYZ,
+		float XrotationDegrees,
+		float YrotationDegrees,
+		float ZrotationDegrees,
+		glm::vec3 positionXYZ);
+
+	void BuildPencil();
 
-	void RenderPencil();
+	void BuildCards();
 
-	void RenderCards();
+	void BuildDice();
 
-	void RenderDice();
+	// add randomly placed objects of every mesh, material and texture
+	void BuildStressScene();
+	// add the nodes of the loaded scene file
+	void BuildSceneFileNodes(const std::vector<int>& textureSlots, const std::vector<int>& materialIndices);
 
 };
\ No newline at end of file
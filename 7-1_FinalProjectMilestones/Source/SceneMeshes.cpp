@@ -0,0 +1,1024 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenemeshes.cpp
+// ============
+// create and draw the basic shape meshes used by the 3D scene, either
+// one at a time or as instanced batches
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneMeshes.h"
+
+#include <glm/gtc/packing.hpp>
+
+#include <cmath>
+#include <cstddef>
+
+// declaration of global variables
+namespace
+{
+	// number of segments around the curved shapes at each level
+	// of detail
+	const int g_LodSegments[SceneMeshes::LOD_LEVELS] = { 36, 16, 8 };
+	// bottom and top radius of each curved mesh, in CURVED_MESH
+	// order
+	const float g_CurvedRadii[SceneMeshes::CURVED_MESH_COUNT][2] =
+	{
+		{ 1.0f, 0.0f },
+		{ 1.0f, 1.0f },
+		{ 1.0f, 0.5f }
+	};
+	// floats per vertex - position, normal and texture coordinate
+	const int g_FloatsPerVertex = 8;
+	const float g_Pi = 3.14159265f;
+
+	// append one interleaved vertex to the vertex list
+	void AddVertex(
+		std::vector<GLfloat>& vertices,
+		glm::vec3 position,
+		glm::vec3 normal,
+		glm::vec2 uv)
+	{
+		vertices.push_back(position.x);
+		vertices.push_back(position.y);
+		vertices.push_back(position.z);
+		vertices.push_back(normal.x);
+		vertices.push_back(normal.y);
+		vertices.push_back(normal.z);
+		vertices.push_back(uv.x);
+		vertices.push_back(uv.y);
+	}
+
+	// append a flat quad - corners in counter clockwise order
+	void AddQuad(
+		std::vector<GLfloat>& vertices,
+		std::vector<GLushort>& indices,
+		glm::vec3 p0, glm::vec3 p1, glm::vec3 p2, glm::vec3 p3,
+		glm::vec3 normal)
+	{
+		GLushort first = (GLushort)(vertices.size() / g_FloatsPerVertex);
+
+		AddVertex(vertices, p0, normal, glm::vec2(0.0f, 0.0f));
+		AddVertex(vertices, p1, normal, glm::vec2(1.0f, 0.0f));
+		AddVertex(vertices, p2, normal, glm::vec2(1.0f, 1.0f));
+		AddVertex(vertices, p3, normal, glm::vec2(0.0f, 1.0f));
+
+		GLushort quad[] = { 0, 1, 2, 0, 2, 3 };
+		for (int i = 0; i < 6; i++)
+		{
+			indices.push_back(first + quad[i]);
+		}
+	}
+
+	// append a flat triangle - corners in counter clockwise order
+	void AddTriangle(
+		std::vector<GLfloat>& vertices,
+		std::vector<GLushort>& indices,
+		glm::vec3 p0, glm::vec3 p1, glm::vec3 p2)
+	{
+		GLushort first = (GLushort)(vertices.size() / g_FloatsPerVertex);
+		glm::vec3 normal = glm::normalize(glm::cross(p1 - p0, p2 - p0));
+
+		AddVertex(vertices, p0, normal, glm::vec2(0.0f, 0.0f));
+		AddVertex(vertices, p1, normal, glm::vec2(1.0f, 0.0f));
+		AddVertex(vertices, p2, normal, glm::vec2(0.5f, 1.0f));
+
+		indices.push_back(first);
+		indices.push_back(first + 1);
+		indices.push_back(first + 2);
+	}
+}
+
+/***********************************************************
+ *  GLMesh()
+ *
+ *  The constructor for an unloaded mesh
+ ***********************************************************/
+SceneMeshes::GLMesh::GLMesh()
+	: vertexArray(GLObject::OBJECT_VERTEX_ARRAY),
+	vbo(GLObject::OBJECT_BUFFER),
+	ebo(GLObject::OBJECT_BUFFER)
+{
+	vao = 0;
+	nIndices = 0;
+	firstIndex = 0;
+	baseVertex = 0;
+}
+
+/***********************************************************
+ *  SceneMeshes()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneMeshes::SceneMeshes()
+	: m_packedVertexArray(GLObject::OBJECT_VERTEX_ARRAY),
+	m_packedVertexBuffer(GLObject::OBJECT_BUFFER),
+	m_packedIndexBuffer(GLObject::OBJECT_BUFFER),
+	m_instanceBuffer(GLObject::OBJECT_BUFFER)
+{
+	m_bPackMeshes = false;
+	m_boundVertexArray = 0;
+	m_instanceCapacity = 0;
+	m_instanceSource = 0;
+	m_instanceBase = 0;
+	m_pProfiler = NULL;
+}
+
+/***********************************************************
+ *  ~SceneMeshes()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+SceneMeshes::~SceneMeshes()
+{
+	DestroyMesh(m_boxMesh);
+	DestroyMesh(m_planeMesh);
+	DestroyMesh(m_pyramid3Mesh);
+	for (int lod = 0; lod < LOD_LEVELS; lod++)
+	{
+		DestroyMesh(m_coneMesh[lod]);
+		DestroyMesh(m_cylinderMesh[lod]);
+		DestroyMesh(m_taperedCylinderMesh[lod]);
+	}
+	DestroyPackedBuffers();
+
+	m_instanceBuffer.Reset();
+}
+
+/***********************************************************
+ *  SetPackedMeshes()
+ *
+ *  This method is used for choosing whether the meshes
+ *  loaded afterwards go into the shared packed buffers or
+ *  get their own vertex array and buffers.
+ ***********************************************************/
+void SceneMeshes::SetPackedMeshes(bool bPacked)
+{
+	m_bPackMeshes = bPacked;
+}
+
+/***********************************************************
+ *  IsPacked()
+ *
+ *  This method is used for checking whether new meshes go
+ *  into the shared packed buffers.
+ ***********************************************************/
+bool SceneMeshes::IsPacked() const
+{
+	return(m_bPackMeshes);
+}
+
+/***********************************************************
+ *  CreateMesh()
+ *
+ *  This method is used for uploading the interleaved vertex
+ *  data and the indices of a mesh, and for attaching the
+ *  shared instance buffer to the mesh vertex array.  In
+ *  packed mode the mesh is appended to the shared buffers
+ *  instead.
+ ***********************************************************/
+void SceneMeshes::CreateMesh(
+	GLMesh& mesh,
+	const std::vector<GLfloat>& vertices,
+	const std::vector<GLushort>& indices)
+{
+	const GLsizei stride = sizeof(GLfloat) * g_FloatsPerVertex;
+
+	DestroyMesh(mesh);
+
+	// every mesh reads its instances from the same buffer, which
+	// always holds at least one instance so that single draws
+	// never read the instance attributes out of bounds
+	if (m_instanceBuffer.Get() == 0)
+	{
+		INSTANCE_DATA identity = { glm::mat4(1.0f), glm::vec2(1.0f, 1.0f), -1, -1 };
+		SetInstanceData(&identity, 1);
+	}
+
+	if (m_bPackMeshes)
+	{
+		AppendPackedMesh(mesh, vertices, indices);
+		return;
+	}
+
+	mesh.vao = mesh.vertexArray.Create();
+	BindVertexArray(mesh.vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, mesh.vbo.Create());
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GLfloat), vertices.data(), GL_STATIC_DRAW);
+	mesh.vbo.SetByteSize(vertices.size() * sizeof(GLfloat));
+
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.ebo.Create());
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), indices.data(), GL_STATIC_DRAW);
+	mesh.ebo.SetByteSize(indices.size() * sizeof(GLushort));
+	mesh.nIndices = (GLsizei)indices.size();
+
+	glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride, (void*)0);
+	glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+	glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 3));
+	glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+	glVertexAttribPointer(TEXTURE_COORD_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, stride, (void*)(sizeof(GLfloat) * 6));
+	glEnableVertexAttribArray(TEXTURE_COORD_ATTRIBUTE);
+
+	AttachInstanceAttributes(0);
+
+	BindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+}
+
+/***********************************************************
+ *  AppendPackedMesh()
+ *
+ *  This method is used for converting a mesh to the packed
+ *  vertex layout and appending it to the shared buffers.
+ *  The mesh keeps its 16 bit indices, which the base vertex
+ *  offsets into the shared vertex buffer.  The meshes are
+ *  small, so the whole shared buffers are uploaded again
+ *  for every mesh loaded.
+ ***********************************************************/
+void SceneMeshes::AppendPackedMesh(
+	GLMesh& mesh,
+	const std::vector<GLfloat>& vertices,
+	const std::vector<GLushort>& indices)
+{
+	mesh.nIndices = (GLsizei)indices.size();
+	mesh.firstIndex = (GLuint)m_packedIndices.size();
+	mesh.baseVertex = (GLint)m_packedVertices.size();
+
+	for (size_t i = 0; i + g_FloatsPerVertex <= vertices.size(); i += g_FloatsPerVertex)
+	{
+		PACKED_VERTEX vertex;
+
+		vertex.position[0] = vertices[i];
+		vertex.position[1] = vertices[i + 1];
+		vertex.position[2] = vertices[i + 2];
+		vertex.normal[0] = glm::packHalf1x16(vertices[i + 3]);
+		vertex.normal[1] = glm::packHalf1x16(vertices[i + 4]);
+		vertex.normal[2] = glm::packHalf1x16(vertices[i + 5]);
+		vertex.normal[3] = 0;
+		vertex.uv[0] = glm::packHalf1x16(vertices[i + 6]);
+		vertex.uv[1] = glm::packHalf1x16(vertices[i + 7]);
+		m_packedVertices.push_back(vertex);
+	}
+	m_packedIndices.insert(m_packedIndices.end(), indices.begin(), indices.end());
+
+	if (m_packedVertexArray.Get() == 0)
+	{
+		const GLsizei stride = sizeof(PACKED_VERTEX);
+
+		BindVertexArray(m_packedVertexArray.Create());
+		glBindBuffer(GL_ARRAY_BUFFER, m_packedVertexBuffer.Create());
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_packedIndexBuffer.Create());
+
+		glVertexAttribPointer(POSITION_ATTRIBUTE, 3, GL_FLOAT, GL_FALSE, stride,
+			(void*)offsetof(PACKED_VERTEX, position));
+		glEnableVertexAttribArray(POSITION_ATTRIBUTE);
+		glVertexAttribPointer(NORMAL_ATTRIBUTE, 3, GL_HALF_FLOAT, GL_FALSE, stride,
+			(void*)offsetof(PACKED_VERTEX, normal));
+		glEnableVertexAttribArray(NORMAL_ATTRIBUTE);
+		glVertexAttribPointer(TEXTURE_COORD_ATTRIBUTE, 2, GL_HALF_FLOAT, GL_FALSE, stride,
+			(void*)offsetof(PACKED_VERTEX, uv));
+		glEnableVertexAttribArray(TEXTURE_COORD_ATTRIBUTE);
+
+		AttachInstanceAttributes(0);
+	}
+
+	// the index buffer binding is part of the vertex array
+	BindVertexArray(m_packedVertexArray.Get());
+	glBindBuffer(GL_ARRAY_BUFFER, m_packedVertexBuffer.Get());
+	glBufferData(GL_ARRAY_BUFFER, m_packedVertices.size() * sizeof(PACKED_VERTEX), m_packedVertices.data(), GL_STATIC_DRAW);
+	m_packedVertexBuffer.SetByteSize(m_packedVertices.size() * sizeof(PACKED_VERTEX));
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_packedIndexBuffer.Get());
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_packedIndices.size() * sizeof(GLushort), m_packedIndices.data(), GL_STATIC_DRAW);
+	m_packedIndexBuffer.SetByteSize(m_packedIndices.size() * sizeof(GLushort));
+	BindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	mesh.vao = m_packedVertexArray.Get();
+}
+
+/***********************************************************
+ *  AttachInstanceAttributes()
+ *
+ *  This method is used for pointing the per-instance
+ *  attributes of the bound vertex array at the shared
+ *  instance buffer, or at the buffer set as the instance
+ *  source, starting at one of its instances.
+ ***********************************************************/
+void SceneMeshes::AttachInstanceAttributes(int firstInstance)
+{
+	const size_t base = sizeof(INSTANCE_DATA) * firstInstance;
+
+	// the instance attributes advance once per drawn instance
+	glBindBuffer(GL_ARRAY_BUFFER, (m_instanceSource != 0) ? m_instanceSource : m_instanceBuffer.Get());
+	for (int column = 0; column < 4; column++)
+	{
+		GLuint location = INSTANCE_MODEL_ATTRIBUTE + column;
+		glVertexAttribPointer(location, 4, GL_FLOAT, GL_FALSE, sizeof(INSTANCE_DATA),
+			(void*)(base + offsetof(INSTANCE_DATA, model) + sizeof(glm::vec4) * column));
+		glEnableVertexAttribArray(location);
+		glVertexAttribDivisor(location, 1);
+	}
+	glVertexAttribPointer(INSTANCE_UV_SCALE_ATTRIBUTE, 2, GL_FLOAT, GL_FALSE, sizeof(INSTANCE_DATA),
+		(void*)(base + offsetof(INSTANCE_DATA, UVscale)));
+	glEnableVertexAttribArray(INSTANCE_UV_SCALE_ATTRIBUTE);
+	glVertexAttribDivisor(INSTANCE_UV_SCALE_ATTRIBUTE, 1);
+	// integer attributes need the I variant to skip conversion
+	glVertexAttribIPointer(INSTANCE_TEXTURE_LAYER_ATTRIBUTE, 1, GL_INT, sizeof(INSTANCE_DATA),
+		(void*)(base + offsetof(INSTANCE_DATA, textureLayer)));
+	glEnableVertexAttribArray(INSTANCE_TEXTURE_LAYER_ATTRIBUTE);
+	glVertexAttribDivisor(INSTANCE_TEXTURE_LAYER_ATTRIBUTE, 1);
+	glVertexAttribIPointer(INSTANCE_MATERIAL_ATTRIBUTE, 1, GL_INT, sizeof(INSTANCE_DATA),
+		(void*)(base + offsetof(INSTANCE_DATA, materialIndex)));
+	glEnableVertexAttribArray(INSTANCE_MATERIAL_ATTRIBUTE);
+	glVertexAttribDivisor(INSTANCE_MATERIAL_ATTRIBUTE, 1);
+}
+
+/***********************************************************
+ *  BindVertexArray()
+ *
+ *  This method is used for binding a vertex array, skipping
+ *  the call when it is already bound.
+ ***********************************************************/
+void SceneMeshes::BindVertexArray(GLuint vertexArray)
+{
+	if (vertexArray != m_boundVertexArray)
+	{
+		glBindVertexArray(vertexArray);
+		m_boundVertexArray = vertexArray;
+	}
+}
+
+/***********************************************************
+ *  DestroyMesh()
+ *
+ *  This method is used for freeing the OpenGL objects of
+ *  a loaded mesh.
+ ***********************************************************/
+void SceneMeshes::DestroyMesh(GLMesh& mesh)
+{
+	// a deleted vertex array is unbound with it - a packed
+	// mesh owns nothing, it only points into the shared buffers
+	if ((mesh.vertexArray.Get() != 0) && (mesh.vertexArray.Get() == m_boundVertexArray))
+	{
+		m_boundVertexArray = 0;
+	}
+	mesh.vertexArray.Reset();
+	mesh.vbo.Reset();
+	mesh.ebo.Reset();
+
+	mesh.vao = 0;
+	mesh.nIndices = 0;
+	mesh.firstIndex = 0;
+	mesh.baseVertex = 0;
+}
+
+/***********************************************************
+ *  DestroyPackedBuffers()
+ *
+ *  This method is used for freeing the shared vertex array
+ *  and buffers of the packed meshes.
+ ***********************************************************/
+void SceneMeshes::DestroyPackedBuffers()
+{
+	if ((m_packedVertexArray.Get() != 0) && (m_packedVertexArray.Get() == m_boundVertexArray))
+	{
+		m_boundVertexArray = 0;
+	}
+	m_packedVertexArray.Reset();
+	m_packedVertexBuffer.Reset();
+	m_packedIndexBuffer.Reset();
+
+	m_packedVertices.clear();
+	m_packedIndices.clear();
+}
+
+/***********************************************************
+ *  LoadBoxMesh()
+ *
+ *  This method is used for creating a unit box centered on
+ *  the origin.
+ ***********************************************************/
+void SceneMeshes::LoadBoxMesh()
+{
+	std::vector<GLfloat> vertices;
+	std::vector<GLushort> indices;
+
+	// the eight corners of the box
+	glm::vec3 lbf(-0.5f, -0.5f, 0.5f);
+	glm::vec3 rbf(0.5f, -0.5f, 0.5f);
+	glm::vec3 rtf(0.5f, 0.5f, 0.5f);
+	glm::vec3 ltf(-0.5f, 0.5f, 0.5f);
+	glm::vec3 lbb(-0.5f, -0.5f, -0.5f);
+	glm::vec3 rbb(0.5f, -0.5f, -0.5f);
+	glm::vec3 rtb(0.5f, 0.5f, -0.5f);
+	glm::vec3 ltb(-0.5f, 0.5f, -0.5f);
+
+	AddQuad(vertices, indices, lbf, rbf, rtf, ltf, glm::vec3(0.0f, 0.0f, 1.0f));
+	AddQuad(vertices, indices, rbb, lbb, ltb, rtb, glm::vec3(0.0f, 0.0f, -1.0f));
+	AddQuad(vertices, indices, lbb, lbf, ltf, ltb, glm::vec3(-1.0f, 0.0f, 0.0f));
+	AddQuad(vertices, indices, rbf, rbb, rtb, rtf, glm::vec3(1.0f, 0.0f, 0.0f));
+	AddQuad(vertices, indices, ltf, rtf, rtb, ltb, glm::vec3(0.0f, 1.0f, 0.0f));
+	AddQuad(vertices, indices, lbb, rbb, rbf, lbf, glm::vec3(0.0f, -1.0f, 0.0f));
+
+	CreateMesh(m_boxMesh, vertices, indices);
+}
+
+/***********************************************************
+ *  LoadPlaneMesh()
+ *
+ *  This method is used for creating a 2x2 plane in the XZ
+ *  plane, facing up.
+ ***********************************************************/
+void SceneMeshes::LoadPlaneMesh()
+{
+	std::vector<GLfloat> vertices;
+	std::vector<GLushort> indices;
+
+	AddQuad(vertices, indices,
+		glm::vec3(-1.0f, 0.0f, 1.0f),
+		glm::vec3(1.0f, 0.0f, 1.0f),
+		glm::vec3(1.0f, 0.0f, -1.0f),
+		glm::vec3(-1.0f, 0.0f, -1.0f),
+		glm::vec3(0.0f, 1.0f, 0.0f));
+
+	CreateMesh(m_planeMesh, vertices, indices);
+}
+
+/***********************************************************
+ *  LoadPyramid3Mesh()
+ *
+ *  This method is used for creating a three sided pyramid
+ *  with its base at y = -0.5 and its tip at y = 0.5.
+ ***********************************************************/
+void SceneMeshes::LoadPyramid3Mesh()
+{
+	std::vector<GLfloat> vertices;
+	std::vector<GLushort> indices;
+
+	glm::vec3 left(-0.5f, -0.5f, 0.5f);
+	glm::vec3 right(0.5f, -0.5f, 0.5f);
+	glm::vec3 back(0.0f, -0.5f, -0.5f);
+	glm::vec3 tip(0.0f, 0.5f, 0.0f);
+
+	AddTriangle(vertices, indices, left, right, tip);
+	AddTriangle(vertices, indices, right, back, tip);
+	AddTriangle(vertices, indices, back, left, tip);
+	AddTriangle(vertices, indices, left, back, right);
+
+	CreateMesh(m_pyramid3Mesh, vertices, indices);
+}
+
+/***********************************************************
+ *  CreateTaperedMesh()
+ *
+ *  This method is used for creating a capped shape around
+ *  the Y axis with the passed in number of sides, narrowing
+ *  from the bottom radius at y = 0 to the top radius at
+ *  y = 1.  A top radius of zero makes a cone.
+ ***********************************************************/
+void SceneMeshes::CreateTaperedMesh(GLMesh& mesh, float bottomRadius, float topRadius, int segments)
+{
+	std::vector<GLfloat> vertices;
+	std::vector<GLushort> indices;
+
+	// the side normals lean by the slope from bottom to top
+	const float slope = bottomRadius - topRadius;
+
+	// side wall - the seam repeats so the texture can wrap
+	for (int i = 0; i <= segments; i++)
+	{
+		float u = (float)i / segments;
+		float angle = u * 2.0f * g_Pi;
+		float c = cosf(angle);
+		float s = sinf(angle);
+		glm::vec3 normal = glm::normalize(glm::vec3(c, slope, s));
+
+		AddVertex(vertices, glm::vec3(c * bottomRadius, 0.0f, s * bottomRadius), normal, glm::vec2(u, 0.0f));
+		AddVertex(vertices, glm::vec3(c * topRadius, 1.0f, s * topRadius), normal, glm::vec2(u, 1.0f));
+	}
+	for (int i = 0; i < segments; i++)
+	{
+		GLushort bottom = (GLushort)(i * 2);
+		GLushort top = bottom + 1;
+		GLushort nextBottom = bottom + 2;
+		GLushort nextTop = bottom + 3;
+
+		indices.push_back(bottom);
+		indices.push_back(top);
+		indices.push_back(nextBottom);
+		indices.push_back(nextBottom);
+		indices.push_back(top);
+		indices.push_back(nextTop);
+	}
+
+	// flat caps at each end - a cone has no top cap
+	for (int cap = 0; cap < 2; cap++)
+	{
+		float radius = (cap == 0) ? bottomRadius : topRadius;
+		float y = (cap == 0) ? 0.0f : 1.0f;
+		glm::vec3 normal(0.0f, (cap == 0) ? -1.0f : 1.0f, 0.0f);
+
+		if (radius <= 0.0f)
+		{
+			continue;
+		}
+
+		GLushort center = (GLushort)(vertices.size() / g_FloatsPerVertex);
+		AddVertex(vertices, glm::vec3(0.0f, y, 0.0f), normal, glm::vec2(0.5f, 0.5f));
+		for (int i = 0; i <= segments; i++)
+		{
+			float angle = (float)i / segments * 2.0f * g_Pi;
+			float c = cosf(angle);
+			float s = sinf(angle);
+
+			AddVertex(vertices, glm::vec3(c * radius, y, s * radius), normal,
+				glm::vec2(0.5f + 0.5f * c, 0.5f + 0.5f * s));
+		}
+		for (int i = 0; i < segments; i++)
+		{
+			indices.push_back(center);
+			indices.push_back(center + 1 + i);
+			indices.push_back(center + 2 + i);
+		}
+	}
+
+	CreateMesh(mesh, vertices, indices);
+}
+
+/***********************************************************
+ *  CreateTaperedLevels()
+ *
+ *  This method is used for creating every level of detail
+ *  of a tapered shape, each with fewer segments around it
+ *  than the level before.
+ ***********************************************************/
+void SceneMeshes::CreateTaperedLevels(GLMesh meshes[], float bottomRadius, float topRadius)
+{
+	for (int lod = 0; lod < LOD_LEVELS; lod++)
+	{
+		CreateTaperedMesh(meshes[lod], bottomRadius, topRadius, g_LodSegments[lod]);
+	}
+}
+
+/***********************************************************
+ *  ClampLod()
+ *
+ *  This method is used for clamping a level of detail to
+ *  the levels that exist.
+ ***********************************************************/
+int SceneMeshes::ClampLod(int lod)
+{
+	if (lod < 0)
+	{
+		return(0);
+	}
+
+	return((lod < LOD_LEVELS) ? lod : LOD_LEVELS - 1);
+}
+
+/***********************************************************
+ *  ResolveLod()
+ *
+ *  This method is used for getting the level of detail a
+ *  draw uses: the requested level when it is loaded, else
+ *  the next coarser loaded level, else the next finer one.
+ ***********************************************************/
+const SceneMeshes::GLMesh& SceneMeshes::ResolveLod(const GLMesh meshes[], int lod)
+{
+	lod = ClampLod(lod);
+
+	for (int level = lod; level < LOD_LEVELS; level++)
+	{
+		if (meshes[level].vao != 0)
+		{
+			return(meshes[level]);
+		}
+	}
+	for (int level = lod - 1; level >= 0; level--)
+	{
+		if (meshes[level].vao != 0)
+		{
+			return(meshes[level]);
+		}
+	}
+
+	return(meshes[lod]);
+}
+
+/***********************************************************
+ *  GetCurvedLevels()
+ *
+ *  This method is used for getting the levels of detail of
+ *  a curved mesh.
+ ***********************************************************/
+SceneMeshes::GLMesh* SceneMeshes::GetCurvedLevels(CURVED_MESH mesh)
+{
+	switch (mesh)
+	{
+	case CURVED_CONE:
+		return(m_coneMesh);
+	case CURVED_CYLINDER:
+		return(m_cylinderMesh);
+	case CURVED_TAPERED_CYLINDER:
+		return(m_taperedCylinderMesh);
+	default:
+		return(NULL);
+	}
+}
+
+/***********************************************************
+ *  GetCurvedLevels()
+ *
+ *  This method is used for getting the levels of detail of
+ *  a curved mesh, for reading.
+ ***********************************************************/
+const SceneMeshes::GLMesh* SceneMeshes::GetCurvedLevels(CURVED_MESH mesh) const
+{
+	return(const_cast<SceneMeshes*>(this)->GetCurvedLevels(mesh));
+}
+
+/***********************************************************
+ *  SetLevelLoaded()
+ *
+ *  This method is used for building one level of detail of
+ *  a curved mesh again, or freeing its buffers.  Packed
+ *  meshes share their buffers, so their levels stay loaded.
+ ***********************************************************/
+bool SceneMeshes::SetLevelLoaded(CURVED_MESH mesh, int lod, bool bLoaded)
+{
+	GLMesh* pLevels = GetCurvedLevels(mesh);
+
+	if (m_bPackMeshes || (NULL == pLevels) || (lod < 0) || (lod >= LOD_LEVELS))
+	{
+		return false;
+	}
+
+	if (bLoaded && (pLevels[lod].vao == 0))
+	{
+		CreateTaperedMesh(pLevels[lod], g_CurvedRadii[mesh][0], g_CurvedRadii[mesh][1], g_LodSegments[lod]);
+	}
+	else if (!bLoaded)
+	{
+		DestroyMesh(pLevels[lod]);
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  IsLevelLoaded()
+ *
+ *  This method is used for checking whether a level of
+ *  detail of a curved mesh has its buffers.
+ ***********************************************************/
+bool SceneMeshes::IsLevelLoaded(CURVED_MESH mesh, int lod) const
+{
+	const GLMesh* pLevels = GetCurvedLevels(mesh);
+
+	return((NULL != pLevels) && (lod >= 0) && (lod < LOD_LEVELS) && (pLevels[lod].vao != 0));
+}
+
+/***********************************************************
+ *  GetLevelBytes()
+ *
+ *  This method is used for getting the bytes of the vertex
+ *  and index buffers of a loaded level of detail, 0 when it
+ *  is not loaded or lives in the shared buffers.
+ ***********************************************************/
+long long SceneMeshes::GetLevelBytes(CURVED_MESH mesh, int lod) const
+{
+	if (!IsLevelLoaded(mesh, lod))
+	{
+		return(0);
+	}
+
+	const GLMesh& level = GetCurvedLevels(mesh)[lod];
+
+	return(level.vbo.GetByteSize() + level.ebo.GetByteSize());
+}
+
+/***********************************************************
+ *  LoadConeMesh()
+ *
+ *  This method is used for creating a cone with a unit
+ *  radius base at y = 0 and its tip at y = 1, at every
+ *  level of detail.
+ ***********************************************************/
+void SceneMeshes::LoadConeMesh()
+{
+	CreateTaperedLevels(m_coneMesh, g_CurvedRadii[CURVED_CONE][0], g_CurvedRadii[CURVED_CONE][1]);
+}
+
+/***********************************************************
+ *  LoadCylinderMesh()
+ *
+ *  This method is used for creating a unit radius cylinder
+ *  from y = 0 to y = 1, at every level of detail.
+ ***********************************************************/
+void SceneMeshes::LoadCylinderMesh()
+{
+	CreateTaperedLevels(m_cylinderMesh, g_CurvedRadii[CURVED_CYLINDER][0], g_CurvedRadii[CURVED_CYLINDER][1]);
+}
+
+/***********************************************************
+ *  LoadTaperedCylinderMesh()
+ *
+ *  This method is used for creating a cylinder from y = 0
+ *  to y = 1 whose radius narrows from 1 to 0.5, at every
+ *  level of detail.
+ ***********************************************************/
+void SceneMeshes::LoadTaperedCylinderMesh()
+{
+	CreateTaperedLevels(m_taperedCylinderMesh, g_CurvedRadii[CURVED_TAPERED_CYLINDER][0], g_CurvedRadii[CURVED_TAPERED_CYLINDER][1]);
+}
+
+/***********************************************************
+ *  DrawMesh()
+ *
+ *  This method is used for drawing a loaded mesh.  A count
+ *  of zero draws it once without instancing.  The packed
+ *  vertex array is left bound, so consecutive draws of
+ *  packed meshes skip the rebind.
+ ***********************************************************/
+void SceneMeshes::DrawMesh(const GLMesh& mesh, int count, int firstInstance)
+{
+	if (mesh.vao == 0)
+	{
+		return;
+	}
+
+	const void* indexOffset = (const void*)(mesh.firstIndex * sizeof(GLushort));
+
+	BindVertexArray(mesh.vao);
+	// without base instances, such as on the 3.3 context, the
+	// instance attributes are pointed at the first instance of
+	// the batch instead, and back at the start of the source
+	// for single draws
+	const bool bBaseInstance = GLEW_VERSION_4_2 || GLEW_ARB_base_instance;
+	if (!bBaseInstance)
+	{
+		AttachInstanceAttributes((count == 0) ? 0 : m_instanceBase + firstInstance);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+	if (count == 0)
+	{
+		glDrawElementsBaseVertex(
+			GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, indexOffset,
+			mesh.baseVertex);
+	}
+	else if (bBaseInstance)
+	{
+		glDrawElementsInstancedBaseVertexBaseInstance(
+			GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, indexOffset,
+			count, mesh.baseVertex, m_instanceBase + firstInstance);
+	}
+	else
+	{
+		glDrawElementsInstancedBaseVertex(
+			GL_TRIANGLES, mesh.nIndices, GL_UNSIGNED_SHORT, indexOffset,
+			count, mesh.baseVertex);
+	}
+	if (mesh.vao != m_packedVertexArray.Get())
+	{
+		BindVertexArray(0);
+	}
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_DRAW_CALLS);
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_INSTANCES, (count == 0) ? 1 : count);
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_TRIANGLES, (mesh.nIndices / 3) * ((count == 0) ? 1 : count));
+	}
+}
+
+/***********************************************************
+ *  DrawIndirect()
+ *
+ *  This method is used for drawing a range of the indirect
+ *  commands in the bound GL_DRAW_INDIRECT_BUFFER with a
+ *  vertex array, in a single multi-draw call.  The commands
+ *  are the 20 byte DrawElementsIndirectCommand layout.
+ ***********************************************************/
+void SceneMeshes::DrawIndirect(GLuint vertexArray, int firstCommand, int commandCount)
+{
+	if ((vertexArray == 0) || (commandCount <= 0))
+	{
+		return;
+	}
+
+	const size_t commandSize = 5 * sizeof(GLuint);
+
+	BindVertexArray(vertexArray);
+	glMultiDrawElementsIndirect(
+		GL_TRIANGLES, GL_UNSIGNED_SHORT,
+		(const void*)(firstCommand * commandSize),
+		commandCount, 0);
+	if (vertexArray != m_packedVertexArray.Get())
+	{
+		BindVertexArray(0);
+	}
+
+	// the instance counts are only known on the GPU
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_DRAW_CALLS);
+	}
+}
+
+/***********************************************************
+ *  Draw*Mesh()
+ *
+ *  These methods are used for drawing one copy of a mesh
+ *  with the transformation set in the shader uniforms.  The
+ *  curved shapes take a level of detail, drawn with the
+ *  next coarser one while it is not loaded.
+ ***********************************************************/
+void SceneMeshes::DrawBoxMesh() { DrawMesh(m_boxMesh, 0, 0); }
+void SceneMeshes::DrawConeMesh(int lod) { DrawMesh(ResolveLod(m_coneMesh, lod), 0, 0); }
+void SceneMeshes::DrawCylinderMesh(int lod) { DrawMesh(ResolveLod(m_cylinderMesh, lod), 0, 0); }
+void SceneMeshes::DrawPlaneMesh() { DrawMesh(m_planeMesh, 0, 0); }
+void SceneMeshes::DrawPyramid3Mesh() { DrawMesh(m_pyramid3Mesh, 0, 0); }
+void SceneMeshes::DrawTaperedCylinderMesh(int lod) { DrawMesh(ResolveLod(m_taperedCylinderMesh, lod), 0, 0); }
+
+/***********************************************************
+ *  Draw*MeshInstanced()
+ *
+ *  These methods are used for drawing count copies of a mesh
+ *  in one call, reading each copy's transformation from the
+ *  instance buffer starting at firstInstance.
+ ***********************************************************/
+void SceneMeshes::DrawBoxMeshInstanced(int count, int firstInstance) { DrawMesh(m_boxMesh, count, firstInstance); }
+void SceneMeshes::DrawConeMeshInstanced(int count, int firstInstance, int lod) { DrawMesh(ResolveLod(m_coneMesh, lod), count, firstInstance); }
+void SceneMeshes::DrawCylinderMeshInstanced(int count, int firstInstance, int lod) { DrawMesh(ResolveLod(m_cylinderMesh, lod), count, firstInstance); }
+void SceneMeshes::DrawPlaneMeshInstanced(int count, int firstInstance) { DrawMesh(m_planeMesh, count, firstInstance); }
+void SceneMeshes::DrawPyramid3MeshInstanced(int count, int firstInstance) { DrawMesh(m_pyramid3Mesh, count, firstInstance); }
+void SceneMeshes::DrawTaperedCylinderMeshInstanced(int count, int firstInstance, int lod) { DrawMesh(ResolveLod(m_taperedCylinderMesh, lod), count, firstInstance); }
+
+/***********************************************************
+ *  Draw*MeshIndirect()
+ *
+ *  These methods are used for drawing a range of indirect
+ *  commands of a mesh in one call.  Each command reads its
+ *  instances from the instance buffer at its base instance.
+ ***********************************************************/
+void SceneMeshes::DrawBoxMeshIndirect(int firstCommand, int commandCount) { DrawIndirect(m_boxMesh.vao, firstCommand, commandCount); }
+void SceneMeshes::DrawConeMeshIndirect(int firstCommand, int commandCount, int lod) { DrawIndirect(ResolveLod(m_coneMesh, lod).vao, firstCommand, commandCount); }
+void SceneMeshes::DrawCylinderMeshIndirect(int firstCommand, int commandCount, int lod) { DrawIndirect(ResolveLod(m_cylinderMesh, lod).vao, firstCommand, commandCount); }
+void SceneMeshes::DrawPlaneMeshIndirect(int firstCommand, int commandCount) { DrawIndirect(m_planeMesh.vao, firstCommand, commandCount); }
+void SceneMeshes::DrawPyramid3MeshIndirect(int firstCommand, int commandCount) { DrawIndirect(m_pyramid3Mesh.vao, firstCommand, commandCount); }
+void SceneMeshes::DrawTaperedCylinderMeshIndirect(int firstCommand, int commandCount, int lod) { DrawIndirect(ResolveLod(m_taperedCylinderMesh, lod).vao, firstCommand, commandCount); }
+
+/***********************************************************
+ *  DrawPackedIndirect()
+ *
+ *  This method is used for drawing a range of indirect
+ *  commands that may mix every packed mesh in one call,
+ *  since they all share one vertex array.
+ ***********************************************************/
+void SceneMeshes::DrawPackedIndirect(int firstCommand, int commandCount)
+{
+	DrawIndirect(m_packedVertexArray.Get(), firstCommand, commandCount);
+}
+
+/***********************************************************
+ *  Get*MeshRange()
+ *
+ *  These methods are used for getting the index count,
+ *  first index and base vertex of a loaded mesh, with a
+ *  zero index count when it is not loaded.
+ ***********************************************************/
+SceneMeshes::MESH_RANGE SceneMeshes::GetBoxMeshRange() const { MESH_RANGE range = { m_boxMesh.nIndices, m_boxMesh.firstIndex, m_boxMesh.baseVertex }; return(range); }
+SceneMeshes::MESH_RANGE SceneMeshes::GetConeMeshRange(int lod) const { const GLMesh& mesh = ResolveLod(m_coneMesh, lod); MESH_RANGE range = { mesh.nIndices, mesh.firstIndex, mesh.baseVertex }; return(range); }
+SceneMeshes::MESH_RANGE SceneMeshes::GetCylinderMeshRange(int lod) const { const GLMesh& mesh = ResolveLod(m_cylinderMesh, lod); MESH_RANGE range = { mesh.nIndices, mesh.firstIndex, mesh.baseVertex }; return(range); }
+SceneMeshes::MESH_RANGE SceneMeshes::GetPlaneMeshRange() const { MESH_RANGE range = { m_planeMesh.nIndices, m_planeMesh.firstIndex, m_planeMesh.baseVertex }; return(range); }
+SceneMeshes::MESH_RANGE SceneMeshes::GetPyramid3MeshRange() const { MESH_RANGE range = { m_pyramid3Mesh.nIndices, m_pyramid3Mesh.firstIndex, m_pyramid3Mesh.baseVertex }; return(range); }
+SceneMeshes::MESH_RANGE SceneMeshes::GetTaperedCylinderMeshRange(int lod) const { const GLMesh& mesh = ResolveLod(m_taperedCylinderMesh, lod); MESH_RANGE range = { mesh.nIndices, mesh.firstIndex, mesh.baseVertex }; return(range); }
+
+/***********************************************************
+ *  SetInstanceData()
+ *
+ *  This method is used for replacing the contents of the
+ *  shared instance buffer.  NULL instances allocate the
+ *  buffer for GPU writes without copying any data.
+ ***********************************************************/
+void SceneMeshes::SetInstanceData(const INSTANCE_DATA* instances, int count)
+{
+	if (m_instanceBuffer.Get() == 0)
+	{
+		m_instanceBuffer.Create();
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer.Get());
+	glBufferData(GL_ARRAY_BUFFER, sizeof(INSTANCE_DATA) * count, instances, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_instanceBuffer.SetByteSize(sizeof(INSTANCE_DATA) * count);
+
+	m_instanceCapacity = count;
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+	}
+}
+
+/***********************************************************
+ *  UpdateInstanceData()
+ *
+ *  This method is used for overwriting a range of the
+ *  shared instance buffer, such as the instances of scene
+ *  nodes that moved.
+ ***********************************************************/
+void SceneMeshes::UpdateInstanceData(int firstInstance, const INSTANCE_DATA* instances, int count)
+{
+	if ((firstInstance < 0) || (count <= 0) || (firstInstance + count > m_instanceCapacity))
+	{
+		return;
+	}
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer.Get());
+	glBufferSubData(GL_ARRAY_BUFFER, sizeof(INSTANCE_DATA) * firstInstance, sizeof(INSTANCE_DATA) * count, instances);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+	}
+}
+
+/***********************************************************
+ *  GetInstanceBuffer()
+ *
+ *  This method is used for getting the shared instance
+ *  buffer, so that a compute shader can fill it.
+ ***********************************************************/
+GLuint SceneMeshes::GetInstanceBuffer() const
+{
+	return(m_instanceBuffer.Get());
+}
+
+/***********************************************************
+ *  SetInstanceSource()
+ *
+ *  This method is used for drawing the instances from a
+ *  range of another buffer, such as the frame region of a
+ *  stream buffer.  The range starts at a whole instance, so
+ *  the draws only add the base instance to their first
+ *  instance.  The vertex arrays are pointed at the buffer
+ *  only when it changes.
+ ***********************************************************/
+void SceneMeshes::SetInstanceSource(GLuint buffer, int baseInstance)
+{
+	m_instanceBase = baseInstance;
+	if (buffer == m_instanceSource)
+	{
+		return;
+	}
+	m_instanceSource = buffer;
+
+	GLMesh* meshes[3 + LOD_LEVELS * 3];
+	int meshCount = 0;
+
+	meshes[meshCount++] = &m_boxMesh;
+	meshes[meshCount++] = &m_planeMesh;
+	meshes[meshCount++] = &m_pyramid3Mesh;
+	for (int lod = 0; lod < LOD_LEVELS; lod++)
+	{
+		meshes[meshCount++] = &m_coneMesh[lod];
+		meshes[meshCount++] = &m_cylinderMesh[lod];
+		meshes[meshCount++] = &m_taperedCylinderMesh[lod];
+	}
+
+	// packed meshes share one vertex array, attached once below
+	for (int i = 0; i < meshCount; i++)
+	{
+		if ((meshes[i]->vao != 0) && (meshes[i]->vao != m_packedVertexArray.Get()))
+		{
+			BindVertexArray(meshes[i]->vao);
+			AttachInstanceAttributes(0);
+		}
+	}
+	if (m_packedVertexArray.Get() != 0)
+	{
+		BindVertexArray(m_packedVertexArray.Get());
+		AttachInstanceAttributes(0);
+	}
+	BindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the draw calls and instance buffer uploads.
+ ***********************************************************/
+void SceneMeshes::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
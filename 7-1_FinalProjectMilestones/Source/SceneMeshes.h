@@ -0,0 +1,255 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenemeshes.h
+// ============
+// create and draw the basic shape meshes used by the 3D scene, either
+// one at a time or as instanced batches
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+
+#include <vector>
+
+/***********************************************************
+ *  SceneMeshes
+ *
+ *  This class generates the basic shape meshes with the same
+ *  dimensions as the ShapeMeshes library - a unit box, a 2x2
+ *  plane and unit height curved shapes - and adds instanced
+ *  draws fed from a shared per-instance buffer.  In packed
+ *  mode every mesh lives in one shared vertex and index
+ *  buffer with half float normals and texture coordinates,
+ *  drawn through a single vertex array at per-mesh base
+ *  vertex and first index offsets.  The curved shapes are
+ *  built at several levels of detail, level 0 being the
+ *  finest.  Outside packed mode a level can be freed and
+ *  built again, for the residency manager, and a draw of a
+ *  freed level uses the next coarser one that is loaded.
+ ***********************************************************/
+class SceneMeshes
+{
+public:
+	// constructor
+	SceneMeshes();
+	// destructor
+	~SceneMeshes();
+
+	// per-instance values read by the vertex shader when
+	// bUseInstancing is set
+	struct INSTANCE_DATA
+	{
+		glm::mat4 model;
+		glm::vec2 UVscale;
+		// texture array layer, -1 for an untextured instance
+		int textureLayer;
+		// material table index, read when bUseInstanceMaterials
+		// is set - also pads the struct to its std430 size
+		int materialIndex;
+	};
+
+	// vertex attribute locations used by the shaders
+	enum ATTRIBUTE_LOCATION
+	{
+		POSITION_ATTRIBUTE = 0,
+		NORMAL_ATTRIBUTE = 1,
+		TEXTURE_COORD_ATTRIBUTE = 2,
+		// the instance model matrix takes locations 3 to 6
+		INSTANCE_MODEL_ATTRIBUTE = 3,
+		INSTANCE_UV_SCALE_ATTRIBUTE = 7,
+		INSTANCE_TEXTURE_LAYER_ATTRIBUTE = 8,
+		INSTANCE_MATERIAL_ATTRIBUTE = 9
+	};
+
+	// levels of detail of the cone and the cylinders
+	static const int LOD_LEVELS = 3;
+
+	// meshes built at several levels of detail
+	enum CURVED_MESH
+	{
+		CURVED_CONE,
+		CURVED_CYLINDER,
+		CURVED_TAPERED_CYLINDER,
+		CURVED_MESH_COUNT
+	};
+
+	// where a mesh lives in its index and vertex buffers
+	struct MESH_RANGE
+	{
+		GLsizei indexCount;
+		GLuint firstIndex;
+		GLint baseVertex;
+	};
+
+	// pack the meshes loaded afterwards into the shared buffers
+	void SetPackedMeshes(bool bPacked);
+	// true when new meshes go into the shared buffers
+	bool IsPacked() const;
+
+	// build or free one level of detail of a curved mesh -
+	// false in packed mode, where every level stays loaded
+	bool SetLevelLoaded(CURVED_MESH mesh, int lod, bool bLoaded);
+	// true when a level of detail of a curved mesh is loaded
+	bool IsLevelLoaded(CURVED_MESH mesh, int lod) const;
+	// get the buffer bytes of a loaded level of detail
+	long long GetLevelBytes(CURVED_MESH mesh, int lod) const;
+
+	// create the meshes in memory
+	void LoadBoxMesh();
+	void LoadConeMesh();
+	void LoadCylinderMesh();
+	void LoadPlaneMesh();
+	void LoadPyramid3Mesh();
+	void LoadTaperedCylinderMesh();
+
+	// draw a single mesh with the model matrix uniform
+	void DrawBoxMesh();
+	void DrawConeMesh(int lod = 0);
+	void DrawCylinderMesh(int lod = 0);
+	void DrawPlaneMesh();
+	void DrawPyramid3Mesh();
+	void DrawTaperedCylinderMesh(int lod = 0);
+
+	// draw count copies of a mesh from the instance buffer,
+	// starting at firstInstance
+	void DrawBoxMeshInstanced(int count, int firstInstance = 0);
+	void DrawConeMeshInstanced(int count, int firstInstance = 0, int lod = 0);
+	void DrawCylinderMeshInstanced(int count, int firstInstance = 0, int lod = 0);
+	void DrawPlaneMeshInstanced(int count, int firstInstance = 0);
+	void DrawPyramid3MeshInstanced(int count, int firstInstance = 0);
+	void DrawTaperedCylinderMeshInstanced(int count, int firstInstance = 0, int lod = 0);
+
+	// draw commandCount indirect commands of a mesh in one call,
+	// from the bound GL_DRAW_INDIRECT_BUFFER
+	void DrawBoxMeshIndirect(int firstCommand, int commandCount);
+	void DrawConeMeshIndirect(int firstCommand, int commandCount, int lod = 0);
+	void DrawCylinderMeshIndirect(int firstCommand, int commandCount, int lod = 0);
+	void DrawPlaneMeshIndirect(int firstCommand, int commandCount);
+	void DrawPyramid3MeshIndirect(int firstCommand, int commandCount);
+	void DrawTaperedCylinderMeshIndirect(int firstCommand, int commandCount, int lod = 0);
+
+	// draw commandCount indirect commands of any packed meshes
+	// in one call - the commands hold the mesh offsets
+	void DrawPackedIndirect(int firstCommand, int commandCount);
+
+	// get the index range of a mesh, for indirect commands
+	MESH_RANGE GetBoxMeshRange() const;
+	MESH_RANGE GetConeMeshRange(int lod = 0) const;
+	MESH_RANGE GetCylinderMeshRange(int lod = 0) const;
+	MESH_RANGE GetPlaneMeshRange() const;
+	MESH_RANGE GetPyramid3MeshRange() const;
+	MESH_RANGE GetTaperedCylinderMeshRange(int lod = 0) const;
+
+	// replace the whole instance buffer - NULL instances only
+	// allocate it
+	void SetInstanceData(const INSTANCE_DATA* instances, int count);
+	// overwrite a range of the instance buffer
+	void UpdateInstanceData(int firstInstance, const INSTANCE_DATA* instances, int count);
+
+	// get the instance buffer, for writing it on the GPU
+	GLuint GetInstanceBuffer() const;
+	// draw the instances from another buffer, with every first
+	// instance offset by baseInstance - buffer 0 selects the
+	// instance buffer again
+	void SetInstanceSource(GLuint buffer, int baseInstance);
+
+	// set the profiler that counts the draw calls, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+
+private:
+	// OpenGL objects of one loaded mesh - packed meshes use
+	// the shared vertex array and own no objects
+	struct GLMesh
+	{
+		GLMesh();
+
+		// vertex array the mesh is drawn with
+		GLuint vao;
+		GLObject vertexArray;
+		GLObject vbo;
+		GLObject ebo;
+		GLsizei nIndices;
+		GLuint firstIndex;
+		GLint baseVertex;
+	};
+
+	// 24 byte vertex of the shared buffer - the normal is
+	// padded to four halves to keep the fields aligned
+	struct PACKED_VERTEX
+	{
+		GLfloat position[3];
+		GLushort normal[4];
+		GLushort uv[2];
+	};
+
+	GLMesh m_boxMesh;
+	GLMesh m_coneMesh[LOD_LEVELS];
+	GLMesh m_cylinderMesh[LOD_LEVELS];
+	GLMesh m_planeMesh;
+	GLMesh m_pyramid3Mesh;
+	GLMesh m_taperedCylinderMesh[LOD_LEVELS];
+
+	// shared buffers of the packed meshes, with a CPU copy that
+	// grows as meshes are loaded
+	bool m_bPackMeshes;
+	GLObject m_packedVertexArray;
+	GLObject m_packedVertexBuffer;
+	GLObject m_packedIndexBuffer;
+	std::vector<PACKED_VERTEX> m_packedVertices;
+	std::vector<GLushort> m_packedIndices;
+	// vertex array left bound by the last draw - the packed one
+	// stays bound between draws
+	GLuint m_boundVertexArray;
+
+	// per-instance data shared by every mesh
+	GLObject m_instanceBuffer;
+	int m_instanceCapacity;
+	// buffer the instance attributes read from instead of the
+	// instance buffer, or 0, and the instance the draws start at
+	GLuint m_instanceSource;
+	int m_instanceBase;
+	// counts the draw calls and buffer uploads, may be NULL
+	FrameProfiler* m_pProfiler;
+
+	// upload interleaved position/normal/uv vertices and indices
+	void CreateMesh(
+		GLMesh& mesh,
+		const std::vector<GLfloat>& vertices,
+		const std::vector<GLushort>& indices);
+	// append a mesh to the shared buffers and upload them
+	void AppendPackedMesh(
+		GLMesh& mesh,
+		const std::vector<GLfloat>& vertices,
+		const std::vector<GLushort>& indices);
+	// point the instance attributes of the bound vertex array at
+	// the instance source, from its firstInstance
+	void AttachInstanceAttributes(int firstInstance);
+	// bind a vertex array unless it is already bound
+	void BindVertexArray(GLuint vertexArray);
+	// build a capped shape with segments sides that narrows from
+	// the bottom radius at y = 0 to the top radius at y = 1
+	void CreateTaperedMesh(GLMesh& mesh, float bottomRadius, float topRadius, int segments);
+	// build every level of detail of a tapered shape
+	void CreateTaperedLevels(GLMesh meshes[], float bottomRadius, float topRadius);
+	// get a level of detail clamped to the valid range
+	static int ClampLod(int lod);
+	// get the finest loaded level of detail of a curved mesh
+	// at or coarser than the passed in one
+	static const GLMesh& ResolveLod(const GLMesh meshes[], int lod);
+	// get the levels of detail of a curved mesh
+	GLMesh* GetCurvedLevels(CURVED_MESH mesh);
+	const GLMesh* GetCurvedLevels(CURVED_MESH mesh) const;
+	// issue the draw for a loaded mesh
+	void DrawMesh(const GLMesh& mesh, int count, int firstInstance);
+	// issue the multi-draw for indirect commands with a vertex array
+	void DrawIndirect(GLuint vertexArray, int firstCommand, int commandCount);
+	// free the OpenGL objects of a mesh
+	void DestroyMesh(GLMesh& mesh);
+	// free the shared buffers of the packed meshes
+	void DestroyPackedBuffers();
+};
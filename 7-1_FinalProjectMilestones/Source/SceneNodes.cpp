@@ -0,0 +1,467 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenenodes.cpp
+// ============
+// keep the retained scene nodes as separate arrays per field and rebuild
+// the world matrices of several nodes at once with SIMD
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "SceneNodes.h"
+
+#include <algorithm>
+#include <cmath>
+
+// x64 and the default x86 MSVC target both have SSE2, and every
+// 64 bit ARM target has NEON
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define SCENE_NODES_USE_SSE
+#include <emmintrin.h>
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define SCENE_NODES_USE_NEON
+#include <arm_neon.h>
+#endif
+
+// declaration of global variables
+namespace
+{
+	// sine and cosine polynomials on [-pi/4, pi/4]
+	const float g_SinCoefficients[3] = { -1.9515295891e-4f, 8.3321608736e-3f, -1.6666654611e-1f };
+	const float g_CosCoefficients[3] = { 2.443315711809948e-5f, -1.388731625493765e-3f, 4.166664568298827e-2f };
+	const float g_RadiansPerDegree = 3.14159265358979f / 180.0f;
+
+	// the lane operations of the kernel, on four floats or
+	// four ints at a time
+#if defined(SCENE_NODES_USE_SSE)
+	typedef __m128 LANES;
+	typedef __m128i INT_LANES;
+
+	inline LANES Set(float a, float b, float c, float d) { return(_mm_set_ps(d, c, b, a)); }
+	inline LANES Splat(float value) { return(_mm_set1_ps(value)); }
+	inline LANES AddLanes(LANES a, LANES b) { return(_mm_add_ps(a, b)); }
+	inline LANES SubLanes(LANES a, LANES b) { return(_mm_sub_ps(a, b)); }
+	inline LANES MulLanes(LANES a, LANES b) { return(_mm_mul_ps(a, b)); }
+	inline void Store(float* pValues, LANES a) { _mm_storeu_ps(pValues, a); }
+	inline INT_LANES RoundToInt(LANES a) { return(_mm_cvtps_epi32(a)); }
+	inline LANES ToFloat(INT_LANES a) { return(_mm_cvtepi32_ps(a)); }
+	inline INT_LANES AddInt(INT_LANES a, int value) { return(_mm_add_epi32(a, _mm_set1_epi32(value))); }
+	// negate the lanes whose quadrant has bit 1 set
+	inline LANES NegateByQuadrant(LANES a, INT_LANES quadrant)
+	{
+		INT_LANES sign = _mm_slli_epi32(_mm_and_si128(quadrant, _mm_set1_epi32(2)), 30);
+		return(_mm_xor_ps(a, _mm_castsi128_ps(sign)));
+	}
+	// pick odd in the lanes of odd quadrants and even elsewhere
+	inline LANES SelectByQuadrant(INT_LANES quadrant, LANES odd, LANES even)
+	{
+		INT_LANES one = _mm_set1_epi32(1);
+		LANES mask = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(quadrant, one), one));
+		return(_mm_or_ps(_mm_and_ps(mask, odd), _mm_andnot_ps(mask, even)));
+	}
+#elif defined(SCENE_NODES_USE_NEON)
+	typedef float32x4_t LANES;
+	typedef int32x4_t INT_LANES;
+
+	inline LANES Set(float a, float b, float c, float d) { const float values[4] = { a, b, c, d }; return(vld1q_f32(values)); }
+	inline LANES Splat(float value) { return(vdupq_n_f32(value)); }
+	inline LANES AddLanes(LANES a, LANES b) { return(vaddq_f32(a, b)); }
+	inline LANES SubLanes(LANES a, LANES b) { return(vsubq_f32(a, b)); }
+	inline LANES MulLanes(LANES a, LANES b) { return(vmulq_f32(a, b)); }
+	inline void Store(float* pValues, LANES a) { vst1q_f32(pValues, a); }
+	inline INT_LANES RoundToInt(LANES a) { return(vcvtnq_s32_f32(a)); }
+	inline LANES ToFloat(INT_LANES a) { return(vcvtq_f32_s32(a)); }
+	inline INT_LANES AddInt(INT_LANES a, int value) { return(vaddq_s32(a, vdupq_n_s32(value))); }
+	inline LANES NegateByQuadrant(LANES a, INT_LANES quadrant)
+	{
+		uint32x4_t sign = vreinterpretq_u32_s32(vshlq_n_s32(vandq_s32(quadrant, vdupq_n_s32(2)), 30));
+		return(vreinterpretq_f32_u32(veorq_u32(vreinterpretq_u32_f32(a), sign)));
+	}
+	inline LANES SelectByQuadrant(INT_LANES quadrant, LANES odd, LANES even)
+	{
+		INT_LANES one = vdupq_n_s32(1);
+		return(vbslq_f32(vceqq_s32(vandq_s32(quadrant, one), one), odd, even));
+	}
+#else
+	struct LANES { float v[4]; };
+	struct INT_LANES { int v[4]; };
+
+	inline LANES Set(float a, float b, float c, float d) { LANES r = { { a, b, c, d } }; return(r); }
+	inline LANES Splat(float value) { return(Set(value, value, value, value)); }
+	inline LANES AddLanes(LANES a, LANES b) { for (int i = 0; i < 4; i++) { a.v[i] += b.v[i]; } return(a); }
+	inline LANES SubLanes(LANES a, LANES b) { for (int i = 0; i < 4; i++) { a.v[i] -= b.v[i]; } return(a); }
+	inline LANES MulLanes(LANES a, LANES b) { for (int i = 0; i < 4; i++) { a.v[i] *= b.v[i]; } return(a); }
+	inline void Store(float* pValues, LANES a) { for (int i = 0; i < 4; i++) { pValues[i] = a.v[i]; } }
+	inline INT_LANES RoundToInt(LANES a) { INT_LANES r; for (int i = 0; i < 4; i++) { r.v[i] = (int)floorf(a.v[i] + 0.5f); } return(r); }
+	inline LANES ToFloat(INT_LANES a) { LANES r; for (int i = 0; i < 4; i++) { r.v[i] = (float)a.v[i]; } return(r); }
+	inline INT_LANES AddInt(INT_LANES a, int value) { for (int i = 0; i < 4; i++) { a.v[i] += value; } return(a); }
+	inline LANES NegateByQuadrant(LANES a, INT_LANES quadrant)
+	{
+		for (int i = 0; i < 4; i++) { a.v[i] = (quadrant.v[i] & 2) ? -a.v[i] : a.v[i]; }
+		return(a);
+	}
+	inline LANES SelectByQuadrant(INT_LANES quadrant, LANES odd, LANES even)
+	{
+		for (int i = 0; i < 4; i++) { even.v[i] = (quadrant.v[i] & 1) ? odd.v[i] : even.v[i]; }
+		return(even);
+	}
+#endif
+
+	// sine and cosine of four angles in degrees - the angle is
+	// reduced to the nearest multiple of 90 degrees, so right
+	// angles come out exact
+	void SinCosDegrees(LANES degrees, LANES& sine, LANES& cosine)
+	{
+		INT_LANES quadrant = RoundToInt(MulLanes(degrees, Splat(1.0f / 90.0f)));
+		LANES x = MulLanes(SubLanes(degrees, MulLanes(ToFloat(quadrant), Splat(90.0f))), Splat(g_RadiansPerDegree));
+		LANES z = MulLanes(x, x);
+
+		LANES sinX = AddLanes(MulLanes(MulLanes(AddLanes(MulLanes(AddLanes(MulLanes(Splat(g_SinCoefficients[0]), z),
+			Splat(g_SinCoefficients[1])), z), Splat(g_SinCoefficients[2])), z), x), x);
+		LANES cosX = AddLanes(SubLanes(MulLanes(MulLanes(AddLanes(MulLanes(AddLanes(MulLanes(Splat(g_CosCoefficients[0]), z),
+			Splat(g_CosCoefficients[1])), z), Splat(g_CosCoefficients[2])), z), z),
+			MulLanes(Splat(0.5f), z)), Splat(1.0f));
+
+		// odd quadrants swap the two, and the signs follow the
+		// quadrant of each result
+		sine = NegateByQuadrant(SelectByQuadrant(quadrant, cosX, sinX), quadrant);
+		cosine = NegateByQuadrant(SelectByQuadrant(quadrant, sinX, cosX), AddInt(quadrant, 1));
+	}
+
+	// load a field of four nodes into lanes
+	inline LANES Gather(const std::vector<float>& values, const int nodes[4])
+	{
+		return(Set(values[nodes[0]], values[nodes[1]], values[nodes[2]], values[nodes[3]]));
+	}
+}
+
+/***********************************************************
+ *  SceneNodes()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+SceneNodes::SceneNodes()
+{
+}
+
+/***********************************************************
+ *  Add()
+ *
+ *  This method is used for appending a node to every array.
+ ***********************************************************/
+int SceneNodes::Add(
+	int mesh,
+	glm::vec3 scaleXYZ,
+	glm::vec3 rotationDegrees,
+	glm::vec3 positionXYZ,
+	int textureSlot,
+	glm::vec2 UVscale,
+	int materialIndex,
+	bool bTransparent)
+{
+	m_scaleX.push_back(scaleXYZ.x);
+	m_scaleY.push_back(scaleXYZ.y);
+	m_scaleZ.push_back(scaleXYZ.z);
+	m_rotationX.push_back(rotationDegrees.x);
+	m_rotationY.push_back(rotationDegrees.y);
+	m_rotationZ.push_back(rotationDegrees.z);
+	m_positionX.push_back(positionXYZ.x);
+	m_positionY.push_back(positionXYZ.y);
+	m_positionZ.push_back(positionXYZ.z);
+	m_worldMatrices.push_back(glm::mat4(1.0f));
+	m_meshes.push_back(mesh);
+	m_materialIndices.push_back(materialIndex);
+	m_textureSlots.push_back(textureSlot);
+	m_UVscales.push_back(UVscale);
+	m_instanceIndices.push_back(-1);
+	m_transparent.push_back(bTransparent ? 1 : 0);
+	m_dirty.push_back(1);
+
+	return((int)m_meshes.size() - 1);
+}
+
+/***********************************************************
+ *  Clear()
+ *
+ *  This method is used for removing every node.
+ ***********************************************************/
+void SceneNodes::Clear()
+{
+	m_scaleX.clear();
+	m_scaleY.clear();
+	m_scaleZ.clear();
+	m_rotationX.clear();
+	m_rotationY.clear();
+	m_rotationZ.clear();
+	m_positionX.clear();
+	m_positionY.clear();
+	m_positionZ.clear();
+	m_worldMatrices.clear();
+	m_meshes.clear();
+	m_materialIndices.clear();
+	m_textureSlots.clear();
+	m_UVscales.clear();
+	m_instanceIndices.clear();
+	m_transparent.clear();
+	m_dirty.clear();
+}
+
+/***********************************************************
+ *  Reserve()
+ *
+ *  This method is used for making room for a number of
+ *  nodes in every array.
+ ***********************************************************/
+void SceneNodes::Reserve(int count)
+{
+	m_scaleX.reserve(count);
+	m_scaleY.reserve(count);
+	m_scaleZ.reserve(count);
+	m_rotationX.reserve(count);
+	m_rotationY.reserve(count);
+	m_rotationZ.reserve(count);
+	m_positionX.reserve(count);
+	m_positionY.reserve(count);
+	m_positionZ.reserve(count);
+	m_worldMatrices.reserve(count);
+	m_meshes.reserve(count);
+	m_materialIndices.reserve(count);
+	m_textureSlots.reserve(count);
+	m_UVscales.reserve(count);
+	m_instanceIndices.reserve(count);
+	m_transparent.reserve(count);
+	m_dirty.reserve(count);
+}
+
+/***********************************************************
+ *  GetCount()
+ *
+ *  This method is used for getting the number of nodes.
+ ***********************************************************/
+int SceneNodes::GetCount() const
+{
+	return((int)m_meshes.size());
+}
+
+/***********************************************************
+ *  SetTransformation()
+ *
+ *  This method is used for changing the scale, rotation and
+ *  position of a node.  The world matrix is not rebuilt
+ *  here; the node is flagged so the next update rebuilds it
+ *  once, however many times it was changed in between.
+ ***********************************************************/
+bool SceneNodes::SetTransformation(
+	int node,
+	glm::vec3 scaleXYZ,
+	glm::vec3 rotationDegrees,
+	glm::vec3 positionXYZ)
+{
+	// unchanged values keep the cached world matrix valid
+	if ((m_scaleX[node] == scaleXYZ.x) && (m_scaleY[node] == scaleXYZ.y) && (m_scaleZ[node] == scaleXYZ.z) &&
+		(m_rotationX[node] == rotationDegrees.x) && (m_rotationY[node] == rotationDegrees.y) && (m_rotationZ[node] == rotationDegrees.z) &&
+		(m_positionX[node] == positionXYZ.x) && (m_positionY[node] == positionXYZ.y) && (m_positionZ[node] == positionXYZ.z))
+	{
+		return(false);
+	}
+
+	m_scaleX[node] = scaleXYZ.x;
+	m_scaleY[node] = scaleXYZ.y;
+	m_scaleZ[node] = scaleXYZ.z;
+	m_rotationX[node] = rotationDegrees.x;
+	m_rotationY[node] = rotationDegrees.y;
+	m_rotationZ[node] = rotationDegrees.z;
+	m_positionX[node] = positionXYZ.x;
+	m_positionY[node] = positionXYZ.y;
+	m_positionZ[node] = positionXYZ.z;
+	m_dirty[node] = 1;
+
+	return(true);
+}
+
+/***********************************************************
+ *  FindDirtyNodes()
+ *
+ *  This method is used for appending the dirty nodes of a
+ *  range to a list.  Only the flag array is read, so static
+ *  nodes cost one byte each.
+ ***********************************************************/
+void SceneNodes::FindDirtyNodes(int first, int last, std::vector<int>& nodes) const
+{
+	for (int i = first; i < last; i++)
+	{
+		if (m_dirty[i] != 0)
+		{
+			nodes.push_back(i);
+		}
+	}
+}
+
+/***********************************************************
+ *  UpdateWorldMatrices()
+ *
+ *  This method is used for rebuilding translation *
+ *  rotationX * rotationY * rotationZ * scale for a list of
+ *  nodes, SIMD_WIDTH nodes per iteration.  Every lane works
+ *  on one node, so the math is the same as the scalar
+ *  formula in SceneManager::BuildTransformation(), with the
+ *  six sines and cosines of all the lanes computed at once.
+ *  A short last group repeats its final node in the unused
+ *  lanes, so every node goes through the same code.
+ ***********************************************************/
+void SceneNodes::UpdateWorldMatrices(const int* pNodes, int count)
+{
+	for (int first = 0; first < count; first += SIMD_WIDTH)
+	{
+		int laneCount = std::min(count - first, (int)SIMD_WIDTH);
+		int nodes[SIMD_WIDTH];
+
+		for (int lane = 0; lane < SIMD_WIDTH; lane++)
+		{
+			nodes[lane] = pNodes[first + std::min(lane, laneCount - 1)];
+		}
+
+		LANES sx, cx, sy, cy, sz, cz;
+		SinCosDegrees(Gather(m_rotationX, nodes), sx, cx);
+		SinCosDegrees(Gather(m_rotationY, nodes), sy, cy);
+		SinCosDegrees(Gather(m_rotationZ, nodes), sz, cz);
+
+		LANES scaleX = Gather(m_scaleX, nodes);
+		LANES scaleY = Gather(m_scaleY, nodes);
+		LANES scaleZ = Gather(m_scaleZ, nodes);
+		LANES sxsy = MulLanes(sx, sy);
+		LANES cxsy = MulLanes(cx, sy);
+
+		// each rotation column scaled by its axis scale, one
+		// row of lanes per matrix element
+		float elements[9][SIMD_WIDTH];
+		Store(elements[0], MulLanes(MulLanes(cy, cz), scaleX));
+		Store(elements[1], MulLanes(AddLanes(MulLanes(cx, sz), MulLanes(sxsy, cz)), scaleX));
+		Store(elements[2], MulLanes(SubLanes(MulLanes(sx, sz), MulLanes(cxsy, cz)), scaleX));
+		Store(elements[3], MulLanes(SubLanes(Splat(0.0f), MulLanes(cy, sz)), scaleY));
+		Store(elements[4], MulLanes(SubLanes(MulLanes(cx, cz), MulLanes(sxsy, sz)), scaleY));
+		Store(elements[5], MulLanes(AddLanes(MulLanes(sx, cz), MulLanes(cxsy, sz)), scaleY));
+		Store(elements[6], MulLanes(sy, scaleZ));
+		Store(elements[7], MulLanes(SubLanes(Splat(0.0f), MulLanes(sx, cy)), scaleZ));
+		Store(elements[8], MulLanes(MulLanes(cx, cy), scaleZ));
+
+		for (int lane = 0; lane < laneCount; lane++)
+		{
+			int node = nodes[lane];
+			glm::mat4& model = m_worldMatrices[node];
+
+			model[0] = glm::vec4(elements[0][lane], elements[1][lane], elements[2][lane], 0.0f);
+			model[1] = glm::vec4(elements[3][lane], elements[4][lane], elements[5][lane], 0.0f);
+			model[2] = glm::vec4(elements[6][lane], elements[7][lane], elements[8][lane], 0.0f);
+			// the translation goes straight into the last column
+			model[3] = glm::vec4(m_positionX[node], m_positionY[node], m_positionZ[node], 1.0f);
+			m_dirty[node] = 0;
+		}
+	}
+}
+
+/***********************************************************
+ *  GetMesh()
+ *
+ *  This method is used for getting the mesh of a node.
+ ***********************************************************/
+int SceneNodes::GetMesh(int node) const
+{
+	return(m_meshes[node]);
+}
+
+/***********************************************************
+ *  GetMaterialIndex()
+ *
+ *  This method is used for getting the material of a node.
+ ***********************************************************/
+int SceneNodes::GetMaterialIndex(int node) const
+{
+	return(m_materialIndices[node]);
+}
+
+/***********************************************************
+ *  GetTextureSlot()
+ *
+ *  This method is used for getting the texture array layer
+ *  of a node, -1 when it is untextured.
+ ***********************************************************/
+int SceneNodes::GetTextureSlot(int node) const
+{
+	return(m_textureSlots[node]);
+}
+
+/***********************************************************
+ *  GetUVScale()
+ *
+ *  This method is used for getting the texture coordinate
+ *  scale of a node.
+ ***********************************************************/
+glm::vec2 SceneNodes::GetUVScale(int node) const
+{
+	return(m_UVscales[node]);
+}
+
+/***********************************************************
+ *  GetWorldMatrix()
+ *
+ *  This method is used for getting the cached model matrix
+ *  of a node.
+ ***********************************************************/
+const glm::mat4& SceneNodes::GetWorldMatrix(int node) const
+{
+	return(m_worldMatrices[node]);
+}
+
+/***********************************************************
+ *  IsTransparent()
+ *
+ *  This method is used for checking whether a node is drawn
+ *  in the blended pass.
+ ***********************************************************/
+bool SceneNodes::IsTransparent(int node) const
+{
+	return(m_transparent[node] != 0);
+}
+
+/***********************************************************
+ *  IsDirty()
+ *
+ *  This method is used for checking whether the world
+ *  matrix of a node has to be rebuilt.
+ ***********************************************************/
+bool SceneNodes::IsDirty(int node) const
+{
+	return(m_dirty[node] != 0);
+}
+
+/***********************************************************
+ *  GetInstanceIndex()
+ *
+ *  This method is used for getting the slot of a node in
+ *  the instance buffer, -1 before the batches are built.
+ ***********************************************************/
+int SceneNodes::GetInstanceIndex(int node) const
+{
+	return(m_instanceIndices[node]);
+}
+
+/***********************************************************
+ *  SetInstanceIndex()
+ *
+ *  This method is used for setting the slot of a node in
+ *  the instance buffer.
+ ***********************************************************/
+void SceneNodes::SetInstanceIndex(int node, int instanceIndex)
+{
+	m_instanceIndices[node] = instanceIndex;
+}
+
+/***********************************************************
+ *  SetTransparent()
+ *
+ *  This method is used for moving a node between the
+ *  opaque and the blended pass.
+ ***********************************************************/
+void SceneNodes::SetTransparent(int node, bool bTransparent)
+{
+	m_transparent[node] = bTransparent ? 1 : 0;
+}
@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// scenenodes.h
+// ============
+// keep the retained scene nodes as separate arrays per field and rebuild
+// the world matrices of several nodes at once with SIMD
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <vector>
+
+/***********************************************************
+ *  SceneNodes
+ *
+ *  This class holds the retained scene nodes as a structure
+ *  of arrays.  Every field lives in its own contiguous
+ *  array, and the transformations are split further into
+ *  one array per component, so a loop reads only the fields
+ *  it uses.  UpdateWorldMatrices() rebuilds the matrices of
+ *  a list of nodes SIMD_WIDTH at a time, with sines and
+ *  cosines computed for all the nodes together, using SSE
+ *  or NEON when they are available.  Nodes are only added,
+ *  never removed, so an index stays valid for the life of
+ *  the scene.
+ ***********************************************************/
+class SceneNodes
+{
+public:
+	// constructor
+	SceneNodes();
+
+	// nodes rebuilt together by one kernel iteration
+	static const int SIMD_WIDTH = 4;
+
+	// add a node, flagged dirty so its world matrix is built by
+	// the next UpdateWorldMatrices() - returns its index
+	int Add(
+		int mesh,
+		glm::vec3 scaleXYZ,
+		glm::vec3 rotationDegrees,
+		glm::vec3 positionXYZ,
+		int textureSlot,
+		glm::vec2 UVscale,
+		int materialIndex,
+		bool bTransparent);
+	// remove every node
+	void Clear();
+	// make room for more nodes without reallocating
+	void Reserve(int count);
+	// get the number of nodes
+	int GetCount() const;
+
+	// change the transformation of a node and flag it dirty -
+	// false when the values are unchanged
+	bool SetTransformation(
+		int node,
+		glm::vec3 scaleXYZ,
+		glm::vec3 rotationDegrees,
+		glm::vec3 positionXYZ);
+	// append the dirty nodes of the range [first, last)
+	void FindDirtyNodes(int first, int last, std::vector<int>& nodes) const;
+	// rebuild the world matrices of a list of nodes and clear
+	// their dirty flags - lists in different jobs must not
+	// share nodes
+	void UpdateWorldMatrices(const int* pNodes, int count);
+
+	// get the fields of a node
+	int GetMesh(int node) const;
+	int GetMaterialIndex(int node) const;
+	int GetTextureSlot(int node) const;
+	glm::vec2 GetUVScale(int node) const;
+	const glm::mat4& GetWorldMatrix(int node) const;
+	bool IsTransparent(int node) const;
+	bool IsDirty(int node) const;
+	// get and set the slot of a node in the instance buffer
+	int GetInstanceIndex(int node) const;
+	void SetInstanceIndex(int node, int instanceIndex);
+	// move a node to the blended back to front pass
+	void SetTransparent(int node, bool bTransparent);
+
+private:
+	// transformation components, one array each
+	std::vector<float> m_scaleX;
+	std::vector<float> m_scaleY;
+	std::vector<float> m_scaleZ;
+	std::vector<float> m_rotationX;
+	std::vector<float> m_rotationY;
+	std::vector<float> m_rotationZ;
+	std::vector<float> m_positionX;
+	std::vector<float> m_positionY;
+	std::vector<float> m_positionZ;
+	// cached model matrices, valid while the node is not dirty
+	std::vector<glm::mat4> m_worldMatrices;
+	std::vector<int> m_meshes;
+	std::vector<int> m_materialIndices;
+	// texture array layers, -1 for an untextured node
+	std::vector<int> m_textureSlots;
+	std::vector<glm::vec2> m_UVscales;
+	std::vector<int> m_instanceIndices;
+	// one byte flags, so jobs on different nodes never share
+	// the same element
+	std::vector<unsigned char> m_transparent;
+	std::vector<unsigned char> m_dirty;
+};
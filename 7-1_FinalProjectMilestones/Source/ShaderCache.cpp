@@ -0,0 +1,697 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.cpp
+// ============
+// build the shader programs from their GLSL files, keep the linked
+// program binaries for the next launch and rebuild them when they change
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderCache.h"
+
+#include <sys/stat.h>
+
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// declaration of global variables
+namespace
+{
+	// first bytes of a program binary cache file
+	const char g_BinaryMagic[4] = { 'G', 'L', 'P', 'B' };
+	// bump to invalidate the cache files after a format change
+	const uint32_t g_BinaryVersion = 1;
+	// time between checks of the watched files
+	const int g_WatchIntervalMilliseconds = 500;
+	// starting value of the FNV-1a hashes
+	const uint64_t g_HashSeed = 14695981039346656037ull;
+
+	/***********************************************************
+	 *  HashText()
+	 *
+	 *  Add text to a 64 bit FNV-1a hash.
+	 ***********************************************************/
+	uint64_t HashText(uint64_t hash, const std::string& text)
+	{
+		for (size_t i = 0; i < text.size(); i++)
+		{
+			hash ^= (unsigned char)text[i];
+			hash *= 1099511628211ull;
+		}
+
+		// a separator, so that moving text between the parts
+		// changes the hash
+		hash ^= 0xff;
+		hash *= 1099511628211ull;
+
+		return(hash);
+	}
+
+	/***********************************************************
+	 *  GetString()
+	 *
+	 *  Get an OpenGL string, empty when it is not available.
+	 ***********************************************************/
+	std::string GetString(GLenum name)
+	{
+		const GLubyte* value = glGetString(name);
+
+		return((value != NULL) ? std::string((const char*)value) : std::string());
+	}
+
+	/***********************************************************
+	 *  CompileShader()
+	 *
+	 *  Compile one shader stage, writing the log to the console
+	 *  and returning 0 when it fails.
+	 ***********************************************************/
+	GLuint CompileShader(GLenum type, const std::string& source)
+	{
+		const char* sourceText = source.c_str();
+		GLuint shader = glCreateShader(type);
+
+		glShaderSource(shader, 1, &sourceText, NULL);
+		glCompileShader(shader);
+
+		GLint status = GL_FALSE;
+		glGetShaderiv(shader, GL_COMPILE_STATUS, &status);
+		if (status != GL_TRUE)
+		{
+			char log[1024];
+			glGetShaderInfoLog(shader, sizeof(log), NULL, log);
+			std::cout << "Could not compile " << ((type == GL_VERTEX_SHADER) ? "vertex" : "fragment")
+				<< " shader:\n" << log << std::endl;
+			glDeleteShader(shader);
+			return 0;
+		}
+
+		return(shader);
+	}
+}
+
+/***********************************************************
+ *  ShaderCache()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderCache::ShaderCache()
+{
+	m_bBinarySupported = false;
+	m_pWatchWindow = NULL;
+	m_bWatching = false;
+}
+
+/***********************************************************
+ *  ~ShaderCache()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderCache::~ShaderCache()
+{
+	StopWatching();
+
+	m_programs.clear();
+	m_sources.clear();
+}
+
+/***********************************************************
+ *  ParseWatchArgument()
+ *
+ *  This method is used for reading the shader option:
+ *
+ *    --watch-shaders      rebuild the shaders when they change
+ ***********************************************************/
+bool ShaderCache::ParseWatchArgument(int argc, char* argv[])
+{
+	for (int i = 1; i < argc; i++)
+	{
+		if (strcmp(argv[i], "--watch-shaders") == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/***********************************************************
+ *  LoadProgram()
+ *
+ *  This method is used for building the program of a vertex
+ *  and fragment shader file, with the passed in #define
+ *  lines, and adding it to the loaded programs.  The cached
+ *  binary is used when it was saved for the same sources by
+ *  the same driver.
+ ***********************************************************/
+GLuint ShaderCache::LoadProgram(
+	const char* vertexFilename,
+	const char* fragmentFilename,
+	const std::string& defines)
+{
+	// a driver update changes the binary format, so it is part
+	// of the key of every binary
+	if (m_driverVersion.empty())
+	{
+		m_driverVersion = GetString(GL_VENDOR) + GetString(GL_RENDERER) + GetString(GL_VERSION);
+
+		GLint formatCount = 0;
+		glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formatCount);
+		m_bBinarySupported = (formatCount > 0);
+	}
+
+	PROGRAM_SOURCE source;
+	source.vertexFilename = vertexFilename;
+	source.fragmentFilename = fragmentFilename;
+	source.defines = defines;
+
+	GLuint program = BuildProgram(source);
+	if (program != 0)
+	{
+		m_sources.push_back(source);
+		GLObject object(GLObject::OBJECT_PROGRAM);
+		object.Adopt(program);
+		m_programs.push_back(std::move(object));
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  GetProgramCount()
+ *
+ *  This method is used for getting the number of loaded
+ *  programs.
+ ***********************************************************/
+int ShaderCache::GetProgramCount() const
+{
+	return((int)m_programs.size());
+}
+
+/***********************************************************
+ *  GetProgram()
+ *
+ *  This method is used for getting a loaded program, 0 when
+ *  the index is out of range.
+ ***********************************************************/
+GLuint ShaderCache::GetProgram(int index) const
+{
+	if ((index < 0) || (index >= (int)m_programs.size()))
+	{
+		return 0;
+	}
+
+	return(m_programs[index].Get());
+}
+
+/***********************************************************
+ *  ReplaceProgram()
+ *
+ *  This method is used for replacing a loaded program, such
+ *  as with a rebuilt one, and freeing the program it
+ *  replaces.
+ ***********************************************************/
+void ShaderCache::ReplaceProgram(int index, GLuint program)
+{
+	if ((index < 0) || (index >= (int)m_programs.size()))
+	{
+		return;
+	}
+
+	m_programs[index].Adopt(program);
+}
+
+/***********************************************************
+ *  BuildProgram()
+ *
+ *  This method is used for building a program from its
+ *  files.  A cache miss compiles and links the sources and
+ *  saves the binary for the next build.
+ ***********************************************************/
+GLuint ShaderCache::BuildProgram(const PROGRAM_SOURCE& source)
+{
+	std::string vertexSource;
+	std::string fragmentSource;
+
+	if (!ReadFile(source.vertexFilename, vertexSource) || !ReadFile(source.fragmentFilename, fragmentSource))
+	{
+		return 0;
+	}
+	vertexSource = AddDefines(vertexSource, source.defines);
+	fragmentSource = AddDefines(fragmentSource, source.defines);
+
+	uint64_t key = g_HashSeed;
+	key = HashText(key, vertexSource);
+	key = HashText(key, fragmentSource);
+	key = HashText(key, m_driverVersion);
+
+	std::string path = GetBinaryPath(source);
+	GLuint program = LoadBinary(path, key);
+	if (program != 0)
+	{
+		return(program);
+	}
+
+	program = CompileProgram(vertexSource, fragmentSource);
+	if (program != 0)
+	{
+		SaveBinary(path, key, program);
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  CompileProgram()
+ *
+ *  This method is used for compiling and linking a vertex
+ *  and fragment shader.  Errors are written to the console
+ *  and 0 is returned.
+ ***********************************************************/
+GLuint ShaderCache::CompileProgram(const std::string& vertexSource, const std::string& fragmentSource)
+{
+	GLuint vertexShader = CompileShader(GL_VERTEX_SHADER, vertexSource);
+	if (vertexShader == 0)
+	{
+		return 0;
+	}
+	GLuint fragmentShader = CompileShader(GL_FRAGMENT_SHADER, fragmentSource);
+	if (fragmentShader == 0)
+	{
+		glDeleteShader(vertexShader);
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	// the binary can only be read back when asked for before linking
+	if (m_bBinarySupported)
+	{
+		glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+	glAttachShader(program, vertexShader);
+	glAttachShader(program, fragmentShader);
+	glLinkProgram(program);
+	glDetachShader(program, vertexShader);
+	glDetachShader(program, fragmentShader);
+	glDeleteShader(vertexShader);
+	glDeleteShader(fragmentShader);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		char log[1024];
+		glGetProgramInfoLog(program, sizeof(log), NULL, log);
+		std::cout << "Could not link shader program:\n" << log << std::endl;
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  LoadBinary()
+ *
+ *  This method is used for creating a program from the
+ *  cached binary when the file holds the passed in key.  A
+ *  binary the driver no longer accepts is ignored, and the
+ *  program is compiled and saved again.
+ ***********************************************************/
+GLuint ShaderCache::LoadBinary(const std::string& path, uint64_t key)
+{
+	if (!m_bBinarySupported)
+	{
+		return 0;
+	}
+
+	std::ifstream file(path.c_str(), std::ios::binary);
+	if (!file)
+	{
+		return 0;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	uint64_t fileKey = 0;
+	uint32_t format = 0;
+	uint32_t length = 0;
+
+	file.read(magic, sizeof(magic));
+	file.read((char*)&version, sizeof(version));
+	file.read((char*)&fileKey, sizeof(fileKey));
+	file.read((char*)&format, sizeof(format));
+	file.read((char*)&length, sizeof(length));
+	if (!file ||
+		(memcmp(magic, g_BinaryMagic, sizeof(magic)) != 0) ||
+		(version != g_BinaryVersion) ||
+		(fileKey != key) ||
+		(length == 0))
+	{
+		return 0;
+	}
+
+	std::vector<char> binary(length);
+	file.read(binary.data(), length);
+	if (!file)
+	{
+		return 0;
+	}
+
+	GLuint program = glCreateProgram();
+	glProgramBinary(program, (GLenum)format, binary.data(), (GLsizei)length);
+
+	GLint status = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &status);
+	if (status != GL_TRUE)
+	{
+		glDeleteProgram(program);
+		return 0;
+	}
+
+	return(program);
+}
+
+/***********************************************************
+ *  SaveBinary()
+ *
+ *  This method is used for writing the binary of a linked
+ *  program to the cache file, replacing the binary of the
+ *  previous sources.
+ ***********************************************************/
+void ShaderCache::SaveBinary(const std::string& path, uint64_t key, GLuint program)
+{
+	if (!m_bBinarySupported)
+	{
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+	{
+		return;
+	}
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(program, length, &length, &format, binary.data());
+
+	std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+	if (!file)
+	{
+		std::cout << "Could not write shader cache file:" << path << std::endl;
+		return;
+	}
+
+	uint32_t fileFormat = (uint32_t)format;
+	uint32_t fileLength = (uint32_t)length;
+
+	file.write(g_BinaryMagic, sizeof(g_BinaryMagic));
+	file.write((const char*)&g_BinaryVersion, sizeof(g_BinaryVersion));
+	file.write((const char*)&key, sizeof(key));
+	file.write((const char*)&fileFormat, sizeof(fileFormat));
+	file.write((const char*)&fileLength, sizeof(fileLength));
+	file.write(binary.data(), length);
+}
+
+/***********************************************************
+ *  GetBinaryPath()
+ *
+ *  This method is used for getting the path of the binary
+ *  cache file of a program - the vertex shader path with a
+ *  hash of the fragment shader and the defines, so every
+ *  variant keeps its own file, and a .program extension.
+ ***********************************************************/
+std::string ShaderCache::GetBinaryPath(const PROGRAM_SOURCE& source)
+{
+	const std::string& filename = source.vertexFilename;
+	size_t extension = filename.find_last_of('.');
+	size_t separator = filename.find_last_of("/\\");
+	std::string basePath = filename;
+
+	if ((extension != std::string::npos) &&
+		((separator == std::string::npos) || (extension > separator)))
+	{
+		basePath = filename.substr(0, extension);
+	}
+
+	uint64_t variant = HashText(HashText(g_HashSeed, source.fragmentFilename), source.defines);
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%016llx.program", (unsigned long long)variant);
+
+	return(basePath + suffix);
+}
+
+/***********************************************************
+ *  StartWatching()
+ *
+ *  This method is used for starting the watcher thread.  Its
+ *  hidden window is created here, since GLFW only creates
+ *  windows on the main thread, and shares its objects with
+ *  the passed in window so the rebuilt programs can be used
+ *  there.
+ ***********************************************************/
+bool ShaderCache::StartWatching(GLFWwindow* shareWindow)
+{
+	StopWatching();
+
+	if (m_sources.empty())
+	{
+		return false;
+	}
+
+	glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+	m_pWatchWindow = glfwCreateWindow(1, 1, "Shader Watcher", NULL, shareWindow);
+	glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);
+	if (m_pWatchWindow == NULL)
+	{
+		std::cout << "Could not create the shader watcher context" << std::endl;
+		return false;
+	}
+
+	m_bWatching = true;
+	// the thread gets its own copy, so programs loaded later
+	// are not watched
+	m_watchThread = std::thread(&ShaderCache::WatchLoop, this, m_sources);
+
+	return true;
+}
+
+/***********************************************************
+ *  StopWatching()
+ *
+ *  This method is used for stopping the watcher thread and
+ *  freeing its window and any programs left unclaimed.
+ ***********************************************************/
+void ShaderCache::StopWatching()
+{
+	if (m_watchThread.joinable())
+	{
+		{
+			std::lock_guard<std::mutex> lock(m_watchMutex);
+			m_bWatching = false;
+		}
+		m_watchCondition.notify_all();
+		m_watchThread.join();
+	}
+	m_bWatching = false;
+
+	if (m_pWatchWindow != NULL)
+	{
+		glfwDestroyWindow(m_pWatchWindow);
+		m_pWatchWindow = NULL;
+	}
+
+	int index = 0;
+	GLuint program = 0;
+	while (TakeReloadedProgram(index, program))
+	{
+		glDeleteProgram(program);
+	}
+}
+
+/***********************************************************
+ *  TakeReloadedProgram()
+ *
+ *  This method is used for taking one of the programs the
+ *  watcher rebuilt since the last call, with the index of
+ *  the program it replaces.  The caller owns it until it is
+ *  passed to ReplaceProgram().
+ ***********************************************************/
+bool ShaderCache::TakeReloadedProgram(int& index, GLuint& program)
+{
+	std::lock_guard<std::mutex> lock(m_reloadMutex);
+
+	if (m_reloadedPrograms.empty())
+	{
+		return false;
+	}
+
+	index = m_reloadedPrograms.back().first;
+	program = m_reloadedPrograms.back().second;
+	m_reloadedPrograms.pop_back();
+
+	return true;
+}
+
+/***********************************************************
+ *  HasReloadedProgram()
+ *
+ *  This method is used for checking whether the watcher has
+ *  rebuilt a program that was not taken yet, so an idle
+ *  frame loop knows to render.
+ ***********************************************************/
+bool ShaderCache::HasReloadedProgram()
+{
+	std::lock_guard<std::mutex> lock(m_reloadMutex);
+
+	return(!m_reloadedPrograms.empty());
+}
+
+/***********************************************************
+ *  WatchLoop()
+ *
+ *  This method is used for checking the shader files for
+ *  changes on the watcher thread and rebuilding the
+ *  programs built from them on the hidden context.  The
+ *  builds are finished before the programs are handed over,
+ *  since the other context may use them right away.  A
+ *  program that fails to build keeps the previous one in
+ *  use.
+ ***********************************************************/
+void ShaderCache::WatchLoop(std::vector<PROGRAM_SOURCE> sources)
+{
+	glfwMakeContextCurrent(m_pWatchWindow);
+
+	std::vector<long long> vertexTimes(sources.size());
+	std::vector<long long> fragmentTimes(sources.size());
+	for (size_t i = 0; i < sources.size(); i++)
+	{
+		vertexTimes[i] = GetModifiedTime(sources[i].vertexFilename);
+		fragmentTimes[i] = GetModifiedTime(sources[i].fragmentFilename);
+	}
+
+	while (true)
+	{
+		// the stop flag is read under the lock StopWatching() sets
+		// it with, so a stop is never missed before the wait
+		{
+			std::unique_lock<std::mutex> lock(m_watchMutex);
+			if (m_watchCondition.wait_for(lock, std::chrono::milliseconds(g_WatchIntervalMilliseconds),
+				[this]() { return(!m_bWatching); }))
+			{
+				break;
+			}
+		}
+
+		std::vector<std::pair<int, GLuint> > rebuilt;
+		for (size_t i = 0; i < sources.size(); i++)
+		{
+			long long vertexTime = GetModifiedTime(sources[i].vertexFilename);
+			long long fragmentTime = GetModifiedTime(sources[i].fragmentFilename);
+			if ((vertexTime == vertexTimes[i]) && (fragmentTime == fragmentTimes[i]))
+			{
+				continue;
+			}
+			vertexTimes[i] = vertexTime;
+			fragmentTimes[i] = fragmentTime;
+
+			GLuint program = BuildProgram(sources[i]);
+			if (program != 0)
+			{
+				rebuilt.push_back(std::make_pair((int)i, program));
+			}
+		}
+		if (rebuilt.empty())
+		{
+			continue;
+		}
+		glFinish();
+		std::cout << "Reloaded " << rebuilt.size() << " shader programs" << std::endl;
+
+		// a program the frame loop has not taken yet is replaced
+		std::lock_guard<std::mutex> lock(m_reloadMutex);
+		for (size_t i = 0; i < rebuilt.size(); i++)
+		{
+			for (size_t j = 0; j < m_reloadedPrograms.size(); j++)
+			{
+				if (m_reloadedPrograms[j].first == rebuilt[i].first)
+				{
+					glDeleteProgram(m_reloadedPrograms[j].second);
+					m_reloadedPrograms.erase(m_reloadedPrograms.begin() + j);
+					break;
+				}
+			}
+			m_reloadedPrograms.push_back(rebuilt[i]);
+		}
+		// wake a frame loop waiting for events
+		glfwPostEmptyEvent();
+	}
+
+	glfwMakeContextCurrent(NULL);
+}
+
+/***********************************************************
+ *  AddDefines()
+ *
+ *  This method is used for inserting #define lines after the
+ *  #version line of a shader source, which must come first.
+ ***********************************************************/
+std::string ShaderCache::AddDefines(const std::string& source, const std::string& defines)
+{
+	if (defines.empty())
+	{
+		return(source);
+	}
+
+	size_t version = source.find("#version");
+	size_t lineEnd = (version == std::string::npos) ? std::string::npos : source.find('\n', version);
+	if (lineEnd == std::string::npos)
+	{
+		return(defines + "\n" + source);
+	}
+
+	return(source.substr(0, lineEnd + 1) + defines + "\n" + source.substr(lineEnd + 1));
+}
+
+/***********************************************************
+ *  ReadFile()
+ *
+ *  This method is used for reading a whole text file.
+ ***********************************************************/
+bool ShaderCache::ReadFile(const std::string& filename, std::string& contents)
+{
+	std::ifstream file(filename.c_str());
+	if (!file)
+	{
+		std::cout << "Could not open shader file:" << filename << std::endl;
+		return false;
+	}
+
+	std::stringstream text;
+	text << file.rdbuf();
+	contents = text.str();
+
+	return true;
+}
+
+/***********************************************************
+ *  GetModifiedTime()
+ *
+ *  This method is used for getting the last write time of a
+ *  file, or -1 when the file does not exist.
+ ***********************************************************/
+long long ShaderCache::GetModifiedTime(const std::string& filename)
+{
+	struct stat fileStatus;
+
+	if (stat(filename.c_str(), &fileStatus) != 0)
+	{
+		return(-1);
+	}
+	return((long long)fileStatus.st_mtime);
+}
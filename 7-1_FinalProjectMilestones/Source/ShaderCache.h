@@ -0,0 +1,125 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadercache.h
+// ============
+// build the shader programs from their GLSL files, keep the linked
+// program binaries for the next launch and rebuild them when they change
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include "GLFW/glfw3.h"
+
+#include "GLObject.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/***********************************************************
+ *  ShaderCache
+ *
+ *  This class compiles and links vertex and fragment shader
+ *  programs and saves each linked binary beside the shader
+ *  files.  A program can be a variant of its files, built
+ *  with #define lines inserted after the #version line.
+ *  The binary is keyed by a hash of both sources, the
+ *  defines and the driver version, so a warm start loads it
+ *  with glProgramBinary() instead of compiling.  When the
+ *  files are watched, a worker thread with a hidden shared
+ *  context rebuilds the programs after every change; the
+ *  OpenGL thread picks the new programs up between frames
+ *  with TakeReloadedProgram().
+ ***********************************************************/
+class ShaderCache
+{
+public:
+	// constructor
+	ShaderCache();
+	// destructor
+	~ShaderCache();
+
+	// read the --watch-shaders option from the command line
+	static bool ParseWatchArgument(int argc, char* argv[]);
+
+	// build a program of a vertex and fragment shader file with
+	// #define lines, from the cached binary when it matches - 0
+	// on failure, otherwise it is added to the programs
+	GLuint LoadProgram(
+		const char* vertexFilename,
+		const char* fragmentFilename,
+		const std::string& defines = std::string());
+	// get the number of loaded programs
+	int GetProgramCount() const;
+	// get a loaded program by the order it was loaded in
+	GLuint GetProgram(int index) const;
+	// replace a loaded program, freeing the previous one
+	void ReplaceProgram(int index, GLuint program);
+
+	// rebuild the programs loaded so far on a hidden context
+	// sharing with the passed in window whenever their files
+	// change
+	bool StartWatching(GLFWwindow* shareWindow);
+	// stop the watcher thread and free its context
+	void StopWatching();
+	// take a program rebuilt since the last call - false when
+	// there is none
+	bool TakeReloadedProgram(int& index, GLuint& program);
+	// true while a rebuilt program is waiting to be taken
+	bool HasReloadedProgram();
+
+private:
+	// files and defines a program is built from
+	struct PROGRAM_SOURCE
+	{
+		std::string vertexFilename;
+		std::string fragmentFilename;
+		std::string defines;
+	};
+
+	// build a program from its files, through the binary cache
+	GLuint BuildProgram(const PROGRAM_SOURCE& source);
+	// compile and link the sources - 0 on failure
+	GLuint CompileProgram(const std::string& vertexSource, const std::string& fragmentSource);
+	// load the cached binary with the passed in key, or 0
+	GLuint LoadBinary(const std::string& path, uint64_t key);
+	// save the binary of a linked program under a key
+	void SaveBinary(const std::string& path, uint64_t key, GLuint program);
+	// get the path of the binary cache file of a program
+	static std::string GetBinaryPath(const PROGRAM_SOURCE& source);
+	// rebuild the programs when their files change
+	void WatchLoop(std::vector<PROGRAM_SOURCE> sources);
+
+	// insert the defines after the #version line of a source
+	static std::string AddDefines(const std::string& source, const std::string& defines);
+	// read a whole text file
+	static bool ReadFile(const std::string& filename, std::string& contents);
+	// get the last write time of a file, -1 when it is missing
+	static long long GetModifiedTime(const std::string& filename);
+
+	// vendor, renderer and version strings the binaries are
+	// only valid for
+	std::string m_driverVersion;
+	// true when the driver can save program binaries
+	bool m_bBinarySupported;
+	// loaded programs and what they were built from
+	std::vector<PROGRAM_SOURCE> m_sources;
+	std::vector<GLObject> m_programs;
+
+	// hidden window whose context the watcher compiles on
+	GLFWwindow* m_pWatchWindow;
+	std::thread m_watchThread;
+	std::atomic<bool> m_bWatching;
+	// wakes the watcher early when it is stopped
+	std::mutex m_watchMutex;
+	std::condition_variable m_watchCondition;
+	// programs rebuilt by the watcher, by program index
+	std::mutex m_reloadMutex;
+	std::vector<std::pair<int, GLuint> > m_reloadedPrograms;
+};
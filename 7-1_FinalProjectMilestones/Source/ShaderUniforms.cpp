@@ -0,0 +1,741 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.cpp
+// ============
+// cache uniform locations and manage the uniform buffer objects that
+// feed the per-frame, light and material data into the shaders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShaderUniforms.h"
+
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// shader names of the per-draw uniforms, in UNIFORM_ID order
+	const char* g_UniformNames[ShaderUniforms::UNIFORM_COUNT] =
+	{
+		"model",
+		"objectColor",
+		"objectTextures",
+		"textureLayer",
+		"bUseTexture",
+		"UVscale",
+		"bUseInstancing",
+		"bUseInstanceMaterials",
+		"shadowMaps",
+		"streamedTextures"
+	};
+
+	// shader names of the uniform blocks
+	const char* g_FrameBlockName = "FrameData";
+	const char* g_LightBlockName = "LightData";
+	const char* g_MaterialBlockName = "MaterialData";
+	const char* g_MaterialTableBlockName = "MaterialTable";
+	const char* g_ShadowBlockName = "ShadowData";
+	const char* g_ClusterBlockName = "ClusterData";
+	const char* g_TextureResidencyBlockName = "TextureResidency";
+	// shader storage blocks of the clustered lights
+	const char* g_ClusterLightsBlockName = "ClusterLights";
+	const char* g_ClusterCountsBlockName = "ClusterCounts";
+	const char* g_ClusterIndicesBlockName = "ClusterIndices";
+}
+
+/***********************************************************
+ *  ShaderUniforms()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShaderUniforms::ShaderUniforms()
+	: m_frameBuffer(GLObject::OBJECT_BUFFER),
+	m_lightBuffer(GLObject::OBJECT_BUFFER),
+	m_materialBuffer(GLObject::OBJECT_BUFFER),
+	m_materialTableBuffer(GLObject::OBJECT_BUFFER),
+	m_shadowBuffer(GLObject::OBJECT_BUFFER)
+{
+	m_currentProgram = -1;
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		m_values[i].type = VALUE_NONE;
+		m_values[i].matrix = glm::mat4(1.0f);
+		m_values[i].vector = glm::vec4(0.0f);
+		m_values[i].integer = 0;
+		m_values[i].version = 0;
+	}
+	m_frameData.view = glm::mat4(1.0f);
+	m_frameData.projection = glm::mat4(1.0f);
+	m_frameData.viewPosition = glm::vec3(0.0f, 0.0f, 0.0f);
+	m_frameData.padding = 0.0f;
+	m_materialStride = 0;
+	m_materialCount = 0;
+	m_boundMaterial = -1;
+	m_pProfiler = NULL;
+	m_pStreamBuffer = NULL;
+}
+
+/***********************************************************
+ *  ~ShaderUniforms()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShaderUniforms::~ShaderUniforms()
+{
+	DestroyBuffers();
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for resolving the uniform locations
+ *  of the currently active shader program as program 0,
+ *  binding its uniform blocks and creating the uniform
+ *  buffers.
+ ***********************************************************/
+bool ShaderUniforms::Initialize()
+{
+	GLint currentProgram = 0;
+
+	glGetIntegerv(GL_CURRENT_PROGRAM, &currentProgram);
+	if (currentProgram == 0)
+	{
+		std::cout << "ShaderUniforms: no active shader program" << std::endl;
+		return false;
+	}
+	m_programs.clear();
+	m_currentProgram = -1;
+	if (AddProgram((GLuint)currentProgram) < 0)
+	{
+		return false;
+	}
+	m_currentProgram = 0;
+
+	DestroyBuffers();
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_frameBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(FRAME_BLOCK), NULL, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, m_frameBuffer.Get());
+	m_frameBuffer.SetByteSize(sizeof(FRAME_BLOCK));
+
+	// unused light sources stay zeroed so they add no light
+	std::vector<LIGHT_SOURCE> noLights(MAX_LIGHT_SOURCES, LIGHT_SOURCE());
+	glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(LIGHT_SOURCE) * MAX_LIGHT_SOURCES, noLights.data(), GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, LIGHT_BLOCK_BINDING, m_lightBuffer.Get());
+	m_lightBuffer.SetByteSize(sizeof(LIGHT_SOURCE) * MAX_LIGHT_SOURCES);
+
+	m_materialBuffer.Create();
+
+	// the table is always full size, so unset entries read zero
+	std::vector<MATERIAL_BLOCK> noMaterials(MAX_MATERIALS, MATERIAL_BLOCK());
+	glBindBuffer(GL_UNIFORM_BUFFER, m_materialTableBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(MATERIAL_BLOCK) * MAX_MATERIALS, noMaterials.data(), GL_STATIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, MATERIAL_TABLE_BINDING, m_materialTableBuffer.Get());
+	m_materialTableBuffer.SetByteSize(sizeof(MATERIAL_BLOCK) * MAX_MATERIALS);
+
+	// read only by the shadowed variants, once the maps exist
+	SHADOW_BLOCK noShadows = {};
+	glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(SHADOW_BLOCK), &noShadows, GL_DYNAMIC_DRAW);
+	glBindBufferBase(GL_UNIFORM_BUFFER, SHADOW_BLOCK_BINDING, m_shadowBuffer.Get());
+	m_shadowBuffer.SetByteSize(sizeof(SHADOW_BLOCK));
+
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	// material ranges must start on the driver's offset alignment
+	GLint offsetAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &offsetAlignment);
+	m_materialStride =
+		((sizeof(MATERIAL_BLOCK) + offsetAlignment - 1) / offsetAlignment) * offsetAlignment;
+
+	return true;
+}
+
+/***********************************************************
+ *  AddProgram()
+ *
+ *  This method is used for resolving the uniform locations
+ *  of a shader program variant and binding its uniform
+ *  blocks.  The uniform buffers are shared, since they stay
+ *  bound to their binding points.
+ ***********************************************************/
+int ShaderUniforms::AddProgram(GLuint program)
+{
+	for (size_t i = 0; i < m_programs.size(); i++)
+	{
+		if (m_programs[i].program == program)
+		{
+			return((int)i);
+		}
+	}
+
+	PROGRAM_STATE state;
+	if (ResolveProgram(program, state) == false)
+	{
+		return -1;
+	}
+	m_programs.push_back(state);
+
+	return((int)m_programs.size() - 1);
+}
+
+/***********************************************************
+ *  HasProgram()
+ *
+ *  This method is used for checking whether a program was
+ *  added, so its rebuilds must go through ReplaceProgram().
+ ***********************************************************/
+bool ShaderUniforms::HasProgram(GLuint program) const
+{
+	for (size_t i = 0; i < m_programs.size(); i++)
+	{
+		if (m_programs[i].program == program)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/***********************************************************
+ *  ReplaceProgram()
+ *
+ *  This method is used for switching an added program to a
+ *  rebuilt version of it.  Only the locations and block
+ *  bindings are resolved again; every value set so far is
+ *  sent to the new program when it is next made current.
+ ***********************************************************/
+bool ShaderUniforms::ReplaceProgram(GLuint oldProgram, GLuint newProgram)
+{
+	for (size_t i = 0; i < m_programs.size(); i++)
+	{
+		if (m_programs[i].program != oldProgram)
+		{
+			continue;
+		}
+
+		PROGRAM_STATE state;
+		if (ResolveProgram(newProgram, state) == false)
+		{
+			return false;
+		}
+		m_programs[i] = state;
+
+		// the rebuilt current program takes over right away
+		if ((int)i == m_currentProgram)
+		{
+			m_currentProgram = -1;
+			UseProgram((int)i);
+		}
+
+		return true;
+	}
+
+	return false;
+}
+
+/***********************************************************
+ *  UseProgram()
+ *
+ *  This method is used for making an added program current.
+ *  The uniform values that were set while another program
+ *  was in use are sent first, so the draws see the same
+ *  values whichever variant they use.
+ ***********************************************************/
+void ShaderUniforms::UseProgram(int programIndex)
+{
+	if ((programIndex < 0) ||
+		(programIndex >= (int)m_programs.size()) ||
+		(programIndex == m_currentProgram))
+	{
+		return;
+	}
+
+	m_currentProgram = programIndex;
+	glUseProgram(m_programs[m_currentProgram].program);
+
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		if (m_programs[m_currentProgram].appliedVersions[i] != m_values[i].version)
+		{
+			ApplyValue((UNIFORM_ID)i);
+		}
+	}
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+}
+
+/***********************************************************
+ *  UseProgram()
+ *
+ *  This method is used for making the current program
+ *  current again, such as after a compute dispatch.
+ ***********************************************************/
+void ShaderUniforms::UseProgram()
+{
+	if (m_currentProgram >= 0)
+	{
+		glUseProgram(m_programs[m_currentProgram].program);
+	}
+}
+
+/***********************************************************
+ *  GetCurrentProgram()
+ *
+ *  This method is used for getting the index of the program
+ *  in use, -1 before Initialize().
+ ***********************************************************/
+int ShaderUniforms::GetCurrentProgram() const
+{
+	return(m_currentProgram);
+}
+
+/***********************************************************
+ *  ResolveProgram()
+ *
+ *  This method is used for caching the uniform locations of
+ *  a program and attaching its uniform blocks to their
+ *  binding points.  The per-frame block is checked first,
+ *  so a program without it is rejected before anything
+ *  changes.  The light, material, shadow, cluster and
+ *  texture residency blocks are optional, since the unlit
+ *  variants compile them out.
+ *  The storage blocks of the clustered lights can only be
+ *  found with OpenGL 4.3.
+ ***********************************************************/
+bool ShaderUniforms::ResolveProgram(GLuint program, PROGRAM_STATE& state)
+{
+	const char* blockNames[] =
+	{
+		g_FrameBlockName, g_LightBlockName, g_MaterialBlockName, g_MaterialTableBlockName, g_ShadowBlockName, g_ClusterBlockName,
+		g_TextureResidencyBlockName
+	};
+	const GLuint bindings[] =
+	{
+		FRAME_BLOCK_BINDING, LIGHT_BLOCK_BINDING, MATERIAL_BLOCK_BINDING, MATERIAL_TABLE_BINDING, SHADOW_BLOCK_BINDING, CLUSTER_BLOCK_BINDING,
+		TEXTURE_RESIDENCY_BINDING
+	};
+	const int blockCount = sizeof(bindings) / sizeof(bindings[0]);
+	GLuint blockIndices[blockCount];
+
+	for (int i = 0; i < blockCount; i++)
+	{
+		blockIndices[i] = glGetUniformBlockIndex(program, blockNames[i]);
+	}
+	if (blockIndices[0] == GL_INVALID_INDEX)
+	{
+		std::cout << "ShaderUniforms: shader has no " << blockNames[0] << " block" << std::endl;
+		return false;
+	}
+
+	state.program = program;
+
+	// resolve every per-draw uniform location once - a value
+	// version of 0 means the program holds its defaults
+	for (int i = 0; i < UNIFORM_COUNT; i++)
+	{
+		state.locations[i] = glGetUniformLocation(program, g_UniformNames[i]);
+		state.appliedVersions[i] = 0;
+	}
+	state.namedLocations.clear();
+
+	// attach the uniform blocks to their binding points
+	for (int i = 0; i < blockCount; i++)
+	{
+		if (blockIndices[i] != GL_INVALID_INDEX)
+		{
+			glUniformBlockBinding(program, blockIndices[i], bindings[i]);
+		}
+	}
+
+	if (GLEW_VERSION_4_3)
+	{
+		const char* storageNames[] = { g_ClusterLightsBlockName, g_ClusterCountsBlockName, g_ClusterIndicesBlockName };
+		const GLuint storageBindings[] = { CLUSTER_LIGHTS_BINDING, CLUSTER_COUNTS_BINDING, CLUSTER_INDICES_BINDING };
+
+		for (int i = 0; i < 3; i++)
+		{
+			GLuint storageIndex = glGetProgramResourceIndex(program, GL_SHADER_STORAGE_BLOCK, storageNames[i]);
+			if (storageIndex != GL_INVALID_INDEX)
+			{
+				glShaderStorageBlockBinding(program, storageIndex, storageBindings[i]);
+			}
+		}
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  ApplyValue()
+ *
+ *  This method is used for sending the cached value of a
+ *  uniform to the current program.
+ ***********************************************************/
+void ShaderUniforms::ApplyValue(UNIFORM_ID uniform)
+{
+	PROGRAM_STATE& state = m_programs[m_currentProgram];
+	const UNIFORM_VALUE& value = m_values[uniform];
+	GLint location = state.locations[uniform];
+
+	switch (value.type)
+	{
+	case VALUE_MAT4:
+		glUniformMatrix4fv(location, 1, GL_FALSE, glm::value_ptr(value.matrix));
+		break;
+	case VALUE_VEC4:
+		glUniform4fv(location, 1, glm::value_ptr(value.vector));
+		break;
+	case VALUE_VEC2:
+		glUniform2fv(location, 1, glm::value_ptr(value.vector));
+		break;
+	case VALUE_INT:
+		glUniform1i(location, value.integer);
+		break;
+	default:
+		break;
+	}
+	state.appliedVersions[uniform] = value.version;
+
+	if ((NULL != m_pProfiler) && (value.type != VALUE_NONE))
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_UNIFORM_UPDATES);
+	}
+}
+
+/***********************************************************
+ *  DestroyBuffers()
+ *
+ *  This method is used for freeing the uniform buffers.
+ ***********************************************************/
+void ShaderUniforms::DestroyBuffers()
+{
+	m_frameBuffer.Reset();
+	m_lightBuffer.Reset();
+	m_materialBuffer.Reset();
+	m_materialTableBuffer.Reset();
+	m_shadowBuffer.Reset();
+	m_materialCount = 0;
+	m_boundMaterial = -1;
+}
+
+/***********************************************************
+ *  GetLocation()
+ *
+ *  This method is used for getting the cached location of
+ *  a per-draw uniform in the current program.
+ ***********************************************************/
+GLint ShaderUniforms::GetLocation(UNIFORM_ID uniform) const
+{
+	if (m_currentProgram < 0)
+	{
+		return -1;
+	}
+
+	return(m_programs[m_currentProgram].locations[uniform]);
+}
+
+/***********************************************************
+ *  FindLocation()
+ *
+ *  This method is used for getting the location of a uniform
+ *  by name in the current program.  The location is only
+ *  queried from the driver the first time a name is seen.
+ ***********************************************************/
+GLint ShaderUniforms::FindLocation(const std::string& name)
+{
+	if (m_currentProgram < 0)
+	{
+		return -1;
+	}
+
+	PROGRAM_STATE& state = m_programs[m_currentProgram];
+	std::unordered_map<std::string, GLint>::const_iterator found =
+		state.namedLocations.find(name);
+
+	if (found != state.namedLocations.end())
+	{
+		return(found->second);
+	}
+
+	GLint location = glGetUniformLocation(state.program, name.c_str());
+	state.namedLocations.emplace(name, location);
+
+	return(location);
+}
+
+/***********************************************************
+ *  SetMat4Value()
+ *
+ *  This method is used for setting a 4x4 matrix uniform.
+ *  The other programs receive it when they are next used.
+ ***********************************************************/
+void ShaderUniforms::SetMat4Value(UNIFORM_ID uniform, const glm::mat4& value)
+{
+	UNIFORM_VALUE& cached = m_values[uniform];
+
+	cached.type = VALUE_MAT4;
+	cached.matrix = value;
+	cached.version++;
+
+	if (m_currentProgram >= 0)
+	{
+		ApplyValue(uniform);
+	}
+}
+
+/***********************************************************
+ *  SetVec4Value()
+ *
+ *  This method is used for setting a vec4 uniform.
+ ***********************************************************/
+void ShaderUniforms::SetVec4Value(UNIFORM_ID uniform, const glm::vec4& value)
+{
+	UNIFORM_VALUE& cached = m_values[uniform];
+
+	cached.type = VALUE_VEC4;
+	cached.vector = value;
+	cached.version++;
+
+	if (m_currentProgram >= 0)
+	{
+		ApplyValue(uniform);
+	}
+}
+
+/***********************************************************
+ *  SetVec2Value()
+ *
+ *  This method is used for setting a vec2 uniform.
+ ***********************************************************/
+void ShaderUniforms::SetVec2Value(UNIFORM_ID uniform, const glm::vec2& value)
+{
+	UNIFORM_VALUE& cached = m_values[uniform];
+
+	cached.type = VALUE_VEC2;
+	cached.vector = glm::vec4(value, 0.0f, 0.0f);
+	cached.version++;
+
+	if (m_currentProgram >= 0)
+	{
+		ApplyValue(uniform);
+	}
+}
+
+/***********************************************************
+ *  SetIntValue()
+ *
+ *  This method is used for setting an int, bool or sampler
+ *  uniform.
+ ***********************************************************/
+void ShaderUniforms::SetIntValue(UNIFORM_ID uniform, int value)
+{
+	UNIFORM_VALUE& cached = m_values[uniform];
+
+	cached.type = VALUE_INT;
+	cached.integer = value;
+	cached.version++;
+
+	if (m_currentProgram >= 0)
+	{
+		ApplyValue(uniform);
+	}
+}
+
+/***********************************************************
+ *  SetFrameData()
+ *
+ *  This method is used for uploading the view, projection
+ *  and camera position for the current frame.  With a
+ *  mapped stream buffer the block is written into the
+ *  region of this frame and its range is bound instead, so
+ *  the update never waits on draws still reading the last
+ *  frame's block.
+ ***********************************************************/
+void ShaderUniforms::SetFrameData(
+	const glm::mat4& view,
+	const glm::mat4& projection,
+	const glm::vec3& viewPosition)
+{
+	m_frameData.view = view;
+	m_frameData.projection = projection;
+	m_frameData.viewPosition = viewPosition;
+	m_frameData.padding = 0.0f;
+
+	StreamBuffer::ALLOCATION allocation;
+	if ((NULL != m_pStreamBuffer) &&
+		m_pStreamBuffer->Allocate(sizeof(FRAME_BLOCK), m_pStreamBuffer->GetUniformAlignment(), allocation))
+	{
+		memcpy(allocation.pMemory, &m_frameData, sizeof(FRAME_BLOCK));
+		glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, m_pStreamBuffer->GetBuffer(),
+			allocation.offset, sizeof(FRAME_BLOCK));
+		return;
+	}
+
+	// a stream that is full this frame falls back on the block's
+	// own buffer, which has to be bound again
+	glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_BLOCK_BINDING, m_frameBuffer.Get());
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FRAME_BLOCK), &m_frameData);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+	}
+}
+
+/***********************************************************
+ *  GetFrameData()
+ *
+ *  This method is used for getting the view data uploaded
+ *  by the last SetFrameData() call.
+ ***********************************************************/
+const ShaderUniforms::FRAME_BLOCK& ShaderUniforms::GetFrameData() const
+{
+	return(m_frameData);
+}
+
+/***********************************************************
+ *  SetLightSources()
+ *
+ *  This method is used for uploading the light sources.
+ *  Lights past the passed in count are left off.
+ ***********************************************************/
+void ShaderUniforms::SetLightSources(const LIGHT_SOURCE* lights, int lightCount)
+{
+	std::vector<LIGHT_SOURCE> block(MAX_LIGHT_SOURCES, LIGHT_SOURCE());
+
+	for (int i = 0; (i < lightCount) && (i < MAX_LIGHT_SOURCES); i++)
+	{
+		block[i] = lights[i];
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_lightBuffer.Get());
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(LIGHT_SOURCE) * MAX_LIGHT_SOURCES, block.data());
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+	}
+}
+
+/***********************************************************
+ *  SetShadowData()
+ *
+ *  This method is used for uploading the matrices that take
+ *  a world position into the shadow map of each light.  The
+ *  shaders only read the matrices of the shadowed lights.
+ ***********************************************************/
+void ShaderUniforms::SetShadowData(const glm::mat4* shadowMatrices, int lightCount, const glm::vec4& shadowParameters)
+{
+	SHADOW_BLOCK block = {};
+
+	for (int i = 0; (i < lightCount) && (i < MAX_LIGHT_SOURCES); i++)
+	{
+		block.shadowMatrices[i] = shadowMatrices[i];
+	}
+	block.shadowParameters = shadowParameters;
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_shadowBuffer.Get());
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(SHADOW_BLOCK), &block);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_BUFFER_UPLOADS);
+	}
+}
+
+/***********************************************************
+ *  SetMaterials()
+ *
+ *  This method is used for uploading all the materials into
+ *  one uniform buffer, each at an aligned offset, so that a
+ *  material switch is a single glBindBufferRange().  The
+ *  first MAX_MATERIALS are also packed into the material
+ *  table that instanced draws index per instance.
+ ***********************************************************/
+void ShaderUniforms::SetMaterials(const std::vector<MATERIAL_BLOCK>& materials)
+{
+	std::vector<unsigned char> data(m_materialStride * materials.size(), 0);
+
+	for (size_t i = 0; i < materials.size(); i++)
+	{
+		memcpy(&data[i * m_materialStride], &materials[i], sizeof(MATERIAL_BLOCK));
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_materialBuffer.Get());
+	glBufferData(GL_UNIFORM_BUFFER, data.size(), data.data(), GL_STATIC_DRAW);
+	m_materialBuffer.SetByteSize(data.size());
+
+	GLsizeiptr tableCount = std::min((GLsizeiptr)materials.size(), (GLsizeiptr)MAX_MATERIALS);
+	if (tableCount > 0)
+	{
+		glBindBuffer(GL_UNIFORM_BUFFER, m_materialTableBuffer.Get());
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(MATERIAL_BLOCK) * tableCount, materials.data());
+	}
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+
+	m_materialCount = (int)materials.size();
+	m_boundMaterial = -1;
+}
+
+/***********************************************************
+ *  BindMaterial()
+ *
+ *  This method is used for binding the buffer range of the
+ *  material at the passed in index to the material block.
+ ***********************************************************/
+void ShaderUniforms::BindMaterial(int materialIndex)
+{
+	if ((materialIndex < 0) ||
+		(materialIndex >= m_materialCount) ||
+		(materialIndex == m_boundMaterial))
+	{
+		return;
+	}
+
+	glBindBufferRange(
+		GL_UNIFORM_BUFFER,
+		MATERIAL_BLOCK_BINDING,
+		m_materialBuffer.Get(),
+		materialIndex * m_materialStride,
+		sizeof(MATERIAL_BLOCK));
+	m_boundMaterial = materialIndex;
+
+	if (NULL != m_pProfiler)
+	{
+		m_pProfiler->AddCount(FrameProfiler::COUNTER_STATE_CHANGES);
+	}
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the uniform updates and material binds.
+ ***********************************************************/
+void ShaderUniforms::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  SetStreamBuffer()
+ *
+ *  This method is used for setting the ring buffer the
+ *  per-frame view data is written into.
+ ***********************************************************/
+void ShaderUniforms::SetStreamBuffer(StreamBuffer* pStreamBuffer)
+{
+	m_pStreamBuffer = pStreamBuffer;
+}
@@ -0,0 +1,248 @@
+///////////////////////////////////////////////////////////////////////////////
+// shaderuniforms.h
+// ============
+// cache uniform locations and manage the uniform buffer objects that
+// feed the per-frame, light and material data into the shaders
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+#include "StreamBuffer.h"
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/***********************************************************
+ *  ShaderUniforms
+ *
+ *  This class resolves the uniform locations of each shader
+ *  program variant once, after the shaders are loaded, and
+ *  owns the std140 uniform buffers shared by the shaders.
+ *  The last value of every per-draw uniform is kept, so a
+ *  switch to another variant only sends the values that
+ *  changed since that variant was last in use.
+ ***********************************************************/
+class ShaderUniforms
+{
+public:
+	// constructor
+	ShaderUniforms();
+	// destructor
+	~ShaderUniforms();
+
+	// per-draw uniforms with cached locations
+	enum UNIFORM_ID
+	{
+		UNIFORM_MODEL,
+		UNIFORM_OBJECT_COLOR,
+		UNIFORM_OBJECT_TEXTURES,
+		UNIFORM_TEXTURE_LAYER,
+		UNIFORM_USE_TEXTURE,
+		UNIFORM_UV_SCALE,
+		UNIFORM_USE_INSTANCING,
+		UNIFORM_USE_INSTANCE_MATERIALS,
+		UNIFORM_SHADOW_MAPS,
+		UNIFORM_STREAMED_TEXTURES,
+		UNIFORM_COUNT
+	};
+
+	// binding points that Initialize() attaches the uniform
+	// blocks of the shader program to
+	enum BLOCK_BINDING
+	{
+		FRAME_BLOCK_BINDING = 0,
+		LIGHT_BLOCK_BINDING = 1,
+		MATERIAL_BLOCK_BINDING = 2,
+		MATERIAL_TABLE_BINDING = 3,
+		SHADOW_BLOCK_BINDING = 4,
+		CLUSTER_BLOCK_BINDING = 5,
+		TEXTURE_RESIDENCY_BINDING = 6
+	};
+
+	// shader storage binding points of the clustered lights,
+	// past the ones of the culling shader
+	enum STORAGE_BINDING
+	{
+		CLUSTER_LIGHTS_BINDING = 4,
+		CLUSTER_COUNTS_BINDING = 5,
+		CLUSTER_INDICES_BINDING = 6
+	};
+
+	// must match TOTAL_LIGHTS in the fragment shader
+	static const int MAX_LIGHT_SOURCES = 4;
+	// must match MAX_MATERIALS in the fragment shader
+	static const int MAX_MATERIALS = 64;
+
+	// std140 layout of the FrameData block
+	struct FRAME_BLOCK
+	{
+		glm::mat4 view;
+		glm::mat4 projection;
+		glm::vec3 viewPosition;
+		float padding;
+	};
+
+	// std140 layout of one LightSource in the LightData block
+	struct LIGHT_SOURCE
+	{
+		glm::vec3 position;
+		float focalStrength;
+		glm::vec3 ambientColor;
+		float specularIntensity;
+		glm::vec3 diffuseColor;
+		float padding0;
+		glm::vec3 specularColor;
+		float padding1;
+	};
+
+	// std140 layout of the MaterialData block
+	struct MATERIAL_BLOCK
+	{
+		glm::vec3 ambientColor;
+		float ambientStrength;
+		glm::vec3 diffuseColor;
+		float shininess;
+		glm::vec3 specularColor;
+		float padding;
+	};
+
+	// std140 layout of the ShadowData block
+	struct SHADOW_BLOCK
+	{
+		// world to shadow map space of each light
+		glm::mat4 shadowMatrices[MAX_LIGHT_SOURCES];
+		// depth bias, normal offset and shadow map texel size
+		glm::vec4 shadowParameters;
+	};
+
+	// resolve the locations of the active program as program 0
+	// and create the uniform buffers - call once the program is
+	// in use
+	bool Initialize();
+	// resolve the locations of another program variant - -1 when
+	// the program lacks the FrameData block
+	int AddProgram(GLuint program);
+	// true when a program was added
+	bool HasProgram(GLuint program) const;
+	// switch an added program to a rebuilt one - false when the
+	// old program was never added or the new one lacks FrameData
+	bool ReplaceProgram(GLuint oldProgram, GLuint newProgram);
+	// make an added program current, sending the values it
+	// missed while another one was in use
+	void UseProgram(int programIndex);
+	// make the current program current again, such as after a
+	// compute dispatch
+	void UseProgram();
+	// get the index of the current program
+	int GetCurrentProgram() const;
+
+	// get the location of a per-draw uniform in the current
+	// program
+	GLint GetLocation(UNIFORM_ID uniform) const;
+	// get the location of any other uniform, cached by name
+	GLint FindLocation(const std::string& name);
+
+	// set the per-draw uniform values
+	void SetMat4Value(UNIFORM_ID uniform, const glm::mat4& value);
+	void SetVec4Value(UNIFORM_ID uniform, const glm::vec4& value);
+	void SetVec2Value(UNIFORM_ID uniform, const glm::vec2& value);
+	void SetIntValue(UNIFORM_ID uniform, int value);
+
+	// upload the per-frame view data
+	void SetFrameData(
+		const glm::mat4& view,
+		const glm::mat4& projection,
+		const glm::vec3& viewPosition);
+	// get the per-frame view data uploaded last
+	const FRAME_BLOCK& GetFrameData() const;
+	// upload the light sources
+	void SetLightSources(const LIGHT_SOURCE* lights, int lightCount);
+	// upload the shadow map matrices of the lights
+	void SetShadowData(const glm::mat4* shadowMatrices, int lightCount, const glm::vec4& shadowParameters);
+	// upload every material into one buffer
+	void SetMaterials(const std::vector<MATERIAL_BLOCK>& materials);
+	// bind the range of one uploaded material
+	void BindMaterial(int materialIndex);
+
+	// set the profiler that counts the uniform updates, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+	// set the ring the frame data is written into, or NULL to
+	// upload it into its own buffer
+	void SetStreamBuffer(StreamBuffer* pStreamBuffer);
+
+private:
+	// type of a cached per-draw uniform value
+	enum VALUE_TYPE
+	{
+		VALUE_NONE,
+		VALUE_MAT4,
+		VALUE_VEC4,
+		VALUE_VEC2,
+		VALUE_INT
+	};
+
+	// last value set for a per-draw uniform
+	struct UNIFORM_VALUE
+	{
+		VALUE_TYPE type;
+		glm::mat4 matrix;
+		// vec2 values use the first two components
+		glm::vec4 vector;
+		int integer;
+		// bumped on every change, 0 while never set
+		unsigned int version;
+	};
+
+	// locations of one program and the value versions it holds
+	struct PROGRAM_STATE
+	{
+		GLuint program;
+		GLint locations[UNIFORM_COUNT];
+		unsigned int appliedVersions[UNIFORM_COUNT];
+		// cached locations of other uniforms by name
+		std::unordered_map<std::string, GLint> namedLocations;
+	};
+
+	// every added program, program 0 from Initialize()
+	std::vector<PROGRAM_STATE> m_programs;
+	// index of the program in use, -1 before Initialize()
+	int m_currentProgram;
+	// last values of the per-draw uniforms
+	UNIFORM_VALUE m_values[UNIFORM_COUNT];
+
+	// copy of the per-frame view data for CPU side use
+	FRAME_BLOCK m_frameData;
+
+	// uniform buffer objects
+	GLObject m_frameBuffer;
+	GLObject m_lightBuffer;
+	GLObject m_materialBuffer;
+	// every material packed as a std140 array, for per-instance
+	// material indices
+	GLObject m_materialTableBuffer;
+	GLObject m_shadowBuffer;
+	// distance between materials in the material buffer
+	GLsizeiptr m_materialStride;
+	// number of uploaded materials
+	int m_materialCount;
+	// material range currently bound
+	int m_boundMaterial;
+	// counts the uniform updates and buffer binds, may be NULL
+	FrameProfiler* m_pProfiler;
+	// per-frame ring of the frame data, may be NULL
+	StreamBuffer* m_pStreamBuffer;
+
+	// cache the locations of a program and bind its blocks
+	bool ResolveProgram(GLuint program, PROGRAM_STATE& state);
+	// send the cached value of a uniform to the current program
+	void ApplyValue(UNIFORM_ID uniform);
+	// free the uniform buffer objects
+	void DestroyBuffers();
+};
@@ -0,0 +1,379 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.cpp
+// ============
+// render and cache a depth shadow map for each scene light
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "ShadowMaps.h"
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// slope scaled and constant depth offset of the casters,
+	// which keeps lit surfaces from shadowing themselves
+	const float g_PolygonOffsetFactor = 2.0f;
+	const float g_PolygonOffsetUnits = 4.0f;
+	// depth bias and world space normal offset of the lookups
+	const float g_DepthBias = 0.0002f;
+	const float g_NormalOffset = 0.03f;
+	// frustum of a light inside the scene bounds, which cannot
+	// hold all of them
+	const float g_InsideFieldOfViewDegrees = 120.0f;
+	const float g_InsideNearPlane = 0.1f;
+	// fraction added to the bounds radius, so the casters at
+	// the edge stay inside the frustum
+	const float g_RadiusMargin = 1.05f;
+}
+
+/***********************************************************
+ *  ShadowMaps()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+ShadowMaps::ShadowMaps() :
+	m_pShaderCache(NULL),
+	m_programIndex(-1),
+	m_lightViewProjectionLocation(-1),
+	m_locationProgram(0),
+	m_depthTexture(GLObject::OBJECT_TEXTURE),
+	m_framebuffer(GLObject::OBJECT_FRAMEBUFFER),
+	m_instanceBuffer(GLObject::OBJECT_BUFFER),
+	m_lightCount(0),
+	m_bInvalid(true),
+	m_previousFramebuffer(0)
+{
+	for (int i = 0; i < ShaderUniforms::MAX_LIGHT_SOURCES; i++)
+	{
+		m_lightPositions[i] = glm::vec3(0.0f, 0.0f, 0.0f);
+		m_shadowMatrices[i] = glm::mat4(1.0f);
+	}
+	for (int i = 0; i < 4; i++)
+	{
+		m_previousViewport[i] = 0;
+	}
+}
+
+/***********************************************************
+ *  ~ShadowMaps()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+ShadowMaps::~ShadowMaps()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  SetLightPositions()
+ *
+ *  This method is used for setting the lights that cast
+ *  shadows.  Lights past the most the light buffer holds
+ *  are dropped.
+ ***********************************************************/
+void ShadowMaps::SetLightPositions(const glm::vec3* positions, int lightCount)
+{
+	m_lightCount = std::min(std::max(lightCount, 0), (int)ShaderUniforms::MAX_LIGHT_SOURCES);
+	for (int i = 0; i < m_lightCount; i++)
+	{
+		m_lightPositions[i] = positions[i];
+	}
+	m_bInvalid = true;
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for creating a depth map layer for
+ *  each light set, the framebuffer they are drawn through
+ *  and the depth only program.  The maps are bound to their
+ *  texture unit, where they stay for every draw.
+ ***********************************************************/
+bool ShadowMaps::Initialize(ShaderCache* pShaderCache, const char* vertexFilename, const char* fragmentFilename)
+{
+	Destroy();
+
+	if ((NULL == pShaderCache) || (m_lightCount == 0))
+	{
+		return false;
+	}
+
+	if (pShaderCache->LoadProgram(vertexFilename, fragmentFilename) == 0)
+	{
+		std::cout << "Could not build the shadow map shaders, drawing without shadows" << std::endl;
+		return false;
+	}
+	m_pShaderCache = pShaderCache;
+	m_programIndex = pShaderCache->GetProgramCount() - 1;
+	m_locationProgram = pShaderCache->GetProgram(m_programIndex);
+	m_lightViewProjectionLocation = glGetUniformLocation(m_locationProgram, "lightViewProjection");
+
+	// the comparison mode lets the lookups filter the compared
+	// results, rather than the depths
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_depthTexture.Create());
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT24, MAP_SIZE, MAP_SIZE, m_lightCount);
+	}
+	else
+	{
+		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT24, MAP_SIZE, MAP_SIZE, m_lightCount, 0,
+			GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, NULL);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);
+	}
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glActiveTexture(GL_TEXTURE0);
+	m_depthTexture.SetByteSize((long long)MAP_SIZE * MAP_SIZE * 4 * m_lightCount);
+
+	GLint previousFramebuffer = 0;
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer.Create());
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture.Get(), 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)previousFramebuffer);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		std::cout << "Could not create the shadow map framebuffer, drawing without shadows" << std::endl;
+		Destroy();
+		return false;
+	}
+
+	m_instanceBuffer.Create();
+	m_bInvalid = true;
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the maps, their
+ *  framebuffer and the caster instances.  The depth only
+ *  program stays with the shader cache that owns it.
+ ***********************************************************/
+void ShadowMaps::Destroy()
+{
+	m_depthTexture.Reset();
+	m_framebuffer.Reset();
+	m_instanceBuffer.Reset();
+	m_pShaderCache = NULL;
+	m_programIndex = -1;
+	m_lightViewProjectionLocation = -1;
+	m_locationProgram = 0;
+}
+
+/***********************************************************
+ *  IsInitialized()
+ *
+ *  This method is used for checking whether the maps were
+ *  created.
+ ***********************************************************/
+bool ShadowMaps::IsInitialized() const
+{
+	return(m_depthTexture.Get() != 0);
+}
+
+/***********************************************************
+ *  GetLightCount()
+ *
+ *  This method is used for getting the number of lights
+ *  with a shadow map.
+ ***********************************************************/
+int ShadowMaps::GetLightCount() const
+{
+	return(IsInitialized() ? m_lightCount : 0);
+}
+
+/***********************************************************
+ *  Invalidate()
+ *
+ *  This method is used for marking the maps out of date, so
+ *  the next update redraws them.
+ ***********************************************************/
+void ShadowMaps::Invalidate()
+{
+	m_bInvalid = true;
+}
+
+/***********************************************************
+ *  NeedsUpdate()
+ *
+ *  This method is used for checking whether the maps must
+ *  be redrawn before they are sampled, which they also are
+ *  once the depth only program was rebuilt.
+ ***********************************************************/
+bool ShadowMaps::NeedsUpdate() const
+{
+	if (!IsInitialized())
+	{
+		return false;
+	}
+
+	return(m_bInvalid || (m_pShaderCache->GetProgram(m_programIndex) != m_locationProgram));
+}
+
+/***********************************************************
+ *  BeginUpdate()
+ *
+ *  This method is used for starting to redraw the maps.
+ *  The light frustums are fitted to the scene bounds and
+ *  every caster instance is uploaded, since a caster
+ *  outside the view still shadows what is inside it.  A
+ *  rebuilt depth only program has its light matrix location
+ *  resolved again.  The framebuffer and viewport in use are
+ *  saved for EndUpdate().
+ ***********************************************************/
+bool ShadowMaps::BeginUpdate(const SceneBVH::BOUNDS& sceneBounds, const SceneMeshes::INSTANCE_DATA* instances, int instanceCount)
+{
+	GLuint program = (NULL != m_pShaderCache) ? m_pShaderCache->GetProgram(m_programIndex) : 0;
+
+	if (!IsInitialized() || (program == 0) || (instanceCount <= 0))
+	{
+		return false;
+	}
+	if (program != m_locationProgram)
+	{
+		m_locationProgram = program;
+		m_lightViewProjectionLocation = glGetUniformLocation(program, "lightViewProjection");
+	}
+
+	UpdateShadowMatrices(sceneBounds);
+
+	GLsizeiptr size = sizeof(SceneMeshes::INSTANCE_DATA) * instanceCount;
+	glBindBuffer(GL_ARRAY_BUFFER, m_instanceBuffer.Get());
+	glBufferData(GL_ARRAY_BUFFER, size, instances, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	m_instanceBuffer.SetByteSize(size);
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, m_previousViewport);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer.Get());
+	glViewport(0, 0, MAP_SIZE, MAP_SIZE);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(g_PolygonOffsetFactor, g_PolygonOffsetUnits);
+	glUseProgram(program);
+
+	return true;
+}
+
+/***********************************************************
+ *  BeginLight()
+ *
+ *  This method is used for attaching the map layer of a
+ *  light, clearing it and setting the light's matrix in the
+ *  depth only program.
+ ***********************************************************/
+void ShadowMaps::BeginLight(int lightIndex)
+{
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_depthTexture.Get(), 0, lightIndex);
+	glClear(GL_DEPTH_BUFFER_BIT);
+	glUniformMatrix4fv(m_lightViewProjectionLocation, 1, GL_FALSE, glm::value_ptr(m_shadowMatrices[lightIndex]));
+}
+
+/***********************************************************
+ *  EndUpdate()
+ *
+ *  This method is used for putting back the framebuffer and
+ *  viewport saved by BeginUpdate() and marking the maps up
+ *  to date.  The caller makes its own program current
+ *  again.
+ ***********************************************************/
+void ShadowMaps::EndUpdate()
+{
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glBindFramebuffer(GL_FRAMEBUFFER, (GLuint)m_previousFramebuffer);
+	glViewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+	m_bInvalid = false;
+}
+
+/***********************************************************
+ *  GetInstanceBuffer()
+ *
+ *  This method is used for getting the buffer the caster
+ *  instances were uploaded into.
+ ***********************************************************/
+GLuint ShadowMaps::GetInstanceBuffer() const
+{
+	return(m_instanceBuffer.Get());
+}
+
+/***********************************************************
+ *  GetShadowMatrices()
+ *
+ *  This method is used for getting the projection and view
+ *  of each light, which take a world position into its
+ *  shadow map.
+ ***********************************************************/
+const glm::mat4* ShadowMaps::GetShadowMatrices() const
+{
+	return(m_shadowMatrices);
+}
+
+/***********************************************************
+ *  GetShadowParameters()
+ *
+ *  This method is used for getting the depth bias, the
+ *  normal offset and the texel size of the maps for the
+ *  lookups.
+ ***********************************************************/
+glm::vec4 ShadowMaps::GetShadowParameters() const
+{
+	return(glm::vec4(g_DepthBias, g_NormalOffset, 1.0f / MAP_SIZE, 0.0f));
+}
+
+/***********************************************************
+ *  UpdateShadowMatrices()
+ *
+ *  This method is used for aiming each light at the center
+ *  of the scene bounds with a perspective frustum around
+ *  the sphere that holds them.  The near and far planes
+ *  touch the sphere, which keeps the depth precision on the
+ *  scene.  A light inside the sphere looks at the center
+ *  with a wide fixed frustum instead.
+ ***********************************************************/
+void ShadowMaps::UpdateShadowMatrices(const SceneBVH::BOUNDS& sceneBounds)
+{
+	glm::vec3 center = (sceneBounds.minimum + sceneBounds.maximum) * 0.5f;
+	float radius = std::max(glm::length(sceneBounds.maximum - sceneBounds.minimum) * 0.5f * g_RadiusMargin, 0.01f);
+
+	for (int i = 0; i < m_lightCount; i++)
+	{
+		glm::vec3 toCenter = center - m_lightPositions[i];
+		float distance = glm::length(toCenter);
+		glm::vec3 direction = (distance > 0.0001f) ? toCenter / distance : glm::vec3(0.0f, -1.0f, 0.0f);
+		// a light straight above or below needs another up axis
+		glm::vec3 up = (fabsf(direction.y) > 0.99f) ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+
+		float fieldOfView = glm::radians(g_InsideFieldOfViewDegrees);
+		float nearPlane = g_InsideNearPlane;
+		float farPlane = distance + radius;
+		if (distance > radius)
+		{
+			fieldOfView = 2.0f * asinf(radius / distance);
+			nearPlane = distance - radius;
+		}
+
+		glm::mat4 view = glm::lookAt(m_lightPositions[i], m_lightPositions[i] + direction, up);
+		glm::mat4 projection = glm::perspective(fieldOfView, 1.0f, std::max(nearPlane, g_InsideNearPlane), farPlane);
+		m_shadowMatrices[i] = projection * view;
+	}
+}
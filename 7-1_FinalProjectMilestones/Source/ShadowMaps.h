@@ -0,0 +1,107 @@
+///////////////////////////////////////////////////////////////////////////////
+// shadowmaps.h
+// ============
+// render and cache a depth shadow map for each scene light
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLObject.h"
+#include "SceneBVH.h"
+#include "SceneMeshes.h"
+#include "ShaderCache.h"
+#include "ShaderUniforms.h"
+
+/***********************************************************
+ *  ShadowMaps
+ *
+ *  This class keeps one depth map per light in the layers
+ *  of a single array texture, sampled with hardware depth
+ *  comparison.  Each light looks at the center of the scene
+ *  bounds with a perspective frustum just wide enough to
+ *  hold them, so the maps spend their texels on the scene.
+ *  The casters are drawn with a depth only program through
+ *  the instanced path, from a copy of the instances that
+ *  ignores the view culling.  The maps are only redrawn
+ *  after Invalidate(), so a scene where nothing moves pays
+ *  for them once.
+ ***********************************************************/
+class ShadowMaps
+{
+public:
+	// constructor
+	ShadowMaps();
+	// destructor
+	~ShadowMaps();
+
+	// width and height of every shadow map
+	static const int MAP_SIZE = 2048;
+	// texture unit the shadow maps stay bound to
+	static const int TEXTURE_UNIT = 1;
+
+	// set the positions of the lights that cast shadows - every
+	// map is redrawn on the next update
+	void SetLightPositions(const glm::vec3* positions, int lightCount);
+	// create the maps of the lights set and load the depth only
+	// program - false when they cannot be made
+	bool Initialize(ShaderCache* pShaderCache, const char* vertexFilename, const char* fragmentFilename);
+	// free the maps and forget the program
+	void Destroy();
+	// true once the maps were created
+	bool IsInitialized() const;
+	// get the number of lights with a shadow map
+	int GetLightCount() const;
+
+	// mark the maps out of date, such as when a caster moved
+	void Invalidate();
+	// true when the maps must be redrawn before they are used
+	bool NeedsUpdate() const;
+
+	// fit the light frustums to the scene bounds, upload every
+	// caster instance and bind the depth only program and the
+	// map framebuffer - the caller draws the casters for each
+	// light between BeginLight() calls, then calls EndUpdate()
+	bool BeginUpdate(const SceneBVH::BOUNDS& sceneBounds, const SceneMeshes::INSTANCE_DATA* instances, int instanceCount);
+	// clear the map of a light and draw into it
+	void BeginLight(int lightIndex);
+	// put the framebuffer and viewport back and mark the maps
+	// up to date
+	void EndUpdate();
+
+	// get the buffer the caster instances were uploaded into
+	GLuint GetInstanceBuffer() const;
+	// get the world to shadow map matrix of every light
+	const glm::mat4* GetShadowMatrices() const;
+	// get the depth bias, normal offset and texel size the
+	// shaders sample the maps with
+	glm::vec4 GetShadowParameters() const;
+
+private:
+	// fit the frustum of each light to the scene bounds
+	void UpdateShadowMatrices(const SceneBVH::BOUNDS& sceneBounds);
+
+	// builds the depth only program, may be NULL
+	ShaderCache* m_pShaderCache;
+	// index of the depth only program in the shader cache,
+	// read by index since a rebuild can replace it
+	int m_programIndex;
+	// light matrix location and the program it was resolved
+	// for, resolved again when a rebuild replaces it
+	GLint m_lightViewProjectionLocation;
+	GLuint m_locationProgram;
+	GLObject m_depthTexture;
+	GLObject m_framebuffer;
+	GLObject m_instanceBuffer;
+	glm::vec3 m_lightPositions[ShaderUniforms::MAX_LIGHT_SOURCES];
+	glm::mat4 m_shadowMatrices[ShaderUniforms::MAX_LIGHT_SOURCES];
+	int m_lightCount;
+	// true when the maps are older than the casters or lights
+	bool m_bInvalid;
+	// framebuffer and viewport in use before BeginUpdate()
+	GLint m_previousFramebuffer;
+	GLint m_previousViewport[4];
+};
@@ -0,0 +1,318 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.cpp
+// ============
+// stream the per-frame dynamic data through one persistently mapped
+// buffer split into fenced frame regions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "StreamBuffer.h"
+
+#include <algorithm>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// longest wait on a region fence, in nanoseconds - a region
+	// is three frames old by then, so this only ends a GPU hang
+	const GLuint64 g_RegionFenceTimeout = 1000000000;
+	// growth of the regions past the largest frame seen, so a
+	// slowly growing scene does not grow them every frame
+	const double g_RegionGrowth = 1.5;
+}
+
+/***********************************************************
+ *  StreamBuffer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+StreamBuffer::StreamBuffer() :
+	m_buffer(GLObject::OBJECT_BUFFER),
+	m_pMemory(NULL),
+	m_regionSize(0),
+	m_currentRegion(0),
+	m_usedBytes(0),
+	m_requestedBytes(0),
+	m_bufferVersion(0),
+	m_uniformAlignment(256),
+	m_pProfiler(NULL)
+{
+	for (int i = 0; i < FRAME_REGION_COUNT; i++)
+	{
+		m_regionFences[i] = NULL;
+	}
+}
+
+/***********************************************************
+ *  ~StreamBuffer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+StreamBuffer::~StreamBuffer()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for creating the buffer with
+ *  immutable storage for every region and mapping it once.
+ *  Coherent writes are seen by the GPU without any flush,
+ *  so the fences are the only synchronization.
+ ***********************************************************/
+bool StreamBuffer::Create(GLsizeiptr regionSize)
+{
+	Destroy();
+
+	if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage)
+	{
+		std::cout << "Persistent buffer mapping needs OpenGL 4.4, streaming with buffer uploads" << std::endl;
+		return false;
+	}
+
+	GLint uniformAlignment = 256;
+	glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &uniformAlignment);
+	m_uniformAlignment = uniformAlignment;
+
+	// every buffer binding reads from the one buffer, so any
+	// target works for creating it
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+	GLsizeiptr bufferSize = regionSize * FRAME_REGION_COUNT;
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.Create());
+	glBufferStorage(GL_COPY_WRITE_BUFFER, bufferSize, NULL, flags);
+	m_pMemory = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, bufferSize, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+
+	if (NULL == m_pMemory)
+	{
+		std::cout << "Could not map the stream buffer, streaming with buffer uploads" << std::endl;
+		m_buffer.Reset();
+		return false;
+	}
+	m_buffer.SetByteSize(bufferSize);
+
+	m_regionSize = regionSize;
+	m_currentRegion = 0;
+	m_usedBytes = 0;
+	m_bufferVersion++;
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for unmapping and freeing the
+ *  buffer.  Without a current context there is nothing left
+ *  to unmap or free.
+ ***********************************************************/
+void StreamBuffer::Destroy()
+{
+	bool bHasContext = GLObject::HasContext();
+
+	for (int i = 0; i < FRAME_REGION_COUNT; i++)
+	{
+		if ((NULL != m_regionFences[i]) && bHasContext)
+		{
+			glDeleteSync(m_regionFences[i]);
+		}
+		m_regionFences[i] = NULL;
+	}
+	if ((m_buffer.Get() != 0) && (NULL != m_pMemory) && bHasContext)
+	{
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_buffer.Get());
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+	m_pMemory = NULL;
+	m_buffer.Reset();
+	m_regionSize = 0;
+	m_usedBytes = 0;
+}
+
+/***********************************************************
+ *  BeginFrame()
+ *
+ *  This method is used for moving on to the region of the
+ *  next frame.  When the last frame asked for more than a
+ *  region holds, every region is waited for and the buffer
+ *  is made again at the larger size.
+ ***********************************************************/
+void StreamBuffer::BeginFrame()
+{
+	if (NULL == m_pMemory)
+	{
+		return;
+	}
+
+	if (m_requestedBytes > m_regionSize)
+	{
+		GLsizeiptr regionSize = (GLsizeiptr)(m_requestedBytes * g_RegionGrowth);
+
+		for (int i = 0; i < FRAME_REGION_COUNT; i++)
+		{
+			WaitForRegion(i);
+		}
+		if (!Create(regionSize))
+		{
+			std::cout << "Could not grow the stream buffer to " << regionSize << " bytes per frame" << std::endl;
+		}
+		m_requestedBytes = 0;
+		return;
+	}
+
+	m_currentRegion = (m_currentRegion + 1) % FRAME_REGION_COUNT;
+	m_usedBytes = 0;
+	WaitForRegion(m_currentRegion);
+}
+
+/***********************************************************
+ *  EndFrame()
+ *
+ *  This method is used for fencing every command of the
+ *  frame, after which its region can be written again once
+ *  the fence signals.
+ ***********************************************************/
+void StreamBuffer::EndFrame()
+{
+	if (NULL == m_pMemory)
+	{
+		return;
+	}
+
+	if (NULL != m_regionFences[m_currentRegion])
+	{
+		glDeleteSync(m_regionFences[m_currentRegion]);
+	}
+	m_regionFences[m_currentRegion] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+/***********************************************************
+ *  Allocate()
+ *
+ *  This method is used for bump allocating memory in the
+ *  region of the current frame.  The alignment does not
+ *  have to be a power of two, so instance data can start at
+ *  a whole instance for a base instance draw.  The memory
+ *  is only for the draws of this frame - the fence of a
+ *  region covers one frame, so later frames write their
+ *  data again.  When the region is full the request is
+ *  remembered for growing the buffer, and the caller
+ *  uploads the data its own way for this frame.
+ ***********************************************************/
+bool StreamBuffer::Allocate(GLsizeiptr size, GLsizeiptr alignment, ALLOCATION& allocation)
+{
+	if ((NULL == m_pMemory) || (size <= 0))
+	{
+		return false;
+	}
+	if (alignment < 1)
+	{
+		alignment = 1;
+	}
+
+	GLintptr regionStart = (GLintptr)m_currentRegion * m_regionSize;
+	GLintptr offset = regionStart + m_usedBytes;
+	offset = ((offset + alignment - 1) / alignment) * alignment;
+
+	GLsizeiptr usedBytes = (GLsizeiptr)(offset - regionStart) + size;
+	if (usedBytes > m_regionSize)
+	{
+		m_requestedBytes = std::max(m_requestedBytes, usedBytes);
+		return false;
+	}
+
+	m_usedBytes = usedBytes;
+	m_requestedBytes = std::max(m_requestedBytes, usedBytes);
+	allocation.pMemory = m_pMemory + offset;
+	allocation.offset = offset;
+
+	return true;
+}
+
+/***********************************************************
+ *  IsMapped()
+ *
+ *  This method is used for checking whether allocations can
+ *  be made.
+ ***********************************************************/
+bool StreamBuffer::IsMapped() const
+{
+	return(NULL != m_pMemory);
+}
+
+/***********************************************************
+ *  GetBuffer()
+ *
+ *  This method is used for getting the OpenGL name of the
+ *  buffer the allocations are in.
+ ***********************************************************/
+GLuint StreamBuffer::GetBuffer() const
+{
+	return(m_buffer.Get());
+}
+
+/***********************************************************
+ *  GetBufferVersion()
+ *
+ *  This method is used for getting the number of times the
+ *  buffer was created.  Vertex arrays attached to the old
+ *  buffer keep it alive, so callers compare versions rather
+ *  than names to know when to attach them again.
+ ***********************************************************/
+int StreamBuffer::GetBufferVersion() const
+{
+	return(m_bufferVersion);
+}
+
+/***********************************************************
+ *  GetUniformAlignment()
+ *
+ *  This method is used for getting the offset alignment of
+ *  uniform buffer ranges bound from the buffer.
+ ***********************************************************/
+GLsizeiptr StreamBuffer::GetUniformAlignment() const
+{
+	return(m_uniformAlignment);
+}
+
+/***********************************************************
+ *  SetProfiler()
+ *
+ *  This method is used for setting the profiler that counts
+ *  the waits on regions the GPU had not finished with.
+ ***********************************************************/
+void StreamBuffer::SetProfiler(FrameProfiler* pProfiler)
+{
+	m_pProfiler = pProfiler;
+}
+
+/***********************************************************
+ *  WaitForRegion()
+ *
+ *  This method is used for waiting until the GPU is done
+ *  with the commands that read a region.  The fence is
+ *  polled first, so only a real stall is counted.
+ ***********************************************************/
+void StreamBuffer::WaitForRegion(int region)
+{
+	if (NULL == m_regionFences[region])
+	{
+		return;
+	}
+
+	GLenum result = glClientWaitSync(m_regionFences[region], 0, 0);
+	if ((result != GL_ALREADY_SIGNALED) && (result != GL_CONDITION_SATISFIED))
+	{
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->AddCount(FrameProfiler::COUNTER_SYNC_STALLS);
+		}
+		glClientWaitSync(m_regionFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, g_RegionFenceTimeout);
+	}
+
+	glDeleteSync(m_regionFences[region]);
+	m_regionFences[region] = NULL;
+}
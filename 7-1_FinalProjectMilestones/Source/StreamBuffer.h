@@ -0,0 +1,103 @@
+///////////////////////////////////////////////////////////////////////////////
+// streambuffer.h
+// ============
+// stream the per-frame dynamic data through one persistently mapped
+// buffer split into fenced frame regions
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "FrameProfiler.h"
+#include "GLObject.h"
+
+/***********************************************************
+ *  StreamBuffer
+ *
+ *  This class keeps one buffer mapped with persistent and
+ *  coherent writes for the life of the context, split into
+ *  one region per frame in flight.  Each frame the data
+ *  that changes every frame, such as the packed instances
+ *  and the view data, is bump allocated from the region of
+ *  that frame and written straight into the mapping.  A
+ *  fence placed after the frame is waited on before its
+ *  region is written again, so the driver never has to
+ *  synchronize or orphan the buffer itself.  A frame that
+ *  runs out of room makes the regions grow at the start of
+ *  the next one.
+ ***********************************************************/
+class StreamBuffer
+{
+public:
+	// constructor
+	StreamBuffer();
+	// destructor
+	~StreamBuffer();
+
+	// frames in flight, each with its own region
+	static const int FRAME_REGION_COUNT = 3;
+	// starting size of each region, in bytes
+	static const int DEFAULT_REGION_SIZE = 4 * 1024 * 1024;
+
+	// memory handed out for the current frame
+	struct ALLOCATION
+	{
+		// mapped memory to write the data into
+		void* pMemory;
+		// offset of the memory in the buffer
+		GLintptr offset;
+	};
+
+	// create and map the buffer - false without OpenGL 4.4
+	// buffer storage, so callers can keep their own uploads
+	bool Create(GLsizeiptr regionSize = DEFAULT_REGION_SIZE);
+	// unmap and free the buffer
+	void Destroy();
+
+	// wait for the GPU to finish with the region of the new
+	// frame, growing the regions first when the last frame ran
+	// out of room
+	void BeginFrame();
+	// fence the commands that read the region of this frame
+	void EndFrame();
+
+	// allocate memory in the region of the current frame at an
+	// offset that is a multiple of alignment - false when the
+	// region is full or the buffer is not mapped
+	bool Allocate(GLsizeiptr size, GLsizeiptr alignment, ALLOCATION& allocation);
+
+	// true once the buffer is mapped
+	bool IsMapped() const;
+	// get the OpenGL name of the buffer, which changes when the
+	// regions grow
+	GLuint GetBuffer() const;
+	// get the number of times the buffer was created - a grown
+	// buffer can get the name of the one it replaced
+	int GetBufferVersion() const;
+	// get the alignment of uniform buffer ranges
+	GLsizeiptr GetUniformAlignment() const;
+
+	// set the profiler that counts the fence stalls, or NULL
+	void SetProfiler(FrameProfiler* pProfiler);
+
+private:
+	// wait for the fence of a region and free it
+	void WaitForRegion(int region);
+
+	GLObject m_buffer;
+	unsigned char* m_pMemory;
+	GLsizeiptr m_regionSize;
+	// fence after the last frame that used each region
+	GLsync m_regionFences[FRAME_REGION_COUNT];
+	// region of the current frame and the bytes used in it
+	int m_currentRegion;
+	GLsizeiptr m_usedBytes;
+	// most bytes a frame asked for, to grow the regions to
+	GLsizeiptr m_requestedBytes;
+	int m_bufferVersion;
+	GLsizeiptr m_uniformAlignment;
+	// counts the waits on unfinished regions, may be NULL
+	FrameProfiler* m_pProfiler;
+};
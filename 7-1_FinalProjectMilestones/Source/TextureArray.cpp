@@ -0,0 +1,410 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturearray.cpp
+// ============
+// pack the scene textures into the layers of a single OpenGL 2D array
+// texture so that they can all be sampled without rebinding
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureArray.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <vector>
+
+// declaration of global variables
+namespace
+{
+	// every layer is stored as BC3 (DXT5), 1 byte per pixel
+	const GLenum g_CompressedFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+	// BC3 block of neutral grey shown until the image of a layer
+	// is uploaded - opaque alpha and grey as both 565 endpoints
+	const GLubyte g_PlaceholderBlock[TextureCache::BLOCK_BYTES] =
+	{
+		255, 255, 0, 0, 0, 0, 0, 0,
+		0x10, 0x84, 0x10, 0x84, 0, 0, 0, 0
+	};
+	// longest wait on an upload fence before giving up, in nanoseconds
+	const GLuint64 g_UploadFenceTimeout = 1000000000;
+}
+
+/***********************************************************
+ *  TextureArray()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureArray::TextureArray()
+	: m_arrayTexture(GLObject::OBJECT_TEXTURE),
+	m_uploadBuffer(GLObject::OBJECT_BUFFER)
+{
+	m_pUploadMemory = NULL;
+	for (int i = 0; i < UPLOAD_REGION_COUNT; i++)
+	{
+		m_uploadFences[i] = NULL;
+	}
+	m_nextUploadRegion = 0;
+	m_layerCount = 0;
+	m_layerSize = 0;
+	m_levelCount = 0;
+}
+
+/***********************************************************
+ *  ~TextureArray()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureArray::~TextureArray()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Create()
+ *
+ *  This method is used for creating the compressed array
+ *  texture with a fixed number of layers, every level
+ *  filled with the placeholder block, and the persistently
+ *  mapped upload buffer.  The placeholder is written one
+ *  layer at a time, so a large array does not need a large
+ *  staging copy.  Without buffer storage there is no upload
+ *  buffer and the images are uploaded from client memory.
+ ***********************************************************/
+bool TextureArray::Create(int layerCount, int layerSize, int levelCount)
+{
+	GLint maxLayers = 256;
+	glGetIntegerv(GL_MAX_ARRAY_TEXTURE_LAYERS, &maxLayers);
+
+	if (m_arrayTexture.Get() != 0)
+	{
+		std::cout << "Texture array was already created" << std::endl;
+		return false;
+	}
+	if ((layerCount <= 0) || (layerCount > maxLayers))
+	{
+		std::cout << "Texture array cannot hold " << layerCount << " layers, the limit is " << maxLayers << std::endl;
+		return false;
+	}
+	if ((layerSize <= 0) || (layerSize > LAYER_SIZE) ||
+		(levelCount < 0) || (levelCount > TextureCache::GetLevelCount(layerSize)))
+	{
+		std::cout << "Texture array layers cannot be " << layerSize << " x " << layerSize << " with " << levelCount << " levels" << std::endl;
+		return false;
+	}
+	if (!GLEW_EXT_texture_compression_s3tc)
+	{
+		std::cout << "S3TC texture compression is not supported" << std::endl;
+		return false;
+	}
+
+	if (levelCount == 0)
+	{
+		levelCount = TextureCache::GetLevelCount(layerSize);
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_arrayTexture.Create());
+	if (GLEW_VERSION_4_2 || GLEW_ARB_texture_storage)
+	{
+		glTexStorage3D(GL_TEXTURE_2D_ARRAY, levelCount, g_CompressedFormat, layerSize, layerSize, layerCount);
+	}
+	else
+	{
+		// without immutable storage every level is allocated on
+		// its own, and the levels past the last one are excluded
+		// so the texture is complete
+		for (GLint level = 0; level < levelCount; level++)
+		{
+			int levelSize = std::max(layerSize >> level, 1);
+
+			glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, level, g_CompressedFormat,
+				levelSize, levelSize, layerCount, 0,
+				TextureCache::GetLevelBytes(layerSize, level) * layerCount, NULL);
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BASE_LEVEL, 0);
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, levelCount - 1);
+	}
+
+	// set the texture wrapping parameters
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	// set texture filtering parameters
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+	// every level is filled so the placeholder is sampled at any
+	// distance - compressed textures cannot be cleared directly
+	std::vector<GLubyte> placeholder;
+	long long textureBytes = 0;
+	for (GLint level = 0; level < levelCount; level++)
+	{
+		int levelSize = std::max(layerSize >> level, 1);
+		int levelBytes = TextureCache::GetLevelBytes(layerSize, level);
+
+		textureBytes += (long long)levelBytes * layerCount;
+		placeholder.resize(levelBytes);
+		for (int offset = 0; offset < levelBytes; offset += TextureCache::BLOCK_BYTES)
+		{
+			memcpy(&placeholder[offset], g_PlaceholderBlock, TextureCache::BLOCK_BYTES);
+		}
+		for (int layer = 0; layer < layerCount; layer++)
+		{
+			glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+				levelSize, levelSize, 1, g_CompressedFormat, levelBytes, placeholder.data());
+		}
+	}
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+	m_arrayTexture.SetByteSize(textureBytes);
+
+	// the upload buffer stays mapped for the life of the array
+	if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage)
+	{
+		std::cout << "Persistent buffer mapping needs OpenGL 4.4, images are uploaded from client memory" << std::endl;
+	}
+	else
+	{
+		GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer.Create());
+		glBufferStorage(GL_PIXEL_UNPACK_BUFFER, (GLsizeiptr)UPLOAD_REGION_SIZE * UPLOAD_REGION_COUNT, NULL, flags);
+		m_uploadBuffer.SetByteSize((long long)UPLOAD_REGION_SIZE * UPLOAD_REGION_COUNT);
+		m_pUploadMemory = (unsigned char*)glMapBufferRange(
+			GL_PIXEL_UNPACK_BUFFER, 0, (GLsizeiptr)UPLOAD_REGION_SIZE * UPLOAD_REGION_COUNT, flags);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		if (NULL == m_pUploadMemory)
+		{
+			std::cout << "Could not map the texture upload buffer, images are uploaded from client memory" << std::endl;
+			m_uploadBuffer.Reset();
+		}
+	}
+
+	m_layerCount = layerCount;
+	m_layerSize = layerSize;
+	m_levelCount = levelCount;
+
+	return true;
+}
+
+/***********************************************************
+ *  UploadLayer()
+ *
+ *  This method is used for copying the compressed mip chain
+ *  of an image into every level of a layer of the array.
+ ***********************************************************/
+bool TextureArray::UploadLayer(
+	int layer,
+	const TextureCache::COMPRESSED_IMAGE& image)
+{
+	return(UploadLevels(layer, image, 0, m_levelCount));
+}
+
+/***********************************************************
+ *  UploadLevels()
+ *
+ *  This method is used for copying a range of levels of a
+ *  layer from an image.  The image may be larger than the
+ *  layers, its first levels then being skipped, so level 0
+ *  of the array takes the image level of the same size.
+ *  The levels are contiguous in the image, so they go
+ *  through the mapped upload buffer as one copy, or from
+ *  client memory when they do not fit in an upload region.
+ ***********************************************************/
+bool TextureArray::UploadLevels(
+	int layer,
+	const TextureCache::COMPRESSED_IMAGE& image,
+	int firstLevel,
+	int levelCount)
+{
+	if ((m_arrayTexture.Get() == 0) || (layer < 0) || (layer >= m_layerCount))
+	{
+		std::cout << "Texture array has no layer " << layer << std::endl;
+		return false;
+	}
+
+	// image levels skipped before the first level of the array
+	int levelOffset = TextureCache::GetLevelCount(image.size) - TextureCache::GetLevelCount(m_layerSize);
+
+	if ((levelOffset < 0) || ((image.size >> levelOffset) != m_layerSize) ||
+		(image.levelCount != TextureCache::GetLevelCount(image.size)))
+	{
+		std::cout << "Texture array layers need an image of " << m_layerSize << " x " << m_layerSize << " or larger with a full mip chain" << std::endl;
+		return false;
+	}
+	if ((firstLevel < 0) || (levelCount <= 0) || (firstLevel + levelCount > m_levelCount))
+	{
+		std::cout << "Texture array has no levels " << firstLevel << " to " << (firstLevel + levelCount - 1) << std::endl;
+		return false;
+	}
+
+	size_t firstByte = 0;
+	size_t byteCount = 0;
+	for (int level = 0; level < levelOffset + firstLevel + levelCount; level++)
+	{
+		size_t levelBytes = (size_t)TextureCache::GetLevelBytes(image.size, level);
+
+		if (level < levelOffset + firstLevel)
+		{
+			firstByte += levelBytes;
+		}
+		else
+		{
+			byteCount += levelBytes;
+		}
+	}
+	if (firstByte + byteCount > image.data.size())
+	{
+		std::cout << "Texture array image data is shorter than its mip chain" << std::endl;
+		return false;
+	}
+
+	// with an unpack buffer bound the data pointer is an offset
+	// into the buffer instead of an address
+	const unsigned char* source = image.data.data() + firstByte;
+	size_t offset = 0;
+	int region = -1;
+
+	if ((NULL != m_pUploadMemory) && (byteCount <= (size_t)UPLOAD_REGION_SIZE))
+	{
+		region = m_nextUploadRegion;
+		m_nextUploadRegion = (m_nextUploadRegion + 1) % UPLOAD_REGION_COUNT;
+
+		// wait until the GPU has finished reading the region
+		if (NULL != m_uploadFences[region])
+		{
+			glClientWaitSync(m_uploadFences[region], GL_SYNC_FLUSH_COMMANDS_BIT, g_UploadFenceTimeout);
+			glDeleteSync(m_uploadFences[region]);
+			m_uploadFences[region] = NULL;
+		}
+
+		offset = (size_t)region * UPLOAD_REGION_SIZE;
+		memcpy(m_pUploadMemory + offset, source, byteCount);
+
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer.Get());
+		source = NULL;
+	}
+
+	GLint previousTexture = 0;
+	glGetIntegerv(GL_TEXTURE_BINDING_2D_ARRAY, &previousTexture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_arrayTexture.Get());
+
+	for (int level = firstLevel; level < firstLevel + levelCount; level++)
+	{
+		int levelSize = std::max(m_layerSize >> level, 1);
+		int levelBytes = TextureCache::GetLevelBytes(m_layerSize, level);
+
+		glCompressedTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, layer,
+			levelSize, levelSize, 1, g_CompressedFormat, levelBytes,
+			(NULL != source) ? (const void*)(source + offset) : (const void*)offset);
+		offset += levelBytes;
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, previousTexture);
+
+	if (region >= 0)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		m_uploadFences[region] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for binding the array texture to a
+ *  texture unit.
+ ***********************************************************/
+void TextureArray::Bind(GLuint textureUnit) const
+{
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_arrayTexture.Get());
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the array texture and
+ *  the upload buffer.  Without a current context there is
+ *  nothing left to unmap or free.
+ ***********************************************************/
+void TextureArray::Destroy()
+{
+	bool bHasContext = GLObject::HasContext();
+
+	for (int i = 0; i < UPLOAD_REGION_COUNT; i++)
+	{
+		if ((NULL != m_uploadFences[i]) && bHasContext)
+		{
+			glDeleteSync(m_uploadFences[i]);
+		}
+		m_uploadFences[i] = NULL;
+	}
+	if ((m_uploadBuffer.Get() != 0) && (NULL != m_pUploadMemory) && bHasContext)
+	{
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_uploadBuffer.Get());
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+	m_pUploadMemory = NULL;
+	m_uploadBuffer.Reset();
+	m_arrayTexture.Reset();
+	m_nextUploadRegion = 0;
+	m_layerCount = 0;
+	m_layerSize = 0;
+	m_levelCount = 0;
+}
+
+/***********************************************************
+ *  GetID()
+ *
+ *  This method is used for getting the OpenGL name of the
+ *  array texture.
+ ***********************************************************/
+GLuint TextureArray::GetID() const
+{
+	return(m_arrayTexture.Get());
+}
+
+/***********************************************************
+ *  GetLayerCount()
+ *
+ *  This method is used for getting the number of layers of
+ *  the array texture.
+ ***********************************************************/
+int TextureArray::GetLayerCount() const
+{
+	return(m_layerCount);
+}
+
+/***********************************************************
+ *  GetLayerSize()
+ *
+ *  This method is used for getting the width and height of
+ *  the first level of every layer.
+ ***********************************************************/
+int TextureArray::GetLayerSize() const
+{
+	return(m_layerSize);
+}
+
+/***********************************************************
+ *  GetLevelCount()
+ *
+ *  This method is used for getting the number of levels of
+ *  every layer.
+ ***********************************************************/
+int TextureArray::GetLevelCount() const
+{
+	return(m_levelCount);
+}
+
+/***********************************************************
+ *  GetByteSize()
+ *
+ *  This method is used for getting the video memory of the
+ *  array texture, without the upload buffer.
+ ***********************************************************/
+long long TextureArray::GetByteSize() const
+{
+	return(m_arrayTexture.GetByteSize());
+}
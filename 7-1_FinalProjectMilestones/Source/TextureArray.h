@@ -0,0 +1,92 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturearray.h
+// ============
+// pack the scene textures into the layers of a single OpenGL 2D array
+// texture so that they can all be sampled without rebinding
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+
+#include "GLObject.h"
+#include "TextureCache.h"
+
+/***********************************************************
+ *  TextureArray
+ *
+ *  This class holds the scene textures in the layers of one
+ *  BC3 compressed GL_TEXTURE_2D_ARRAY.  A texture is
+ *  identified by its layer index alone, so there is no
+ *  limit of 16 texture units and no rebinding between
+ *  objects.  The layers are allocated up front with a
+ *  placeholder color and filled in with the cached mip
+ *  chains as they arrive, through a persistently mapped
+ *  pixel unpack buffer.  An array can be smaller than the
+ *  cached images or hold only their finest levels, so the
+ *  texture streamer keeps the coarse levels of every image
+ *  in one array and the fine levels of a few in another.
+ ***********************************************************/
+class TextureArray
+{
+public:
+	// constructor
+	TextureArray();
+	// destructor
+	~TextureArray();
+
+	// width and height of the scene texture images
+	static const int LAYER_SIZE = 1024;
+	// size of each region of the pixel upload buffer, which
+	// fits the whole compressed mip chain of one layer
+	static const int UPLOAD_REGION_SIZE = 2 * 1024 * 1024;
+	// regions of the upload buffer used in turn, so a new
+	// image never waits on the previous copy
+	static const int UPLOAD_REGION_COUNT = 2;
+
+	// create the array texture with placeholder layers of a
+	// size, with that many levels - 0 for a full mip chain
+	bool Create(int layerCount, int layerSize = LAYER_SIZE, int levelCount = 0);
+	// copy the compressed mip chain of an image into a layer
+	bool UploadLayer(
+		int layer,
+		const TextureCache::COMPRESSED_IMAGE& image);
+	// copy some levels of the array from the matching levels of
+	// a larger or equal image into a layer
+	bool UploadLevels(
+		int layer,
+		const TextureCache::COMPRESSED_IMAGE& image,
+		int firstLevel,
+		int levelCount);
+	// bind the array texture to the passed in texture unit
+	void Bind(GLuint textureUnit) const;
+	// free the array texture and the upload buffer
+	void Destroy();
+
+	// get the OpenGL name of the array texture
+	GLuint GetID() const;
+	// get the number of layers
+	int GetLayerCount() const;
+	// get the size of the first level and the number of levels
+	int GetLayerSize() const;
+	int GetLevelCount() const;
+	// get the video memory of the array texture
+	long long GetByteSize() const;
+
+private:
+	// the array texture
+	GLObject m_arrayTexture;
+	// persistently mapped pixel unpack buffer
+	GLObject m_uploadBuffer;
+	unsigned char* m_pUploadMemory;
+	// fence of the last copy out of each upload region
+	GLsync m_uploadFences[UPLOAD_REGION_COUNT];
+	int m_nextUploadRegion;
+	// number of layers in the array texture
+	int m_layerCount;
+	// size of the first level of every layer
+	int m_layerSize;
+	// number of levels of every layer
+	int m_levelCount;
+};
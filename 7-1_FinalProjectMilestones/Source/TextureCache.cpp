@@ -0,0 +1,607 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.cpp
+// ============
+// convert texture images into BC3 compressed mip chains and keep them in
+// DDS files next to the source images for the next launch
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureCache.h"
+
+#include "stb_image.h"
+
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+
+// declaration of global variables
+namespace
+{
+	// DDS file layout values used by the cache files
+	const uint32_t g_DDSMagic = 0x20534444;			// "DDS "
+	const uint32_t g_DXT5FourCC = 0x35545844;		// "DXT5"
+	const uint32_t g_DDSHeaderSize = 124;
+	const uint32_t g_DDSPixelFormatSize = 32;
+	const uint32_t g_DDSHeaderFlags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000;
+	const uint32_t g_DDSPixelFormatFourCC = 0x4;
+	const uint32_t g_DDSCaps = 0x8 | 0x1000 | 0x400000;
+	// DDS header words, counted after the magic number
+	const int g_DDSHeaderWords = 31;
+	const int g_HeaderFlagsWord = 1;
+	const int g_HeaderHeightWord = 2;
+	const int g_HeaderWidthWord = 3;
+	const int g_HeaderLinearSizeWord = 4;
+	const int g_HeaderMipCountWord = 6;
+	// the first two reserved words mark the files written here
+	// and whether the image is translucent
+	const int g_HeaderCacheVersionWord = 7;
+	const int g_HeaderTranslucentWord = 8;
+	const int g_PixelFormatSizeWord = 18;
+	const int g_PixelFormatFlagsWord = 19;
+	const int g_PixelFormatFourCCWord = 20;
+	const int g_HeaderCapsWord = 26;
+	// bump to invalidate the cache files after an encoder change
+	const uint32_t g_CacheVersion = 1;
+
+	/***********************************************************
+	 *  PackColor565()
+	 *
+	 *  Round an 8 bit per channel color to RGB565.
+	 ***********************************************************/
+	uint16_t PackColor565(const int* color)
+	{
+		int red = (color[0] * 31 + 127) / 255;
+		int green = (color[1] * 63 + 127) / 255;
+		int blue = (color[2] * 31 + 127) / 255;
+
+		return((uint16_t)((red << 11) | (green << 5) | blue));
+	}
+
+	/***********************************************************
+	 *  UnpackColor565()
+	 *
+	 *  Expand an RGB565 color to 8 bits per channel, the way
+	 *  the GPU decodes it.
+	 ***********************************************************/
+	void UnpackColor565(uint16_t packed, int* color)
+	{
+		int red = (packed >> 11) & 31;
+		int green = (packed >> 5) & 63;
+		int blue = packed & 31;
+
+		color[0] = (red << 3) | (red >> 2);
+		color[1] = (green << 2) | (green >> 4);
+		color[2] = (blue << 3) | (blue >> 2);
+	}
+
+	/***********************************************************
+	 *  GetModifiedTime()
+	 *
+	 *  Get the last write time of a file, or -1 when the file
+	 *  does not exist.
+	 ***********************************************************/
+	long long GetModifiedTime(const std::string& path)
+	{
+		struct stat fileStatus;
+
+		if (stat(path.c_str(), &fileStatus) != 0)
+		{
+			return(-1);
+		}
+		return((long long)fileStatus.st_mtime);
+	}
+}
+
+/***********************************************************
+ *  LoadCompressedImage()
+ *
+ *  This method is used for getting the compressed mip
+ *  chain of an image file.  The cache file is used when it
+ *  is at least as new as the image; otherwise the image is
+ *  converted and the cache file is rewritten.
+ ***********************************************************/
+bool TextureCache::LoadCompressedImage(
+	const std::string& filename,
+	int size,
+	COMPRESSED_IMAGE& image)
+{
+	std::string cachePath = GetCachePath(filename);
+	long long sourceTime = GetModifiedTime(filename);
+	long long cacheTime = GetModifiedTime(cachePath);
+
+	// a cache file without its source image is still usable
+	if ((cacheTime >= 0) && (cacheTime >= sourceTime))
+	{
+		if (ReadCacheFile(cachePath, size, image))
+		{
+			return true;
+		}
+	}
+
+	if (!BuildImage(filename, size, image))
+	{
+		return false;
+	}
+
+	// a failed write only costs the conversion on the next launch
+	if (!WriteCacheFile(cachePath, image))
+	{
+		std::cout << "Could not write texture cache file:" << cachePath << std::endl;
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  GetLevelCount()
+ *
+ *  This method is used for getting the number of mip levels
+ *  of a square image, down to and including 1 x 1.
+ ***********************************************************/
+int TextureCache::GetLevelCount(int size)
+{
+	int levelCount = 1;
+
+	while (size > 1)
+	{
+		size /= 2;
+		levelCount++;
+	}
+	return(levelCount);
+}
+
+/***********************************************************
+ *  GetLevelBytes()
+ *
+ *  This method is used for getting the byte size of one
+ *  compressed mip level.  Levels smaller than a block still
+ *  take a whole block.
+ ***********************************************************/
+int TextureCache::GetLevelBytes(int size, int level)
+{
+	int levelSize = std::max(size >> level, 1);
+	int blocks = (levelSize + 3) / 4;
+
+	return(blocks * blocks * BLOCK_BYTES);
+}
+
+/***********************************************************
+ *  GetCachePath()
+ *
+ *  This method is used for getting the cache file path of
+ *  an image file - the same path with a .dds extension.
+ ***********************************************************/
+std::string TextureCache::GetCachePath(const std::string& filename)
+{
+	size_t extension = filename.find_last_of('.');
+	size_t separator = filename.find_last_of("/\\");
+
+	if ((extension == std::string::npos) ||
+		((separator != std::string::npos) && (extension < separator)))
+	{
+		return(filename + ".dds");
+	}
+	return(filename.substr(0, extension) + ".dds");
+}
+
+/***********************************************************
+ *  ReadCacheFile()
+ *
+ *  This method is used for reading a cache file.  Files of
+ *  another size, format or cache version are rejected.
+ ***********************************************************/
+bool TextureCache::ReadCacheFile(
+	const std::string& path,
+	int size,
+	COMPRESSED_IMAGE& image)
+{
+	std::ifstream file(path.c_str(), std::ios::binary);
+	uint32_t magic = 0;
+	uint32_t header[g_DDSHeaderWords];
+
+	if (!file.read((char*)&magic, sizeof(magic)) ||
+		!file.read((char*)header, sizeof(header)))
+	{
+		return false;
+	}
+
+	if ((magic != g_DDSMagic) ||
+		(header[g_HeaderCacheVersionWord] != g_CacheVersion) ||
+		(header[g_PixelFormatFourCCWord] != g_DXT5FourCC) ||
+		(header[g_HeaderWidthWord] != (uint32_t)size) ||
+		(header[g_HeaderHeightWord] != (uint32_t)size) ||
+		(header[g_HeaderMipCountWord] != (uint32_t)GetLevelCount(size)))
+	{
+		return false;
+	}
+
+	image.size = size;
+	image.levelCount = GetLevelCount(size);
+	image.bTranslucent = (header[g_HeaderTranslucentWord] != 0);
+
+	size_t byteCount = 0;
+	for (int level = 0; level < image.levelCount; level++)
+	{
+		byteCount += GetLevelBytes(size, level);
+	}
+	image.data.resize(byteCount);
+
+	return(!!file.read((char*)image.data.data(), byteCount));
+}
+
+/***********************************************************
+ *  WriteCacheFile()
+ *
+ *  This method is used for writing a compressed image as a
+ *  standard DXT5 .dds file.
+ ***********************************************************/
+bool TextureCache::WriteCacheFile(
+	const std::string& path,
+	const COMPRESSED_IMAGE& image)
+{
+	uint32_t header[g_DDSHeaderWords];
+
+	memset(header, 0, sizeof(header));
+	header[0] = g_DDSHeaderSize;
+	header[g_HeaderFlagsWord] = g_DDSHeaderFlags;
+	header[g_HeaderHeightWord] = image.size;
+	header[g_HeaderWidthWord] = image.size;
+	header[g_HeaderLinearSizeWord] = GetLevelBytes(image.size, 0);
+	header[g_HeaderMipCountWord] = image.levelCount;
+	header[g_HeaderCacheVersionWord] = g_CacheVersion;
+	header[g_HeaderTranslucentWord] = image.bTranslucent ? 1 : 0;
+	header[g_PixelFormatSizeWord] = g_DDSPixelFormatSize;
+	header[g_PixelFormatFlagsWord] = g_DDSPixelFormatFourCC;
+	header[g_PixelFormatFourCCWord] = g_DXT5FourCC;
+	header[g_HeaderCapsWord] = g_DDSCaps;
+
+	std::ofstream file(path.c_str(), std::ios::binary | std::ios::trunc);
+
+	file.write((const char*)&g_DDSMagic, sizeof(g_DDSMagic));
+	file.write((const char*)header, sizeof(header));
+	file.write((const char*)image.data.data(), image.data.size());
+
+	return(!!file);
+}
+
+/***********************************************************
+ *  BuildImage()
+ *
+ *  This method is used for converting an image file into a
+ *  compressed mip chain.  The image is resampled to the
+ *  requested size, each smaller level is box filtered from
+ *  the one above it, and every level is compressed to BC3.
+ ***********************************************************/
+bool TextureCache::BuildImage(
+	const std::string& filename,
+	int size,
+	COMPRESSED_IMAGE& image)
+{
+	int width = 0;
+	int height = 0;
+	int colorChannels = 0;
+
+	// try to parse the image data from the specified image file
+	unsigned char* pixels = stbi_load(
+		filename.c_str(),
+		&width,
+		&height,
+		&colorChannels,
+		0);
+
+	if (NULL == pixels)
+	{
+		return false;
+	}
+	if ((colorChannels != 3) && (colorChannels != 4))
+	{
+		std::cout << "Not implemented to handle image with " << colorChannels << " channels" << std::endl;
+		stbi_image_free(pixels);
+		return false;
+	}
+
+	// an image is translucent when any of its pixels are not
+	// fully opaque - such objects are drawn in the blended pass
+	image.bTranslucent = false;
+	if (colorChannels == 4)
+	{
+		long byteCount = (long)width * height * 4;
+		for (long i = 3; (i < byteCount) && (image.bTranslucent == false); i += 4)
+		{
+			image.bTranslucent = (pixels[i] < 255);
+		}
+	}
+
+	std::vector<unsigned char> level;
+	ResampleImage(pixels, width, height, colorChannels, size, level);
+
+	// free the image data from local memory
+	stbi_image_free(pixels);
+
+	image.size = size;
+	image.levelCount = GetLevelCount(size);
+	image.data.clear();
+
+	int levelSize = size;
+	for (int levelIndex = 0; levelIndex < image.levelCount; levelIndex++)
+	{
+		int blocks = (levelSize + 3) / 4;
+		size_t offset = image.data.size();
+		image.data.resize(offset + (size_t)blocks * blocks * BLOCK_BYTES);
+
+		for (int blockY = 0; blockY < blocks; blockY++)
+		{
+			for (int blockX = 0; blockX < blocks; blockX++)
+			{
+				unsigned char block[16 * 4];
+
+				// levels smaller than a block repeat their edge pixels
+				for (int y = 0; y < 4; y++)
+				{
+					for (int x = 0; x < 4; x++)
+					{
+						int sourceX = std::min(blockX * 4 + x, levelSize - 1);
+						int sourceY = std::min(blockY * 4 + y, levelSize - 1);
+						memcpy(&block[(y * 4 + x) * 4], &level[((size_t)sourceY * levelSize + sourceX) * 4], 4);
+					}
+				}
+
+				CompressBlock(block, &image.data[offset + ((size_t)blockY * blocks + blockX) * BLOCK_BYTES]);
+			}
+		}
+
+		// box filter the next level down from this one
+		if (levelSize > 1)
+		{
+			int nextSize = levelSize / 2;
+			std::vector<unsigned char> next((size_t)nextSize * nextSize * 4);
+
+			for (int y = 0; y < nextSize; y++)
+			{
+				for (int x = 0; x < nextSize; x++)
+				{
+					for (int channel = 0; channel < 4; channel++)
+					{
+						int sum =
+							level[(((size_t)y * 2) * levelSize + x * 2) * 4 + channel] +
+							level[(((size_t)y * 2) * levelSize + x * 2 + 1) * 4 + channel] +
+							level[(((size_t)y * 2 + 1) * levelSize + x * 2) * 4 + channel] +
+							level[(((size_t)y * 2 + 1) * levelSize + x * 2 + 1) * 4 + channel];
+						next[((size_t)y * nextSize + x) * 4 + channel] = (unsigned char)((sum + 2) / 4);
+					}
+				}
+			}
+			level.swap(next);
+			levelSize = nextSize;
+		}
+	}
+
+	return true;
+}
+
+/***********************************************************
+ *  ResampleImage()
+ *
+ *  This method is used for resampling an RGB or RGBA image
+ *  to a square RGBA image.  Each output pixel averages the
+ *  source pixels it covers when shrinking, and interpolates
+ *  bilinearly when enlarging.
+ ***********************************************************/
+void TextureCache::ResampleImage(
+	const unsigned char* pixels,
+	int width,
+	int height,
+	int colorChannels,
+	int size,
+	std::vector<unsigned char>& rgba)
+{
+	rgba.resize((size_t)size * size * 4);
+
+	float scaleX = (float)width / size;
+	float scaleY = (float)height / size;
+
+	for (int y = 0; y < size; y++)
+	{
+		for (int x = 0; x < size; x++)
+		{
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			float weight = 0.0f;
+
+			if ((scaleX >= 1.0f) && (scaleY >= 1.0f))
+			{
+				// average every source pixel under the output pixel
+				int x0 = (int)(x * scaleX);
+				int x1 = std::max(x0 + 1, std::min((int)((x + 1) * scaleX), width));
+				int y0 = (int)(y * scaleY);
+				int y1 = std::max(y0 + 1, std::min((int)((y + 1) * scaleY), height));
+
+				for (int sourceY = y0; sourceY < y1; sourceY++)
+				{
+					for (int sourceX = x0; sourceX < x1; sourceX++)
+					{
+						const unsigned char* source = &pixels[((size_t)sourceY * width + sourceX) * colorChannels];
+						for (int channel = 0; channel < colorChannels; channel++)
+						{
+							sum[channel] += source[channel];
+						}
+						weight += 1.0f;
+					}
+				}
+			}
+			else
+			{
+				// interpolate between the four nearest source pixels
+				float sourceX = std::max((x + 0.5f) * scaleX - 0.5f, 0.0f);
+				float sourceY = std::max((y + 0.5f) * scaleY - 0.5f, 0.0f);
+				int x0 = std::min((int)sourceX, width - 1);
+				int y0 = std::min((int)sourceY, height - 1);
+				int x1 = std::min(x0 + 1, width - 1);
+				int y1 = std::min(y0 + 1, height - 1);
+				float fractionX = sourceX - x0;
+				float fractionY = sourceY - y0;
+
+				const int cornersX[4] = { x0, x1, x0, x1 };
+				const int cornersY[4] = { y0, y0, y1, y1 };
+				const float cornerWeights[4] =
+				{
+					(1.0f - fractionX) * (1.0f - fractionY),
+					fractionX * (1.0f - fractionY),
+					(1.0f - fractionX) * fractionY,
+					fractionX * fractionY
+				};
+
+				for (int corner = 0; corner < 4; corner++)
+				{
+					const unsigned char* source = &pixels[((size_t)cornersY[corner] * width + cornersX[corner]) * colorChannels];
+					for (int channel = 0; channel < colorChannels; channel++)
+					{
+						sum[channel] += source[channel] * cornerWeights[corner];
+					}
+				}
+				weight = 1.0f;
+			}
+
+			unsigned char* output = &rgba[((size_t)y * size + x) * 4];
+			for (int channel = 0; channel < 4; channel++)
+			{
+				if (channel < colorChannels)
+				{
+					output[channel] = (unsigned char)std::min(sum[channel] / weight + 0.5f, 255.0f);
+				}
+				else
+				{
+					output[channel] = 255;
+				}
+			}
+		}
+	}
+}
+
+/***********************************************************
+ *  CompressBlock()
+ *
+ *  This method is used for compressing a 4x4 block of RGBA
+ *  pixels into a 16 byte BC3 block.  The endpoints are the
+ *  corners of the block's color and alpha ranges, and each
+ *  pixel takes the nearest of the interpolated values.
+ ***********************************************************/
+void TextureCache::CompressBlock(
+	const unsigned char* block,
+	unsigned char* output)
+{
+	int minColor[3] = { 255, 255, 255 };
+	int maxColor[3] = { 0, 0, 0 };
+	int minAlpha = 255;
+	int maxAlpha = 0;
+
+	for (int i = 0; i < 16; i++)
+	{
+		for (int channel = 0; channel < 3; channel++)
+		{
+			minColor[channel] = std::min(minColor[channel], (int)block[i * 4 + channel]);
+			maxColor[channel] = std::max(maxColor[channel], (int)block[i * 4 + channel]);
+		}
+		minAlpha = std::min(minAlpha, (int)block[i * 4 + 3]);
+		maxAlpha = std::max(maxAlpha, (int)block[i * 4 + 3]);
+	}
+
+	// alpha block - 8 interpolated values when alpha0 > alpha1
+	int alphas[8];
+	alphas[0] = maxAlpha;
+	alphas[1] = minAlpha;
+	for (int i = 2; i < 8; i++)
+	{
+		alphas[i] = ((8 - i) * maxAlpha + (i - 1) * minAlpha + 3) / 7;
+	}
+
+	uint64_t alphaIndices = 0;
+	if (maxAlpha > minAlpha)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int alpha = block[i * 4 + 3];
+			int bestIndex = 0;
+			int bestError = 256;
+
+			for (int index = 0; index < 8; index++)
+			{
+				int error = std::abs(alpha - alphas[index]);
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = index;
+				}
+			}
+			alphaIndices |= (uint64_t)bestIndex << (3 * i);
+		}
+	}
+
+	output[0] = (unsigned char)maxAlpha;
+	output[1] = (unsigned char)minAlpha;
+	for (int i = 0; i < 6; i++)
+	{
+		output[2 + i] = (unsigned char)(alphaIndices >> (8 * i));
+	}
+
+	// inset the color range a little to reduce the error of
+	// the rounding to RGB565
+	for (int channel = 0; channel < 3; channel++)
+	{
+		int inset = (maxColor[channel] - minColor[channel]) / 16;
+		minColor[channel] += inset;
+		maxColor[channel] -= inset;
+	}
+
+	uint16_t color0 = PackColor565(maxColor);
+	uint16_t color1 = PackColor565(minColor);
+
+	// color block - always decoded with 4 colors in BC3
+	int palette[4][3];
+	UnpackColor565(color0, palette[0]);
+	UnpackColor565(color1, palette[1]);
+	for (int channel = 0; channel < 3; channel++)
+	{
+		palette[2][channel] = (2 * palette[0][channel] + palette[1][channel]) / 3;
+		palette[3][channel] = (palette[0][channel] + 2 * palette[1][channel]) / 3;
+	}
+
+	uint32_t colorIndices = 0;
+	if (color0 != color1)
+	{
+		for (int i = 0; i < 16; i++)
+		{
+			int bestIndex = 0;
+			int bestError = 3 * 256 * 256;
+
+			for (int index = 0; index < 4; index++)
+			{
+				int error = 0;
+				for (int channel = 0; channel < 3; channel++)
+				{
+					int difference = block[i * 4 + channel] - palette[index][channel];
+					error += difference * difference;
+				}
+				if (error < bestError)
+				{
+					bestError = error;
+					bestIndex = index;
+				}
+			}
+			colorIndices |= (uint32_t)bestIndex << (2 * i);
+		}
+	}
+
+	output[8] = (unsigned char)(color0 & 0xFF);
+	output[9] = (unsigned char)(color0 >> 8);
+	output[10] = (unsigned char)(color1 & 0xFF);
+	output[11] = (unsigned char)(color1 >> 8);
+	for (int i = 0; i < 4; i++)
+	{
+		output[12 + i] = (unsigned char)(colorIndices >> (8 * i));
+	}
+}
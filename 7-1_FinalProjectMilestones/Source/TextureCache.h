@@ -0,0 +1,83 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturecache.h
+// ============
+// convert texture images into BC3 compressed mip chains and keep them in
+// DDS files next to the source images for the next launch
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+/***********************************************************
+ *  TextureCache
+ *
+ *  This class produces the BC3 (DXT5) compressed, fully
+ *  mipmapped version of a texture image at a fixed square
+ *  size.  The first load of an image decodes, resamples and
+ *  compresses it and writes the result beside the source
+ *  file as a .dds; later loads read that file directly as
+ *  long as it is newer than the source image.  No OpenGL
+ *  calls are made, so it is safe to use on worker threads.
+ ***********************************************************/
+class TextureCache
+{
+public:
+	// bytes in one compressed 4x4 block
+	static const int BLOCK_BYTES = 16;
+
+	// compressed mip chain of one image
+	struct COMPRESSED_IMAGE
+	{
+		// width and height of the top level
+		int size;
+		int levelCount;
+		// true when the image has pixels that are not fully opaque
+		bool bTranslucent;
+		// every level, largest first, packed back to back
+		std::vector<unsigned char> data;
+	};
+
+	// load the cached compressed image, building it when needed
+	static bool LoadCompressedImage(
+		const std::string& filename,
+		int size,
+		COMPRESSED_IMAGE& image);
+
+	// get the number of mip levels for a square size
+	static int GetLevelCount(int size);
+	// get the byte size of one compressed mip level
+	static int GetLevelBytes(int size, int level);
+
+private:
+	// get the path of the cache file for an image file
+	static std::string GetCachePath(const std::string& filename);
+	// read a cache file written by WriteCacheFile()
+	static bool ReadCacheFile(
+		const std::string& path,
+		int size,
+		COMPRESSED_IMAGE& image);
+	// write a compressed image to a cache file
+	static bool WriteCacheFile(
+		const std::string& path,
+		const COMPRESSED_IMAGE& image);
+	// decode, resample and compress an image file
+	static bool BuildImage(
+		const std::string& filename,
+		int size,
+		COMPRESSED_IMAGE& image);
+	// resample an image to a square RGBA image
+	static void ResampleImage(
+		const unsigned char* pixels,
+		int width,
+		int height,
+		int colorChannels,
+		int size,
+		std::vector<unsigned char>& rgba);
+	// compress one 4x4 block of RGBA pixels
+	static void CompressBlock(
+		const unsigned char* block,
+		unsigned char* output);
+};
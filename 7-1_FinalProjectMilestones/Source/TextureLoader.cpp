@@ -0,0 +1,191 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureloader.cpp
+// ============
+// load texture images on a pool of worker threads so that the OpenGL
+// thread only has to upload the compressed mip chains
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureLoader.h"
+
+#include "stb_image.h"
+
+#include <algorithm>
+#include <utility>
+
+// declaration of global variables
+namespace
+{
+	// loading is bound by memory and disk, so a few threads are enough
+	const unsigned int g_MaxWorkerThreads = 4;
+}
+
+/***********************************************************
+ *  TextureLoader()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureLoader::TextureLoader()
+{
+	m_pendingCount = 0;
+	m_bStopping = false;
+}
+
+/***********************************************************
+ *  ~TextureLoader()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureLoader::~TextureLoader()
+{
+	Stop();
+}
+
+/***********************************************************
+ *  QueueImage()
+ *
+ *  This method is used for queueing an image file to be
+ *  loaded on a worker thread.  The worker threads are
+ *  started by the first queued image.
+ ***********************************************************/
+void TextureLoader::QueueImage(const std::string& filename, int layer, int size)
+{
+	LOAD_JOB job;
+	job.filename = filename;
+	job.layer = layer;
+	job.size = size;
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+		m_pendingCount++;
+	}
+	m_jobAvailable.notify_one();
+
+	StartWorkers();
+}
+
+/***********************************************************
+ *  PollDecodedImages()
+ *
+ *  This method is used for collecting the images loaded
+ *  since the last call without waiting.
+ ***********************************************************/
+int TextureLoader::PollDecodedImages(std::vector<DECODED_IMAGE>& images)
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	int count = (int)m_decodedImages.size();
+
+	for (size_t i = 0; i < m_decodedImages.size(); i++)
+	{
+		images.push_back(std::move(m_decodedImages[i]));
+	}
+	m_decodedImages.clear();
+	m_pendingCount -= count;
+
+	return(count);
+}
+
+/***********************************************************
+ *  GetPendingCount()
+ *
+ *  This method is used for getting the number of queued
+ *  images that have not been polled yet.
+ ***********************************************************/
+int TextureLoader::GetPendingCount()
+{
+	std::lock_guard<std::mutex> lock(m_mutex);
+	return(m_pendingCount);
+}
+
+/***********************************************************
+ *  Stop()
+ *
+ *  This method is used for stopping and joining the worker
+ *  threads.  Jobs that were not started and images that
+ *  were not polled are dropped.
+ ***********************************************************/
+void TextureLoader::Stop()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_bStopping = true;
+		m_jobs.clear();
+	}
+	m_jobAvailable.notify_all();
+
+	for (size_t i = 0; i < m_workers.size(); i++)
+	{
+		m_workers[i].join();
+	}
+	m_workers.clear();
+
+	m_decodedImages.clear();
+	m_pendingCount = 0;
+	m_bStopping = false;
+}
+
+/***********************************************************
+ *  StartWorkers()
+ *
+ *  This method is used for starting the worker threads.
+ *  One core is left for the OpenGL thread.
+ ***********************************************************/
+void TextureLoader::StartWorkers()
+{
+	if (!m_workers.empty())
+	{
+		return;
+	}
+
+	// stb_image keeps the flip setting in a global, so it is set
+	// here once before any worker reads it
+	stbi_set_flip_vertically_on_load(true);
+
+	unsigned int hardwareThreads = std::thread::hardware_concurrency();
+	unsigned int workerCount = (hardwareThreads > 1) ? hardwareThreads - 1 : 1;
+	workerCount = std::min(workerCount, g_MaxWorkerThreads);
+
+	for (unsigned int i = 0; i < workerCount; i++)
+	{
+		m_workers.push_back(std::thread(&TextureLoader::WorkerLoop, this));
+	}
+}
+
+/***********************************************************
+ *  WorkerLoop()
+ *
+ *  This method is used for loading queued images on a
+ *  worker thread until the loader is stopped.
+ ***********************************************************/
+void TextureLoader::WorkerLoop()
+{
+	while (true)
+	{
+		LOAD_JOB job;
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobAvailable.wait(lock, [this]() { return(m_bStopping || !m_jobs.empty()); });
+
+			if (m_bStopping)
+			{
+				return;
+			}
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+
+		DECODED_IMAGE image;
+		image.filename = job.filename;
+		image.layer = job.layer;
+		image.bLoaded = TextureCache::LoadCompressedImage(job.filename, job.size, image.image);
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_bStopping)
+		{
+			return;
+		}
+		m_decodedImages.push_back(std::move(image));
+	}
+}
@@ -0,0 +1,80 @@
+///////////////////////////////////////////////////////////////////////////////
+// textureloader.h
+// ============
+// load texture images on a pool of worker threads so that the OpenGL
+// thread only has to upload the compressed mip chains
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include "TextureCache.h"
+
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/***********************************************************
+ *  TextureLoader
+ *
+ *  This class owns a small pool of worker threads that load
+ *  queued image files through the TextureCache, converting
+ *  them on the first launch.  The loaded images are
+ *  collected on the OpenGL thread by calling
+ *  PollDecodedImages() once per frame.  No OpenGL calls are
+ *  made by this class.
+ ***********************************************************/
+class TextureLoader
+{
+public:
+	// constructor
+	TextureLoader();
+	// destructor
+	~TextureLoader();
+
+	// one decoded image and the layer it was requested for
+	struct DECODED_IMAGE
+	{
+		std::string filename;
+		int layer;
+		// false when the file could not be loaded
+		bool bLoaded;
+		TextureCache::COMPRESSED_IMAGE image;
+	};
+
+	// queue an image file to be loaded at a size for a texture layer
+	void QueueImage(const std::string& filename, int layer, int size);
+	// move the images loaded since the last call into the list
+	int PollDecodedImages(std::vector<DECODED_IMAGE>& images);
+	// get the number of queued images not yet polled
+	int GetPendingCount();
+	// stop the worker threads and drop any unpolled images
+	void Stop();
+
+private:
+	// one queued image file
+	struct LOAD_JOB
+	{
+		std::string filename;
+		int layer;
+		int size;
+	};
+
+	// load queued images until Stop() is called
+	void WorkerLoop();
+	// start the worker threads when none are running
+	void StartWorkers();
+
+	std::vector<std::thread> m_workers;
+	// guards the job queue, the decoded list and the stop flag
+	std::mutex m_mutex;
+	std::condition_variable m_jobAvailable;
+	std::deque<LOAD_JOB> m_jobs;
+	std::vector<DECODED_IMAGE> m_decodedImages;
+	// number of images queued but not yet polled
+	int m_pendingCount;
+	bool m_bStopping;
+};
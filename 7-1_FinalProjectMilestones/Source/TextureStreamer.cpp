@@ -0,0 +1,329 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturestreamer.cpp
+// ============
+// keep the fine mip levels of the scene textures in a fixed pool of texture
+// array slots, streamed in and out as the residency manager decides
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#include "TextureStreamer.h"
+#include "ShaderUniforms.h"
+
+#include <algorithm>
+#include <iostream>
+#include <utility>
+
+/***********************************************************
+ *  TextureStreamer()
+ *
+ *  The constructor for the class
+ ***********************************************************/
+TextureStreamer::TextureStreamer()
+	: m_residencyBuffer(GLObject::OBJECT_BUFFER)
+{
+	for (int i = 0; i < MAX_LAYERS; i++)
+	{
+		m_residency.layers[i] = glm::ivec4(-1, FALLBACK_LEVEL, 0, 0);
+	}
+	m_bResidencyChanged = false;
+}
+
+/***********************************************************
+ *  ~TextureStreamer()
+ *
+ *  The destructor for the class
+ ***********************************************************/
+TextureStreamer::~TextureStreamer()
+{
+	Destroy();
+}
+
+/***********************************************************
+ *  Initialize()
+ *
+ *  This method is used for creating the slot array with as
+ *  many slots as the budget holds, but no more than one per
+ *  layer, and the residency block with every layer on its
+ *  fallback.  The slots keep the placeholder until a layer
+ *  streams into them.
+ ***********************************************************/
+bool TextureStreamer::Initialize(int layerCount, long long budgetBytes)
+{
+	Destroy();
+
+	if ((layerCount <= 0) || (layerCount > MAX_LAYERS))
+	{
+		std::cout << "Texture streaming supports 1 to " << MAX_LAYERS << " textures, not " << layerCount << std::endl;
+		return false;
+	}
+
+	long long slotBytes = GetSlotBytes();
+	int slotCount = (int)std::min(budgetBytes / slotBytes, (long long)layerCount);
+	if (slotCount <= 0)
+	{
+		std::cout << "The texture budget does not fit one streamed texture of " << slotBytes << " bytes" << std::endl;
+		return false;
+	}
+	if (!m_slotArray.Create(slotCount, TextureArray::LAYER_SIZE, FALLBACK_LEVEL))
+	{
+		return false;
+	}
+
+	m_images.assign(layerCount, TextureCache::COMPRESSED_IMAGE());
+	m_layerSlots.assign(layerCount, -1);
+	// the lowest slots are handed out first
+	m_freeSlots.clear();
+	for (int slot = slotCount - 1; slot >= 0; slot--)
+	{
+		m_freeSlots.push_back(slot);
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_residencyBuffer.Create());
+	glBufferData(GL_UNIFORM_BUFFER, sizeof(RESIDENCY_BLOCK), &m_residency, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_residencyBuffer.SetByteSize(sizeof(RESIDENCY_BLOCK));
+	m_bResidencyChanged = false;
+
+	std::cout << "Streaming the finest texture levels through " << slotCount << " of " << layerCount << " slots" << std::endl;
+
+	return true;
+}
+
+/***********************************************************
+ *  Destroy()
+ *
+ *  This method is used for freeing the slot array, the
+ *  residency block and the kept mip chains.
+ ***********************************************************/
+void TextureStreamer::Destroy()
+{
+	m_slotArray.Destroy();
+	m_residencyBuffer.Reset();
+	m_images.clear();
+	m_layerSlots.clear();
+	m_freeSlots.clear();
+	for (int i = 0; i < MAX_LAYERS; i++)
+	{
+		m_residency.layers[i] = glm::ivec4(-1, FALLBACK_LEVEL, 0, 0);
+	}
+	m_bResidencyChanged = false;
+}
+
+/***********************************************************
+ *  IsInitialized()
+ *
+ *  This method is used for checking whether the slots were
+ *  created.
+ ***********************************************************/
+bool TextureStreamer::IsInitialized() const
+{
+	return(m_slotArray.GetID() != 0);
+}
+
+/***********************************************************
+ *  GetSlotCount()
+ *
+ *  This method is used for getting the number of slots of
+ *  the slot array.
+ ***********************************************************/
+int TextureStreamer::GetSlotCount() const
+{
+	return(m_slotArray.GetLayerCount());
+}
+
+/***********************************************************
+ *  GetByteSize()
+ *
+ *  This method is used for getting the video memory of the
+ *  slot array, all allocated by Initialize().
+ ***********************************************************/
+long long TextureStreamer::GetByteSize() const
+{
+	return(m_slotArray.GetByteSize());
+}
+
+/***********************************************************
+ *  GetLevelBytes()
+ *
+ *  This method is used for getting the compressed bytes of
+ *  one streamed level of a layer.
+ ***********************************************************/
+long long TextureStreamer::GetLevelBytes(int level)
+{
+	return(TextureCache::GetLevelBytes(TextureArray::LAYER_SIZE, level));
+}
+
+/***********************************************************
+ *  GetSlotBytes()
+ *
+ *  This method is used for getting the compressed bytes of
+ *  every level finer than the fallback of one layer, the
+ *  size of one slot.
+ ***********************************************************/
+long long TextureStreamer::GetSlotBytes()
+{
+	long long bytes = 0;
+
+	for (int level = 0; level < FALLBACK_LEVEL; level++)
+	{
+		bytes += GetLevelBytes(level);
+	}
+
+	return(bytes);
+}
+
+/***********************************************************
+ *  GetFallbackBytes()
+ *
+ *  This method is used for getting the compressed bytes of
+ *  the fallback array for a number of layers, every level
+ *  from FALLBACK_LEVEL down.
+ ***********************************************************/
+long long TextureStreamer::GetFallbackBytes(int layerCount)
+{
+	long long bytes = 0;
+
+	for (int level = FALLBACK_LEVEL; level < TextureCache::GetLevelCount(TextureArray::LAYER_SIZE); level++)
+	{
+		bytes += GetLevelBytes(level);
+	}
+
+	return(bytes * layerCount);
+}
+
+/***********************************************************
+ *  AddImage()
+ *
+ *  This method is used for keeping the decoded mip chain of
+ *  a layer, once its coarse levels are in the fallback
+ *  array, so its fine levels can be streamed in later.
+ ***********************************************************/
+void TextureStreamer::AddImage(int layer, TextureCache::COMPRESSED_IMAGE image)
+{
+	if ((layer < 0) || (layer >= (int)m_images.size()))
+	{
+		return;
+	}
+
+	m_images[layer] = std::move(image);
+}
+
+/***********************************************************
+ *  HasImage()
+ *
+ *  This method is used for checking whether the mip chain
+ *  of a layer was added.
+ ***********************************************************/
+bool TextureStreamer::HasImage(int layer) const
+{
+	return((layer >= 0) && (layer < (int)m_images.size()) && !m_images[layer].data.empty());
+}
+
+/***********************************************************
+ *  SetResidentLevel()
+ *
+ *  This method is used for moving a layer to a new finest
+ *  resident level.  Streaming in takes a slot for the
+ *  first level past the fallback and uploads the levels
+ *  between the two; streaming out only lowers the level
+ *  the shader may sample, and the slot is given back once
+ *  the layer is down to its fallback.  A failed stream in
+ *  leaves the layer as it was.
+ ***********************************************************/
+bool TextureStreamer::SetResidentLevel(int layer, int previousLevel, int residentLevel)
+{
+	if (!IsInitialized() || (layer < 0) || (layer >= (int)m_layerSlots.size()))
+	{
+		return false;
+	}
+
+	residentLevel = std::min(std::max(residentLevel, 0), (int)FALLBACK_LEVEL);
+	previousLevel = std::min(std::max(previousLevel, 0), (int)FALLBACK_LEVEL);
+
+	if (residentLevel < previousLevel)
+	{
+		if (!HasImage(layer))
+		{
+			return false;
+		}
+		if (m_layerSlots[layer] < 0)
+		{
+			if (m_freeSlots.empty())
+			{
+				std::cout << "Texture streaming has no free slot for layer " << layer << std::endl;
+				return false;
+			}
+			m_layerSlots[layer] = m_freeSlots.back();
+			m_freeSlots.pop_back();
+		}
+		if (!m_slotArray.UploadLevels(m_layerSlots[layer], m_images[layer], residentLevel, previousLevel - residentLevel))
+		{
+			// a slot taken for this change is given back
+			if (previousLevel == FALLBACK_LEVEL)
+			{
+				m_freeSlots.push_back(m_layerSlots[layer]);
+				m_layerSlots[layer] = -1;
+			}
+			return false;
+		}
+	}
+	else if ((residentLevel == FALLBACK_LEVEL) && (m_layerSlots[layer] >= 0))
+	{
+		m_freeSlots.push_back(m_layerSlots[layer]);
+		m_layerSlots[layer] = -1;
+	}
+
+	m_residency.layers[layer] = glm::ivec4(m_layerSlots[layer], residentLevel, 0, 0);
+	m_bResidencyChanged = true;
+
+	return true;
+}
+
+/***********************************************************
+ *  GetResidentLevel()
+ *
+ *  This method is used for getting the finest level of a
+ *  layer the shader may sample.
+ ***********************************************************/
+int TextureStreamer::GetResidentLevel(int layer) const
+{
+	if ((layer < 0) || (layer >= MAX_LAYERS))
+	{
+		return(FALLBACK_LEVEL);
+	}
+
+	return(m_residency.layers[layer].y);
+}
+
+/***********************************************************
+ *  Flush()
+ *
+ *  This method is used for uploading the residency block
+ *  once after the changes of a frame.
+ ***********************************************************/
+void TextureStreamer::Flush()
+{
+	if (!m_bResidencyChanged || (m_residencyBuffer.Get() == 0))
+	{
+		return;
+	}
+
+	glBindBuffer(GL_UNIFORM_BUFFER, m_residencyBuffer.Get());
+	glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(RESIDENCY_BLOCK), &m_residency);
+	glBindBuffer(GL_UNIFORM_BUFFER, 0);
+	m_bResidencyChanged = false;
+}
+
+/***********************************************************
+ *  Bind()
+ *
+ *  This method is used for binding the slot array to its
+ *  texture unit and the residency block to its binding
+ *  point.
+ ***********************************************************/
+void TextureStreamer::Bind() const
+{
+	m_slotArray.Bind(TEXTURE_UNIT);
+	glActiveTexture(GL_TEXTURE0);
+	glBindBufferBase(GL_UNIFORM_BUFFER, ShaderUniforms::TEXTURE_RESIDENCY_BINDING, m_residencyBuffer.Get());
+}
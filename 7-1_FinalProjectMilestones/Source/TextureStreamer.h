@@ -0,0 +1,110 @@
+///////////////////////////////////////////////////////////////////////////////
+// texturestreamer.h
+// ============
+// keep the fine mip levels of the scene textures in a fixed pool of texture
+// array slots, streamed in and out as the residency manager decides
+//
+///////////////////////////////////////////////////////////////////////////////
+
+#pragma once
+
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "GLObject.h"
+#include "TextureArray.h"
+#include "TextureCache.h"
+
+#include <vector>
+
+/***********************************************************
+ *  TextureStreamer
+ *
+ *  This class holds the levels of the scene textures finer
+ *  than the fallback array, which keeps every layer from
+ *  FALLBACK_LEVEL down and stays resident.  The finer
+ *  levels live in the slots of a second array, sized to
+ *  the budget, and a texture takes a slot while any of
+ *  them is resident.  The decoded mip chains are kept in
+ *  memory, so streaming a level in is an upload and never
+ *  a read from disk.  The fragment shader finds the slot
+ *  and the finest resident level of each layer in the
+ *  TextureResidency uniform block.
+ ***********************************************************/
+class TextureStreamer
+{
+public:
+	// constructor
+	TextureStreamer();
+	// destructor
+	~TextureStreamer();
+
+	// first level of the images kept in the fallback array,
+	// must match the fragment shader
+	static const int FALLBACK_LEVEL = 3;
+	// size of the first level of the fallback array
+	static const int FALLBACK_SIZE = TextureArray::LAYER_SIZE >> FALLBACK_LEVEL;
+	// texture unit the slot array is bound to, past the
+	// shadow maps and the depth pyramid
+	static const int TEXTURE_UNIT = 3;
+	// most layers the residency block describes, must match
+	// the fragment shader
+	static const int MAX_LAYERS = 256;
+
+	// std140 layout of the TextureResidency block - x is the
+	// slot of a layer or -1, y its finest resident level
+	struct RESIDENCY_BLOCK
+	{
+		glm::ivec4 layers[MAX_LAYERS];
+	};
+
+	// create as many slots as fit in the budget, up to one per
+	// layer - false when not even one fits
+	bool Initialize(int layerCount, long long budgetBytes);
+	// free the slots and the kept images
+	void Destroy();
+	// true once Initialize() has succeeded
+	bool IsInitialized() const;
+
+	// get the number of slots and the video memory they take
+	int GetSlotCount() const;
+	long long GetByteSize() const;
+	// get the bytes of a streamed level of one layer, and of
+	// every streamed level of a slot
+	static long long GetLevelBytes(int level);
+	static long long GetSlotBytes();
+	// get the bytes of the levels of every layer kept in the
+	// fallback array
+	static long long GetFallbackBytes(int layerCount);
+
+	// keep the decoded mip chain of a layer for streaming
+	void AddImage(int layer, TextureCache::COMPRESSED_IMAGE image);
+	// true once the image of a layer was added
+	bool HasImage(int layer) const;
+	// stream a layer in or out to a new finest resident level,
+	// FALLBACK_LEVEL to give its slot back
+	bool SetResidentLevel(int layer, int previousLevel, int residentLevel);
+	// get the finest resident level of a layer
+	int GetResidentLevel(int layer) const;
+
+	// upload the residency block when it changed
+	void Flush();
+	// bind the slot array and the residency block
+	void Bind() const;
+
+private:
+	// the levels finer than FALLBACK_LEVEL of the streamed layers
+	TextureArray m_slotArray;
+	// decoded mip chain of every layer, empty until it loads
+	std::vector<TextureCache::COMPRESSED_IMAGE> m_images;
+	// slot of every layer, -1 for none
+	std::vector<int> m_layerSlots;
+	// slots no layer holds
+	std::vector<int> m_freeSlots;
+
+	// slot and finest level of every layer for the shader
+	RESIDENCY_BLOCK m_residency;
+	GLObject m_residencyBuffer;
+	// true when m_residency changed since the last upload
+	bool m_bResidencyChanged;
+};
@@ -12,7 +12,11 @@
 // GLM Math Header inclusions
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
-#include <glm/gtc/type_ptr.hpp>    
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/constants.hpp>    
+
+#include <algorithm>
+#include <iostream>
 
 // declaration of the global variables and defines
 namespace
@@ -20,8 +24,14 @@ namespace
 	// Variables for window width and height
 	const int WINDOW_WIDTH = 1000;
 	const int WINDOW_HEIGHT = 800;
-	const char* g_ViewName = "view";
-	const char* g_ProjectionName = "projection";
+
+	// size of the window framebuffer in pixels, which differs
+	// from the window size on high DPI displays
+	int gFramebufferWidth = WINDOW_WIDTH;
+	int gFramebufferHeight = WINDOW_HEIGHT;
+	// aspect of the projection, kept from the last size while
+	// the window is minimized
+	float gAspectRatio = (float)WINDOW_WIDTH / (float)WINDOW_HEIGHT;
 
 	// camera object used for viewing and interacting with
 	// the 3D scene
@@ -38,6 +48,15 @@ namespace
 	// time between current frame and last frame
 	float gDeltaTime = 0.0f; 
 	float gLastFrame = 0.0f;
+	// longest frame step of the camera - the first frame after
+	// an idle wait would otherwise move it by the whole wait
+	const float g_MaxDeltaTime = 0.1f;
+
+	// keys held down, kept by the key callback
+	bool gKeysDown[GLFW_KEY_LAST + 1] = {};
+	// set by anything that changes the view, so the on-demand
+	// mode knows to render another frame
+	bool gRedrawRequested = true;
 
 	// the following variable is false when orthographic projection
 	// is off and true when it is on
@@ -45,6 +64,19 @@ namespace
 
 	// bool used for locking or unlocking mouse
 	bool mouseLocked = true;
+
+	// file the profiled frames are written to
+	const char* g_ProfileFilename = "frame_profile.csv";
+
+	// true while the camera follows the scripted benchmark path
+	bool gScriptedCamera = false;
+	// scripted path - turns around the table at a fixed radius
+	// while the height rises and falls
+	const glm::vec3 g_CameraPathCenter = glm::vec3(0.0f, 0.0f, 1.0f);
+	const float g_CameraPathRadius = 16.0f;
+	const float g_CameraPathHeight = 8.0f;
+	const float g_CameraPathHeightRange = 4.0f;
+	const float g_CameraPathTurns = 2.0f;
 }
 
 /***********************************************************
@@ -53,10 +85,12 @@ namespace
  *  The constructor for the class
  ***********************************************************/
 ViewManager::ViewManager(
-	ShaderManager *pShaderManager)
+	ShaderUniforms *pShaderUniforms,
+	FrameProfiler *pProfiler)
 {
 	// initialize the member variables
-	m_pShaderManager = pShaderManager;
+	m_pShaderUniforms = pShaderUniforms;
+	m_pProfiler = pProfiler;
 	m_pWindow = NULL;
 	g_pCamera = new Camera();
 	// default camera view parameters
@@ -74,7 +108,8 @@ ViewManager::ViewManager(
 ViewManager::~ViewManager()
 {
 	// free up allocated memory
-	m_pShaderManager = NULL;
+	m_pShaderUniforms = NULL;
+	m_pProfiler = NULL;
 	m_pWindow = NULL;
 	if (NULL != g_pCamera)
 	{
@@ -112,9 +147,22 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
 	// this callback is used to receive mouse moving events
 	glfwSetCursorPosCallback(window, &ViewManager::Mouse_Position_Callback);
 
+	// this callback is used to receive key presses and releases,
+	// and finds the view manager through the window
+	glfwSetWindowUserPointer(window, this);
+	glfwSetKeyCallback(window, &ViewManager::Key_Callback);
+
+	// this callback asks for a frame when the window contents
+	// were damaged, such as after being uncovered
+	glfwSetWindowRefreshCallback(window, &ViewManager::Window_Refresh_Callback);
+
 	// this callback is added to receive scroll wheel events
 	glfwSetScrollCallback(window, &ViewManager::Scroll_Wheel_Callback);
 
+	// this callback follows the framebuffer through resizes
+	glfwGetFramebufferSize(window, &gFramebufferWidth, &gFramebufferHeight);
+	glfwSetFramebufferSizeCallback(window, &ViewManager::Framebuffer_Size_Callback);
+
 	// enable blending for supporting tranparent rendering
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
@@ -132,6 +180,12 @@ GLFWwindow* ViewManager::CreateDisplayWindow(const char* windowTitle)
  ***********************************************************/
 void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos, double yMousePos)
 {
+	// the scripted camera ignores the mouse
+	if (gScriptedCamera)
+	{
+		return;
+	}
+
 	// when the first mouse move event is received, this needs to be recorded so that
 	// all subsequent mouse moves can correctly calculate the X position offset and Y
 	// position offset for proper operation
@@ -152,6 +206,7 @@ void ViewManager::Mouse_Position_Callback(GLFWwindow* window, double xMousePos,
 
 	// move the 3D camera according to the calculated offsets
 	g_pCamera->ProcessMouseMovement(xOffset, yOffset);
+	gRedrawRequested = true;
 }
 
 /***********************************************************
@@ -169,87 +224,182 @@ void ViewManager::Scroll_Wheel_Callback(GLFWwindow* window, double xOffset, doub
 	if (gCameraSpeed < 0.1f) gCameraSpeed = 0.1f;
 	// set a highest speed
 	else if (gCameraSpeed > 20) gCameraSpeed = 20.0f;
+
+	gRedrawRequested = true;
 }
 
+/***********************************************************
+ *  Key_Callback()
+ *
+ *  This method is automatically called from GLFW whenever a
+ *  key is pressed, repeated or released.  The held keys are
+ *  recorded for the camera movement, and the toggles act on
+ *  the press alone, so holding a key flips them only once.
+ ***********************************************************/
+void ViewManager::Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods)
+{
+	if ((key < 0) || (key > GLFW_KEY_LAST) || (action == GLFW_REPEAT))
+	{
+		return;
+	}
+
+	gKeysDown[key] = (action == GLFW_PRESS);
+	gRedrawRequested = true;
+
+	ViewManager* pViewManager = (ViewManager*)glfwGetWindowUserPointer(window);
+	if ((action == GLFW_PRESS) && (NULL != pViewManager))
+	{
+		pViewManager->ProcessKeyPress(key);
+	}
+}
 
 /***********************************************************
- *  ProcessKeyboardEvents()
+ *  Framebuffer_Size_Callback()
  *
- *  This method is called to process any keyboard events
- *  that may be waiting in the event queue.
+ *  This method is automatically called from GLFW whenever
+ *  the framebuffer of the window is resized.  A minimized
+ *  window has a size of zero.
  ***********************************************************/
-void ViewManager::ProcessKeyboardEvents()
+void ViewManager::Framebuffer_Size_Callback(GLFWwindow* window, int width, int height)
+{
+	gFramebufferWidth = width;
+	gFramebufferHeight = height;
+
+	glViewport(0, 0, width, height);
+	gRedrawRequested = true;
+}
+
+/***********************************************************
+ *  Window_Refresh_Callback()
+ *
+ *  This method is automatically called from GLFW whenever
+ *  the contents of the window need to be drawn again.
+ ***********************************************************/
+void ViewManager::Window_Refresh_Callback(GLFWwindow* window)
+{
+	gRedrawRequested = true;
+}
+
+/***********************************************************
+ *  ProcessKeyPress()
+ *
+ *  This method is called from the key callback once for
+ *  every key press, for the keys that toggle a state.  The
+ *  scripted camera takes no input but the escape key, so a
+ *  benchmark run can still be stopped.
+ ***********************************************************/
+void ViewManager::ProcessKeyPress(int key)
 {
 	// close the window if the escape key has been pressed
-	if (glfwGetKey(m_pWindow, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+	if (key == GLFW_KEY_ESCAPE)
 	{
 		glfwSetWindowShouldClose(m_pWindow, true);
+		return;
+	}
+	if (gScriptedCamera)
+	{
+		return;
 	}
 
+	switch (key)
+	{
+	// F3 shows or hides the profiling overlay and F4 writes the
+	// recorded frames to a CSV file
+	case GLFW_KEY_F3:
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->ToggleOverlay();
+		}
+		break;
+	case GLFW_KEY_F4:
+		if (NULL != m_pProfiler)
+		{
+			m_pProfiler->WriteCSV(g_ProfileFilename);
+		}
+		break;
+
+	//Added cases for O and P to change the camera orientation
+	case GLFW_KEY_O:
+		bOrthographicProjection = true;
+		break;
+	case GLFW_KEY_P:
+		bOrthographicProjection = false;
+		break;
+
+	// lock or unlock mouse
+	case GLFW_KEY_M:
+		if (mouseLocked)
+		{
+			glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+		}
+		else
+		{
+			glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+		}
+		mouseLocked = !mouseLocked;
+		break;
+
+	default:
+		break;
+	}
+}
+
+/***********************************************************
+ *  ProcessKeyboardEvents()
+ *
+ *  This method is called every frame to move the camera by
+ *  the keys held down.  While the camera is moving another
+ *  frame is asked for.
+ ***********************************************************/
+void ViewManager::ProcessKeyboardEvents()
+{
 	// if the camera object is null, then exit this method
 	if (NULL == g_pCamera)
 	{
 		return;
 	}
 
+	bool bMoving = false;
+
 	// process camera zooming in and out
-	if (glfwGetKey(m_pWindow, GLFW_KEY_W) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_W])
 	{
 		g_pCamera->ProcessKeyboard(FORWARD, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_S) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_S])
 	{
 		g_pCamera->ProcessKeyboard(BACKWARD, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
 
 	// process camera panning left and right
-	if (glfwGetKey(m_pWindow, GLFW_KEY_A) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_A])
 	{
 		g_pCamera->ProcessKeyboard(LEFT, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_D) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_D])
 	{
 		g_pCamera->ProcessKeyboard(RIGHT, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
 
 	//Added if statements to check for Q and E presses for moving the camera up and down respectively
-	if (glfwGetKey(m_pWindow, GLFW_KEY_Q) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_Q])
 	{
 		g_pCamera->ProcessKeyboard(UP, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_E) == GLFW_PRESS)
+	if (gKeysDown[GLFW_KEY_E])
 	{
 		g_pCamera->ProcessKeyboard(DOWN, gDeltaTime * gCameraSpeed);
+		bMoving = true;
 	}
 
-	//Added if statements for O and P to change the camera orientation
-	if (glfwGetKey(m_pWindow, GLFW_KEY_O) == GLFW_PRESS)
-	{
-		if (bOrthographicProjection == false) 
-		{
-			bOrthographicProjection = true;
-		}
-	}
-	if (glfwGetKey(m_pWindow, GLFW_KEY_P) == GLFW_PRESS)
+	if (bMoving)
 	{
-		if (bOrthographicProjection)
-		{
-			bOrthographicProjection = false;
-		}
-	}
-
-	// lock or unlock mouse
-	if (glfwGetKey(m_pWindow, GLFW_KEY_M) == GLFW_PRESS)
-	{
-		if (mouseLocked)
-		{
-			glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-		}
-		else
-		{
-			glfwSetInputMode(m_pWindow, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
-		}
-		mouseLocked = !mouseLocked;
+		gRedrawRequested = true;
 	}
 }
 
@@ -267,34 +417,94 @@ void ViewManager::PrepareSceneView()
 
 	// per-frame timing
 	float currentFrame = glfwGetTime();
-	gDeltaTime = currentFrame - gLastFrame;
+	gDeltaTime = std::min(currentFrame - gLastFrame, g_MaxDeltaTime);
 	gLastFrame = currentFrame;
 
-	// process any keyboard events that may be waiting in the 
-	// event queue
-	ProcessKeyboardEvents();
+	// move the camera by the keys held down - the scripted
+	// camera takes no input
+	if (gScriptedCamera == false)
+	{
+		ProcessKeyboardEvents();
+	}
 
 	// get the current view matrix from the camera
 	view = g_pCamera->GetViewMatrix();
 
+	// follow the aspect of the framebuffer
+	if ((gFramebufferWidth > 0) && (gFramebufferHeight > 0))
+	{
+		gAspectRatio = (float)gFramebufferWidth / (float)gFramebufferHeight;
+	}
+
 	// define the current projection matrix based off of the bOrthographicProjection Bool
 	// false for perspective and true for orthographic
 
 	if (bOrthographicProjection == false) {
-		projection = glm::perspective(glm::radians(g_pCamera->Zoom), (GLfloat)WINDOW_WIDTH / (GLfloat)WINDOW_HEIGHT, 0.1f, 100.0f);
+		projection = glm::perspective(glm::radians(g_pCamera->Zoom), gAspectRatio, 0.1f, 100.0f);
 	}
 	else { // For Orthographic projection
-		projection = glm::ortho(-10.0f, 10.0f, -10.0f, 10.0f, 0.1f, 100.0f);
+		projection = glm::ortho(-10.0f * gAspectRatio, 10.0f * gAspectRatio, -10.0f, 10.0f, 0.1f, 100.0f);
 	}
 
-	// if the shader manager object is valid
-	if (NULL != m_pShaderManager)
+	// if the shader uniforms object is valid
+	if (NULL != m_pShaderUniforms)
 	{
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ViewName, view);
-		// set the view matrix into the shader for proper rendering
-		m_pShaderManager->setMat4Value(g_ProjectionName, projection);
-		// set the view position of the camera into the shader for proper rendering
-		m_pShaderManager->setVec3Value("viewPosition", g_pCamera->Position);
+		// upload the view matrix, projection matrix and camera
+		// position into the per-frame uniform buffer in one call
+		m_pShaderUniforms->SetFrameData(view, projection, g_pCamera->Position);
 	}
-}
\ No newline at end of file
+}
+
+/***********************************************************
+ *  GetFramebufferSize()
+ *
+ *  This method is used for getting the size of the window
+ *  framebuffer, as of the last resize.
+ ***********************************************************/
+void ViewManager::GetFramebufferSize(int& width, int& height) const
+{
+	width = gFramebufferWidth;
+	height = gFramebufferHeight;
+}
+
+/***********************************************************
+ *  TakeRedrawRequest()
+ *
+ *  This method is used for checking whether the view has
+ *  changed since the last call, for the on-demand mode.
+ ***********************************************************/
+bool ViewManager::TakeRedrawRequest()
+{
+	bool bRedrawRequested = gRedrawRequested;
+
+	gRedrawRequested = false;
+	return(bRedrawRequested);
+}
+
+/***********************************************************
+ *  SetCameraPath()
+ *
+ *  This method is used for placing the camera on the
+ *  scripted benchmark path.  The position depends only on
+ *  the passed in path position, so every run sees the same
+ *  views, and the camera always looks at the table.
+ ***********************************************************/
+void ViewManager::SetCameraPath(float pathPosition)
+{
+	if (NULL == g_pCamera)
+	{
+		return;
+	}
+
+	gScriptedCamera = true;
+
+	float angle = glm::two_pi<float>() * g_CameraPathTurns * pathPosition;
+	float height = g_CameraPathHeight + g_CameraPathHeightRange * sinf(glm::two_pi<float>() * pathPosition);
+
+	g_pCamera->Position = g_CameraPathCenter + glm::vec3(
+		g_CameraPathRadius * sinf(angle),
+		height,
+		g_CameraPathRadius * cosf(angle));
+	g_pCamera->Front = glm::normalize(g_CameraPathCenter - g_pCamera->Position);
+	g_pCamera->Up = glm::vec3(0.0f, 1.0f, 0.0f);
+}
@@ -9,7 +9,8 @@
 
 #pragma once
 
-#include "ShaderManager.h"
+#include "ShaderUniforms.h"
+#include "FrameProfiler.h"
 #include "camera.h"
 
 // GLFW library
@@ -20,7 +21,8 @@ class ViewManager
 public:
 	// constructor
 	ViewManager(
-		ShaderManager* pShaderManager);
+		ShaderUniforms* pShaderUniforms,
+		FrameProfiler* pProfiler);
 	// destructor
 	~ViewManager();
 
@@ -29,14 +31,29 @@ public:
 
 	static void Scroll_Wheel_Callback(GLFWwindow* window, double xOffset, double yOffset);
 
+	// framebuffer size callback keeping the viewport and the
+	// projection in step with the window
+	static void Framebuffer_Size_Callback(GLFWwindow* window, int width, int height);
+
+	// key callback recording the held keys and acting on presses
+	static void Key_Callback(GLFWwindow* window, int key, int scancode, int action, int mods);
+
+	// window refresh callback asking for a frame when the
+	// window contents were lost
+	static void Window_Refresh_Callback(GLFWwindow* window);
+
 private:
-	// pointer to shader manager object
-	ShaderManager* m_pShaderManager;
+	// pointer to the cached shader uniforms and buffers
+	ShaderUniforms* m_pShaderUniforms;
+	// pointer to the frame timings and counters, may be NULL
+	FrameProfiler* m_pProfiler;
 	// active OpenGL display window
 	GLFWwindow* m_pWindow;
 
 	// process keyboard events for interaction with the 3D scene
 	void ProcessKeyboardEvents();
+	// act on a key press that toggles a state
+	void ProcessKeyPress(int key);
 
 public:
 	// create the initial OpenGL display window
@@ -44,4 +61,14 @@ public:
 	
 	// prepare the conversion from 3D object display to 2D scene display
 	void PrepareSceneView();
+
+	// get the size of the window framebuffer in pixels
+	void GetFramebufferSize(int& width, int& height) const;
+
+	// true once when the view changed since the last call
+	bool TakeRedrawRequest();
+
+	// place the camera on the scripted benchmark path, 0 to 1 -
+	// user input is ignored from then on
+	void SetCameraPath(float pathPosition);
 };
\ No newline at end of file